@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "bench.h"
+
+#include "kernel_benchmarks.cpp"
+#include "generator_benchmarks.cpp"
+
+using namespace VorGen;
+
+static void usage()
+{
+    printf("usage: bench [options]\n"
+           "  --warmup N        discarded repetitions per benchmark (default 2)\n"
+           "  --reps N          timed repetitions per benchmark (default 10)\n"
+           "  --min-n N         smallest end to end input size (default 1e3)\n"
+           "  --max-n N         largest end to end input size (default 1e6, up to 1e8)\n"
+           "  --threads A,B,..  worker thread counts for end to end runs, at least 3\n"
+           "                    (default 3,6)\n"
+           "  --dist A,B,..     end to end input distributions: uniform, clustered,\n"
+           "                    band, grid, fibonacci or all (default uniform)\n"
+           "  --sweep-stats     print the per-sweep coverage report after each run\n"
+           "  --filter NAME     only run benchmarks whose name contains NAME\n"
+           "  --json            write JSON instead of CSV\n"
+           "  -o PATH           write results to PATH instead of stdout\n");
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        ::std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--warmup" && hasValue)
+        {
+            int warmup = atoi(argv[++i]);
+            if (warmup < 0)
+            {
+                fprintf(stderr, "--warmup must be at least 0\n");
+                return 1;
+            }
+            options.warmup = warmup;
+        }
+        else if (arg == "--reps" && hasValue)
+        {
+            int reps = atoi(argv[++i]);
+            if (reps < 1)
+            {
+                fprintf(stderr, "--reps must be at least 1\n");
+                return 1;
+            }
+            options.reps = reps;
+        }
+        else if (arg == "--min-n" && hasValue)
+        {
+            options.minCount = (size_t)atof(argv[++i]);
+            if (options.minCount < 1)
+            {
+                fprintf(stderr, "--min-n must be at least 1\n");
+                return 1;
+            }
+        }
+        else if (arg == "--max-n" && hasValue)
+            options.maxCount = (size_t)atof(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+        {
+            options.threads.clear();
+            ::std::stringstream ss(argv[++i]);
+            ::std::string item;
+            while (::std::getline(ss, item, ','))
+            {
+                // the generator runs at least MIN_WORKER_THREADS, rows are
+                // labelled with the count it actually uses
+                int threads = ::std::max(atoi(item.c_str()), (int)VoronoiGenerator::MIN_WORKER_THREADS);
+                if (::std::find(options.threads.begin(), options.threads.end(), threads) == options.threads.end())
+                    options.threads.push_back(threads);
+            }
+        }
+        else if (arg == "--dist" && hasValue)
+        {
+            options.distributions.clear();
+            ::std::stringstream ss(argv[++i]);
+            ::std::string item;
+            while (::std::getline(ss, item, ','))
+            {
+                size_t known = options.distributions.size();
+                for (int d = Uniform; d <= Fibonacci; d++)
+                {
+                    if (item == "all" || item == SampleGenerator::getDistributionName((Distribution)d))
+                        options.distributions.push_back((Distribution)d);
+                }
+                if (options.distributions.size() == known)
+                {
+                    fprintf(stderr, "--dist has no distribution %s\n", item.c_str());
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "--sweep-stats")
+            options.sweepStats = true;
+        else if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--json")
+            options.json = true;
+        else if (arg == "-o" && hasValue)
+            options.output = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    Bench bench(options);
+    runKernelBenchmarks(bench);
+    runGeneratorBenchmarks(bench);
+    bench.report();
+
+    return 0;
+}
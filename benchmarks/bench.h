@@ -0,0 +1,206 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../src/mp_sample_generator.h"
+
+namespace VorGen {
+
+struct BenchOptions
+{
+    size_t warmup = 2;
+    size_t reps = 10;
+
+    // end to end runs cover every power of ten in [minCount, maxCount]
+    size_t minCount = 1000;
+    size_t maxCount = 1000000;
+    ::std::vector<int> threads = { 3, 6 };
+    ::std::vector<Distribution> distributions = { Uniform };
+
+    // print the per-sweep coverage report after each end to end run
+    bool sweepStats = false;
+
+    // only run benchmarks whose name contains this string
+    ::std::string filter;
+
+    bool json = false;
+    ::std::string output;
+};
+
+struct BenchResult
+{
+    ::std::string name;
+    ::std::string params;
+    size_t items; // work items per repetition, used for ns/item
+    size_t warmup;
+    size_t reps;
+    double mean;  // milliseconds
+    double stddev;
+    double min;
+    double max;
+};
+
+class Bench
+{
+    public:
+
+        Bench(const BenchOptions & options) : m_options(options) {}
+
+        const BenchOptions & options() { return m_options; }
+
+        bool selected(const ::std::string & name)
+        {
+            return name.find(m_options.filter) != ::std::string::npos;
+        }
+
+        // Runs setup() untimed and body() timed for every repetition.
+        // The first options().warmup repetitions are discarded.
+        template <typename Setup, typename Body>
+        void run(const ::std::string & name, const ::std::string & params,
+                 size_t items, size_t reps, Setup setup, Body body)
+        {
+            if (!selected(name)) return;
+
+            size_t warmup = ::std::min(m_options.warmup, reps);
+            ::std::vector<double> samples;
+            for (size_t i = 0; i < warmup + reps; i++)
+            {
+                setup();
+                auto start = ::std::chrono::steady_clock::now();
+                body();
+                double elapsed = ::std::chrono::duration<double, ::std::milli>
+                    (::std::chrono::steady_clock::now() - start).count();
+                if (i >= warmup)
+                    samples.push_back(elapsed);
+            }
+
+            BenchResult r = { name, params, items, warmup, reps, 0.0, 0.0, samples[0], samples[0] };
+            for (double s : samples)
+            {
+                r.mean += s;
+                r.min = ::std::min(r.min, s);
+                r.max = ::std::max(r.max, s);
+            }
+            r.mean /= samples.size();
+            for (double s : samples)
+                r.stddev += (s - r.mean) * (s - r.mean);
+            if (samples.size() > 1)
+                r.stddev = sqrt(r.stddev / (samples.size() - 1));
+
+            fprintf(stderr, "%-24s %-28s %12.4f ms +- %.4f\n",
+                name.c_str(), params.c_str(), r.mean, r.stddev);
+            m_results.push_back(r);
+        }
+
+        template <typename Setup, typename Body>
+        void run(const ::std::string & name, const ::std::string & params,
+                 size_t items, Setup setup, Body body)
+        {
+            run(name, params, items, m_options.reps, setup, body);
+        }
+
+        void report()
+        {
+            FILE* out = stdout;
+            if (!m_options.output.empty())
+            {
+                out = fopen(m_options.output.c_str(), "w");
+                if (out == NULL)
+                {
+                    fprintf(stderr, "Unable to write results to %s\n", m_options.output.c_str());
+                    out = stdout;
+                }
+            }
+
+            if (m_options.json)
+            {
+                fprintf(out, "[\n");
+                for (size_t i = 0; i < m_results.size(); i++)
+                {
+                    const BenchResult & r = m_results[i];
+                    fprintf(out, "  {\"benchmark\": \"%s\", \"params\": \"%s\", \"items\": %zu, "
+                                 "\"warmup\": %zu, \"reps\": %zu, \"mean_ms\": %.6f, \"stddev_ms\": %.6f, "
+                                 "\"min_ms\": %.6f, \"max_ms\": %.6f, \"ns_per_item\": %.4f}%s\n",
+                        jsonString(r.name).c_str(), jsonString(r.params).c_str(), r.items, r.warmup, r.reps,
+                        r.mean, r.stddev, r.min, r.max, nsPerItem(r),
+                        i + 1 < m_results.size() ? "," : "");
+                }
+                fprintf(out, "]\n");
+            }
+            else
+            {
+                fprintf(out, "benchmark,params,items,warmup,reps,mean_ms,stddev_ms,min_ms,max_ms,ns_per_item\n");
+                for (const BenchResult & r : m_results)
+                {
+                    fprintf(out, "%s,%s,%zu,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.4f\n",
+                        csvField(r.name).c_str(), csvField(r.params).c_str(), r.items, r.warmup, r.reps,
+                        r.mean, r.stddev, r.min, r.max, nsPerItem(r));
+                }
+            }
+
+            if (out != stdout)
+                fclose(out);
+        }
+
+    private:
+
+        BenchOptions m_options;
+        ::std::vector<BenchResult> m_results;
+
+        static double nsPerItem(const BenchResult & r)
+        {
+            return r.items ? r.mean * 1e6 / r.items : 0.0;
+        }
+
+        // the body of a JSON string, quotes, backslashes and control
+        // characters escaped
+        static ::std::string jsonString(const ::std::string & s)
+        {
+            ::std::string out;
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if ((unsigned char)c < 0x20)
+                {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\u%04x", (unsigned char)c);
+                    out += hex;
+                }
+                else
+                    out += c;
+            }
+            return out;
+        }
+
+        // quoted with doubled quotes when it holds a separator, quote,
+        // backslash or line break
+        static ::std::string csvField(const ::std::string & s)
+        {
+            if (s.find_first_of(",\"\\\r\n") == ::std::string::npos)
+                return s;
+            ::std::string out = "\"";
+            for (char c : s)
+            {
+                if (c == '"')
+                    out += '"';
+                out += c;
+            }
+            return out + "\"";
+        }
+};
+
+// keeps the compiler from discarding benchmarked results
+inline void doNotOptimize(double value)
+{
+    asm volatile("" : : "g"(value) : "memory");
+}
+
+}
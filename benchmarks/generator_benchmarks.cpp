@@ -0,0 +1,43 @@
+#include "bench.h"
+#include "../src/voronoi_generator.h"
+#include <string>
+
+namespace VorGen {
+
+void runGeneratorBenchmarks(Bench & bench)
+{
+    const BenchOptions & options = bench.options();
+    if (!bench.selected("generate")) return;
+
+    for (Distribution d : options.distributions)
+    for (size_t count = options.minCount; count <= options.maxCount; count *= 10)
+    {
+        SampleGenerator sg(1);
+        glm::dvec3* points = sg.getPointsSphere(d, count);
+        VoronoiGenerator vg;
+
+        // very large runs take seconds each, so cap their repetitions
+        size_t reps = count >= 10000000 ? ::std::min(options.reps, (size_t)3) : options.reps;
+
+        for (int threads : options.threads)
+        {
+            vg.setWorkerThreads(threads);
+            VoronoiCell* cells = NULL;
+            ::std::string params = ::std::string("dist=") + SampleGenerator::getDistributionName(d) +
+                " n=" + ::std::to_string(count) + " threads=" + ::std::to_string(threads);
+
+            bench.run("generate", params, count, reps,
+                [&]() { delete[] cells; cells = NULL; },
+                [&]() { cells = vg.generate(points, count, count, false); });
+
+            if (options.sweepStats)
+                vg.printSweepStats(stderr);
+
+            delete[] cells;
+        }
+
+        delete[] points;
+    }
+}
+
+}
@@ -0,0 +1,504 @@
+#include "bench.h"
+#include "../src/voronoi.h"
+#include "../src/voronoi_generator.h"
+#include "../src/voronoi_tasks.h"
+#include "../src/memblock.h"
+#include "../src/platform.h"
+#include <memory>
+#include <random>
+
+namespace VorGen {
+
+static ::std::vector<VoronoiSite> makeSites(VoronoiCell* cells, glm::dvec3* points, size_t count)
+{
+    ::std::vector<VoronoiSite> sites(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        new(cells + i) VoronoiCell(points[i]);
+        sites[i] = VoronoiSite(points[i], cells + i);
+        computePolarAndAzimuth<X>(sites[i]);
+    }
+    return sites;
+}
+
+void benchIntersect2(Bench & bench, SampleGenerator & sg)
+{
+    const size_t count = 4096;
+    const size_t calls = 1 << 20;
+    glm::dvec3* points = sg.getRandomPointsSphere(count);
+    ::std::vector<VoronoiSite> sites(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        sites[i] = VoronoiSite(points[i], NULL);
+        computePolarAndAzimuth<X>(sites[i]);
+    }
+
+    SkipNode<Increasing, NarrowIndex, double> sn(0);
+    SweepLine sl;
+    sl.m_polar = 1.0;
+    sl.m_polCos = cos(sl.m_polar);
+    sl.m_polSin = sin(sl.m_polar);
+
+    bench.run("intersect2", "calls=1048576", calls, [](){}, [&]()
+    {
+        ALIGN(16) double out[2];
+        double sum = 0.0;
+        for (size_t i = 0; i < calls; i++)
+        {
+            size_t j = (i * 4) & (count - 1);
+            sn.intersect2(&sites[j], &sites[j+1], &sites[j+2], &sites[j+3], sl, 0.5, out);
+            sum += out[0] + out[1];
+        }
+        doNotOptimize(sum);
+    });
+
+    delete[] points;
+}
+
+void benchCircumcenter(Bench & bench, SampleGenerator & sg)
+{
+    const size_t count = 4096;
+    const size_t calls = 1 << 20;
+    glm::dvec3* points = sg.getRandomPointsSphere(count);
+
+    bench.run("circumcenter", "calls=1048576", calls, [](){}, [&]()
+    {
+        glm::dvec3 sum(0.0);
+        for (size_t i = 0; i < calls; i++)
+        {
+            size_t j = i & (count - 1);
+            sum += VoronoiSweeper<Increasing, X, NarrowIndex, double>::circumcenter(
+                points[j], points[(j+1) & (count-1)], points[(j+2) & (count-1)]);
+        }
+        doNotOptimize(sum.x + sum.y + sum.z);
+    });
+
+    delete[] points;
+}
+
+void benchPolarAndAzimuth(Bench & bench, SampleGenerator & sg)
+{
+    const size_t count = 1 << 20;
+    glm::dvec3* points = sg.getRandomPointsSphere(count);
+    ::std::vector<VoronoiSite> sites(count);
+    for (size_t i = 0; i < count; i++)
+        sites[i] = VoronoiSite(points[i], NULL);
+
+    bench.run("computePolarAndAzimuth", "sites=1048576", count, [](){}, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+            computePolarAndAzimuth<X>(sites[i]);
+        doNotOptimize(sites[count / 2].m_aziSinPS);
+    });
+
+    delete[] points;
+}
+
+void benchPriQueue(Bench & bench)
+{
+    typedef PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, X, NarrowIndex, double>, 8, 64> Queue;
+
+    const size_t count = 1 << 18;
+    ::std::vector<CircleEvent<Increasing, double>> events(count);
+    ::std::default_random_engine re(1);
+    ::std::uniform_real_distribution<double> unif(0.0, M_PI);
+    for (size_t i = 0; i < count; i++)
+        events[i] = CircleEvent<Increasing, double>(unif(re), 0.01 * unif(re), glm::dvec3(0.0));
+
+    ::std::unique_ptr<Queue> pq;
+    auto reset = [&]()
+    {
+        // the queue releases its nodes as they are popped
+        if (pq)
+            while (!pq->empty())
+                pq->pop();
+        pq.reset(new Queue);
+        for (size_t i = 0; i < count; i++)
+            events[i].pqn = nullptr;
+    };
+    auto fill = [&]()
+    {
+        reset();
+        for (size_t i = 0; i < count; i++)
+            pq->push(&events[i]);
+    };
+
+    bench.run("PriQueue::push", "events=262144", count, reset, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+            pq->push(&events[i]);
+    });
+
+    bench.run("PriQueue::pop", "events=262144", count, fill, [&]()
+    {
+        while (!pq->empty())
+            pq->pop();
+    });
+
+    bench.run("PriQueue::erase", "events=262144", count, fill, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+            pq->erase(&events[i]);
+    });
+
+    reset();
+}
+
+void benchFindAndInsert(Bench & bench, SampleGenerator & sg)
+{
+    // Inserts sites into a beachline without processing circle events. The
+    // beachline grows to 2 * count arcs, about the size it reaches during a
+    // sweep over a few million sites.
+    const size_t count = 2048;
+    glm::dvec3* points = sg.getRandomPointsSphere(count);
+    ::std::unique_ptr<VoronoiCell[]> cells(new VoronoiCell[count]);
+    ::std::vector<VoronoiSite> sites = makeSites(cells.get(), points, count);
+    sort(sites.begin(), sites.end(), VoronoiSiteCompare());
+
+    MemBlock<Increasing, NarrowIndex, double>* blocks = (MemBlock<Increasing, NarrowIndex, double>*)malloc(2 * count * sizeof(MemBlock<Increasing, NarrowIndex, double>));
+    ::std::unique_ptr<BeachLine<Increasing, NarrowIndex, double>> beachLine;
+    NarrowIndex block = 0;
+    auto initBlock = [&]()
+    {
+        new(&(blocks[block].skipNode)) SkipNode<Increasing, NarrowIndex, double>(block);
+        new(&(blocks[block].circleEvent)) CircleEvent<Increasing, double>();
+        return &(blocks[block++].skipNode);
+    };
+    auto initSite = [&](SkipNode<Increasing, NarrowIndex, double>* node, VoronoiSite* site)
+    {
+        node->m_beachArc.m_site = site;
+        site->m_cell->increment(1);
+    };
+
+    auto setup = [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+            new(cells.get() + i) VoronoiCell(points[i]);
+        beachLine.reset(new BeachLine<Increasing, NarrowIndex, double>);
+        block = 0;
+
+        SkipNode<Increasing, NarrowIndex, double>* node = initBlock();
+        initSite(node, &sites[0]);
+        beachLine->insert1(node);
+        node = initBlock();
+        initSite(node, &sites[1]);
+        beachLine->insert2(node);
+    };
+
+    bench.run("BeachLine::findAndInsert", "sites=2048", count - 2, setup, [&]()
+    {
+        for (size_t i = 2; i < count; i++)
+        {
+            SkipNode<Increasing, NarrowIndex, double>* node = initBlock();
+            initSite(node, &sites[i]);
+            SkipNode<Increasing, NarrowIndex, double>* node2 = initBlock();
+            beachLine->findAndInsert(node, node2, sites[i].m_polar, 1);
+        }
+    });
+
+    free(blocks);
+    delete[] points;
+}
+
+void benchSiteSorts(Bench & bench, SampleGenerator & sg)
+{
+    const size_t count = 1000000;
+    glm::dvec3* points = sg.getRandomPointsSphere(count);
+    ::std::unique_ptr<VoronoiCell[]> cells(new VoronoiCell[count]);
+    ::std::vector<VoronoiSite> unsorted = makeSites(cells.get(), points, count);
+    ::std::vector<VoronoiSite> sites;
+
+    auto setup = [&]() { sites = unsorted; };
+
+    auto dualSort = [&](bool warm)
+    {
+        TaskGraph taskGraph;
+        auto p_temps1 = new promise<VoronoiSite*>; auto p_temps2 = new promise<VoronoiSite*>;
+        auto p_done1 = new promise<bool>; auto p_done2 = new promise<bool>;
+
+        SortPoints1Task* task1 = new SortPoints1Task;
+        task1->td = TaskDataDualSort{&sites, ::std::unique_ptr<promise<VoronoiSite*>>(p_temps1),
+            ::std::unique_ptr<promise<bool>>(p_done1), p_temps2->get_future(), p_done2->get_future(), warm};
+        SortPoints2Task* task2 = new SortPoints2Task;
+        task2->td = TaskDataDualSort{&sites, ::std::unique_ptr<promise<VoronoiSite*>>(p_temps2),
+            ::std::unique_ptr<promise<bool>>(p_done2), p_temps1->get_future(), p_done1->get_future(), warm};
+        taskGraph.addTask(::std::unique_ptr<Task>(task1));
+        taskGraph.addTask(::std::unique_ptr<Task>(task2));
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(1);
+    };
+
+    bench.run("SortPoints", "sites=1000000", count, setup, [&]() { dualSort(false); });
+
+    // the sites of a relax iteration: last iteration's order, each point
+    // moved by a few percent of the point spacing
+    ::std::vector<VoronoiSite> moved = unsorted;
+    sort(moved.begin(), moved.end(), VoronoiSiteCompare());
+    glm::dvec3* offsets = sg.getRandomPointsSphere(count);
+    double spacing = sqrt(4.0 * M_PI / count);
+    for (size_t i = 0; i < count; i++)
+    {
+        moved[i].m_position = glm::normalize(moved[i].m_position + offsets[i] * (0.02 * spacing));
+        computePolarAndAzimuth<X>(moved[i]);
+    }
+    delete[] offsets;
+
+    bench.run("SortPoints warm", "sites=1000000 move=0.02", count, [&]() { sites = moved; }, [&]() { dualSort(true); });
+
+    bench.run("BucketSort", "sites=1000000", count, setup, [&]()
+    {
+        TaskGraph taskGraph;
+        auto p_temps1 = new promise<vector<vector<VoronoiSite>>*>; auto p_temps2 = new promise<vector<vector<VoronoiSite>>*>;
+        auto p_done1 = new promise<bool>; auto p_done2 = new promise<bool>;
+
+        BucketSort1Task* task1 = new BucketSort1Task;
+        task1->td = TaskDataBucketDualSort{&sites, ::std::unique_ptr<promise<vector<vector<VoronoiSite>>*>>(p_temps1),
+            ::std::unique_ptr<promise<bool>>(p_done1), p_temps2->get_future(), p_done2->get_future()};
+        BucketSort2Task* task2 = new BucketSort2Task;
+        task2->td = TaskDataBucketDualSort{&sites, ::std::unique_ptr<promise<vector<vector<VoronoiSite>>*>>(p_temps2),
+            ::std::unique_ptr<promise<bool>>(p_done2), p_temps1->get_future(), p_done1->get_future()};
+        taskGraph.addTask(::std::unique_ptr<Task>(task1));
+        taskGraph.addTask(::std::unique_ptr<Task>(task2));
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(1);
+    });
+
+    delete[] points;
+}
+
+void benchSortCorners(Bench & bench)
+{
+    const size_t count = 100000;
+    VoronoiGenerator vg(1);
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+
+    size_t corners = 0;
+    for (size_t i = 0; i < count; i++)
+        corners += cells[i].corners.size();
+
+    // rotate every ring by one so each call has work to do
+    auto setup = [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            ::std::vector<glm::dvec3> & c = cells[i].corners;
+            if (c.size() > 1)
+                ::std::rotate(c.begin(), c.begin() + 1, c.end());
+        }
+    };
+
+    bench.run("sortCorners", "cells=100000", corners, setup, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+            if (cells[i].corners.size())
+                cells[i].sortCorners();
+    });
+
+    delete[] cells;
+    delete[] points;
+}
+
+void benchRandomPoints(Bench & bench)
+{
+    const size_t count = 1000000;
+    SampleGenerator sg(1);
+
+    bench.run("getRandomPointsSphere", "points=1000000", count, [](){}, [&]()
+    {
+        glm::dvec3* points = sg.getRandomPointsSphere(count);
+        doNotOptimize(points[count - 1].x);
+        delete[] points;
+    });
+
+    ::std::vector<glm::dvec3> out(count);
+    bench.run("getCounterPointsSphere", "points=1000000", count, [](){}, [&]()
+    {
+        sg.getCounterPointsSphere(0, count, out.data());
+        doNotOptimize(out[count - 1].x);
+    });
+}
+
+void benchLocate(Bench & bench, SampleGenerator & sg)
+{
+    const size_t count = 100000;
+    const size_t queries = 1000000;
+    const size_t scanned = 1000;
+    VoronoiGenerator vg(1);
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    glm::dvec3* q = sg.getRandomPointsSphere(queries);
+    ::std::vector<size_t> found(queries);
+
+    PointLocator locator;
+    bench.run("PointLocator::build", "cells=100000", count, [](){}, [&]()
+    {
+        locator.build(cells, count);
+    });
+    if (locator.getCellCount() == 0)
+        locator.build(cells, count);
+
+    bench.run("PointLocator::locate", "cells=100000 queries=1000000", queries, [](){}, [&]()
+    {
+        locator.locate(q, queries, found.data());
+        doNotOptimize((double)found[queries - 1]);
+    });
+
+    // about ten sites each, from the adjacency lists alone
+    const size_t neighborhoods = 200000;
+    const size_t k = 10;
+    ::std::vector<size_t> nearest(neighborhoods * k);
+    bench.run("PointLocator::nearest", "cells=100000 queries=200000 k=10", neighborhoods, [](){}, [&]()
+    {
+        locator.nearest(q, neighborhoods, k, nearest.data());
+        doNotOptimize((double)nearest[neighborhoods * k - 1]);
+    });
+
+    ::std::vector<size_t> start;
+    ::std::vector<size_t> within;
+    bench.run("PointLocator::withinAngle", "cells=100000 queries=200000 angle=0.02", neighborhoods, [](){}, [&]()
+    {
+        locator.withinAngle(q, neighborhoods, 0.02, start, within);
+        doNotOptimize((double)within.size());
+    });
+
+    // the oracle the locator is tested against, a scan of every site
+    bench.run("locate brute force", "cells=100000 queries=1000", scanned, [](){}, [&]()
+    {
+        for (size_t k = 0; k < scanned; k++)
+        {
+            size_t best = 0;
+            double bestDot = -2.0;
+            for (size_t i = 0; i < count; i++)
+            {
+                double d = glm::dot(q[k], cells[i].position);
+                if (d > bestDot)
+                {
+                    best = i;
+                    bestDot = d;
+                }
+            }
+            found[k] = best;
+        }
+        doNotOptimize((double)found[scanned - 1]);
+    });
+
+    delete[] q;
+    delete[] cells;
+    delete[] points;
+}
+
+void benchCellMeasures(Bench & bench)
+{
+    const size_t count = 100000;
+    VoronoiGenerator vg(1);
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+
+    CellMeasures measures;
+    bench.run("CellMeasures::compute", "cells=100000", count, [](){}, [&]()
+    {
+        measures.compute(cells, count);
+        doNotOptimize(measures.getArea(count - 1));
+    });
+
+    CellMeasures serial(0);
+    bench.run("CellMeasures::compute", "cells=100000 threads=0", count, [](){}, [&]()
+    {
+        serial.compute(cells, count);
+        doNotOptimize(serial.getArea(count - 1));
+    });
+
+    // the same sums a cell at a time with the library arctangent
+    ::std::vector<double> areas(count);
+    ::std::vector<glm::dvec3> centroids(count);
+    bench.run("cell measures scalar", "cells=100000", count, [](){}, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const ::std::vector<glm::dvec3> & c = cells[i].corners;
+            glm::dvec3 inside(0.0), moment(0.0);
+            for (const glm::dvec3 & p : c)
+                inside += p;
+            inside = glm::normalize(inside);
+
+            double area = 0.0;
+            for (size_t k = 0; k < c.size(); k++)
+            {
+                const glm::dvec3 & a = c[k];
+                const glm::dvec3 & b = c[(k + 1) % c.size()];
+                glm::dvec3 n = glm::cross(a, b);
+                double s = glm::length(n);
+                double ab = glm::dot(a, b);
+                moment += n * (atan2(s, ab) / s);
+                area += 2 * atan2(fabs(glm::dot(inside, n)), 1 + glm::dot(inside, a) + ab + glm::dot(inside, b));
+            }
+            areas[i] = area;
+            centroids[i] = glm::normalize(moment);
+        }
+        doNotOptimize(areas[count - 1] + centroids[count - 1].x);
+    });
+
+    delete[] cells;
+    delete[] points;
+}
+
+void benchIncremental(Bench & bench)
+{
+    const size_t count = 100000;
+    const size_t changes = 1000;
+    VoronoiGenerator vg(1);
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+
+    // every repetition moves a thousand sites, removed from one place and
+    // inserted at another
+    ::std::mt19937_64 rng(1);
+    auto move = [&](IncrementalDiagram & diagram)
+    {
+        glm::dvec3* moved = vg.genRandomInput(changes);
+        for (size_t k = 0; k < changes; k++)
+        {
+            size_t id;
+            do id = rng() % diagram.getSlotCount(); while (!diagram.isAlive(id));
+            diagram.remove(id);
+            diagram.insert(moved[k]);
+        }
+        delete[] moved;
+    };
+
+    IncrementalDiagram diagram;
+    diagram.build(cells, count);
+    bench.run("IncrementalDiagram::update", "cells=100000 moved=1000", changes, [&]() { move(diagram); }, [&]()
+    {
+        doNotOptimize((double)diagram.update());
+    });
+
+    IncrementalDiagram serial(0);
+    serial.build(cells, count);
+    bench.run("IncrementalDiagram::update", "cells=100000 moved=1000 threads=0", changes, [&]() { move(serial); }, [&]()
+    {
+        doNotOptimize((double)serial.update());
+    });
+
+    delete[] cells;
+    delete[] points;
+}
+
+void runKernelBenchmarks(Bench & bench)
+{
+    SampleGenerator sg(1);
+    benchIntersect2(bench, sg);
+    benchCircumcenter(bench, sg);
+    benchPolarAndAzimuth(bench, sg);
+    benchPriQueue(bench);
+    benchFindAndInsert(bench, sg);
+    benchSiteSorts(bench, sg);
+    benchSortCorners(bench);
+    benchRandomPoints(bench);
+    benchLocate(bench, sg);
+    benchCellMeasures(bench);
+    benchIncremental(bench);
+}
+
+}
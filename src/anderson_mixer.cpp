@@ -0,0 +1,174 @@
+#include "anderson_mixer.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <cmath>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+AndersonMixer::AndersonMixer(size_t depth, int threads)
+{
+    m_depth = ::std::max(depth, (size_t)1);
+    m_threads = ::std::max(threads, 0);
+    m_count = 0;
+    m_chunks = 1;
+    m_history = 0;
+    m_newest = m_depth - 1;
+    m_started = false;
+    m_x = m_g = NULL;
+    m_next = NULL;
+}
+
+void AndersonMixer::reset(size_t count)
+{
+    m_count = count;
+    m_chunks = ::std::max(::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64)), (size_t)1);
+    m_history = 0;
+    m_newest = m_depth - 1;
+    m_started = false;
+
+    m_lastX.resize(count);
+    m_lastF.resize(count);
+    m_dX.resize(m_depth * count);
+    m_dF.resize(m_depth * count);
+    m_sums.assign(m_chunks * (m_depth * m_depth + m_depth), 0.0);
+    m_gamma.assign(m_depth, 0.0);
+}
+
+void AndersonMixer::step(const glm::dvec3* x, const glm::dvec3* g, glm::dvec3* next)
+{
+    if (m_count == 0) return;
+
+    m_x = x;
+    m_g = g;
+    m_next = next;
+
+    // the oldest change makes room for the one from the last iterate
+    if (m_started)
+    {
+        m_newest = (m_newest + 1) % m_depth;
+        m_history = ::std::min(m_history + 1, m_depth);
+    }
+
+    auto run = [&](auto makeTask)
+    {
+        TaskGraph tg;
+        for (size_t c = 0; c < m_chunks; c++)
+            tg.addTask(unique_ptr<Task>(makeTask(c)));
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    };
+
+    run([&](size_t c) { AndersonRecordTask* t = new AndersonRecordTask; t->td = TaskDataAnderson{this, c}; return t; });
+    m_started = true;
+
+    if (m_history && solve())
+        run([&](size_t c) { AndersonExtrapolateTask* t = new AndersonExtrapolateTask; t->td = TaskDataAnderson{this, c}; return t; });
+    else if (next != g)
+        ::std::copy(g, g + m_count, next);
+}
+
+void AndersonMixer::record(size_t chunk)
+{
+    size_t h = m_history;
+    double* sums = &m_sums[chunk * (m_depth * m_depth + m_depth)];
+    ::std::fill(sums, sums + m_depth * m_depth + m_depth, 0.0);
+
+    // slots 0 .. h - 1 hold the changes whatever the newest one is
+    for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i++)
+    {
+        glm::dvec3 f = m_g[i] - m_x[i];
+        if (h)
+        {
+            m_dX[m_newest * m_count + i] = m_x[i] - m_lastX[i];
+            m_dF[m_newest * m_count + i] = f - m_lastF[i];
+        }
+        m_lastX[i] = m_x[i];
+        m_lastF[i] = f;
+
+        for (size_t a = 0; a < h; a++)
+        {
+            const glm::dvec3 & fa = m_dF[a * m_count + i];
+            for (size_t b = a; b < h; b++)
+                sums[a * m_depth + b] += glm::dot(fa, m_dF[b * m_count + i]);
+            sums[m_depth * m_depth + a] += glm::dot(fa, f);
+        }
+    }
+}
+
+bool AndersonMixer::solve()
+{
+    size_t h = m_history;
+    ::std::vector<double> A(h * h, 0.0);
+    ::std::vector<double> b(h, 0.0);
+    for (size_t c = 0; c < m_chunks; c++)
+    {
+        const double* sums = &m_sums[c * (m_depth * m_depth + m_depth)];
+        for (size_t i = 0; i < h; i++)
+        {
+            for (size_t j = i; j < h; j++)
+                A[i * h + j] += sums[i * m_depth + j];
+            b[i] += sums[m_depth * m_depth + i];
+        }
+    }
+
+    // the changes are nearly parallel once the iteration settles, a small
+    // ridge keeps the normal equations solvable
+    double trace = 0.0;
+    for (size_t i = 0; i < h; i++)
+    {
+        for (size_t j = 0; j < i; j++)
+            A[i * h + j] = A[j * h + i];
+        trace += A[i * h + i];
+    }
+    if (!(trace > 0.0))
+        return false;
+    for (size_t i = 0; i < h; i++)
+        A[i * h + i] += 1e-10 * trace;
+
+    // Gaussian elimination with partial pivoting
+    for (size_t k = 0; k < h; k++)
+    {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < h; i++)
+            if (fabs(A[i * h + k]) > fabs(A[pivot * h + k]))
+                pivot = i;
+        if (!(fabs(A[pivot * h + k]) > 0.0))
+            return false;
+        for (size_t j = 0; j < h; j++)
+            ::std::swap(A[k * h + j], A[pivot * h + j]);
+        ::std::swap(b[k], b[pivot]);
+
+        for (size_t i = k + 1; i < h; i++)
+        {
+            double f = A[i * h + k] / A[k * h + k];
+            for (size_t j = k; j < h; j++)
+                A[i * h + j] -= f * A[k * h + j];
+            b[i] -= f * b[k];
+        }
+    }
+    for (size_t k = h; k-- > 0; )
+    {
+        double s = b[k];
+        for (size_t j = k + 1; j < h; j++)
+            s -= A[k * h + j] * m_gamma[j];
+        m_gamma[k] = s / A[k * h + k];
+        if (!::std::isfinite(m_gamma[k]))
+            return false;
+    }
+    return true;
+}
+
+void AndersonMixer::extrapolate(size_t chunk)
+{
+    for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i++)
+    {
+        glm::dvec3 p = m_g[i];
+        for (size_t a = 0; a < m_history; a++)
+            p -= m_gamma[a] * (m_dX[a * m_count + i] + m_dF[a * m_count + i]);
+        m_next[i] = glm::normalize(p);
+    }
+}
+
+}
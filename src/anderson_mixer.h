@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+#include <vector>
+
+namespace VorGen {
+
+// iterates AndersonMixer remembers by default
+const size_t ANDERSON_DEPTH = 5;
+
+/*
+    Anderson acceleration of a fixed point iteration x = G(x) over points
+    on the sphere, used by VoronoiGenerator::relax with G the Lloyd map
+    taking every point to the centroid of its cell.
+
+    Each step is given an iterate x and G(x). The mixer keeps the changes
+    of the last few iterates and their residuals G(x) - x, finds the
+    combination of those changes that best cancels the new residual in the
+    least squares sense, and extrapolates along it. The points are then
+    projected back onto the sphere. The small normal equations are solved
+    on the calling thread, the passes over the points are split across the
+    worker threads.
+
+    Steps are not safeguarded here, a caller that sees the step make things
+    worse should reset the mixer and take G(x) instead.
+*/
+
+class AndersonMixer
+{
+    public:
+
+        AndersonMixer(size_t depth = ANDERSON_DEPTH, int threads = 6);
+
+        // forgets every iterate, ready for count points
+        void reset(size_t count);
+
+        // the next iterate from x and g = G(x), next may be x. Until a
+        // second iterate is known, and whenever the history is degenerate,
+        // next is g.
+        void step(const glm::dvec3* x, const glm::dvec3* g, glm::dvec3* next);
+
+        // changes remembered, the extrapolation uses them all
+        size_t getHistory() const { return m_history; }
+
+    private:
+
+        size_t m_depth;
+        int m_threads;
+        size_t m_count;
+        size_t m_chunks;
+        size_t m_history; // changes held, the newest in slot m_newest
+        size_t m_newest;
+        bool m_started;   // m_lastX and m_lastF hold an iterate
+
+        ::std::vector<glm::dvec3> m_lastX;
+        ::std::vector<glm::dvec3> m_lastF;
+        // change of the iterate and of its residual, depth slots of count
+        ::std::vector<glm::dvec3> m_dX;
+        ::std::vector<glm::dvec3> m_dF;
+
+        // partial sums of each chunk, the Gram matrix of the residual
+        // changes then their products with the residual
+        ::std::vector<double> m_sums;
+        ::std::vector<double> m_gamma;
+
+        // the step being taken
+        const glm::dvec3* m_x;
+        const glm::dvec3* m_g;
+        glm::dvec3* m_next;
+
+        size_t chunkStart(size_t chunk) const { return m_count * chunk / m_chunks; }
+
+        void record(size_t chunk);
+        void extrapolate(size_t chunk);
+        bool solve();
+
+        friend class AndersonRecordTask;
+        friend class AndersonExtrapolateTask;
+};
+
+}
@@ -1,6 +1,8 @@
 #include "beachline.h"
 #include "memblock.h"
 #include "platform.h"
+#include "voronoi_event_compare.h"
+#include <cfloat>
 #include <cstring>
 #include <algorithm>
 #include <iostream>
@@ -18,126 +20,117 @@ constexpr int SKIP_DEPTH_B_sub1 = SKIP_DEPTH_B - 1;
 
 // SkipNode Implementation //
 
-template <Order O>
-inline void SkipNode<O>::init(int i)
+template <Order O, typename I, typename T>
+inline void SkipNode<O, I, T>::init(I i)
 {
     index = i;
-    memset(skips, -1, sizeof(int) * SKIP_DEPTH_B);
-    memset(p_skips, -1, sizeof(int) * SKIP_DEPTH_B);
+    memset(skips, -1, sizeof(skips));
+    memset(p_skips, -1, sizeof(p_skips));
     prev = next = -1;
-    range_end = 0.0;
+    search = 0;
+    range_end.set(0.0, 0.0);
 }
 
-template <Order O>
-inline void SkipNode<O>::initSite(VoronoiSite* site, uint8_t threadId)
+template <Order O, typename I, typename T>
+inline void SkipNode<O, I, T>::initSite(VoronoiSite* site, uint8_t threadId)
 {
     m_beachArc.m_site = site;
     site->m_cell->increment(threadId);
 }
 
-template <>
-SkipNode<Increasing>::SkipNode(int i)
+template <Order O, typename I, typename T>
+SkipNode<O, I, T>::SkipNode(I i)
 {
-    sweepline_pos = 0.0;
-
     init(i);
 }
 
-template <>
-SkipNode<Decreasing>::SkipNode(int i)
-{
-    sweepline_pos = M_PI;
-
-    init(i);
-}
-
-template <Order O>
-SkipNode<O>::~SkipNode()
+template <Order O, typename I, typename T>
+SkipNode<O, I, T>::~SkipNode()
 {
     
 }
 
-template <>
-double SkipNode<Increasing>
+template <Order O, typename I, typename T>
+double SkipNode<O, I, T>
 ::getRangeEnd(const SweepLine & sl,
               double shift,
-              SkipNode<Increasing>* other)
+              SkipNode<O, I, T>* other)
 {
-    if (sl.m_polar > sweepline_pos)
+    if (sl.m_search != search)
     {
+        // the arcs run the other way round when sweeping towards the axis
         ALIGN(16) double ends[2];
-        intersect2(m_beachArc.m_site,
-                   NODE(this,next)->m_beachArc.m_site,
-                   other->m_beachArc.m_site,
-                   NODE(other,next)->m_beachArc.m_site,
-                   sl,
-                   shift,
-                   ends);
-
-        range_end = ends[1];
-        other->range_end = ends[0];
-
-        sweepline_pos = sl.m_polar;
-        other->sweepline_pos = sl.m_polar;
+        ALIGN(16) double errs[2];
+        if (O == Increasing)
+        {
+            intersect2(m_beachArc.m_site,
+                       NODE(this,next)->m_beachArc.m_site,
+                       other->m_beachArc.m_site,
+                       NODE(other,next)->m_beachArc.m_site,
+                       sl,
+                       shift,
+                       ends,
+                       errs);
+
+            range_end.set(ends[1], errs[1]);
+            other->range_end.set(ends[0], errs[0]);
+        }
+        else
+        {
+            intersect2(NODE(other,next)->m_beachArc.m_site,
+                       other->m_beachArc.m_site,
+                       NODE(this,next)->m_beachArc.m_site,
+                       m_beachArc.m_site,
+                       sl,
+                       shift,
+                       ends,
+                       errs);
+
+            range_end.set(ends[0], errs[0]);
+            other->range_end.set(ends[1], errs[1]);
+        }
+
+        search = sl.m_search;
+        other->search = sl.m_search;
     }
 
-    return range_end;
+    return range_end.end;
 }
 
-template <>
-double SkipNode<Decreasing>
-::getRangeEnd(const SweepLine & sl,
-              double shift,
-              SkipNode<Decreasing>* other)
+template <Order O, typename I, typename T>
+double SkipNode<O, I, T>
+::getExactRangeEnd(const SweepLine & sl, double shift)
 {
-    if (sl.m_polar < sweepline_pos)
-    {
-        ALIGN(16) double ends[2];
-        intersect2(NODE(other,next)->m_beachArc.m_site,
-                        other->m_beachArc.m_site,
-                        NODE(this,next)->m_beachArc.m_site,
-                        m_beachArc.m_site,
-                        sl,
-                        shift,
-                        ends);
-
-        range_end = ends[0];
-        other->range_end = ends[1];
-
-        sweepline_pos = sl.m_polar;
-        other->sweepline_pos = sl.m_polar;
-    }
-
-    return range_end;
+    // the pair getRangeEnd takes its end from
+    if (O == Increasing)
+        return intersect(m_beachArc.m_site, NODE(this,next)->m_beachArc.m_site, sl, shift);
+    return intersect(NODE(this,next)->m_beachArc.m_site, m_beachArc.m_site, sl, shift);
 }
 
 
 constexpr double PI2 = M_PI*2.0;
 constexpr double PI2i = 0.5/M_PI;
 
-template <Order O>
-double SkipNode<O>::intersect(VoronoiSite* siteA, VoronoiSite* siteB, 
-                              const SweepLine & sl, double shift)
+template <Order O, typename I, typename T>
+double SkipNode<O, I, T>::intersect(VoronoiSite* siteA, VoronoiSite* siteB, 
+                                    const SweepLine & sl, double shift)
 {
     double eps = (siteA->m_polCos - siteB->m_polCos) * sl.m_polSin;
 
-    double a = (sl.m_polCos - siteB->m_polCos) * siteA->m_aziCosPS -
-                (sl.m_polCos - siteA->m_polCos) * siteB->m_aziCosPS;
+    // both sites on the sweepline meet at their bisector, see intersect2
+    double w = sl.m_polCos - siteB->m_polCos;
+    double z = sl.m_polCos - siteA->m_polCos;
+    if (w == 0.0 && z == 0.0)
+        w = z = O == Increasing ? -1.0 : 1.0;
 
-    double b = (sl.m_polCos - siteB->m_polCos) * siteA->m_aziSinPS -
-                (sl.m_polCos - siteA->m_polCos) * siteB->m_aziSinPS;
+    double a = w * siteA->m_aziCosPS - z * siteB->m_aziCosPS;
+    double b = w * siteA->m_aziSinPS - z * siteB->m_aziSinPS;
 
-    double ab_hyp = 1.0L / sqrt(a*a + b*b);
-
-    double gamma;
-    if (b > 0) gamma = asin(a*ab_hyp);
-    else
-    {
-        if (a > 0) gamma = acos(b*ab_hyp);
-        else gamma = acos(b*ab_hyp) - 2*asin(a*ab_hyp);
-    }
+    // cosine of the breakpoint turned by gamma, as in intersect2
+    glm::dvec3 ab = siteA->m_position - siteB->m_position;
+    double h = w * z * glm::dot(ab, ab);
 
-    double azi = asin(eps * ab_hyp) - gamma;
+    double azi = atan2(eps, sqrt(::std::max(h, 0.0))) - atan2(a, b);
 
     azi += shift;
     azi = azi * PI2i;
@@ -146,46 +139,78 @@ double SkipNode<O>::intersect(VoronoiSite* siteA, VoronoiSite* siteB,
     return azi * PI2;
 }
 
-// compiler replaces this with sse2_asin
-inline void asin128(__m128d & inout)
-{
-    ALIGN(16) double d[2];
-    _mm_store_pd(d, inout);
-
-    d[0] = asin(d[0]);
-    d[1] = asin(d[1]);
-
-    inout = _mm_load_pd(d);
-}
-
-// compiler replaces this with sse2_acos
-inline void acos128(__m128d & inout)
+// both lanes of y turned into atan2(y, x)
+inline void atan2128(__m128d & y, const __m128d & x)
 {
     ALIGN(16) double d[2];
-    _mm_store_pd(d, inout);
+    ALIGN(16) double e[2];
+    _mm_store_pd(d, y);
+    _mm_store_pd(e, x);
 
-    d[0] = acos(d[0]);
-    d[1] = acos(d[1]);
+    d[0] = atan2(d[0], e[0]);
+    d[1] = atan2(d[1], e[1]);
 
-    inout = _mm_load_pd(d);
+    y = _mm_load_pd(d);
 }
 
+// The terms of the intersections of a,b and c,d in the lanes of intersect2.
+// The distances to the sweepline cancel, so these are always in double.
 template <Order O>
-void SkipNode<O>::intersect2(VoronoiSite* siteA, VoronoiSite* siteB, 
-                             VoronoiSite* siteC, VoronoiSite* siteD, 
-                             const SweepLine & sl, double shift, double* out)
+inline void intersectTerms(VoronoiSite* siteA, VoronoiSite* siteB, 
+                           VoronoiSite* siteC, VoronoiSite* siteD, 
+                           const SweepLine & sl, __m128d & W, __m128d & Z,
+                           __m128d & EPS, __m128d & COS2)
 {
     ALIGN(16) double zero[2] = { 0.0,0.0 }; __m128d* ZERO = (__m128d*)zero;
-    ALIGN(16) double one[2]  = { 1.0,1.0 }; __m128d* ONE  = (__m128d*)one;
-    ALIGN(16) double two[2]  = { 2.0,2.0 }; __m128d* TWO  = (__m128d*)two;
 
     __m128d EE = _mm_set1_pd(sl.m_polCos);
 
     __m128d FM = _mm_set_pd(siteB->m_polCos, siteD->m_polCos);
     __m128d GN = _mm_set_pd(siteA->m_polCos, siteC->m_polCos);
 
-    __m128d W = _mm_sub_pd(EE, FM);
-    __m128d Z = _mm_sub_pd(EE, GN);
+    W = _mm_sub_pd(EE, FM);
+    Z = _mm_sub_pd(EE, GN);
+
+    // two sites both on the sweepline meet where their arcs do at any
+    // sweepline past them, which takes only the sign of its distance
+    __m128d ON = _mm_and_pd(_mm_cmpeq_pd(W, *ZERO), _mm_cmpeq_pd(Z, *ZERO));
+    __m128d PAST = _mm_set1_pd(O == Increasing ? -1.0 : 1.0);
+    W = _mm_or_pd(W, _mm_and_pd(ON, PAST));
+    Z = _mm_or_pd(Z, _mm_and_pd(ON, PAST));
+
+    // The arcs meet where the azimuth turned by gamma, the angle of (a, b),
+    // has a sine of eps over their hypotenuse h. Its cosine is taken from
+    // h^2 - eps^2 = (s - Ac)(s - Bc)|A - B|^2, which keeps its precision
+    // where asin(eps / h) loses it, as both sites near the sweepline.
+    glm::dvec3 ab = siteA->m_position - siteB->m_position;
+    glm::dvec3 cd = siteC->m_position - siteD->m_position;
+    __m128d DIST = _mm_set_pd(glm::dot(ab, ab), glm::dot(cd, cd));
+    COS2 = _mm_max_pd(_mm_mul_pd(_mm_mul_pd(W, Z), DIST), *ZERO);
+    EPS = _mm_mul_pd(_mm_sub_pd(GN, FM), _mm_set1_pd(sl.m_polSin));
+}
+
+// the breakpoint azimuths EPS of intersect2 shifted into [0, 2pi)
+inline void shiftAzimuths(__m128d & EPS, double shift, double* out)
+{
+    __m128d SHIFT = _mm_set1_pd(shift);
+    __m128d PI2I_ = _mm_set1_pd(PI2i);
+    __m128d PI2_ = _mm_set1_pd(PI2);
+
+    EPS = _mm_add_pd(EPS, SHIFT);
+    EPS = _mm_mul_pd(EPS, PI2I_);
+    EPS = _mm_sub_pd(EPS, _mm_floor_pd(EPS));
+    EPS = _mm_mul_pd(EPS, PI2_);
+
+    _mm_store_pd(out, EPS);
+}
+
+template <Order O>
+inline void intersect2Double(VoronoiSite* siteA, VoronoiSite* siteB, 
+                             VoronoiSite* siteC, VoronoiSite* siteD, 
+                             const SweepLine & sl, double shift, double* out)
+{
+    __m128d W, Z, EPS, COS2;
+    intersectTerms<O>(siteA, siteB, siteC, siteD, sl, W, Z, EPS, COS2);
 
     __m128d HO = _mm_set_pd(siteA->m_aziCosPS, siteC->m_aziCosPS);
     __m128d IP = _mm_set_pd(siteB->m_aziCosPS, siteD->m_aziCosPS);
@@ -200,47 +225,78 @@ void SkipNode<O>::intersect2(VoronoiSite* siteA, VoronoiSite* siteB,
     __m128d AC = _mm_sub_pd(X, S);
     __m128d BD = _mm_sub_pd(Y, T);
 
-    __m128d U = _mm_mul_pd(AC, AC);
-    __m128d V = _mm_mul_pd(BD, BD);
-
-    __m128d BETA = _mm_add_pd(U, V);
-    BETA = _mm_sqrt_pd(BETA);
-
-    __m128d ALPHA = _mm_div_pd(*ONE, BETA);
-
-    __m128d A_ALPHA = _mm_mul_pd(AC, ALPHA);
-    __m128d B_ALPHA = _mm_mul_pd(BD, ALPHA);
-
-    asin128(A_ALPHA);
-    acos128(B_ALPHA);
+    __m128d COS = _mm_sqrt_pd(COS2);
 
-    __m128d C_ALPHA = _mm_mul_pd(*TWO, A_ALPHA);
-    C_ALPHA = _mm_sub_pd(B_ALPHA, C_ALPHA);
-
-    __m128d LTZ = _mm_cmple_pd(BD, *ZERO);
-    __m128d GTZ = _mm_cmpgt_pd(AC, *ZERO);
-
-    __m128d GAMMA = _mm_blendv_pd(C_ALPHA, B_ALPHA, GTZ);
-    GAMMA = _mm_blendv_pd(A_ALPHA, GAMMA, LTZ);
+    __m128d GAMMA = AC;
+    atan2128(GAMMA, BD);
+    atan2128(EPS, COS);
+    EPS = _mm_sub_pd(EPS, GAMMA);
 
-    EE = _mm_set1_pd(sl.m_polSin);
-    __m128d EPS = _mm_sub_pd(GN, FM);
-    EE = _mm_mul_pd(EE, ALPHA);
-    EPS = _mm_mul_pd(EPS, EE);
+    shiftAzimuths(EPS, shift, out);
+}
 
-    asin128(EPS);
-    EPS = _mm_sub_pd(EPS, GAMMA);
+// Rounding of the float lanes of intersect2Float. a and b take roundings
+// of W, Z, the site terms, their products and their difference, together
+// up to two epsilons of the products, and the angle of (a, b) turns by
+// their error over its hypotenuse. The angle of (eps, cos) turns by under
+// two epsilons, and each atan2f is off by up to two ulps of pi, four
+// epsilons. All are doubled for what a first order bound leaves out.
+constexpr double FLOAT_TERM_ERR = 4.0 * FLT_EPSILON;
+constexpr double FLOAT_ANGLE_ERR = 20.0 * FLT_EPSILON;
+
+// As intersect2Double, with a and b of both pairs in the four lanes of a
+// float register and the square root and angles in float, and the error
+// bound of each result in err.
+template <Order O>
+inline void intersect2Float(VoronoiSite* siteA, VoronoiSite* siteB, 
+                            VoronoiSite* siteC, VoronoiSite* siteD, 
+                            const SweepLine & sl, double shift, double* out, double* err)
+{
+    __m128d W, Z, EPS, COS2;
+    intersectTerms<O>(siteA, siteB, siteC, siteD, sl, W, Z, EPS, COS2);
+
+    // lanes a of c,d, a of a,b, b of c,d, b of a,b
+    __m128 WW = _mm_cvtpd_ps(W); WW = _mm_movelh_ps(WW, WW);
+    __m128 ZZ = _mm_cvtpd_ps(Z); ZZ = _mm_movelh_ps(ZZ, ZZ);
+    __m128 HJ = _mm_set_ps((float)siteA->m_aziSinPS, (float)siteC->m_aziSinPS, (float)siteA->m_aziCosPS, (float)siteC->m_aziCosPS);
+    __m128 IK = _mm_set_ps((float)siteB->m_aziSinPS, (float)siteD->m_aziSinPS, (float)siteB->m_aziCosPS, (float)siteD->m_aziCosPS);
+
+    __m128 XY = _mm_mul_ps(WW, HJ);
+    __m128 ST = _mm_mul_ps(ZZ, IK);
+    __m128 ABS = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    ALIGN(16) float ab[4];
+    ALIGN(16) float terms[4];
+    ALIGN(16) float ec[4];
+    _mm_store_ps(ab, _mm_sub_ps(XY, ST));
+    _mm_store_ps(terms, _mm_add_ps(_mm_and_ps(XY, ABS), _mm_and_ps(ST, ABS)));
+    _mm_store_ps(ec, _mm_movelh_ps(_mm_cvtpd_ps(EPS), _mm_sqrt_ps(_mm_cvtpd_ps(COS2))));
+
+    ALIGN(16) double azi[2];
+    for (int l = 0; l < 2; l++)
+    {
+        float a = ab[l];
+        float b = ab[l + 2];
+        azi[l] = (double)atan2f(ec[l], ec[l + 2]) - (double)atan2f(a, b);
 
-    __m128d SHIFT = _mm_set1_pd(shift);
-    __m128d PI2I_ = _mm_set1_pd(PI2i);
-    __m128d PI2_ = _mm_set1_pd(PI2);
+        // a and b both zero leave no bound, NaN, and every use of it fails
+        if (err)
+            err[l] = FLOAT_TERM_ERR * ((double)terms[l] + terms[l + 2]) / hypot(a, b) + FLOAT_ANGLE_ERR;
+    }
 
-    EPS = _mm_add_pd(EPS, SHIFT);
-    EPS = _mm_mul_pd(EPS, PI2I_);
-    EPS = _mm_sub_pd(EPS, _mm_floor_pd(EPS));
-    EPS = _mm_mul_pd(EPS, PI2_);
+    EPS = _mm_load_pd(azi);
+    shiftAzimuths(EPS, shift, out);
+}
 
-    _mm_store_pd(out, EPS);
+template <Order O, typename I, typename T>
+void SkipNode<O, I, T>::intersect2(VoronoiSite* siteA, VoronoiSite* siteB, 
+                                   VoronoiSite* siteC, VoronoiSite* siteD, 
+                                   const SweepLine & sl, double shift, double* out, double* err)
+{
+    if (sizeof(T) == sizeof(float))
+        intersect2Float<O>(siteA, siteB, siteC, siteD, sl, shift, out, err);
+    else
+        intersect2Double<O>(siteA, siteB, siteC, siteD, sl, shift, out);
 }
 
 
@@ -248,40 +304,41 @@ void SkipNode<O>::intersect2(VoronoiSite* siteA, VoronoiSite* siteB,
 
 constexpr int DIST_MAX = 1 << (SKIP_DEPTH_B + 1);
 
-template <Order O>
-BeachLine<O>::BeachLine()
+template <Order O, typename I, typename T>
+BeachLine<O, I, T>::BeachLine()
 {
     size = 0;
     linked_list = NULL;
+    search_count = 0;
     distribution = ::std::uniform_int_distribution<int>(0,DIST_MAX);
 }
 
-template <Order O>
-BeachLine<O>::~BeachLine()
+template <Order O, typename I, typename T>
+BeachLine<O, I, T>::~BeachLine()
 {
 }
 
-template <Order O>
-int BeachLine<O>::getSize()
+template <Order O, typename I, typename T>
+size_t BeachLine<O, I, T>::getSize()
 {
     return size;
 }
 
-template <Order O>
-void BeachLine<O>::insert1(SkipNode<O>* node)
+template <Order O, typename I, typename T>
+void BeachLine<O, I, T>::insert1(SkipNode<O, I, T>* node)
 {
     insertAfter(node, NULL);
 }
 
-template <Order O>
-void BeachLine<O>::insert2(SkipNode<O>* node)
+template <Order O, typename I, typename T>
+void BeachLine<O, I, T>::insert2(SkipNode<O, I, T>* node)
 {
     insertAfter(node, linked_list);
     addSkips(node, &linked_list, true);
 }
 
-template <Order O>
-void BeachLine<O>::erase(SkipNode<O>* node, uint8_t threadId)
+template <Order O, typename I, typename T>
+bool BeachLine<O, I, T>::erase(SkipNode<O, I, T>* node, uint8_t threadId)
 {
     // change starting position for searches if necessary
     if (node == linked_list)
@@ -292,7 +349,7 @@ void BeachLine<O>::erase(SkipNode<O>* node, uint8_t threadId)
         }
         else
         {
-            SkipNode<O>* next = NODE(linked_list, next);
+            SkipNode<O, I, T>* next = NODE(linked_list, next);
 
             for (int i = 0; i < SKIP_DEPTH_B; i++)
             {	
@@ -315,13 +372,13 @@ void BeachLine<O>::erase(SkipNode<O>* node, uint8_t threadId)
     NODE(node, prev)->next = node->next;
     NODE(node, next)->prev = node->prev;
 
-    node->m_beachArc.m_site->m_cell->decrement(threadId);
-
     size--;
+
+    return node->m_beachArc.m_site->m_cell->decrement(threadId);
 }
 
-template <Order O>
-void BeachLine<O>::removeSkips(SkipNode<O>* node)
+template <Order O, typename I, typename T>
+void BeachLine<O, I, T>::removeSkips(SkipNode<O, I, T>* node)
 {
     for (int i = 0; i < SKIP_DEPTH_B; i++)
     {
@@ -332,16 +389,56 @@ void BeachLine<O>::removeSkips(SkipNode<O>* node)
     }
 }
 
-template <Order O>
-bool BeachLine<O>::isRangeEndGreater(SkipNode<O>* next, SkipNode<O>* curr, SweepLine & sl, double shift, int skipLevel)
+template <Order O, typename I, typename T>
+bool BeachLine<O, I, T>::isRangeEndGreater(SkipNode<O, I, T>* next, SkipNode<O, I, T>* curr, SweepLine & sl, double shift, int skipLevel)
 {
     double c = curr->getRangeEnd(sl, shift, next);
-    return (next->getRangeEnd(sl, shift, NODE(next, skips[skipLevel])) > c);
+    double n = next->getRangeEnd(sl, shift, NODE(next, skips[skipLevel]));
+    settleEnds(next, n, curr, c, sl, shift);
+    return n > c;
+}
+
+template <Order O, typename I, typename T>
+inline void BeachLine<O, I, T>::settleEnds(SkipNode<O, I, T>* a, double & aEnd, SkipNode<O, I, T>* b, double & bEnd, const SweepLine & sl, double shift)
+{
+    if (sizeof(T) != sizeof(float))
+        return;
+
+    double aErr = a->range_end.err;
+    double bErr = b->range_end.err;
+    if (fabs(aEnd - bEnd) > aErr + bErr &&
+        aEnd > aErr && aEnd < PI2 - aErr &&
+        bEnd > bErr && bEnd < PI2 - bErr)
+        return;
+
+    aEnd = a->getExactRangeEnd(sl, shift);
+    bEnd = b->getExactRangeEnd(sl, shift);
+}
+
+// True if the arc of node has no width at the sweepline, so that its ends
+// may come out either way round by their rounding. Its site is on the
+// sweepline, or its event is, as far as the bounds of their angles tell.
+// The ends differ by drop, which is below PI unless they are either side
+// of the search's start.
+template <Order O, typename I, typename T>
+static bool hasNoWidth(SkipNode<O, I, T>* node, const SweepLine & sl, double drop)
+{
+    if (drop >= M_PI)
+        return false;
+    if (fabs(node->m_beachArc.m_site->m_polar - sl.m_polar) <= 2.0 * SITE_POLAR_ERR)
+        return true;
+
+    CircleEvent<O, T>* ce = getCircleEventFromSkipNode(node);
+    if (ce->pqn == nullptr)
+        return false;
+    double polar = O == Increasing ? (double)ce->polar + ce->polar_small 
+                                   : (double)ce->polar - ce->polar_small;
+    return fabs(polar - sl.m_polar) <= ce->err + SITE_POLAR_ERR;
 }
 
 // 3.75% - 6.72%
-template <Order O>
-void BeachLine<O>::findAndInsert(SkipNode<O>* node, SkipNode<O>* node2, double sweepline, uint8_t threadId)
+template <Order O, typename I, typename T>
+bool BeachLine<O, I, T>::findAndInsert(SkipNode<O, I, T>* node, SkipNode<O, I, T>* node2, double sweepline, uint8_t threadId)
 {
     // shift positions on beachline such that the new insertion point goes to zero
     // this means we want to search for the element with the largest post intersection value
@@ -349,13 +446,16 @@ void BeachLine<O>::findAndInsert(SkipNode<O>* node, SkipNode<O>* node2, double s
     double shift = 2.0 * M_PI - node->m_beachArc.m_site->m_azimuth;
 
     int skip_level = SKIP_DEPTH_B_sub1;
-    SkipNode<O>* nodes[SKIP_DEPTH_B];
-    SkipNode<O>* curr = linked_list;
+    SkipNode<O, I, T>* nodes[SKIP_DEPTH_B];
+    SkipNode<O, I, T>* curr = linked_list;
 
+    // range ends are cached for one search, as they depend on its shift
+    // as well as the sweepline, which sites may share
     SweepLine sl;
     sl.m_polar = sweepline;
-    sl.m_polCos = cos(sweepline);
+    sl.m_polCos = node->m_beachArc.m_site->m_polCos;
     sl.m_polSin = sin(sweepline);
+    sl.m_search = ++search_count;
 
     while (true)
     {
@@ -370,17 +470,37 @@ void BeachLine<O>::findAndInsert(SkipNode<O>* node, SkipNode<O>* node2, double s
         }
     }
 
-    // continue search on the linked list level
+    // continue search on the linked list level, passing over arcs with
+    // no width, which end where they start. Every arc may be one when all
+    // the sites so far share the sweepline.
     double currRangeEnd = curr->getRangeEnd(sl, shift, NODE(curr, next));
-    double currRangeEndNext;
-    while ( (currRangeEndNext = NODE(curr, next)->getRangeEnd(sl, shift, NODE_2(curr, next))) > currRangeEnd )
+    for (size_t steps = 0; steps < size; steps++)
     {
-        curr = NODE(curr, next);
-        currRangeEnd = currRangeEndNext;
+        SkipNode<O, I, T>* after = NODE(curr, next);
+        double afterRangeEnd = after->getRangeEnd(sl, shift, NODE(after, next));
+        settleEnds(after, afterRangeEnd, curr, currRangeEnd, sl, shift);
+        if (afterRangeEnd <= currRangeEnd &&
+            !hasNoWidth(after, sl, currRangeEnd - afterRangeEnd))
+            break;
+
+        curr = after;
+        currRangeEnd = afterRangeEnd;
     }
 
     curr = NODE(curr, next);
 
+    // an arc whose site is on the sweepline as well has no width where
+    // its site is, so the new arc goes to whichever side of it its site is
+    if (curr->m_beachArc.m_site->m_polCos == sl.m_polCos)
+    {
+        double siteEnd = fmod(curr->m_beachArc.m_site->m_azimuth + shift, PI2);
+        double currEnd = sizeof(T) == sizeof(float) ? curr->getExactRangeEnd(sl, shift)
+                                                    : curr->getRangeEnd(sl, shift, NODE(curr, next));
+        insertAfter(node, siteEnd <= currEnd ? NODE(curr, prev) : curr);
+        addSkips(node,nodes,false);
+        return false;
+    }
+
     // split node and insert in between
     node2->initSite(curr->m_beachArc.m_site, threadId);
 
@@ -389,10 +509,11 @@ void BeachLine<O>::findAndInsert(SkipNode<O>* node, SkipNode<O>* node2, double s
 
     addSkips(node,nodes,false);
     addSkips(node2,nodes,false);
+    return true;
 }
 
-template <Order O>
-void BeachLine<O>::insertAfter(SkipNode<O>* node, SkipNode<O>* at)
+template <Order O, typename I, typename T>
+void BeachLine<O, I, T>::insertAfter(SkipNode<O, I, T>* node, SkipNode<O, I, T>* at)
 {
     if (at == NULL)
     {
@@ -409,7 +530,7 @@ void BeachLine<O>::insertAfter(SkipNode<O>* node, SkipNode<O>* at)
     else
     {
         // insert into list
-        SkipNode<O>* next = NODE(at, next);
+        SkipNode<O, I, T>* next = NODE(at, next);
         at->next = node->index;
         node->prev = at->index;
         node->next = next->index;
@@ -437,8 +558,8 @@ inline int log2(int n)
     return r;
 }
 
-template <Order O>
-void BeachLine<O>::addSkips(SkipNode<O>* node, SkipNode<O>** previous, bool repeat_first)
+template <Order O, typename I, typename T>
+void BeachLine<O, I, T>::addSkips(SkipNode<O, I, T>* node, SkipNode<O, I, T>** previous, bool repeat_first)
 {
     int skip_count = SKIP_DEPTH_B - log2(::std::max((int)(distribution(generator)), 1));
 
@@ -457,10 +578,19 @@ void BeachLine<O>::addSkips(SkipNode<O>* node, SkipNode<O>** previous, bool repe
     }
 }
 
-template class SkipNode<Increasing>;
-template class SkipNode<Decreasing>;
-
-template class BeachLine<Increasing>;
-template class BeachLine<Decreasing>;
+// the float layout is only used for sweeps the narrow index covers
+template class SkipNode<Increasing, NarrowIndex, double>;
+template class SkipNode<Decreasing, NarrowIndex, double>;
+template class SkipNode<Increasing, WideIndex, double>;
+template class SkipNode<Decreasing, WideIndex, double>;
+template class SkipNode<Increasing, NarrowIndex, float>;
+template class SkipNode<Decreasing, NarrowIndex, float>;
+
+template class BeachLine<Increasing, NarrowIndex, double>;
+template class BeachLine<Decreasing, NarrowIndex, double>;
+template class BeachLine<Increasing, WideIndex, double>;
+template class BeachLine<Decreasing, WideIndex, double>;
+template class BeachLine<Increasing, NarrowIndex, float>;
+template class BeachLine<Decreasing, NarrowIndex, float>;
 
 }
@@ -9,11 +9,16 @@ namespace VorGen {
 
 #define SKIP_DEPTH_B 8
 
-template <Order O>
+template <Order O, typename I>
 class BeachArc
 {
     public:
         VoronoiSite* m_site;
+        // ends of the part of its cell's ring traced by the breakpoints
+        // either side, links of the sweep that owns the cell, see
+        // VoronoiSweeper::CornerLink
+        I m_ringLeft;
+        I m_ringRight;
 };
 
 struct SweepLine
@@ -21,41 +26,64 @@ struct SweepLine
     double m_polar;
     double m_polCos;
     double m_polSin;
+    // the search range ends are cached for
+    uint64_t m_search;
 };
 
-template <Order O>
+// The range end a node caches. Float ends carry a bound on their error,
+// double ones are taken as they are.
+template <typename T>
+struct RangeEnd
+{
+    double end;
+    static constexpr double err = 0.0;
+    void set(double e, double) { end = e; }
+};
+
+template <>
+struct RangeEnd<float>
+{
+    float end;
+    float err;
+    void set(double e, double r) { end = (float)e; err = (float)r; }
+};
+
+template <Order O, typename I, typename T>
 class SkipNode
 {
     public:
 
-        void init(int i);
+        void init(I i);
         void initSite(VoronoiSite* site, uint8_t threadId);
-        SkipNode(int i);
+        SkipNode(I i);
         ~SkipNode();
-        double getRangeEnd(const SweepLine & sl, double shift, SkipNode<O>* other);
+        double getRangeEnd(const SweepLine & sl, double shift, SkipNode<O, I, T>* other);
+        // the range end in double, for float ends too close to call
+        double getExactRangeEnd(const SweepLine & sl, double shift);
         double intersect(VoronoiSite* siteA, VoronoiSite* siteB, const SweepLine & sl, double shift);
 
         // SIMD intersect: computes intersection between a,b and c,d. Stores the results in out[1], out[0]
-        void intersect2(VoronoiSite* siteA, VoronoiSite* siteB, VoronoiSite* siteC, VoronoiSite* siteD, const SweepLine & sl, double shift, double* out);
+        // and, for float nodes given err, bounds on their error in err[1], err[0]
+        void intersect2(VoronoiSite* siteA, VoronoiSite* siteB, VoronoiSite* siteC, VoronoiSite* siteD, const SweepLine & sl, double shift, double* out, double* err = NULL);
 
-        int index;
+        I index;
 
-        int skips[SKIP_DEPTH_B];
-        int p_skips[SKIP_DEPTH_B];
-        int prev;
-        int next;
+        I skips[SKIP_DEPTH_B];
+        I p_skips[SKIP_DEPTH_B];
+        I prev;
+        I next;
 
-        double sweepline_pos;
-        double range_end;
+        uint64_t search; // of range_end
+        RangeEnd<T> range_end;
 
-        BeachArc<O> m_beachArc;
+        BeachArc<O, I> m_beachArc;
 };
 
 /* 
     This class manages the beachline for voronoi tessellation.
 */
 
-template <Order O>
+template <Order O, typename I, typename T>
 class BeachLine
 {
     public:
@@ -63,25 +91,36 @@ class BeachLine
         BeachLine();
         ~BeachLine();
 
-        int getSize();
+        size_t getSize();
+        // any arc, the others follow it through next
+        SkipNode<O, I, T>* getFront() { return linked_list; }
 
-        void findAndInsert(SkipNode<O>* node, SkipNode<O>* node2, double sweepline, uint8_t threadId);
-        void insert1(SkipNode<O>* node);
-        void insert2(SkipNode<O>* node);
-        void erase(SkipNode<O>* node, uint8_t threadId);
+        // splits the arc above node around it, using node2 for the far
+        // side. Returns false if the arc's site is on the sweepline too,
+        // then node goes next to it and node2 is left unused.
+        bool findAndInsert(SkipNode<O, I, T>* node, SkipNode<O, I, T>* node2, double sweepline, uint8_t threadId);
+        void insert1(SkipNode<O, I, T>* node);
+        void insert2(SkipNode<O, I, T>* node);
+        // returns true if removing the arc completed its cell
+        bool erase(SkipNode<O, I, T>* node, uint8_t threadId);
 
     private:
 
-        SkipNode<O>* linked_list;
+        SkipNode<O, I, T>* linked_list;
 
-        int size;
+        size_t size;
+        // searches so far, range ends are cached for one
+        uint64_t search_count;
 
-        bool isRangeEndGreater(SkipNode<O>* next, SkipNode<O>* curr, SweepLine & sl, double shift, int skipLevel);
+        bool isRangeEndGreater(SkipNode<O, I, T>* next, SkipNode<O, I, T>* curr, SweepLine & sl, double shift, int skipLevel);
+        // recomputes the ends of a and b in double if as floats they are
+        // too close to each other, or to the wrap at the new site, to order
+        static void settleEnds(SkipNode<O, I, T>* a, double & aEnd, SkipNode<O, I, T>* b, double & bEnd, const SweepLine & sl, double shift);
         
-        void insertAfter(SkipNode<O>* node, SkipNode<O>* at);
+        void insertAfter(SkipNode<O, I, T>* node, SkipNode<O, I, T>* at);
 
-        void addSkips(SkipNode<O>* node, SkipNode<O>** previous, bool repeat_first);
-        void removeSkips(SkipNode<O>* node);
+        void addSkips(SkipNode<O, I, T>* node, SkipNode<O, I, T>** previous, bool repeat_first);
+        void removeSkips(SkipNode<O, I, T>* node);
 
         // for randomly determining the number of skip levels to add
         ::std::default_random_engine generator;
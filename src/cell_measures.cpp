@@ -0,0 +1,193 @@
+#include "cell_measures.h"
+#include "voronoi_tasks.h"
+#include "platform.h"
+#include <algorithm>
+#include <cmath>
+
+// SSE4.1
+#include <smmintrin.h>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+// arctangent of x >= 0 in two lanes, the rational approximation of the
+// Cephes library after reducing x to [0, 0.66]
+static inline __m128d atanPositive(__m128d x)
+{
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d big = _mm_cmpgt_pd(x, _mm_set1_pd(2.41421356237309504880)); // tan(3 pi / 8)
+    __m128d mid = _mm_andnot_pd(big, _mm_cmpgt_pd(x, _mm_set1_pd(0.66)));
+
+    __m128d r = _mm_blendv_pd(x, _mm_div_pd(_mm_sub_pd(x, one), _mm_add_pd(x, one)), mid);
+    r = _mm_blendv_pd(r, _mm_div_pd(_mm_set1_pd(-1.0), x), big);
+    __m128d y = _mm_or_pd(_mm_and_pd(big, _mm_set1_pd(M_PI_2 + 6.123233995736765886130E-17)),
+                          _mm_and_pd(mid, _mm_set1_pd(M_PI_4 + 0.5 * 6.123233995736765886130E-17)));
+
+    __m128d z = _mm_mul_pd(r, r);
+    __m128d p = _mm_set1_pd(-8.750608600031904122785E-1);
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.615753718733365076637E1));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-7.500855792314704667340E1));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.228866684490136173410E2));
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-6.485021904942025371773E1));
+    __m128d q = _mm_add_pd(z, _mm_set1_pd(2.485846490142306297962E1));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.650270098316988542046E2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.328810604912902668951E2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.853903996359136964868E2));
+    q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.945506571482613964425E2));
+
+    z = _mm_div_pd(_mm_mul_pd(z, p), q);
+    return _mm_add_pd(y, _mm_add_pd(_mm_mul_pd(r, z), r));
+}
+
+// atan2(y, x) for y >= 0, not both zero
+static inline __m128d atan2Positive(__m128d y, __m128d x)
+{
+    __m128d negative = _mm_cmplt_pd(x, _mm_setzero_pd());
+    __m128d absX = _mm_andnot_pd(_mm_set1_pd(-0.0), x);
+    __m128d r = atanPositive(_mm_div_pd(y, absX));
+    return _mm_blendv_pd(r, _mm_sub_pd(_mm_set1_pd(M_PI), r), negative);
+}
+
+CellMeasures::CellMeasures(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_cells = NULL;
+    m_offsets = NULL;
+    m_corners = NULL;
+    m_chunks = 1;
+}
+
+void CellMeasures::compute(const VoronoiCell* cells, size_t count)
+{
+    m_cells = cells;
+    run(count);
+    m_cells = NULL;
+}
+
+void CellMeasures::compute(const uint64_t* offsets, const glm::dvec3* corners, size_t count)
+{
+    m_offsets = offsets;
+    m_corners = corners;
+    run(count);
+    m_offsets = NULL;
+    m_corners = NULL;
+}
+
+void CellMeasures::run(size_t count)
+{
+    m_areas.resize(count);
+    m_perimeters.resize(count);
+    m_centroids.resize(count);
+    if (count == 0) return;
+
+    m_chunks = ::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64));
+    TaskGraph tg;
+    for (size_t c = 0; c < m_chunks; c++)
+    {
+        CellMeasuresTask* task = new CellMeasuresTask;
+        task->td = TaskDataCellMeasures{this, c};
+        tg.addTask(unique_ptr<Task>(task));
+    }
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+}
+
+void CellMeasures::measure(size_t chunk)
+{
+    const glm::dvec3 unused(1.0, 0.0, 0.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d tiny = _mm_set1_pd(1e-300);
+
+    for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i += 2)
+    {
+        // lane 1 of the last cell of an odd chunk has no corners
+        const glm::dvec3* corners[2];
+        size_t n[2] = { 0, 0 };
+        glm::dvec3 inside[2];
+        size_t lanes = ::std::min(chunkStart(chunk + 1) - i, (size_t)2);
+        for (size_t l = 0; l < 2; l++)
+        {
+            corners[l] = &unused;
+            if (l < lanes)
+            {
+                if (m_cells)
+                {
+                    corners[l] = m_cells[i + l].corners.data();
+                    n[l] = m_cells[i + l].corners.size();
+                }
+                else
+                {
+                    corners[l] = m_corners + m_offsets[i + l];
+                    n[l] = m_offsets[i + l + 1] - m_offsets[i + l];
+                }
+                if (n[l] < 3) n[l] = 0;
+            }
+
+            glm::dvec3 sum(0.0);
+            for (size_t k = 0; k < n[l]; k++)
+                sum += corners[l][k];
+            inside[l] = n[l] ? glm::normalize(sum) : unused;
+        }
+
+        __m128d PX = _mm_set_pd(inside[1].x, inside[0].x);
+        __m128d PY = _mm_set_pd(inside[1].y, inside[0].y);
+        __m128d PZ = _mm_set_pd(inside[1].z, inside[0].z);
+        __m128d area = _mm_setzero_pd();
+        __m128d perimeter = _mm_setzero_pd();
+        __m128d MX = _mm_setzero_pd();
+        __m128d MY = _mm_setzero_pd();
+        __m128d MZ = _mm_setzero_pd();
+
+        // edges past the end of a lane's cell run from its first corner to
+        // itself and add nothing
+        for (size_t k = 0; k < ::std::max(n[0], n[1]); k++)
+        {
+            const glm::dvec3 & a0 = k < n[0] ? corners[0][k] : corners[0][0];
+            const glm::dvec3 & b0 = k < n[0] ? corners[0][(k + 1) % n[0]] : corners[0][0];
+            const glm::dvec3 & a1 = k < n[1] ? corners[1][k] : corners[1][0];
+            const glm::dvec3 & b1 = k < n[1] ? corners[1][(k + 1) % n[1]] : corners[1][0];
+            __m128d AX = _mm_set_pd(a1.x, a0.x), AY = _mm_set_pd(a1.y, a0.y), AZ = _mm_set_pd(a1.z, a0.z);
+            __m128d BX = _mm_set_pd(b1.x, b0.x), BY = _mm_set_pd(b1.y, b0.y), BZ = _mm_set_pd(b1.z, b0.z);
+
+            __m128d CX = _mm_sub_pd(_mm_mul_pd(AY, BZ), _mm_mul_pd(AZ, BY));
+            __m128d CY = _mm_sub_pd(_mm_mul_pd(AZ, BX), _mm_mul_pd(AX, BZ));
+            __m128d CZ = _mm_sub_pd(_mm_mul_pd(AX, BY), _mm_mul_pd(AY, BX));
+            __m128d S = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(CX, CX), _mm_mul_pd(CY, CY)), _mm_mul_pd(CZ, CZ)));
+            __m128d AB = _mm_add_pd(_mm_add_pd(_mm_mul_pd(AX, BX), _mm_mul_pd(AY, BY)), _mm_mul_pd(AZ, BZ));
+
+            // arc of the edge, and its share of the first moment
+            __m128d arc = atan2Positive(S, AB);
+            perimeter = _mm_add_pd(perimeter, arc);
+            __m128d f = _mm_div_pd(arc, _mm_max_pd(S, tiny));
+            MX = _mm_add_pd(MX, _mm_mul_pd(f, CX));
+            MY = _mm_add_pd(MY, _mm_mul_pd(f, CY));
+            MZ = _mm_add_pd(MZ, _mm_mul_pd(f, CZ));
+
+            // solid angle of (inside, a, b), Van Oosterom and Strackee
+            __m128d PA = _mm_add_pd(_mm_add_pd(_mm_mul_pd(PX, AX), _mm_mul_pd(PY, AY)), _mm_mul_pd(PZ, AZ));
+            __m128d PB = _mm_add_pd(_mm_add_pd(_mm_mul_pd(PX, BX), _mm_mul_pd(PY, BY)), _mm_mul_pd(PZ, BZ));
+            __m128d PC = _mm_add_pd(_mm_add_pd(_mm_mul_pd(PX, CX), _mm_mul_pd(PY, CY)), _mm_mul_pd(PZ, CZ));
+            __m128d den = _mm_add_pd(_mm_add_pd(one, PA), _mm_add_pd(AB, PB));
+            __m128d half = atan2Positive(_mm_andnot_pd(_mm_set1_pd(-0.0), PC), den);
+            area = _mm_add_pd(area, _mm_add_pd(half, half));
+        }
+
+        ALIGN(16) double areas[2], perimeters[2], mx[2], my[2], mz[2];
+        _mm_store_pd(areas, area);
+        _mm_store_pd(perimeters, perimeter);
+        _mm_store_pd(mx, MX);
+        _mm_store_pd(my, MY);
+        _mm_store_pd(mz, MZ);
+        for (size_t l = 0; l < lanes; l++)
+        {
+            // the moment points into or out of the cell with the corner order
+            glm::dvec3 m(mx[l], my[l], mz[l]);
+            m_areas[i + l] = areas[l];
+            m_perimeters[i + l] = perimeters[l];
+            m_centroids[i + l] = n[l] ? glm::normalize(glm::dot(m, inside[l]) < 0.0 ? -m : m) : glm::dvec3(0.0);
+        }
+    }
+}
+
+}
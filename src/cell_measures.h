@@ -0,0 +1,70 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include <cstdint>
+#include <vector>
+
+namespace VorGen {
+
+/*
+    Area, perimeter and centroid of every cell as a spherical polygon on
+    the unit sphere, computed in one batch pass over the corners rather
+    than per cell in the sweeps.
+
+    The area is the sum of the solid angles of the triangles joining a
+    point inside the cell to each edge, and the perimeter the sum of the
+    edge arcs. The first moment of a spherical polygon is half the sum over
+    its edges of the arc times the unit normal of the edge's great circle,
+    and the centroid is its direction. Every term is an arctangent of
+    products of the corners, no projection or trigonometry per corner.
+
+    Cells are taken two at a time, one per SSE lane, the shorter of the two
+    padded with empty edges. Chunks of cells are split across the worker
+    threads. Corners may be in either order, cells with fewer than three
+    have zero area and perimeter and a zero centroid.
+*/
+
+class CellMeasures
+{
+    public:
+
+        CellMeasures(int threads = 6);
+
+        void compute(const VoronoiCell* cells, size_t count);
+        // cell c's corners are corners[offsets[c] .. offsets[c + 1] - 1], as
+        // in a result file
+        void compute(const uint64_t* offsets, const glm::dvec3* corners, size_t count);
+
+        size_t getCount() const { return m_areas.size(); }
+        const double* getAreas() const { return m_areas.data(); }
+        const double* getPerimeters() const { return m_perimeters.data(); }
+        const glm::dvec3* getCentroids() const { return m_centroids.data(); }
+
+        // steradians
+        double getArea(size_t c) const { return m_areas[c]; }
+        // radians
+        double getPerimeter(size_t c) const { return m_perimeters[c]; }
+        const glm::dvec3 & getCentroid(size_t c) const { return m_centroids[c]; }
+
+    private:
+
+        int m_threads;
+        ::std::vector<double> m_areas;
+        ::std::vector<double> m_perimeters;
+        ::std::vector<glm::dvec3> m_centroids;
+
+        // the input of compute, one of the two
+        const VoronoiCell* m_cells;
+        const uint64_t* m_offsets;
+        const glm::dvec3* m_corners;
+        size_t m_chunks;
+
+        size_t chunkStart(size_t chunk) const { return m_areas.size() * chunk / m_chunks; }
+
+        void run(size_t count);
+        void measure(size_t chunk);
+
+        friend class CellMeasuresTask;
+};
+
+}
@@ -0,0 +1,51 @@
+#include "cell_sink.h"
+
+namespace VorGen {
+
+QueueCellSink::QueueCellSink()
+{
+    m_cells = NULL;
+    m_finished = false;
+}
+
+void QueueCellSink::consume(const VoronoiCell* cells, const size_t* indices, size_t count)
+{
+    ::std::vector<size_t> batch(indices, indices + count);
+    {
+        ::std::lock_guard<::std::mutex> lock(m_mutex);
+        m_cells = cells;
+        m_batches.push_back(::std::move(batch));
+    }
+    m_ready.notify_one();
+}
+
+void QueueCellSink::finish()
+{
+    {
+        ::std::lock_guard<::std::mutex> lock(m_mutex);
+        m_finished = true;
+    }
+    m_ready.notify_all();
+}
+
+bool QueueCellSink::pop(::std::vector<size_t> & batch)
+{
+    ::std::unique_lock<::std::mutex> lock(m_mutex);
+    m_ready.wait(lock, [this] { return !m_batches.empty() || m_finished; });
+    if (m_batches.empty())
+        return false;
+
+    batch = ::std::move(m_batches.front());
+    m_batches.pop_front();
+    return true;
+}
+
+void QueueCellSink::reset()
+{
+    ::std::lock_guard<::std::mutex> lock(m_mutex);
+    m_batches.clear();
+    m_cells = NULL;
+    m_finished = false;
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace VorGen {
+
+// cells a sweep collects before handing them to the sink
+const size_t CELL_SINK_BATCH = 1024;
+
+/*
+    Receives the cells of a run as they are finished. During a full sphere
+    run a sweep delivers each cell it owns as soon as its last arc leaves
+    the beachline, with its corners sorted (and its centroid computed when
+    CENTROID is defined). The cells still on the beachline when a sweep
+    ends are delivered by VoronoiSweeper::finishOpenCells, the cells of a
+    cap by RotateCellsTask, and those of a cap job by CollectCapJobTask.
+    Each cell with corners is delivered exactly once.
+
+    consume is called from several worker threads at once, finish once
+    after the last batch of the run.
+*/
+
+class CellSink
+{
+    public:
+
+        virtual ~CellSink() = default;
+
+        // indices are into cells, the cell array of the run
+        virtual void consume(const VoronoiCell* cells, const size_t* indices, size_t count) = 0;
+        virtual void finish() {}
+};
+
+// queues batches for consumer threads
+class QueueCellSink : public CellSink
+{
+    public:
+
+        QueueCellSink();
+
+        void consume(const VoronoiCell* cells, const size_t* indices, size_t count) override;
+        void finish() override;
+
+        // waits for the next batch, false once the run is finished and
+        // every batch has been taken
+        bool pop(::std::vector<size_t> & batch);
+
+        // the cell array of the run, valid once a batch has been popped
+        const VoronoiCell* getCells() const { return m_cells; }
+
+        // ready for another run
+        void reset();
+
+    private:
+
+        ::std::mutex m_mutex;
+        ::std::condition_variable m_ready;
+        ::std::deque<::std::vector<size_t>> m_batches;
+        const VoronoiCell* m_cells;
+        bool m_finished;
+};
+
+}
@@ -2,10 +2,24 @@
 
 #include <atomic>
 #include <cstdint>
+#include <limits>
 
 namespace VorGen {
 
 extern ::std::atomic<std::size_t> completedCells;
 enum Order { Increasing, Decreasing };
 
+// Beachline nodes are addressed by indices of the sweep's index type.
+// Sweeps of up to NARROW_SWEEP_SITES sites use 32-bit ones, which keep
+// SkipNode small, and larger sweeps 64-bit ones.
+typedef int32_t NarrowIndex;
+typedef int64_t WideIndex;
+
+// a sweep of n sites allocates 2n - 2 nodes
+template <typename I>
+constexpr ::std::size_t maxSweepSites() { return (::std::size_t)::std::numeric_limits<I>::max() / 2; }
+
+constexpr ::std::size_t NARROW_SWEEP_SITES = maxSweepSites<NarrowIndex>();
+constexpr ::std::size_t MAX_SWEEP_SITES = maxSweepSites<WideIndex>();
+
 }
\ No newline at end of file
@@ -0,0 +1,550 @@
+#include "incremental_diagram.h"
+#include "voronoi_generator.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <cmath>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+// fewer sites than this are generated again rather than repaired
+static const size_t MIN_REPAIR_SITES = 16;
+
+// the first cut of a cell is the square cut by the bisectors of the site and
+// four sites this far from it, which leaves nearly a hemisphere
+static const double BOUND_ANGLE = 170.0 * M_PI / 180.0;
+static const size_t BOUND_SITE = SIZE_MAX - 4;
+
+namespace {
+
+// open addressed set of site ids
+struct IdSet
+{
+    ::std::vector<size_t> slots;
+    size_t count;
+
+    void clear()
+    {
+        slots.assign(::std::max(slots.size(), (size_t)64), SIZE_MAX);
+        count = 0;
+    }
+
+    // false if id was already in the set
+    bool insert(size_t id)
+    {
+        if (2 * (count + 1) > slots.size())
+        {
+            ::std::vector<size_t> old(slots.size() * 2, SIZE_MAX);
+            old.swap(slots);
+            count = 0;
+            for (size_t v : old)
+                if (v != SIZE_MAX) insert(v);
+        }
+
+        size_t mask = slots.size() - 1;
+        for (size_t h = (id * 0x9E3779B97F4A7C15ull) >> 20 & mask; ; h = (h + 1) & mask)
+        {
+            if (slots[h] == id) return false;
+            if (slots[h] == SIZE_MAX)
+            {
+                slots[h] = id;
+                count++;
+                return true;
+            }
+        }
+    }
+};
+
+}
+
+IncrementalDiagram::IncrementalDiagram(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_siteCount = 0;
+    m_chunks = 1;
+}
+
+void IncrementalDiagram::build(const VoronoiCell* cells, size_t count)
+{
+    m_positions.assign(count, glm::dvec3(0.0));
+    m_corners.assign(count, ::std::vector<glm::dvec3>());
+    m_neighbors.assign(count, ::std::vector<size_t>());
+    m_state.assign(count, Alive);
+    m_free.clear();
+    m_inserts.clear();
+    m_removes.clear();
+    m_siteCount = count;
+
+    setCells(cells, NULL, count);
+    seedBins();
+}
+
+void IncrementalDiagram::setCells(const VoronoiCell* cells, const size_t* ids, size_t count)
+{
+    // sites sharing a corner, as the locator finds them
+    PointLocator locator(m_threads);
+    locator.build(cells, count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t id = ids ? ids[i] : i;
+        m_positions[id] = cells[i].position;
+        m_corners[id] = cells[i].corners;
+
+        const size_t* neighbors = locator.getNeighbors(i);
+        m_neighbors[id].resize(locator.getNeighborCount(i));
+        for (size_t n = 0; n < m_neighbors[id].size(); n++)
+            m_neighbors[id][n] = ids ? ids[neighbors[n]] : neighbors[n];
+    }
+}
+
+void IncrementalDiagram::seedBins()
+{
+    m_grid.layout(::std::max((size_t)1, (size_t)ceil(sqrt(m_siteCount / 18.0))));
+    m_seeds.assign(m_grid.getBinCount(), SIZE_MAX);
+    m_isSeed.assign(m_state.size(), 0);
+
+    size_t seed = 0;
+    while (seed < m_state.size() && !isOld(seed))
+        seed++;
+    if (seed == m_state.size())
+        return;
+
+    // bins are in face and row order, each walk starts from the last seed
+    for (size_t b = 0; b < m_seeds.size(); b++)
+    {
+        seed = m_seeds[b] = locate(m_grid.getBinCenter(b), seed);
+        m_isSeed[seed] = 1;
+    }
+}
+
+size_t IncrementalDiagram::insert(const glm::dvec3 & p)
+{
+    size_t id;
+    if (!m_free.empty())
+    {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        id = m_positions.size();
+        m_positions.push_back(glm::dvec3(0.0));
+        m_corners.push_back(::std::vector<glm::dvec3>());
+        m_neighbors.push_back(::std::vector<size_t>());
+        m_state.push_back(Empty);
+        m_isSeed.push_back(0);
+    }
+
+    m_positions[id] = glm::normalize(p);
+    m_state[id] = Inserted;
+    m_inserts.push_back(id);
+    return id;
+}
+
+void IncrementalDiagram::remove(size_t id)
+{
+    if (m_state[id] == Alive)
+    {
+        m_state[id] = Removed;
+        m_removes.push_back(id);
+    }
+    else if (m_state[id] == Inserted)
+    {
+        // left in m_inserts and skipped by update
+        m_state[id] = Empty;
+        m_free.push_back(id);
+    }
+}
+
+size_t IncrementalDiagram::locate(const glm::dvec3 & p, size_t cell) const
+{
+    // every step is to a strictly nearer site, so the walk ends
+    double best = glm::dot(m_positions[cell], p);
+    while (true)
+    {
+        size_t next = cell;
+        for (size_t n : m_neighbors[cell])
+        {
+            double d = glm::dot(m_positions[n], p);
+            if (d > best)
+            {
+                best = d;
+                next = n;
+            }
+        }
+
+        if (next == cell)
+            return cell;
+        cell = next;
+    }
+}
+
+template <typename F>
+void IncrementalDiagram::forEachPatchInsert(size_t cell, F f) const
+{
+    auto range = ::std::equal_range(m_patchCells.begin(), m_patchCells.end(), ::std::make_pair(cell, (size_t)0),
+        [](const ::std::pair<size_t, size_t> & a, const ::std::pair<size_t, size_t> & b) { return a.first < b.first; });
+    for (auto it = range.first; it != range.second; ++it)
+        f(m_inserts[it->second]);
+}
+
+size_t IncrementalDiagram::update()
+{
+    // inserts cancelled by remove, or queued twice in a reused slot
+    ::std::sort(m_inserts.begin(), m_inserts.end());
+    m_inserts.erase(::std::unique(m_inserts.begin(), m_inserts.end()), m_inserts.end());
+    m_inserts.erase(::std::remove_if(m_inserts.begin(), m_inserts.end(),
+        [&](size_t id) { return m_state[id] != Inserted; }), m_inserts.end());
+    if (m_inserts.empty() && m_removes.empty())
+        return 0;
+
+    if (m_siteCount < MIN_REPAIR_SITES || m_siteCount - m_removes.size() < MIN_REPAIR_SITES)
+    {
+        rebuild();
+        return m_siteCount;
+    }
+
+    auto run = [&](size_t count, auto makeTask)
+    {
+        if (count == 0) return;
+        m_chunks = ::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64));
+        TaskGraph tg;
+        for (size_t c = 0; c < m_chunks; c++)
+            tg.addTask(unique_ptr<Task>(makeTask(c)));
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    };
+
+    // the cell each new site lands in
+    m_patch.resize(m_inserts.size());
+    for (size_t i = 0; i < m_inserts.size(); i++)
+    {
+        const glm::dvec3 & p = m_positions[m_inserts[i]];
+        m_patch[i].assign(1, locate(p, m_seeds[m_grid.getBin(p)]));
+    }
+
+    run(m_inserts.size(), [&](size_t c) { IncrementalPatchTask* t = new IncrementalPatchTask; t->td = TaskDataIncremental{this, c}; return t; });
+
+    m_patchCells.clear();
+    for (size_t i = 0; i < m_inserts.size(); i++)
+        for (size_t cell : m_patch[i])
+            m_patchCells.push_back(::std::make_pair(cell, i));
+    ::std::sort(m_patchCells.begin(), m_patchCells.end());
+
+    // cells that change, the new sites and their patches and the
+    // neighbours of removed sites
+    m_work.assign(m_inserts.begin(), m_inserts.end());
+    for (const auto & pc : m_patchCells)
+        if (m_state[pc.first] == Alive) m_work.push_back(pc.first);
+    for (size_t id : m_removes)
+        for (size_t n : m_neighbors[id])
+            if (m_state[n] == Alive) m_work.push_back(n);
+    ::std::sort(m_work.begin(), m_work.end());
+    m_work.erase(::std::unique(m_work.begin(), m_work.end()), m_work.end());
+
+    m_newCorners.resize(m_work.size());
+    m_newNeighbors.resize(m_work.size());
+    m_open.assign(m_work.size(), 0);
+    run(m_work.size(), [&](size_t c) { IncrementalClipTask* t = new IncrementalClipTask; t->td = TaskDataIncremental{this, c}; return t; });
+
+    if (::std::find(m_open.begin(), m_open.end(), 1) != m_open.end())
+    {
+        rebuild();
+        return m_siteCount;
+    }
+
+    // removed seeds move to a neighbour that is left, any changed cell
+    // when the whole neighbourhood goes
+    ::std::vector<::std::pair<size_t, size_t>> seeds;
+    for (size_t id : m_removes)
+    {
+        if (!m_isSeed[id]) continue;
+        size_t to = m_work[0];
+        for (size_t n : m_neighbors[id])
+        {
+            if (m_state[n] == Alive)
+            {
+                to = n;
+                break;
+            }
+        }
+        seeds.push_back(::std::make_pair(id, to));
+    }
+
+    for (size_t w = 0; w < m_work.size(); w++)
+    {
+        m_corners[m_work[w]].swap(m_newCorners[w]);
+        m_neighbors[m_work[w]].swap(m_newNeighbors[w]);
+    }
+    for (size_t id : m_removes)
+    {
+        ::std::vector<glm::dvec3>().swap(m_corners[id]);
+        ::std::vector<size_t>().swap(m_neighbors[id]);
+        m_state[id] = Empty;
+        m_free.push_back(id);
+    }
+    for (size_t id : m_inserts)
+        m_state[id] = Alive;
+
+    m_siteCount += m_inserts.size();
+    m_siteCount -= m_removes.size();
+
+    // and walk back to the center of their bins
+    if (!seeds.empty())
+    {
+        ::std::sort(seeds.begin(), seeds.end());
+        for (const auto & moved : seeds)
+            m_isSeed[moved.first] = 0;
+        for (size_t b = 0; b < m_seeds.size(); b++)
+        {
+            if (m_state[m_seeds[b]] != Empty) continue;
+            auto moved = ::std::lower_bound(seeds.begin(), seeds.end(), ::std::make_pair(m_seeds[b], (size_t)0));
+            m_seeds[b] = locate(m_grid.getBinCenter(b), moved->second);
+            m_isSeed[m_seeds[b]] = 1;
+        }
+    }
+
+    m_inserts.clear();
+    m_removes.clear();
+    m_patchCells.clear();
+    return m_work.size();
+}
+
+void IncrementalDiagram::findPatches(size_t chunk)
+{
+    IdSet visited;
+    ::std::vector<size_t> open;
+    for (size_t i = chunkStart(chunk, m_inserts.size()); i < chunkStart(chunk + 1, m_inserts.size()); i++)
+    {
+        // flood from the cell p lands in over the cells with a corner nearer
+        // to p than to their site, and through removed cells
+        const glm::dvec3 & p = m_positions[m_inserts[i]];
+        ::std::vector<size_t> & patch = m_patch[i];
+        visited.clear();
+        visited.insert(patch[0]);
+        open.assign(1, patch[0]);
+
+        while (!open.empty())
+        {
+            size_t cell = open.back();
+            open.pop_back();
+
+            for (size_t n : m_neighbors[cell])
+            {
+                if (!visited.insert(n))
+                    continue;
+
+                bool inPatch = m_state[n] == Removed;
+                for (size_t k = 0; k < m_corners[n].size() && !inPatch; k++)
+                    inPatch = glm::dot(m_corners[n][k], p) > glm::dot(m_corners[n][k], m_positions[n]);
+
+                if (inPatch)
+                {
+                    patch.push_back(n);
+                    open.push_back(n);
+                }
+            }
+        }
+    }
+}
+
+void IncrementalDiagram::candidates(size_t id, ::std::vector<size_t> & found) const
+{
+    IdSet visited;
+    visited.clear();
+    visited.insert(id);
+    found.clear();
+
+    // sites one step from id, through any number of removed sites
+    ::std::vector<size_t> open(1, id);
+    auto reach = [&](size_t n)
+    {
+        if (!visited.insert(n))
+            return;
+        if (m_state[n] == Removed)
+            open.push_back(n);
+        else
+            found.push_back(n);
+    };
+
+    while (!open.empty())
+    {
+        size_t cell = open.back();
+        open.pop_back();
+
+        if (m_state[cell] == Inserted)
+        {
+            size_t i = ::std::lower_bound(m_inserts.begin(), m_inserts.end(), cell) - m_inserts.begin();
+            for (size_t n : m_patch[i])
+                reach(n);
+        }
+        else
+        {
+            for (size_t n : m_neighbors[cell])
+                reach(n);
+            forEachPatchInsert(cell, reach);
+        }
+    }
+
+    // two new sites meet over the cells their patches share
+    if (m_state[id] == Inserted)
+    {
+        size_t count = found.size();
+        for (size_t k = 0; k < count; k++)
+            if (m_state[found[k]] == Alive)
+                forEachPatchInsert(found[k], reach);
+    }
+}
+
+bool IncrementalDiagram::clip(size_t id, const ::std::vector<size_t> & found, ::std::vector<glm::dvec3> & corners,
+                              ::std::vector<size_t> & neighbors) const
+{
+    struct Vertex
+    {
+        glm::dvec3 p;
+        size_t edge; // site across the edge to the next vertex
+    };
+
+    const glm::dvec3 & s = m_positions[id];
+    glm::dvec3 e1 = glm::normalize(glm::cross(s, fabs(s.x) < 0.9 ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 1.0, 0.0)));
+    glm::dvec3 e2 = glm::cross(s, e1);
+    glm::dvec3 bound[4] = { e1, e2, -e1, -e2 };
+    for (glm::dvec3 & b : bound)
+        b = s * cos(BOUND_ANGLE) + b * sin(BOUND_ANGLE);
+
+    auto site = [&](size_t n) -> const glm::dvec3 & { return n >= BOUND_SITE ? bound[n - BOUND_SITE] : m_positions[n]; };
+    // the corner after the edge with a and before the edge with b, counter
+    // clockwise about s, as the sweeps compute it
+    auto corner = [&](size_t a, size_t b) { return glm::normalize(glm::cross(site(a) - s, site(b) - s)); };
+
+    ::std::vector<Vertex> poly, next;
+    poly.reserve(16);
+    next.reserve(16);
+    for (size_t k = 0; k < 4; k++)
+        poly.push_back(Vertex{corner(BOUND_SITE + (k + 3) % 4, BOUND_SITE + k), BOUND_SITE + k});
+
+    // nearest first, the far ones then rarely cut anything
+    ::std::vector<::std::pair<double, size_t>> order(found.size());
+    for (size_t k = 0; k < found.size(); k++)
+        order[k] = ::std::make_pair(-glm::dot(m_positions[found[k]], s), found[k]);
+    ::std::sort(order.begin(), order.end());
+
+    ::std::vector<double> d;
+    for (const auto & o : order)
+    {
+        size_t c = o.second;
+        glm::dvec3 n = s - m_positions[c];
+        if (n == glm::dvec3(0.0))
+            continue;
+
+        d.resize(poly.size());
+        bool cuts = false;
+        for (size_t k = 0; k < poly.size(); k++)
+        {
+            d[k] = glm::dot(poly[k].p, n);
+            cuts |= d[k] < 0.0;
+        }
+        if (!cuts)
+            continue;
+
+        next.clear();
+        for (size_t k = 0; k < poly.size(); k++)
+        {
+            size_t l = (k + 1) % poly.size();
+            if (d[k] >= 0.0)
+            {
+                next.push_back(poly[k]);
+                if (d[l] < 0.0)
+                    next.push_back(Vertex{corner(poly[k].edge, c), c});
+            }
+            else if (d[l] >= 0.0)
+                next.push_back(Vertex{corner(c, poly[k].edge), poly[k].edge});
+        }
+        poly.swap(next);
+        if (poly.size() < 3)
+            return false;
+    }
+
+    corners.resize(poly.size());
+    neighbors.resize(poly.size());
+    for (size_t k = 0; k < poly.size(); k++)
+    {
+        if (poly[k].edge >= BOUND_SITE)
+            return false;
+        corners[k] = poly[k].p;
+        neighbors[k] = poly[k].edge;
+    }
+    return true;
+}
+
+void IncrementalDiagram::clipCells(size_t chunk)
+{
+    ::std::vector<size_t> found;
+    for (size_t w = chunkStart(chunk, m_work.size()); w < chunkStart(chunk + 1, m_work.size()); w++)
+    {
+        candidates(m_work[w], found);
+        m_open[w] = !clip(m_work[w], found, m_newCorners[w], m_newNeighbors[w]);
+    }
+}
+
+void IncrementalDiagram::rebuild()
+{
+    for (size_t id : m_removes)
+    {
+        m_state[id] = Empty;
+        m_free.push_back(id);
+    }
+    for (size_t id : m_inserts)
+        m_state[id] = Alive;
+    m_inserts.clear();
+    m_removes.clear();
+    m_patchCells.clear();
+
+    ::std::vector<size_t> ids;
+    for (size_t id = 0; id < m_state.size(); id++)
+    {
+        ::std::vector<glm::dvec3>().swap(m_corners[id]);
+        ::std::vector<size_t>().swap(m_neighbors[id]);
+        if (m_state[id] == Alive)
+            ids.push_back(id);
+    }
+    m_siteCount = ids.size();
+
+    if (ids.size() >= 4)
+    {
+        ::std::vector<glm::dvec3> points(ids.size());
+        for (size_t i = 0; i < ids.size(); i++)
+            points[i] = m_positions[ids[i]];
+
+        VoronoiGenerator vg;
+        vg.setWorkerThreads(m_threads);
+        VoronoiCell* cells = vg.generate(points.data(), points.size(), points.size(), false);
+        if (cells)
+        {
+            setCells(cells, ids.data(), ids.size());
+            delete[] cells;
+        }
+    }
+    seedBins();
+}
+
+VoronoiCell* IncrementalDiagram::copyCells(::std::vector<size_t> & ids) const
+{
+    ids.clear();
+    for (size_t id = 0; id < m_state.size(); id++)
+        if (m_state[id] == Alive || m_state[id] == Removed) ids.push_back(id);
+
+    VoronoiCell* cells = new VoronoiCell[ids.size()];
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        cells[i].position = m_positions[ids[i]];
+        cells[i].corners = m_corners[ids[i]];
+        cells[i].m_arcs = 0;
+        cells[i].m_owner.store(0);
+    }
+    return cells;
+}
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include "sphere_grid.h"
+#include <cstdint>
+#include <vector>
+
+namespace VorGen {
+
+/*
+    A diagram that is kept up to date as sites are inserted and removed,
+    without generating it again. Every site keeps its corners, in the order
+    of a generated cell, and the sites it shares an edge with. The lists
+    start from the neighbours of a generated result, found as PointLocator
+    finds them.
+
+    Changes are queued and applied together by update. A new site takes
+    area only from the cells with a corner nearer to it than to their own
+    site, and those form a connected patch around the cell it lands in, so
+    they are found by walking to that cell and flooding out along the
+    neighbour lists. The cells of removed sites are passed through. The
+    cells that change are those patches and the neighbours of removed
+    sites, everything else keeps its corners and neighbours.
+
+    Each changed cell is clipped again from the sites one step from it,
+    counting removed sites as no step and adding the new sites whose patch
+    touches it, which holds all of its new neighbours. The cell starts as
+    nearly a hemisphere, cut by the bisector of the site and each
+    candidate, nearest first, and its corners come out as circumcenters of
+    the site and the two neighbours on either side. The work is split
+    across the worker threads and is proportional to the cells that
+    change.
+
+    Site ids stay fixed, the slots of removed sites are reused by later
+    inserts. Sites must be distinct, as for VoronoiGenerator::generate. Should a cell not close within its candidates, which takes a
+    diagram of a handful of sites, the whole diagram is generated again.
+*/
+
+class IncrementalDiagram
+{
+    public:
+
+        IncrementalDiagram(int threads = 6);
+
+        // takes the diagram of a generated result, site i is cells[i]. The
+        // cells are not needed afterwards.
+        void build(const VoronoiCell* cells, size_t count);
+
+        // queues a new site, p need not be normalized, and returns its id
+        size_t insert(const glm::dvec3 & p);
+        // queues the removal of site id, also cancels a queued insert
+        void remove(size_t id);
+
+        // applies the queued changes and returns the number of cells
+        // clipped again, new sites included, or of all of them when the
+        // diagram was generated again
+        size_t update();
+
+        // the diagram as of the last update. Ids are below getSlotCount,
+        // some slots may be empty.
+        size_t getSlotCount() const { return m_positions.size(); }
+        size_t getSiteCount() const { return m_siteCount; }
+        bool isAlive(size_t id) const { return m_state[id] == Alive || m_state[id] == Removed; }
+
+        const glm::dvec3 & getPosition(size_t id) const { return m_positions[id]; }
+        const ::std::vector<glm::dvec3> & getCorners(size_t id) const { return m_corners[id]; }
+        const ::std::vector<size_t> & getNeighbors(size_t id) const { return m_neighbors[id]; }
+
+        // the cells in id order, ids[i] is the id of cell i
+        VoronoiCell* copyCells(::std::vector<size_t> & ids) const;
+
+    private:
+
+        enum State : uint8_t
+        {
+            Empty,    // free slot
+            Alive,
+            Inserted, // queued insert
+            Removed   // queued removal, still in the diagram
+        };
+
+        int m_threads;
+        size_t m_siteCount;
+        ::std::vector<glm::dvec3> m_positions;
+        ::std::vector<::std::vector<glm::dvec3>> m_corners;
+        ::std::vector<::std::vector<size_t>> m_neighbors;
+        ::std::vector<State> m_state;
+        ::std::vector<size_t> m_free;
+
+        // walks start at the site nearest the center of their bin, or near
+        // it once that site is removed
+        SphereGrid m_grid;
+        ::std::vector<size_t> m_seeds;
+        ::std::vector<uint8_t> m_isSeed;
+
+        ::std::vector<size_t> m_inserts;
+        ::std::vector<size_t> m_removes;
+
+        // state of an update. The patch of insert i is m_patch[i], the
+        // (cell, insert) pairs of every patch are sorted by cell, and work
+        // item w is clipped into m_newCorners[w] and m_newNeighbors[w].
+        size_t m_chunks;
+        ::std::vector<::std::vector<size_t>> m_patch;
+        ::std::vector<::std::pair<size_t, size_t>> m_patchCells;
+        ::std::vector<size_t> m_work;
+        ::std::vector<::std::vector<glm::dvec3>> m_newCorners;
+        ::std::vector<::std::vector<size_t>> m_newNeighbors;
+        ::std::vector<uint8_t> m_open;
+
+        // a site of the diagram before the update
+        bool isOld(size_t id) const { return m_state[id] == Alive || m_state[id] == Removed; }
+        size_t chunkStart(size_t chunk, size_t count) const { return count * chunk / m_chunks; }
+
+        // nearest site of the diagram before the update, walking from start
+        size_t locate(const glm::dvec3 & p, size_t start) const;
+        void findPatches(size_t chunk);
+        void clipCells(size_t chunk);
+        void candidates(size_t id, ::std::vector<size_t> & found) const;
+        // false if the cell did not close
+        bool clip(size_t id, const ::std::vector<size_t> & found, ::std::vector<glm::dvec3> & corners,
+                  ::std::vector<size_t> & neighbors) const;
+        // slot ids[i] takes cells[i], ids NULL for slot i
+        void setCells(const VoronoiCell* cells, const size_t* ids, size_t count);
+        void seedBins();
+        void rebuild();
+
+        template <typename F>
+        void forEachPatchInsert(size_t cell, F f) const;
+
+        friend class IncrementalPatchTask;
+        friend class IncrementalClipTask;
+};
+
+}
@@ -4,51 +4,56 @@
 #include "voronoi_event.h"
 #include "platform.h"
 #include "globals.h"
+#include <cstddef>
 #include <cstring>
 
 namespace VorGen {
 
-template <Order O>
+template <Order O, typename I, typename T>
 struct MemBlock
 {
-    SkipNode<O> skipNode;
-    CircleEvent<O> circleEvent;
+    SkipNode<O, I, T> skipNode;
+    CircleEvent<O, T> circleEvent;
 };
 
-template struct MemBlock<Increasing>;
-template struct MemBlock<Decreasing>;
+template struct MemBlock<Increasing, NarrowIndex, double>;
+template struct MemBlock<Decreasing, NarrowIndex, double>;
+template struct MemBlock<Increasing, WideIndex, double>;
+template struct MemBlock<Decreasing, WideIndex, double>;
+template struct MemBlock<Increasing, NarrowIndex, float>;
+template struct MemBlock<Decreasing, NarrowIndex, float>;
 
-template <Order O>
-const int skipNodeOffset = OFFSETOF(MemBlock<O>, skipNode);
+template <Order O, typename I, typename T>
+const int skipNodeOffset = OFFSETOF(MemBlock<O, I, T>, skipNode);
 
-template <Order O>
-const int circleEventOffset = OFFSETOF(MemBlock<O>, circleEvent);
+template <Order O, typename I, typename T>
+const int circleEventOffset = OFFSETOF(MemBlock<O, I, T>, circleEvent);
 
-template <Order O>
-const int beachArcOffset = OFFSETOF(MemBlock<O>, skipNode.m_beachArc);
+template <Order O, typename I, typename T>
+const int beachArcOffset = OFFSETOF(MemBlock<O, I, T>, skipNode.m_beachArc);
 
-template <Order O>
-const int ceTOsn = skipNodeOffset<O> - circleEventOffset<O>;
+template <Order O, typename I, typename T>
+const int ceTOsn = skipNodeOffset<O, I, T> - circleEventOffset<O, I, T>;
 
-template <Order O>
-inline SkipNode<O>* getSkipNodeFromCircleEvent(CircleEvent<O>* circleEvent)
+template <Order O, typename I, typename T>
+inline SkipNode<O, I, T>* getSkipNodeFromCircleEvent(CircleEvent<O, T>* circleEvent)
 {
-    return (SkipNode<O>*)((char*)circleEvent + ceTOsn<O>);
+    return (SkipNode<O, I, T>*)((char*)circleEvent + ceTOsn<O, I, T>);
 }
 
-template <Order O>
-const int snTOce = circleEventOffset<O> - skipNodeOffset<O>;
+template <Order O, typename I, typename T>
+const int snTOce = circleEventOffset<O, I, T> - skipNodeOffset<O, I, T>;
 
-template <Order O>
-inline CircleEvent<O>* getCircleEventFromSkipNode(SkipNode<O>* skipNode)
+template <Order O, typename I, typename T>
+inline CircleEvent<O, T>* getCircleEventFromSkipNode(SkipNode<O, I, T>* skipNode)
 {
-    return (CircleEvent<O>*)((char*)skipNode + snTOce<O>);
+    return (CircleEvent<O, T>*)((char*)skipNode + snTOce<O, I, T>);
 }
 
-template <Order O>
-inline SkipNode<O>* getPointerFromIndex(SkipNode<O>* skipNode, int i)
+template <Order O, typename I, typename T>
+inline SkipNode<O, I, T>* getPointerFromIndex(SkipNode<O, I, T>* skipNode, I i)
 {
-    return (SkipNode<O>*)( (char*)skipNode + (i - skipNode->index) * sizeof(MemBlock<O>) );
+    return (SkipNode<O, I, T>*)( (char*)skipNode + (::std::ptrdiff_t)(i - skipNode->index) * (::std::ptrdiff_t)sizeof(MemBlock<O, I, T>) );
 }
 
 #define NODE(pointer, member) getPointerFromIndex(pointer, pointer->member)
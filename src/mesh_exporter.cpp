@@ -0,0 +1,359 @@
+#include "mesh_exporter.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+MeshExporter::MeshExporter(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_cells = NULL;
+    m_chunks = 1;
+}
+
+void MeshExporter::build(const VoronoiCell* cells, size_t count)
+{
+    m_cells = cells;
+    m_faceCells.clear();
+    m_faceStart.assign(1, 0);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cells[i].m_arcs != 0 || cells[i].corners.size() < 3)
+            continue;
+        m_faceCells.push_back(i);
+        m_faceStart.push_back(m_faceStart.back() + cells[i].corners.size());
+    }
+    m_indices.resize(m_faceStart.back());
+
+    size_t faces = m_faceCells.size();
+    m_chunks = ::std::max(::std::min((size_t)(m_threads + 1) * 4, ::std::min(faces, (size_t)64)), (size_t)1);
+    m_shardCorners.assign(m_chunks * SHARDS, ::std::vector<CornerRef>());
+    m_shardVertices.assign(SHARDS, ::std::vector<glm::dvec3>());
+    m_shardBase.assign(SHARDS + 1, 0);
+    m_shardTables.assign(SHARDS, ::std::vector<Slot>());
+    m_shardLinks.assign(SHARDS, ::std::vector<::std::pair<uint32_t, uint32_t>>());
+
+    // sort the corners of every chunk of faces into shards
+    {
+        TaskGraph tg;
+        for (size_t c = 0; c < m_chunks; c++)
+        {
+            MeshShardTask* task = new MeshShardTask;
+            task->td = TaskDataMesh{this, c};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    }
+
+    // weld each shard on its own, vertices are numbered shard by shard
+    {
+        TaskGraph tg;
+        for (size_t s = 0; s < SHARDS; s++)
+        {
+            MeshWeldTask* task = new MeshWeldTask;
+            task->td = TaskDataMesh{this, s};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    }
+
+    for (size_t s = 0; s < SHARDS; s++)
+        m_shardBase[s + 1] = m_shardBase[s] + m_shardVertices[s].size();
+    m_vertices.resize(m_shardBase[SHARDS]);
+
+    {
+        TaskGraph tg;
+        for (size_t s = 0; s < SHARDS; s++)
+        {
+            MeshPlaceTask* task = new MeshPlaceTask;
+            task->td = TaskDataMesh{this, s};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    }
+
+    // match vertices across the faces of their buckets
+    {
+        TaskGraph tg;
+        for (size_t s = 0; s < SHARDS; s++)
+        {
+            MeshLinkTask* task = new MeshLinkTask;
+            task->td = TaskDataMesh{this, s};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    }
+    mergeLinks();
+
+    m_shardCorners.clear();
+    m_shardVertices.clear();
+    m_shardTables.clear();
+    m_shardLinks.clear();
+}
+
+void MeshExporter::shardCorners(size_t chunk)
+{
+    size_t faces = m_faceCells.size();
+    ::std::vector<CornerRef>* shards = &m_shardCorners[chunk * SHARDS];
+    for (size_t f = chunkStart(chunk, faces); f < chunkStart(chunk + 1, faces); f++)
+    {
+        const ::std::vector<glm::dvec3> & corners = m_cells[m_faceCells[f]].corners;
+        for (size_t j = 0; j < corners.size(); j++)
+            shards[vertexHash(vertexKey(corners[j])) % SHARDS].push_back(CornerRef{m_faceStart[f] + j, &corners[j]});
+    }
+}
+
+void MeshExporter::weldShard(size_t shard)
+{
+    size_t corners = 0;
+    for (size_t c = 0; c < m_chunks; c++)
+        corners += m_shardCorners[c * SHARDS + shard].size();
+
+    // open addressed table from key to vertex, each vertex is shared by about 3 corners
+    size_t size = 16;
+    while (size < corners) size <<= 1;
+    size_t mask = size - 1;
+
+    ::std::vector<Slot> & table = m_shardTables[shard];
+    table.assign(size, Slot{{{0, 0, 0}}, UINT32_MAX});
+    ::std::vector<glm::dvec3> & vertices = m_shardVertices[shard];
+
+    // chunks in order so the numbering does not depend on the chunking.
+    // A bucket may hold more than one vertex, each has its own slot.
+    for (size_t c = 0; c < m_chunks; c++)
+    {
+        for (const CornerRef & ref : m_shardCorners[c * SHARDS + shard])
+        {
+            VertexKey key = vertexKey(*ref.position);
+
+            size_t h = (vertexHash(key) / SHARDS) & mask;
+            while (table[h].vertex != UINT32_MAX && 
+                   !(table[h].key == key && weldMatch(vertices[table[h].vertex], *ref.position)))
+                h = (h + 1) & mask;
+
+            if (table[h].vertex == UINT32_MAX)
+            {
+                table[h] = Slot{key, (uint32_t)vertices.size()};
+                vertices.push_back(*ref.position);
+            }
+            m_indices[ref.index] = table[h].vertex;
+        }
+    }
+}
+
+void MeshExporter::placeShard(size_t shard)
+{
+    ::std::copy(m_shardVertices[shard].begin(), m_shardVertices[shard].end(), m_vertices.begin() + m_shardBase[shard]);
+
+    uint32_t base = (uint32_t)m_shardBase[shard];
+    for (size_t c = 0; c < m_chunks; c++)
+        for (const CornerRef & ref : m_shardCorners[c * SHARDS + shard])
+            m_indices[ref.index] += base;
+}
+
+uint32_t MeshExporter::findVertex(size_t shard, const VertexKey & key, const glm::dvec3 & c) const
+{
+    const ::std::vector<Slot> & table = m_shardTables[shard];
+    if (table.empty())
+        return UINT32_MAX;
+
+    size_t mask = table.size() - 1;
+    for (size_t h = (vertexHash(key) / SHARDS) & mask; table[h].vertex != UINT32_MAX; h = (h + 1) & mask)
+        if (table[h].key == key && weldMatch(m_vertices[m_shardBase[shard] + table[h].vertex], c))
+            return (uint32_t)m_shardBase[shard] + table[h].vertex;
+    return UINT32_MAX;
+}
+
+void MeshExporter::linkShard(size_t shard)
+{
+    // each pair is found from both ends, the later vertex keeps it
+    VertexKey keys[7];
+    for (size_t v = m_shardBase[shard]; v < m_shardBase[shard + 1]; v++)
+    {
+        int n = weldNeighborKeys(m_vertices[v], keys);
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t u = findVertex(vertexHash(keys[i]) % SHARDS, keys[i], m_vertices[v]);
+            if (u < v)
+                m_shardLinks[shard].push_back(::std::make_pair((uint32_t)v, u));
+        }
+    }
+}
+
+void MeshExporter::mergeLinks()
+{
+    size_t links = 0;
+    for (size_t s = 0; s < SHARDS; s++)
+        links += m_shardLinks[s].size();
+    if (links == 0)
+        return;
+
+    // every vertex goes to the first of those linked to it
+    ::std::vector<uint32_t> root(m_vertices.size());
+    for (size_t v = 0; v < root.size(); v++)
+        root[v] = (uint32_t)v;
+    auto find = [&](uint32_t v) {
+        while (root[v] != v)
+            v = root[v] = root[root[v]];
+        return v;
+    };
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        for (const auto & link : m_shardLinks[s])
+        {
+            uint32_t a = find(link.first), b = find(link.second);
+            root[::std::max(a, b)] = ::std::min(a, b);
+        }
+    }
+
+    ::std::vector<uint32_t> index(m_vertices.size());
+    size_t count = 0;
+    for (size_t v = 0; v < m_vertices.size(); v++)
+    {
+        uint32_t r = find((uint32_t)v);
+        if (r == v)
+        {
+            m_vertices[count] = m_vertices[v];
+            index[v] = (uint32_t)count++;
+        }
+        else
+            index[v] = index[r];
+    }
+    m_vertices.resize(count);
+
+    for (uint32_t & i : m_indices)
+        i = index[i];
+}
+
+void MeshExporter::format(Format f, size_t chunk, ::std::string & out) const
+{
+    bool vertices = f == OBJVertices || f == PLYVertices;
+    size_t count = vertices ? m_vertices.size() : m_faceCells.size();
+    size_t start = chunkStart(chunk, count);
+    size_t end = chunkStart(chunk + 1, count);
+
+    char buffer[128];
+    for (size_t i = start; i < end; i++)
+    {
+        switch (f)
+        {
+            case OBJVertices:
+            {
+                char* p = buffer;
+                *p++ = 'v';
+                for (int a = 0; a < 3; a++)
+                {
+                    *p++ = ' ';
+                    p = ::std::to_chars(p, buffer + sizeof(buffer), m_vertices[i][a]).ptr;
+                }
+                *p++ = '\n';
+                out.append(buffer, p - buffer);
+                break;
+            }
+            case OBJFaces:
+            {
+                out += 'f';
+                for (size_t j = 0; j < getFaceSize(i); j++)
+                {
+                    char* p = buffer;
+                    *p++ = ' ';
+                    p = ::std::to_chars(p, buffer + sizeof(buffer), getFace(i)[j] + 1ull).ptr;
+                    out.append(buffer, p - buffer);
+                }
+                out += '\n';
+                break;
+            }
+            case PLYVertices:
+                out.append(reinterpret_cast<const char*>(&m_vertices[i]), sizeof(glm::dvec3));
+                break;
+            case PLYFaces:
+            {
+                uint8_t n = (uint8_t)getFaceSize(i);
+                out += (char)n;
+                out.append(reinterpret_cast<const char*>(getFace(i)), n * sizeof(uint32_t));
+                break;
+            }
+        }
+    }
+}
+
+bool MeshExporter::write(const char* path, const ::std::string & header, Format vertices, Format faces) const
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
+
+    // format every chunk of vertices and faces in parallel, then write them in order
+    ::std::vector<::std::string> buffers(2 * m_chunks);
+    {
+        TaskGraph tg;
+        for (size_t c = 0; c < 2 * m_chunks; c++)
+        {
+            MeshFormatTask* task = new MeshFormatTask;
+            task->td = TaskDataMeshFormat{this, (int)(c < m_chunks ? vertices : faces), c % m_chunks, &buffers[c]};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    }
+
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size();
+    for (size_t c = 0; ok && c < buffers.size(); c++)
+        ok = fwrite(buffers[c].data(), 1, buffers[c].size(), file) == buffers[c].size();
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok)
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
+
+    ::std::cout << "Data written to: " << path << "\n";
+    return true;
+}
+
+bool MeshExporter::writeOBJ(const char* path) const
+{
+    ::std::string header = "# " + ::std::to_string(m_vertices.size()) + " vertices, "
+        + ::std::to_string(m_faceCells.size()) + " faces\n";
+    return write(path, header, OBJVertices, OBJFaces);
+}
+
+bool MeshExporter::writePLY(const char* path) const
+{
+    size_t maxCorners = 0;
+    for (size_t f = 0; f < m_faceCells.size(); f++)
+        maxCorners = ::std::max(maxCorners, getFaceSize(f));
+    if (maxCorners > UINT8_MAX)
+    {
+        ::std::cout << "Cells with more than 255 corners can not be written to PLY.\n";
+        return false;
+    }
+
+    ::std::string header =
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex " + ::std::to_string(m_vertices.size()) + "\n"
+        "property double x\n"
+        "property double y\n"
+        "property double z\n"
+        "element face " + ::std::to_string(m_faceCells.size()) + "\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n";
+    return write(path, header, PLYVertices, PLYFaces);
+}
+
+}
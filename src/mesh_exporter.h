@@ -0,0 +1,158 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace VorGen {
+
+// corners no further apart than WELD_TOL in any coordinate are one Voronoi
+// vertex, which sweeps compute a few ulps apart
+constexpr double WELD_SCALE = (double)(1ull << 33);
+constexpr double WELD_TOL = 1.0 / (double)(1ull << 40);
+
+// a corner rounded to multiples of 2^-33, the bucket it is found in
+struct VertexKey
+{
+    int64_t k[3];
+    bool operator==(const VertexKey & o) const { return k[0] == o.k[0] && k[1] == o.k[1] && k[2] == o.k[2]; }
+    bool operator<(const VertexKey & o) const
+    {
+        return k[0] != o.k[0] ? k[0] < o.k[0] : k[1] != o.k[1] ? k[1] < o.k[1] : k[2] < o.k[2];
+    }
+};
+
+inline VertexKey vertexKey(const glm::dvec3 & c)
+{
+    return VertexKey{{ llround(c.x * WELD_SCALE), llround(c.y * WELD_SCALE), llround(c.z * WELD_SCALE) }};
+}
+
+inline bool weldMatch(const glm::dvec3 & a, const glm::dvec3 & b)
+{
+    return fabs(a.x - b.x) <= WELD_TOL && fabs(a.y - b.y) <= WELD_TOL && fabs(a.z - b.z) <= WELD_TOL;
+}
+
+// The buckets other than its own that corners matching c may be in, those
+// whose faces c is within WELD_TOL of. Returns how many, at most 7.
+inline int weldNeighborKeys(const glm::dvec3 & c, VertexKey* keys)
+{
+    VertexKey key = vertexKey(c);
+    int64_t step[3][2];
+    int steps[3];
+    for (int a = 0; a < 3; a++)
+    {
+        double offset = c[a] * WELD_SCALE - (double)key.k[a];
+        steps[a] = 1;
+        step[a][0] = 0;
+        if (offset + WELD_TOL * WELD_SCALE >= 0.5)
+            step[a][steps[a]++] = 1;
+        else if (offset - WELD_TOL * WELD_SCALE <= -0.5)
+            step[a][steps[a]++] = -1;
+    }
+
+    int n = 0;
+    for (int x = 0; x < steps[0]; x++)
+        for (int y = 0; y < steps[1]; y++)
+            for (int z = 0; z < steps[2]; z++)
+                if (x || y || z)
+                    keys[n++] = VertexKey{{ key.k[0] + step[0][x], key.k[1] + step[1][y], key.k[2] + step[2][z] }};
+    return n;
+}
+
+inline uint64_t vertexHash(const VertexKey & key)
+{
+    uint64_t h = (uint64_t)key.k[0] * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)key.k[1] * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+    h ^= (uint64_t)key.k[2] * 0x165667B19E3779F9ull + (h >> 32);
+    return h ^ (h >> 31);
+}
+
+/*
+    Exports cells as an indexed polygon mesh, one face per cell with its
+    corners in the order the cell stores them. Corners shared by
+    neighbouring cells are welded into a single vertex. Sweeps can compute
+    the same Voronoi vertex a few ulps apart, so corners within WELD_TOL of
+    each other are matched. Each shard welds the corners of its buckets,
+    then vertices near a bucket's faces look for matches in the buckets
+    across them, and the vertices of any they find are merged.
+*/
+
+class MeshExporter
+{
+    public:
+
+        MeshExporter(int threads = 6);
+
+        // welds the corners of the cells writeDataToFile would write
+        void build(const VoronoiCell* cells, size_t count);
+
+        size_t getVertexCount() const { return m_vertices.size(); }
+        size_t getFaceCount() const { return m_faceCells.size(); }
+        const glm::dvec3 & getVertex(size_t v) const { return m_vertices[v]; }
+
+        // face f is cell getFaceCell(f), its vertex indices are
+        // getFace(f)[0 .. getFaceSize(f) - 1]
+        size_t getFaceCell(size_t f) const { return m_faceCells[f]; }
+        size_t getFaceSize(size_t f) const { return m_faceStart[f + 1] - m_faceStart[f]; }
+        const uint32_t* getFace(size_t f) const { return m_indices.data() + m_faceStart[f]; }
+
+        // text OBJ with shortest round trip coordinates
+        bool writeOBJ(const char* path) const;
+        // binary little endian PLY with double vertices
+        bool writePLY(const char* path) const;
+
+    private:
+
+        static const size_t SHARDS = 64;
+
+        int m_threads;
+        const VoronoiCell* m_cells;
+
+        ::std::vector<size_t> m_faceCells;
+        ::std::vector<size_t> m_faceStart;
+        ::std::vector<uint32_t> m_indices;
+        ::std::vector<glm::dvec3> m_vertices;
+
+        // face corners of each chunk of faces sorted into shards by key,
+        // indexed by chunk * SHARDS + shard
+        struct CornerRef
+        {
+            size_t index;
+            const glm::dvec3* position;
+        };
+        size_t m_chunks;
+        ::std::vector<::std::vector<CornerRef>> m_shardCorners;
+        ::std::vector<::std::vector<glm::dvec3>> m_shardVertices;
+        ::std::vector<size_t> m_shardBase;
+
+        // open addressed table of each shard from key to its vertices, and
+        // the pairs of vertices matched across buckets by linkShard
+        struct Slot { VertexKey key; uint32_t vertex; };
+        ::std::vector<::std::vector<Slot>> m_shardTables;
+        ::std::vector<::std::vector<::std::pair<uint32_t, uint32_t>>> m_shardLinks;
+
+        size_t chunkStart(size_t chunk, size_t count) const { return count * chunk / m_chunks; }
+
+        void shardCorners(size_t chunk);
+        void weldShard(size_t shard);
+        void placeShard(size_t shard);
+        void linkShard(size_t shard);
+        void mergeLinks();
+        // global index of the vertex in shard matching c in bucket key, or
+        // UINT32_MAX
+        uint32_t findVertex(size_t shard, const VertexKey & key, const glm::dvec3 & c) const;
+
+        enum Format { OBJVertices, OBJFaces, PLYVertices, PLYFaces };
+        void format(Format f, size_t chunk, ::std::string & out) const;
+        bool write(const char* path, const ::std::string & header, Format vertices, Format faces) const;
+
+        friend class MeshShardTask;
+        friend class MeshWeldTask;
+        friend class MeshPlaceTask;
+        friend class MeshLinkTask;
+        friend class MeshFormatTask;
+};
+
+}
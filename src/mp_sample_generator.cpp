@@ -43,11 +43,11 @@ glm::dvec3* SampleGenerator::getJitteredSamples(int n)
 }
 
 // Generates n random samples in the range [0,1) x [0,1)
-glm::dvec3* SampleGenerator::getRandomSamples(int n)
+glm::dvec3* SampleGenerator::getRandomSamples(size_t n)
 {
     glm::dvec3* samples = new glm::dvec3[n];
 
-    for (int i = 0; i < n; i++)
+    for (size_t i = 0; i < n; i++)
     {
         double x = unif(re);
         double y = unif(re);
@@ -82,12 +82,12 @@ glm::dvec3* SampleGenerator::getJitteredPointsSphere(int n)
     return samples;
 }
 
-glm::dvec3* SampleGenerator::getRandomPointsSphere(int n)
+glm::dvec3* SampleGenerator::getRandomPointsSphere(size_t n)
 {
     const double PI = M_PI;
     glm::dvec3* samples = getRandomSamples(n);
 
-    for (int i = 0; i < n; i++)
+    for (size_t i = 0; i < n; i++)
     {
         glm::dvec3 sample = samples[i];
 
@@ -105,4 +105,168 @@ glm::dvec3* SampleGenerator::getRandomPointsSphere(int n)
     return samples;
 }
 
+// Philox4x32-10 from Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"
+static inline void philox4x32(uint32_t c[4], uint32_t k0, uint32_t k1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+        uint32_t c1 = c[1];
+        c[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c[1] = (uint32_t)p1;
+        c[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+        c[3] = (uint32_t)p0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+void SampleGenerator::getCounterPointsSphere(size_t first, size_t count, glm::dvec3* out) const
+{
+    const double scale = 1.0 / (double)(1ull << 53);
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)((uint64_t)seed >> 32);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t n = first + i;
+        uint32_t c[4] = { (uint32_t)n, (uint32_t)(n >> 32), 0, 0 };
+        philox4x32(c, k0, k1);
+
+        // two 53 bit uniforms in [0,1)
+        double u = (((uint64_t)c[0] << 32 | c[1]) >> 11) * scale;
+        double v = (((uint64_t)c[2] << 32 | c[3]) >> 11) * scale;
+
+        // same mapping as getRandomPointsSphere, already unit length
+        double phi = 2.0 * M_PI * u;
+        double z = 2.0 * v - 1.0;
+        double T = sqrt(1.0 - z * z);
+        out[i] = glm::dvec3(T * cos(phi), T * sin(phi), z);
+    }
+}
+
+glm::dvec3* SampleGenerator::getClusteredPointsSphere(int n, int clusters, double kappa)
+{
+    glm::dvec3* centers = getRandomPointsSphere(clusters);
+    glm::dvec3* samples = new glm::dvec3[n];
+
+    for (int i = 0; i < n; i++)
+    {
+        glm::dvec3 mu = centers[(int)(unif(re) * clusters) % clusters];
+
+        // cosine of the angle to mu for a von Mises-Fisher sample on S2
+        double u = unif(re);
+        double w = 1.0 + log(u + (1.0 - u) * exp(-2.0 * kappa)) / kappa;
+
+        // uniform direction in the tangent plane of mu
+        glm::dvec3 t = glm::abs(mu.x) < 0.9 ? glm::dvec3(1,0,0) : glm::dvec3(0,1,0);
+        glm::dvec3 e1 = glm::normalize(glm::cross(mu, t));
+        glm::dvec3 e2 = glm::cross(mu, e1);
+        double phi = 2.0 * M_PI * unif(re);
+        double r = sqrt(glm::max(0.0, 1.0 - w * w));
+
+        samples[i] = glm::normalize(w * mu + r * (cos(phi) * e1 + sin(phi) * e2));
+    }
+
+    delete[] centers;
+    return samples;
+}
+
+glm::dvec3* SampleGenerator::getBandPointsSphere(int n, const glm::dvec3 & axis, double polar, double width)
+{
+    ::std::normal_distribution<double> normal(polar, width);
+
+    glm::dvec3 a = glm::normalize(axis);
+    glm::dvec3 t = glm::abs(a.x) < 0.9 ? glm::dvec3(1,0,0) : glm::dvec3(0,1,0);
+    glm::dvec3 e1 = glm::normalize(glm::cross(a, t));
+    glm::dvec3 e2 = glm::cross(a, e1);
+
+    glm::dvec3* samples = new glm::dvec3[n];
+    for (int i = 0; i < n; i++)
+    {
+        // reflect at the poles rather than clamping, which would stack
+        // duplicate points on them
+        double theta = glm::abs(normal(re));
+        if (theta > M_PI) theta = 2.0 * M_PI - theta;
+        double phi = 2.0 * M_PI * unif(re);
+        samples[i] = glm::normalize(cos(theta) * a + sin(theta) * (cos(phi) * e1 + sin(phi) * e2));
+    }
+
+    return samples;
+}
+
+glm::dvec3* SampleGenerator::getGridPointsSphere(int n, double jitter)
+{
+    // the first n % rows rows get one extra point
+    int rows = glm::max(1, (int)sqrt(n / 2.0));
+    int cols = n / rows;
+    int extra = n % rows;
+
+    glm::dvec3* samples = new glm::dvec3[n];
+    glm::dvec3* next = samples;
+    for (int i = 0; i < rows; i++)
+    {
+        double theta = M_PI * (i + 0.5) / rows;
+        int rowCols = cols + (i < extra ? 1 : 0);
+        for (int j = 0; j < rowCols; j++)
+        {
+            double phi = 2.0 * M_PI * j / rowCols;
+            glm::dvec3 p(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            *(next++) = this->jitter(p, jitter);
+        }
+    }
+
+    return samples;
+}
+
+glm::dvec3* SampleGenerator::getFibonacciPointsSphere(int n, double jitter)
+{
+    const double golden = M_PI * (3.0 - sqrt(5.0));
+
+    glm::dvec3* samples = new glm::dvec3[n];
+    for (int i = 0; i < n; i++)
+    {
+        double z = 1.0 - (2.0 * i + 1.0) / n;
+        double r = sqrt(1.0 - z * z);
+        double phi = golden * i;
+        samples[i] = this->jitter(glm::dvec3(r * cos(phi), r * sin(phi), z), jitter);
+    }
+
+    return samples;
+}
+
+glm::dvec3 SampleGenerator::jitter(const glm::dvec3 & p, double amount)
+{
+    if (amount == 0.0)
+        return p;
+
+    glm::dvec3 d(unif(re) - 0.5, unif(re) - 0.5, unif(re) - 0.5);
+    return glm::normalize(p + 2.0 * amount * d);
+}
+
+glm::dvec3* SampleGenerator::getPointsSphere(Distribution d, int n)
+{
+    switch (d)
+    {
+        case Clustered:
+            return getClusteredPointsSphere(n, 24, 400.0);
+        case Band:
+            return getBandPointsSphere(n, glm::dvec3(0,0,1), 0.15, 0.05);
+        case Grid:
+            // 1e-4 of the mean spacing between sites
+            return getGridPointsSphere(n, 1e-4 * sqrt(4.0 * M_PI / n));
+        case Fibonacci:
+            return getFibonacciPointsSphere(n, 0.0);
+        default:
+            return getRandomPointsSphere(n);
+    }
+}
+
+const char* SampleGenerator::getDistributionName(Distribution d)
+{
+    const char* names[] = { "uniform", "clustered", "band", "grid", "fibonacci" };
+    return names[d];
+}
+
 }
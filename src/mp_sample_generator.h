@@ -6,6 +6,9 @@
 
 namespace VorGen {
 
+// point distributions available through getPointsSphere
+enum Distribution { Uniform, Clustered, Band, Grid, Fibonacci };
+
 class SampleGenerator
 {
     public:
@@ -14,13 +17,41 @@ class SampleGenerator
         SampleGenerator(size_t seed);
 
         glm::dvec3* getJitteredSamples(int n);
-        glm::dvec3* getRandomSamples(int n);
+        glm::dvec3* getRandomSamples(size_t n);
 
         glm::dvec3* getJitteredPointsSphere(int n);
-        glm::dvec3* getRandomPointsSphere(int n);
+        glm::dvec3* getRandomPointsSphere(size_t n);
+
+        // uniform points from a Philox4x32-10 counter based generator. Point
+        // i depends only on the seed and i, so out receives points
+        // first .. first + count - 1 of the same sequence however the range
+        // is split up.
+        void getCounterPointsSphere(size_t first, size_t count, glm::dvec3* out) const;
+
+        // mixture of von Mises-Fisher distributions around random centers,
+        // larger kappa gives tighter clusters
+        glm::dvec3* getClusteredPointsSphere(int n, int clusters, double kappa);
+
+        // polar angle about axis normally distributed around polar
+        glm::dvec3* getBandPointsSphere(int n, const glm::dvec3 & axis, double polar, double width);
+
+        // latitude/longitude grid with about n points. Rows of the grid are
+        // cocircular, jitter (radians) perturbs them.
+        glm::dvec3* getGridPointsSphere(int n, double jitter);
+
+        // golden spiral lattice
+        glm::dvec3* getFibonacciPointsSphere(int n, double jitter);
+
+        // n points from distribution d with the parameters used by the
+        // benchmarks and tests
+        glm::dvec3* getPointsSphere(Distribution d, int n);
+
+        static const char* getDistributionName(Distribution d);
 
     private:
 
+        glm::dvec3 jitter(const glm::dvec3 & p, double amount);
+
         size_t seed;
         ::std::uniform_real_distribution<double> unif;
         ::std::default_random_engine re;
@@ -0,0 +1,300 @@
+#include "point_loader.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+PointLoader::PointLoader(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_map = NULL;
+    m_mapSize = 0;
+    m_points = NULL;
+    m_count = 0;
+    m_format = XYZ;
+}
+
+PointLoader::~PointLoader()
+{
+    close();
+}
+
+void PointLoader::close()
+{
+    if (m_map)
+        munmap(m_map, m_mapSize);
+
+    m_map = NULL;
+    m_mapSize = 0;
+    m_points = NULL;
+    m_count = 0;
+    m_parsed.clear();
+    m_parsed.shrink_to_fit();
+}
+
+bool PointLoader::map(const char* path)
+{
+    close();
+    m_error.clear();
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        m_error = ::std::string("Unable to open ") + path;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    if (st.st_size == 0)
+    {
+        m_error = ::std::string("No points in ") + path;
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        m_error = ::std::string("Unable to map ") + path;
+        return false;
+    }
+
+    m_map = data;
+    m_mapSize = st.st_size;
+    return true;
+}
+
+template <typename F>
+void PointLoader::run(size_t chunks, F makeTask)
+{
+    TaskGraph tg;
+    for (size_t c = 0; c < chunks; c++)
+        tg.addTask(unique_ptr<Task>(makeTask(c)));
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+}
+
+bool PointLoader::loadBinary(const char* path)
+{
+    if (!map(path))
+        return false;
+
+    if (m_mapSize % sizeof(glm::dvec3) != 0)
+    {
+        m_error = ::std::string(path) + " is not a whole number of x,y,z doubles";
+        close();
+        return false;
+    }
+
+    madvise(m_map, m_mapSize, MADV_WILLNEED);
+    m_points = (const glm::dvec3*)m_map;
+    m_count = m_mapSize / sizeof(glm::dvec3);
+
+    // the sweeps take unit points, any others are normalized into a copy
+    size_t chunks = ::std::min((size_t)(m_threads + 1) * 4, ::std::min(m_count, (size_t)64));
+    m_chunkErrors.assign(chunks, 0);
+    m_chunkScaled.assign(chunks, 0);
+    run(chunks, [&](size_t c) { CheckPointsTask* t = new CheckPointsTask; t->td = TaskDataPointLoader{this, c}; return t; });
+
+    size_t errors = 0, scaled = 0;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        errors += m_chunkErrors[c];
+        scaled += m_chunkScaled[c];
+    }
+
+    if (errors)
+    {
+        m_error = ::std::to_string(errors) + " points of " + path + " are zero or not finite";
+        close();
+        return false;
+    }
+
+    if (scaled)
+    {
+        m_parsed.resize(m_count);
+        run(chunks, [&](size_t c) { NormalizePointsTask* t = new NormalizePointsTask; t->td = TaskDataPointLoader{this, c}; return t; });
+
+        munmap(m_map, m_mapSize);
+        m_map = NULL;
+        m_mapSize = 0;
+        m_points = m_parsed.data();
+    }
+    return true;
+}
+
+void PointLoader::checkPoints(size_t chunk)
+{
+    size_t chunks = m_chunkScaled.size();
+    size_t errors = 0, scaled = 0;
+    for (size_t i = m_count * chunk / chunks; i < m_count * (chunk + 1) / chunks; i++)
+    {
+        glm::dvec3 p = m_points[i];
+        if (!toUnitLength(p))
+            errors++;
+        else if (p != m_points[i])
+            scaled++;
+    }
+    m_chunkErrors[chunk] = errors;
+    m_chunkScaled[chunk] = scaled;
+}
+
+void PointLoader::normalizePoints(size_t chunk)
+{
+    size_t chunks = m_chunkScaled.size();
+    for (size_t i = m_count * chunk / chunks; i < m_count * (chunk + 1) / chunks; i++)
+    {
+        m_parsed[i] = m_points[i];
+        toUnitLength(m_parsed[i]);
+    }
+}
+
+bool PointLoader::loadText(const char* path, TextFormat format)
+{
+    if (!map(path))
+        return false;
+
+    madvise(m_map, m_mapSize, MADV_SEQUENTIAL);
+    m_format = format;
+
+    // split the text at the first line end after each even division
+    const char* text = (const char*)m_map;
+    const char* end = text + m_mapSize;
+    size_t chunks = ::std::min((size_t)(m_threads + 1) * 4, (size_t)64);
+    m_chunkStart.assign(chunks + 1, end);
+    m_chunkStart[0] = text;
+    for (size_t c = 1; c < chunks; c++)
+    {
+        const char* p = ::std::max(text + m_mapSize * c / chunks, m_chunkStart[c - 1]);
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        m_chunkStart[c] = eol ? eol + 1 : end;
+    }
+    m_chunkLines.assign(chunks, 0);
+    m_chunkErrors.assign(chunks, 0);
+
+    // count the points of each chunk to find where its points go
+    run(chunks, [&](size_t c) { CountLinesTask* t = new CountLinesTask; t->td = TaskDataPointLoader{this, c}; return t; });
+
+    size_t count = 0;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        size_t lines = m_chunkLines[c];
+        m_chunkLines[c] = count;
+        count += lines;
+    }
+    m_parsed.resize(count);
+
+    run(chunks, [&](size_t c) { ParseLinesTask* t = new ParseLinesTask; t->td = TaskDataPointLoader{this, c}; return t; });
+
+    size_t errors = 0;
+    for (size_t c = 0; c < chunks; c++)
+        errors += m_chunkErrors[c];
+
+    munmap(m_map, m_mapSize);
+    m_map = NULL;
+    m_mapSize = 0;
+
+    if (errors || count == 0)
+    {
+        m_error = errors ? ::std::to_string(errors) + " lines of " + path + " could not be parsed"
+                         : ::std::string("No points in ") + path;
+        close();
+        return false;
+    }
+
+    m_points = m_parsed.data();
+    m_count = count;
+    return true;
+}
+
+static inline bool isDataLine(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.');
+}
+
+template <typename F>
+static inline void forEachLine(const char* p, const char* end, F f)
+{
+    while (p < end)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        f(p, (eol > p && eol[-1] == '\r') ? eol - 1 : eol);
+        p = eol + 1;
+    }
+}
+
+static inline const char* parseNumber(const char* p, const char* end, double & value)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';'))
+        p++;
+    if (p < end && *p == '+')
+        p++;
+
+    ::std::from_chars_result r = ::std::from_chars(p, end, value);
+    return r.ec == ::std::errc() ? r.ptr : NULL;
+}
+
+void PointLoader::countLines(size_t chunk)
+{
+    size_t lines = 0;
+    forEachLine(m_chunkStart[chunk], m_chunkStart[chunk + 1], [&](const char* p, const char* end)
+    {
+        if (isDataLine(p, end))
+            lines++;
+    });
+    m_chunkLines[chunk] = lines;
+}
+
+void PointLoader::parseLines(size_t chunk)
+{
+    glm::dvec3* out = m_parsed.data() + m_chunkLines[chunk];
+    size_t errors = 0;
+
+    forEachLine(m_chunkStart[chunk], m_chunkStart[chunk + 1], [&](const char* p, const char* end)
+    {
+        if (!isDataLine(p, end))
+            return;
+
+        double v[3] = { 0.0, 0.0, 0.0 };
+        int columns = m_format == XYZ ? 3 : 2;
+        for (int i = 0; i < columns && p; i++)
+            p = parseNumber(p, end, v[i]);
+
+        glm::dvec3 point;
+        if (m_format == XYZ)
+            point = glm::dvec3(v[0], v[1], v[2]);
+        else
+        {
+            double lat = glm::radians(v[0]);
+            double lon = glm::radians(v[1]);
+            point = glm::dvec3(cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat));
+        }
+
+        double length = glm::length(point);
+        if (!p || !(length > 0.0) || !::std::isfinite(length))
+        {
+            errors++;
+            point = glm::dvec3(0.0, 0.0, 1.0);
+            length = 1.0;
+        }
+
+        *(out++) = point / length;
+    });
+
+    m_chunkErrors[chunk] = errors;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace VorGen {
+
+/*
+    Loads sites for VoronoiGenerator::generate from disk.
+
+    Binary files are packed x,y,z doubles, mapped and used in place when
+    every point is of unit length. Points off it are normalized into a copy,
+    and a point that is zero or not finite fails the load. Text files hold one point per line, either x,y,z or latitude and
+    longitude in degrees, with the numbers separated by commas, semicolons
+    or white space. Lines that do not start with a number, such as headers
+    and # comments, are skipped, and extra columns are ignored. Text is
+    split into byte ranges at line ends and parsed by the worker threads,
+    and the points are normalized.
+*/
+
+// squared lengths this close to one are taken as unit length
+const double UNIT_LENGTH_TOLERANCE = 8.0 * DBL_EPSILON;
+
+// scales p to unit length unless it is already, false if it is zero or
+// not finite
+inline bool toUnitLength(glm::dvec3 & p)
+{
+    double length2 = glm::dot(p, p);
+    if (!(length2 > 0.0) || !::std::isfinite(length2))
+        return false;
+    if (fabs(length2 - 1.0) > UNIT_LENGTH_TOLERANCE)
+        p /= sqrt(length2);
+    return true;
+}
+
+class PointLoader
+{
+    public:
+
+        enum TextFormat { XYZ, LatLon };
+
+        PointLoader(int threads = 6);
+        ~PointLoader();
+
+        PointLoader(const PointLoader &) = delete;
+        PointLoader & operator=(const PointLoader &) = delete;
+
+        bool loadBinary(const char* path);
+        bool loadText(const char* path, TextFormat format);
+        void close();
+
+        // valid until close or the next load
+        const glm::dvec3* getPoints() const { return m_points; }
+        size_t getCount() const { return m_count; }
+
+        const ::std::string & getError() const { return m_error; }
+
+    private:
+
+        int m_threads;
+
+        void* m_map;
+        size_t m_mapSize;
+
+        const glm::dvec3* m_points;
+        size_t m_count;
+        ::std::vector<glm::dvec3> m_parsed;
+        ::std::string m_error;
+
+        // text being parsed, split into chunks that start at line starts
+        TextFormat m_format;
+        ::std::vector<const char*> m_chunkStart;
+        ::std::vector<size_t> m_chunkLines;
+        ::std::vector<size_t> m_chunkErrors;
+
+        // binary points being checked, split into even chunks
+        ::std::vector<size_t> m_chunkScaled;
+
+        bool map(const char* path);
+        // runs makeTask(c) for each of chunks chunks on the worker threads
+        template <typename F>
+        void run(size_t chunks, F makeTask);
+
+        void countLines(size_t chunk);
+        void parseLines(size_t chunk);
+
+        void checkPoints(size_t chunk);
+        void normalizePoints(size_t chunk);
+
+        friend class CountLinesTask;
+        friend class ParseLinesTask;
+        friend class CheckPointsTask;
+        friend class NormalizePointsTask;
+};
+
+}
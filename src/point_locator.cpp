@@ -0,0 +1,434 @@
+#include "point_locator.h"
+#include "voronoi_tasks.h"
+#include "platform.h"
+#include <algorithm>
+#include <cmath>
+
+// SSE2
+#include <emmintrin.h>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+PointLocator::PointLocator(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_cells = NULL;
+    m_chunks = 1;
+}
+
+void PointLocator::build(const VoronoiCell* cells, size_t count)
+{
+    m_positions.resize(count);
+    for (size_t i = 0; i < count; i++)
+        m_positions[i] = cells[i].position;
+
+    m_grid.build(cells, count, m_threads);
+
+    m_cells = cells;
+    m_chunks = ::std::max(::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64)), (size_t)1);
+    m_shardCorners.assign(m_chunks * SHARDS, ::std::vector<CornerRef>());
+    m_shardPairs.assign(SHARDS, ::std::vector<::std::pair<size_t, size_t>>());
+
+    auto run = [&](size_t tasks, auto makeTask)
+    {
+        TaskGraph tg;
+        for (size_t t = 0; t < tasks; t++)
+            tg.addTask(unique_ptr<Task>(makeTask(t)));
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    };
+
+    // pair up the cells meeting at each corner, shard by shard
+    run(m_chunks, [&](size_t c) { LocatorShardTask* t = new LocatorShardTask; t->td = TaskDataLocator{this, c}; return t; });
+    run(SHARDS, [&](size_t s) { LocatorPairTask* t = new LocatorPairTask; t->td = TaskDataLocator{this, s}; return t; });
+    ::std::vector<::std::vector<CornerRef>>().swap(m_shardCorners);
+
+    // every pair into the list of its first cell, neighbours sharing an
+    // edge are listed twice until the lists are sorted
+    m_start.assign(count + 1, 0);
+    for (const auto & pairs : m_shardPairs)
+        for (const auto & pair : pairs)
+            m_start[pair.first + 1]++;
+    for (size_t i = 0; i < count; i++)
+        m_start[i + 1] += m_start[i];
+
+    m_neighbors.resize(m_start[count]);
+    ::std::vector<size_t> next(m_start.begin(), m_start.end() - 1);
+    for (const auto & pairs : m_shardPairs)
+        for (const auto & pair : pairs)
+            m_neighbors[next[pair.first]++] = pair.second;
+    ::std::vector<::std::vector<::std::pair<size_t, size_t>>>().swap(m_shardPairs);
+
+    m_count.assign(count, 0);
+    run(m_chunks, [&](size_t c) { LocatorNeighborsTask* t = new LocatorNeighborsTask; t->td = TaskDataLocator{this, c}; return t; });
+    m_cells = NULL;
+
+    // pack the lists, padding each to an even length
+    ::std::vector<size_t> start(count + 1, 0);
+    for (size_t i = 0; i < count; i++)
+        start[i + 1] = start[i] + m_count[i] + (m_count[i] & 1);
+
+    ::std::vector<size_t> neighbors(start[count]);
+    m_x.resize(start[count]);
+    m_y.resize(start[count]);
+    m_z.resize(start[count]);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t n = start[i]; n < start[i + 1]; n++)
+        {
+            size_t j = m_neighbors[m_start[i] + ::std::min(n - start[i], m_count[i] - 1)];
+            neighbors[n] = j;
+            m_x[n] = m_positions[j].x;
+            m_y[n] = m_positions[j].y;
+            m_z[n] = m_positions[j].z;
+        }
+    }
+    m_start.swap(start);
+    m_neighbors.swap(neighbors);
+
+    // bins are in face and row order, so the seed of the last bin is
+    // usually near the center of the next one
+    m_seeds.resize(m_grid.getBinCount());
+    size_t seed = 0;
+    for (size_t b = 0; b < m_seeds.size() && count; b++)
+    {
+        if (m_grid.getBinStart(b) < m_grid.getBinStart(b + 1))
+            seed = m_grid.getIndex(m_grid.getBinStart(b));
+        seed = m_seeds[b] = locate(m_grid.getBinCenter(b), seed);
+    }
+}
+
+void PointLocator::shardCorners(size_t chunk)
+{
+    size_t count = m_positions.size();
+    ::std::vector<CornerRef>* shards = &m_shardCorners[chunk * SHARDS];
+    for (size_t i = chunkStart(chunk, count); i < chunkStart(chunk + 1, count); i++)
+    {
+        for (const glm::dvec3 & corner : m_cells[i].corners)
+        {
+            VertexKey key = vertexKey(corner);
+            shards[vertexHash(key) % SHARDS].push_back(CornerRef{key, i, &corner, true});
+
+            VertexKey keys[7];
+            int n = weldNeighborKeys(corner, keys);
+            for (int k = 0; k < n; k++)
+                shards[vertexHash(keys[k]) % SHARDS].push_back(CornerRef{keys[k], i, &corner, false});
+        }
+    }
+}
+
+void PointLocator::pairShard(size_t shard)
+{
+    ::std::vector<CornerRef> corners;
+    for (size_t c = 0; c < m_chunks; c++)
+        corners.insert(corners.end(), m_shardCorners[c * SHARDS + shard].begin(), m_shardCorners[c * SHARDS + shard].end());
+
+    ::std::sort(corners.begin(), corners.end(), [](const CornerRef & a, const CornerRef & b) { return a.key < b.key; });
+
+    // three cells meet at a corner, more where sites are cocircular. Pairs
+    // are made from the corners of the bucket, those filed from the buckets
+    // next to it are paired in their own.
+    ::std::vector<::std::pair<size_t, size_t>> & pairs = m_shardPairs[shard];
+    for (size_t first = 0, last; first < corners.size(); first = last)
+    {
+        for (last = first + 1; last < corners.size() && corners[last].key == corners[first].key; last++);
+        for (size_t a = first; a < last; a++)
+        {
+            if (!corners[a].own)
+                continue;
+            for (size_t b = first; b < last; b++)
+            {
+                if (corners[a].cell == corners[b].cell || !weldMatch(*corners[a].position, *corners[b].position))
+                    continue;
+                pairs.push_back(::std::make_pair(corners[a].cell, corners[b].cell));
+                if (!corners[b].own)
+                    pairs.push_back(::std::make_pair(corners[b].cell, corners[a].cell));
+            }
+        }
+    }
+}
+
+void PointLocator::sortNeighbors(size_t chunk)
+{
+    size_t count = m_positions.size();
+    for (size_t i = chunkStart(chunk, count); i < chunkStart(chunk + 1, count); i++)
+    {
+        size_t* first = m_neighbors.data() + m_start[i];
+        size_t* last = m_neighbors.data() + m_start[i + 1];
+        ::std::sort(first, last);
+        m_count[i] = ::std::unique(first, last) - first;
+    }
+}
+
+size_t PointLocator::locate(const glm::dvec3 & p) const
+{
+    if (m_positions.empty())
+        return SIZE_MAX;
+    return locate(p, m_seeds[m_grid.getBin(p)]);
+}
+
+size_t PointLocator::locate(const glm::dvec3 & p, size_t cell) const
+{
+    __m128d PX = _mm_set1_pd(p.x);
+    __m128d PY = _mm_set1_pd(p.y);
+    __m128d PZ = _mm_set1_pd(p.z);
+
+    // every step is to a strictly nearer site, so the walk ends
+    const glm::dvec3 & s = m_positions[cell];
+    double best = (s.x * p.x + s.y * p.y) + s.z * p.z;
+    while (true)
+    {
+        size_t next = cell;
+        for (size_t k = m_start[cell]; k < m_start[cell + 1]; k += 2)
+        {
+            __m128d D = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&m_x[k]), PX),
+                                              _mm_mul_pd(_mm_loadu_pd(&m_y[k]), PY)),
+                                   _mm_mul_pd(_mm_loadu_pd(&m_z[k]), PZ));
+
+            ALIGN(16) double d[2];
+            _mm_store_pd(d, D);
+            if (d[0] > best)
+            {
+                best = d[0];
+                next = m_neighbors[k];
+            }
+            if (d[1] > best)
+            {
+                best = d[1];
+                next = m_neighbors[k + 1];
+            }
+        }
+
+        if (next == cell)
+            return cell;
+        cell = next;
+    }
+}
+
+void PointLocator::binOrder(const glm::dvec3* points, size_t start, size_t end, ::std::vector<uint64_t> & order) const
+{
+    order.resize(end - start);
+    for (size_t i = start; i < end; i++)
+        order[i - start] = (uint64_t)m_grid.getBin(points[i]) << 32 | (i - start);
+    ::std::sort(order.begin(), order.end());
+}
+
+size_t PointLocator::queryChunks(size_t count) const
+{
+    // chunks are ordered by a 32 bit index
+    size_t chunks = ::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64));
+    return ::std::max(chunks, (count >> 32) + 1);
+}
+
+void PointLocator::locate(const glm::dvec3* points, size_t* cells, size_t start, size_t end) const
+{
+    if (m_positions.empty())
+    {
+        ::std::fill(cells + start, cells + end, SIZE_MAX);
+        return;
+    }
+
+    // queries in bin order walk the same few cells one after another, in
+    // any other order nearly every step misses the cache
+    ::std::vector<uint64_t> order;
+    binOrder(points, start, end, order);
+
+    for (uint64_t key : order)
+    {
+        size_t i = start + (key & 0xFFFFFFFFull);
+        cells[i] = locate(points[i], m_seeds[key >> 32]);
+    }
+}
+
+void PointLocator::locate(const glm::dvec3* points, size_t count, size_t* cells) const
+{
+    if (count == 0) return;
+
+    size_t chunks = queryChunks(count);
+    TaskGraph tg;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        LocatePointsTask* task = new LocatePointsTask;
+        task->td = TaskDataLocate{this, points, cells, count * c / chunks, count * (c + 1) / chunks};
+        tg.addTask(unique_ptr<Task>(task));
+    }
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+}
+
+template <typename F>
+void PointLocator::expand(const glm::dvec3 & p, double minDot, Query & q, F f) const
+{
+    // the visited set keeps the size the last query grew it to
+    q.frontier.clear();
+    q.visited.assign(::std::max(q.visited.size(), (size_t)64), SIZE_MAX);
+    q.visitedCount = 0;
+
+    size_t first = locate(p);
+    double d = glm::dot(m_positions[first], p);
+    if (d < minDot) return;
+    markVisited(q, first);
+    q.frontier.push_back(::std::make_pair(d, first));
+
+    while (!q.frontier.empty())
+    {
+        ::std::pop_heap(q.frontier.begin(), q.frontier.end());
+        size_t c = q.frontier.back().second;
+        if (!f(c)) return;
+        q.frontier.pop_back();
+
+        // sites below minDot would never be taken, so they are left out
+        // and the frontier stays about as large as the answer
+        for (size_t n = m_start[c]; n < m_start[c] + m_count[c]; n++)
+        {
+            d = (m_x[n] * p.x + m_y[n] * p.y) + m_z[n] * p.z;
+            if (d >= minDot && markVisited(q, m_neighbors[n]))
+            {
+                q.frontier.push_back(::std::make_pair(d, m_neighbors[n]));
+                ::std::push_heap(q.frontier.begin(), q.frontier.end());
+            }
+        }
+    }
+}
+
+bool PointLocator::markVisited(Query & q, size_t c)
+{
+    if (2 * (q.visitedCount + 1) > q.visited.size())
+    {
+        ::std::vector<size_t> old(q.visited.size() * 2, SIZE_MAX);
+        old.swap(q.visited);
+        q.visitedCount = 0;
+        for (size_t v : old)
+            if (v != SIZE_MAX) markVisited(q, v);
+    }
+
+    size_t mask = q.visited.size() - 1;
+    for (size_t h = (c * 0x9E3779B97F4A7C15ull) >> 20 & mask; ; h = (h + 1) & mask)
+    {
+        if (q.visited[h] == c) return false;
+        if (q.visited[h] == SIZE_MAX)
+        {
+            q.visited[h] = c;
+            q.visitedCount++;
+            return true;
+        }
+    }
+}
+
+size_t PointLocator::nearest(const glm::dvec3 & p, size_t k, size_t* cells, Query & q) const
+{
+    size_t found = 0;
+    if (m_positions.empty() || k == 0)
+        return 0;
+
+    expand(p, -INFINITY, q, [&](size_t c) { cells[found++] = c; return found < k; });
+    return found;
+}
+
+void PointLocator::withinAngle(const glm::dvec3 & p, double angle, ::std::vector<size_t> & cells, Query & q) const
+{
+    cells.clear();
+    if (m_positions.empty() || angle < 0.0)
+        return;
+
+    double cosLimit = angle >= M_PI ? -INFINITY : cos(angle);
+    expand(glm::normalize(p), cosLimit, q, [&](size_t c) { cells.push_back(c); return true; });
+}
+
+void PointLocator::nearest(const glm::dvec3* points, size_t k, size_t* cells, size_t start, size_t end) const
+{
+    if (m_positions.empty())
+    {
+        ::std::fill(cells + start * k, cells + end * k, SIZE_MAX);
+        return;
+    }
+
+    ::std::vector<uint64_t> order;
+    binOrder(points, start, end, order);
+
+    Query q;
+    for (uint64_t key : order)
+    {
+        size_t i = start + (key & 0xFFFFFFFFull);
+        size_t found = nearest(points[i], k, cells + i * k, q);
+        ::std::fill(cells + i * k + found, cells + (i + 1) * k, SIZE_MAX);
+    }
+}
+
+void PointLocator::nearest(const glm::dvec3* points, size_t count, size_t k, size_t* cells) const
+{
+    if (count == 0 || k == 0) return;
+
+    size_t chunks = queryChunks(count);
+    TaskGraph tg;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        NearestSitesTask* task = new NearestSitesTask;
+        task->td = TaskDataNearest{this, points, k, cells, count * c / chunks, count * (c + 1) / chunks};
+        tg.addTask(unique_ptr<Task>(task));
+    }
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+}
+
+void PointLocator::withinAngle(const glm::dvec3* points, double angle, size_t* counts, size_t* offsets,
+                               ::std::vector<size_t> & found, size_t start, size_t end) const
+{
+    found.clear();
+    if (m_positions.empty())
+    {
+        ::std::fill(counts + start, counts + end, 0);
+        ::std::fill(offsets + start, offsets + end, 0);
+        return;
+    }
+
+    ::std::vector<uint64_t> order;
+    binOrder(points, start, end, order);
+
+    // the answers of the chunk go one after another in bin order
+    Query q;
+    ::std::vector<size_t> cells;
+    for (uint64_t key : order)
+    {
+        size_t i = start + (key & 0xFFFFFFFFull);
+        withinAngle(points[i], angle, cells, q);
+        offsets[i] = found.size();
+        counts[i] = cells.size();
+        found.insert(found.end(), cells.begin(), cells.end());
+    }
+}
+
+void PointLocator::withinAngle(const glm::dvec3* points, size_t count, double angle,
+                               ::std::vector<size_t> & start, ::std::vector<size_t> & cells) const
+{
+    start.assign(count + 1, 0);
+    cells.clear();
+    if (count == 0) return;
+
+    size_t chunks = queryChunks(count);
+    ::std::vector<size_t> counts(count);
+    ::std::vector<size_t> offsets(count);
+    ::std::vector<::std::vector<size_t>> found(chunks);
+    TaskGraph tg;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        WithinAngleTask* task = new WithinAngleTask;
+        task->td = TaskDataWithinAngle{this, points, angle, counts.data(), offsets.data(), &found[c],
+                                       count * c / chunks, count * (c + 1) / chunks};
+        tg.addTask(unique_ptr<Task>(task));
+    }
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+
+    for (size_t i = 0; i < count; i++)
+        start[i + 1] = start[i] + counts[i];
+
+    cells.resize(start[count]);
+    for (size_t c = 0; c < chunks; c++)
+        for (size_t i = count * c / chunks; i < count * (c + 1) / chunks; i++)
+            ::std::copy(found[c].begin() + offsets[i], found[c].begin() + offsets[i] + counts[i], cells.begin() + start[i]);
+}
+
+}
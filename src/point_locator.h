@@ -0,0 +1,136 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include "sphere_grid.h"
+#include "mesh_exporter.h"
+#include <vector>
+
+namespace VorGen {
+
+/*
+    Finds the cell that holds a point on the sphere, the cell of the site
+    nearest to it, in a generated diagram. The sites are binned into a
+    SphereGrid, and every cell lists the cells it shares a corner with,
+    found by matching corners within WELD_TOL as MeshExporter does.
+
+    A query starts at the site nearest the center of its bin and moves to
+    whichever neighbour is nearer the point until none is, which on a
+    Voronoi diagram ends at the nearest site. The positions of each cell's
+    neighbours are stored with its list, component by component and padded
+    to an even count, so every step is a run of SSE dot products.
+
+    Nearest neighbour and cap queries grow from the located cell along the
+    same lists, taking the nearest site of the frontier each time. The
+    sites nearest any point are connected in the Delaunay graph, so they
+    come off the frontier nearest first and the search stops as soon as it
+    has enough of them, or the next one is outside the cap.
+*/
+
+class PointLocator
+{
+    public:
+
+        // scratch space for neighbourhood queries, reuse it to avoid allocations
+        struct Query
+        {
+            ::std::vector<::std::pair<double, size_t>> frontier; // heap by dot product
+            ::std::vector<size_t> visited; // open addressed set of cells
+            size_t visitedCount;
+        };
+
+        PointLocator(int threads = 6);
+
+        // copies the positions, the cells are not needed afterwards
+        void build(const VoronoiCell* cells, size_t count);
+
+        size_t getCellCount() const { return m_positions.size(); }
+
+        // cell whose site is nearest p, p need not be normalized
+        size_t locate(const glm::dvec3 & p) const;
+        // walks from cell start, e.g. the answer to a nearby query
+        size_t locate(const glm::dvec3 & p, size_t start) const;
+        // cells[i] holds points[i], queries are split across the worker
+        // threads and each share is walked in bin order
+        void locate(const glm::dvec3* points, size_t count, size_t* cells) const;
+
+        // the k sites nearest p, nearest first, returns how many were found
+        size_t nearest(const glm::dvec3 & p, size_t k, size_t* cells, Query & q) const;
+        // the sites within angle radians of p, nearest first
+        void withinAngle(const glm::dvec3 & p, double angle, ::std::vector<size_t> & cells, Query & q) const;
+
+        // cells[i * k .. i * k + k - 1] are the sites nearest points[i],
+        // SIZE_MAX past the last site when there are fewer than k
+        void nearest(const glm::dvec3* points, size_t count, size_t k, size_t* cells) const;
+        // the sites within angle of points[i] are cells[start[i] .. start[i + 1] - 1]
+        void withinAngle(const glm::dvec3* points, size_t count, double angle,
+                         ::std::vector<size_t> & start, ::std::vector<size_t> & cells) const;
+
+        // neighbours of cell c are getNeighbors(c)[0 .. getNeighborCount(c) - 1]
+        size_t getNeighborCount(size_t c) const { return m_count[c]; }
+        const size_t* getNeighbors(size_t c) const { return m_neighbors.data() + m_start[c]; }
+
+    private:
+
+        int m_threads;
+        SphereGrid m_grid;
+        ::std::vector<glm::dvec3> m_positions;
+
+        // the list of cell c is [m_start[c], m_start[c] + m_count[c]) and is
+        // padded with its last entry up to m_start[c + 1]
+        ::std::vector<size_t> m_start;
+        ::std::vector<size_t> m_count;
+        ::std::vector<size_t> m_neighbors;
+        ::std::vector<double> m_x;
+        ::std::vector<double> m_y;
+        ::std::vector<double> m_z;
+
+        // the site nearest the center of each bin
+        ::std::vector<size_t> m_seeds;
+
+        // corners of every chunk of cells sorted into shards by key, indexed
+        // by chunk * SHARDS + shard, then the cells meeting at each corner
+        // paired up shard by shard. A corner near the faces of its bucket
+        // is filed under the buckets across them too, to be paired with
+        // the corners there.
+        static const size_t SHARDS = 64;
+        struct CornerRef
+        {
+            VertexKey key;
+            size_t cell;
+            const glm::dvec3* position;
+            bool own; // key is the corner's own bucket
+        };
+        const VoronoiCell* m_cells;
+        size_t m_chunks;
+        ::std::vector<::std::vector<CornerRef>> m_shardCorners;
+        ::std::vector<::std::vector<::std::pair<size_t, size_t>>> m_shardPairs;
+
+        size_t chunkStart(size_t chunk, size_t count) const { return count * chunk / m_chunks; }
+
+        void shardCorners(size_t chunk);
+        void pairShard(size_t shard);
+        void sortNeighbors(size_t chunk);
+        void locate(const glm::dvec3* points, size_t* cells, size_t start, size_t end) const;
+        void nearest(const glm::dvec3* points, size_t k, size_t* cells, size_t start, size_t end) const;
+        void withinAngle(const glm::dvec3* points, double angle, size_t* counts, size_t* offsets,
+                         ::std::vector<size_t> & found, size_t start, size_t end) const;
+
+        // queries start, start + 1 .. end - 1 keyed by bin, then sorted
+        void binOrder(const glm::dvec3* points, size_t start, size_t end, ::std::vector<uint64_t> & order) const;
+        size_t queryChunks(size_t count) const;
+
+        // calls f(cell) with the sites nearest p in order, from the nearest,
+        // until f returns false or the next has a dot product below minDot
+        template <typename F>
+        void expand(const glm::dvec3 & p, double minDot, Query & q, F f) const;
+        static bool markVisited(Query & q, size_t c);
+
+        friend class LocatorShardTask;
+        friend class LocatorPairTask;
+        friend class LocatorNeighborsTask;
+        friend class LocatePointsTask;
+        friend class NearestSitesTask;
+        friend class WithinAngleTask;
+};
+
+}
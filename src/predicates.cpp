@@ -0,0 +1,122 @@
+#include "predicates.h"
+#include <cmath>
+
+namespace VorGen {
+
+// half an ulp of 1.0, and the splitter of Dekker's product
+constexpr double EPSILON = 1.1102230246251565e-16;
+constexpr double SPLITTER = 134217729.0; // 2^27 + 1
+
+constexpr double O3D_ERRBOUND = (7.0 + 56.0 * EPSILON) * EPSILON;
+
+// a + b = x + y exactly
+inline void twoSum(double a, double b, double & x, double & y)
+{
+    x = a + b;
+    double bv = x - a;
+    double av = x - bv;
+    y = (a - av) + (b - bv);
+}
+
+inline void split(double a, double & hi, double & lo)
+{
+    double c = SPLITTER * a;
+    hi = c - (c - a);
+    lo = a - hi;
+}
+
+// a * b = x + y exactly
+inline void twoProduct(double a, double b, double & x, double & y)
+{
+    x = a * b;
+    double ahi, alo, bhi, blo;
+    split(a, ahi, alo);
+    split(b, bhi, blo);
+    y = alo * blo - (((x - ahi * bhi) - alo * bhi) - ahi * blo);
+}
+
+// adds b to the expansion e of length n, dropping zero components.
+// Components stay nonoverlapping and increase in magnitude.
+static int growExpansion(double* e, int n, double b)
+{
+    int m = 0;
+    double q = b;
+    for (int i = 0; i < n; i++)
+    {
+        double h;
+        twoSum(q, e[i], q, h);
+        if (h != 0.0)
+            e[m++] = h;
+    }
+    if (q != 0.0)
+        e[m++] = q;
+    return m;
+}
+
+// adds the product a * b * c, negated when sign is negative
+static int addTriple(double* e, int n, double a, double b, double c, double sign)
+{
+    double x, y, p[4];
+    twoProduct(a * sign, b, x, y);
+    twoProduct(x, c, p[0], p[1]);
+    twoProduct(y, c, p[2], p[3]);
+    for (int i = 0; i < 4; i++)
+        n = growExpansion(e, n, p[i]);
+    return n;
+}
+
+// a, b and c as the rows of a 3x3 determinant, added with sign
+static int addDet3(double* e, int n, const glm::dvec3 & a, const glm::dvec3 & b,
+                   const glm::dvec3 & c, double sign)
+{
+    n = addTriple(e, n, a.x, b.y, c.z,  sign);
+    n = addTriple(e, n, a.y, b.z, c.x,  sign);
+    n = addTriple(e, n, a.z, b.x, c.y,  sign);
+    n = addTriple(e, n, a.z, b.y, c.x, -sign);
+    n = addTriple(e, n, a.y, b.x, c.z, -sign);
+    n = addTriple(e, n, a.x, b.z, c.y, -sign);
+    return n;
+}
+
+// The determinant of the rows (a, 1), (b, 1), (c, 1), (d, 1), expanded
+// along the last column into 24 products of three coordinates, each
+// four doubles exactly. Its sign is that of the largest component.
+static double orient3dExact(const glm::dvec3 & a, const glm::dvec3 & b,
+                            const glm::dvec3 & c, const glm::dvec3 & d)
+{
+    double e[4 * 24];
+    int n = 0;
+    n = addDet3(e, n, b, c, d, -1.0);
+    n = addDet3(e, n, a, c, d,  1.0);
+    n = addDet3(e, n, a, b, d, -1.0);
+    n = addDet3(e, n, a, b, c,  1.0);
+    return n ? e[n - 1] : 0.0;
+}
+
+double orient3d(const glm::dvec3 & a, const glm::dvec3 & b,
+                const glm::dvec3 & c, const glm::dvec3 & d)
+{
+    double adx = a.x - d.x, bdx = b.x - d.x, cdx = c.x - d.x;
+    double ady = a.y - d.y, bdy = b.y - d.y, cdy = c.y - d.y;
+    double adz = a.z - d.z, bdz = b.z - d.z, cdz = c.z - d.z;
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    double cdxady = cdx * ady, adxcdy = adx * cdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+    double det = adz * (bdxcdy - cdxbdy)
+               + bdz * (cdxady - adxcdy)
+               + cdz * (adxbdy - bdxady);
+
+    double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * fabs(adz)
+                     + (fabs(cdxady) + fabs(adxcdy)) * fabs(bdz)
+                     + (fabs(adxbdy) + fabs(bdxady)) * fabs(cdz);
+
+    double bound = O3D_ERRBOUND * permanent;
+    if (det > bound || -det > bound)
+        return det;
+
+    return orient3dExact(a, b, c, d);
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+
+namespace VorGen {
+
+/*
+    Robust geometric predicates after Shewchuk. The determinant is
+    evaluated in double and kept when it clears a static bound on its
+    rounding error, otherwise it is summed exactly as a floating point
+    expansion. Only the sign of the result is exact.
+
+    Sites lie on the sphere, so four of them share a circle exactly when
+    they share a plane. Which side of the circle through a, b and c the
+    site d lies is the sign of orient3d(a, b, c, d).
+*/
+
+// positive if d lies below the plane through a, b and c, which run
+// counterclockwise seen from above it, negative if above, zero if the
+// four points are coplanar
+double orient3d(const glm::dvec3 & a, const glm::dvec3 & b,
+                const glm::dvec3 & c, const glm::dvec3 & d);
+
+inline bool cocircular(const glm::dvec3 & a, const glm::dvec3 & b,
+                       const glm::dvec3 & c, const glm::dvec3 & d)
+{
+    return orient3d(a, b, c, d) == 0.0;
+}
+
+}
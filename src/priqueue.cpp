@@ -336,10 +336,28 @@ size_t PRIQUEUE::audit()
 }
 
 // Forward declare template types so compiler generates code to link against
-template class PriQueue<CircleEvent<Increasing>, VoronoiEventCompare<Increasing>, 8, 64>;
-template class PriQueue<CircleEvent<Decreasing>, VoronoiEventCompare<Decreasing>, 8, 64>;
-
-template class PriQueueNode<CircleEvent<Increasing>, 8, 64>;
-template class PriQueueNode<CircleEvent<Decreasing>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, X, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, X, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, Y, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, Y, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, Z, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, Z, NarrowIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, X, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, X, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, Y, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, Y, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, double>, VoronoiEventCompare<Increasing, Z, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, double>, VoronoiEventCompare<Decreasing, Z, WideIndex, double>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, float>, VoronoiEventCompare<Increasing, X, NarrowIndex, float>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, float>, VoronoiEventCompare<Decreasing, X, NarrowIndex, float>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, float>, VoronoiEventCompare<Increasing, Y, NarrowIndex, float>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, float>, VoronoiEventCompare<Decreasing, Y, NarrowIndex, float>, 8, 64>;
+template class PriQueue<CircleEvent<Increasing, float>, VoronoiEventCompare<Increasing, Z, NarrowIndex, float>, 8, 64>;
+template class PriQueue<CircleEvent<Decreasing, float>, VoronoiEventCompare<Decreasing, Z, NarrowIndex, float>, 8, 64>;
+
+template class PriQueueNode<CircleEvent<Increasing, double>, 8, 64>;
+template class PriQueueNode<CircleEvent<Decreasing, double>, 8, 64>;
+template class PriQueueNode<CircleEvent<Increasing, float>, 8, 64>;
+template class PriQueueNode<CircleEvent<Decreasing, float>, 8, 64>;
 
 }
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+namespace VorGen {
+
+/*
+    Layout of the random access result file, see output/output_format.txt.
+    Every section starts on a RESULT_ALIGNMENT byte boundary so a mapped
+    file can be used in place.
+*/
+
+const char RESULT_MAGIC[8] = { 'V', 'O', 'R', 'S', 'P', 'H', 'R', 0 };
+const uint32_t RESULT_VERSION = 1;
+const uint64_t RESULT_ALIGNMENT = 64;
+
+enum ResultFlags
+{
+    ResultCentroids = 1 << 0, // positions are cell centroids rather than sites
+    ResultClockwise = 1 << 1, // corners of each cell are in clockwise order
+    ResultMeasures = 1 << 2   // area, perimeter and centroid of each cell precede the corners
+};
+
+struct ResultHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t scalarBytes;     // bytes per coordinate, 8 for double
+    uint32_t reserved;
+    uint64_t cellCount;
+    uint64_t cornerCount;
+    uint64_t offsetsOffset;   // cellCount + 1 uint64_t, first corner of each cell
+    uint64_t positionsOffset; // 3 scalars per cell
+    uint64_t cornersOffset;   // 3 scalars per corner
+    uint64_t fileSize;
+};
+
+static_assert(sizeof(ResultHeader) == 72, "result header layout");
+
+/*
+    Index of a sharded result, see ShardCoordinator. Shard k is the result
+    file at the index path followed by .k, and each input point has an
+    entry naming the shard and the cell within it that hold its cell.
+*/
+
+const char SHARD_INDEX_MAGIC[8] = { 'V', 'O', 'R', 'S', 'H', 'R', 'D', 0 };
+const uint32_t SHARD_INDEX_VERSION = 1;
+
+struct ShardIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t shardCount;
+    uint64_t cellCount;
+    uint64_t entriesOffset;   // cellCount uint64_t entries
+};
+
+static_assert(sizeof(ShardIndexHeader) == 32, "shard index header layout");
+
+// shard in the top 16 bits, cell within the shard below
+const unsigned SHARD_ENTRY_BITS = 48;
+
+inline uint64_t makeShardEntry(uint64_t shard, uint64_t cell) { return shard << SHARD_ENTRY_BITS | cell; }
+inline uint64_t getEntryShard(uint64_t entry) { return entry >> SHARD_ENTRY_BITS; }
+inline uint64_t getEntryCell(uint64_t entry) { return entry & ((1ull << SHARD_ENTRY_BITS) - 1); }
+
+inline uint64_t alignResultOffset(uint64_t offset)
+{
+    return (offset + RESULT_ALIGNMENT - 1) / RESULT_ALIGNMENT * RESULT_ALIGNMENT;
+}
+
+// the sections between the positions and the corners of a file with
+// ResultMeasures, cellCount doubles of areas in steradians, cellCount
+// doubles of perimeters in radians then cellCount centroids of 3 scalars.
+// They depend only on the cell count, so a writer can fill them before it
+// knows how many corners there are.
+struct ResultMeasuresLayout
+{
+    uint64_t areasOffset;
+    uint64_t perimetersOffset;
+    uint64_t centroidsOffset;
+    uint64_t end;
+};
+
+inline ResultMeasuresLayout getResultMeasuresLayout(const ResultHeader & h)
+{
+    ResultMeasuresLayout layout;
+    layout.areasOffset = alignResultOffset(h.positionsOffset + h.cellCount * 3 * sizeof(double));
+    layout.perimetersOffset = alignResultOffset(layout.areasOffset + h.cellCount * sizeof(double));
+    layout.centroidsOffset = alignResultOffset(layout.perimetersOffset + h.cellCount * sizeof(double));
+    layout.end = layout.centroidsOffset + h.cellCount * 3 * sizeof(double);
+    return layout;
+}
+
+// where the corners of a header with its flags, cell count and positions
+// offset set begin
+inline uint64_t getResultCornersOffset(const ResultHeader & h)
+{
+    if (h.flags & ResultMeasures)
+        return alignResultOffset(getResultMeasuresLayout(h).end);
+    return alignResultOffset(h.positionsOffset + h.cellCount * 3 * sizeof(double));
+}
+
+}
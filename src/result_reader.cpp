@@ -0,0 +1,185 @@
+#include "result_reader.h"
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace VorGen {
+
+ResultReader::ResultReader()
+{
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_offsets = NULL;
+    m_positions = NULL;
+    m_corners = NULL;
+    m_areas = NULL;
+    m_perimeters = NULL;
+    m_centroids = NULL;
+}
+
+ResultReader::~ResultReader()
+{
+    close();
+}
+
+bool ResultReader::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ResultHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = data;
+    m_size = st.st_size;
+    m_header = (const ResultHeader*)data;
+    if (!validate())
+    {
+        close();
+        return false;
+    }
+
+    const char* base = (const char*)data;
+    m_offsets = (const uint64_t*)(base + m_header->offsetsOffset);
+    m_positions = (const glm::dvec3*)(base + m_header->positionsOffset);
+    m_corners = (const glm::dvec3*)(base + m_header->cornersOffset);
+    if (m_header->flags & ResultMeasures)
+    {
+        ResultMeasuresLayout layout = getResultMeasuresLayout(*m_header);
+        m_areas = (const double*)(base + layout.areasOffset);
+        m_perimeters = (const double*)(base + layout.perimetersOffset);
+        m_centroids = (const glm::dvec3*)(base + layout.centroidsOffset);
+    }
+    return true;
+}
+
+void ResultReader::close()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_offsets = NULL;
+    m_positions = NULL;
+    m_corners = NULL;
+    m_areas = NULL;
+    m_perimeters = NULL;
+    m_centroids = NULL;
+}
+
+// checks the header against the file without touching the sections, so
+// opening stays cheap for large files
+bool ResultReader::validate() const
+{
+    const ResultHeader & h = *m_header;
+    if (memcmp(h.magic, RESULT_MAGIC, sizeof(RESULT_MAGIC)) != 0 || h.version != RESULT_VERSION)
+        return false;
+    if (h.scalarBytes != sizeof(double) || h.fileSize != m_size)
+        return false;
+
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t bytes)
+    {
+        return offset % RESULT_ALIGNMENT == 0 && offset <= m_size && count <= (m_size - offset) / bytes;
+    };
+
+    if (!fits(h.offsetsOffset, h.cellCount + 1, sizeof(uint64_t)) ||
+        !fits(h.positionsOffset, h.cellCount, sizeof(glm::dvec3)) ||
+        !fits(h.cornersOffset, h.cornerCount, sizeof(glm::dvec3)))
+        return false;
+    if ((h.flags & ResultMeasures) && getResultMeasuresLayout(h).end > h.cornersOffset)
+        return false;
+
+    const uint64_t* offsets = (const uint64_t*)((const char*)m_data + h.offsetsOffset);
+    return offsets[0] == 0 && offsets[h.cellCount] == h.cornerCount;
+}
+
+ShardedResultReader::ShardedResultReader()
+{
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_entries = NULL;
+}
+
+ShardedResultReader::~ShardedResultReader()
+{
+    close();
+}
+
+bool ShardedResultReader::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShardIndexHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = data;
+    m_size = st.st_size;
+    m_header = (const ShardIndexHeader*)data;
+
+    const ShardIndexHeader & h = *m_header;
+    if (memcmp(h.magic, SHARD_INDEX_MAGIC, sizeof(SHARD_INDEX_MAGIC)) != 0 || h.version != SHARD_INDEX_VERSION ||
+        h.entriesOffset > m_size || h.cellCount > (m_size - h.entriesOffset) / sizeof(uint64_t))
+    {
+        close();
+        return false;
+    }
+    m_entries = (const uint64_t*)((const char*)data + h.entriesOffset);
+
+    for (uint32_t k = 0; k < h.shardCount; k++)
+    {
+        m_shards.emplace_back(new ResultReader);
+        ::std::string shardPath = ::std::string(path) + "." + ::std::to_string(k);
+        if (!m_shards.back()->open(shardPath.c_str()))
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShardedResultReader::close()
+{
+    m_shards.clear();
+    if (m_data)
+        munmap(m_data, m_size);
+
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_entries = NULL;
+}
+
+}
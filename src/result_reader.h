@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+#include "result_format.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace VorGen {
+
+/*
+    Maps a result file written by VoronoiGenerator::writeResultFile and
+    gives access to any cell without reading the cells before it. Returned
+    pointers point into the mapping and stay valid until close.
+*/
+
+class ResultReader
+{
+    public:
+
+        ResultReader();
+        ~ResultReader();
+
+        ResultReader(const ResultReader &) = delete;
+        ResultReader & operator=(const ResultReader &) = delete;
+
+        // false if the file can not be mapped or is not a valid result file
+        bool open(const char* path);
+        void close();
+
+        const ResultHeader & getHeader() const { return *m_header; }
+        size_t getCellCount() const { return m_header->cellCount; }
+        size_t getCornerCount() const { return m_header->cornerCount; }
+
+        const glm::dvec3 & getPosition(size_t cell) const { return m_positions[cell]; }
+        size_t getCornerCount(size_t cell) const { return m_offsets[cell + 1] - m_offsets[cell]; }
+        const glm::dvec3* getCorners(size_t cell) const { return m_corners + m_offsets[cell]; }
+
+        // files written with ResultMeasures, see CellMeasures
+        bool hasMeasures() const { return m_areas != NULL; }
+        double getArea(size_t cell) const { return m_areas[cell]; }
+        double getPerimeter(size_t cell) const { return m_perimeters[cell]; }
+        const glm::dvec3 & getCentroid(size_t cell) const { return m_centroids[cell]; }
+
+    private:
+
+        void* m_data;
+        size_t m_size;
+
+        const ResultHeader* m_header;
+        const uint64_t* m_offsets;
+        const glm::dvec3* m_positions;
+        const glm::dvec3* m_corners;
+        const double* m_areas;
+        const double* m_perimeters;
+        const glm::dvec3* m_centroids;
+
+        bool validate() const;
+};
+
+/*
+    Maps the index of a sharded result written by ShardCoordinator and the
+    result file of every shard it names, and gives access to the cell of
+    any input point as ResultReader does.
+*/
+
+class ShardedResultReader
+{
+    public:
+
+        ShardedResultReader();
+        ~ShardedResultReader();
+
+        ShardedResultReader(const ShardedResultReader &) = delete;
+        ShardedResultReader & operator=(const ShardedResultReader &) = delete;
+
+        // false if the index or one of its shards can not be opened
+        bool open(const char* path);
+        void close();
+
+        size_t getCellCount() const { return m_header->cellCount; }
+        size_t getShardCount() const { return m_shards.size(); }
+        const ResultReader & getShard(size_t shard) const { return *m_shards[shard]; }
+
+        const glm::dvec3 & getPosition(size_t cell) const { return shard(cell).getPosition(getEntryCell(m_entries[cell])); }
+        size_t getCornerCount(size_t cell) const { return shard(cell).getCornerCount(getEntryCell(m_entries[cell])); }
+        const glm::dvec3* getCorners(size_t cell) const { return shard(cell).getCorners(getEntryCell(m_entries[cell])); }
+
+        // every shard is written with ResultMeasures or none is
+        bool hasMeasures() const { return m_shards.size() && m_shards[0]->hasMeasures(); }
+        double getArea(size_t cell) const { return shard(cell).getArea(getEntryCell(m_entries[cell])); }
+        double getPerimeter(size_t cell) const { return shard(cell).getPerimeter(getEntryCell(m_entries[cell])); }
+        const glm::dvec3 & getCentroid(size_t cell) const { return shard(cell).getCentroid(getEntryCell(m_entries[cell])); }
+
+    private:
+
+        void* m_data;
+        size_t m_size;
+
+        const ShardIndexHeader* m_header;
+        const uint64_t* m_entries;
+        ::std::vector<::std::unique_ptr<ResultReader>> m_shards;
+
+        const ResultReader & shard(size_t cell) const { return *m_shards[getEntryShard(m_entries[cell])]; }
+};
+
+}
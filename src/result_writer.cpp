@@ -0,0 +1,239 @@
+#include "result_writer.h"
+#include "cell_measures.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace VorGen {
+
+// a cell in the scratch file, followed by its corners
+struct SpillRecord
+{
+    uint64_t index;
+    uint64_t count;
+};
+
+ResultWriter::ResultWriter(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_fd = -1;
+    m_spill = -1;
+    m_header = {};
+    m_map = NULL;
+    m_mapSize = 0;
+    m_offsets = NULL;
+    m_positions = NULL;
+    m_areas = NULL;
+    m_perimeters = NULL;
+    m_centroids = NULL;
+    m_spillSize = 0;
+    m_ok = false;
+}
+
+ResultWriter::~ResultWriter()
+{
+    close();
+}
+
+void ResultWriter::close()
+{
+    if (m_map)
+        munmap(m_map, m_mapSize);
+    if (m_spill >= 0)
+        ::close(m_spill);
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        unlink(m_path.c_str());
+    }
+
+    m_fd = -1;
+    m_spill = -1;
+    m_map = NULL;
+    m_mapSize = 0;
+    m_offsets = NULL;
+    m_positions = NULL;
+    m_areas = NULL;
+    m_perimeters = NULL;
+    m_centroids = NULL;
+    m_spillSize = 0;
+    m_ok = false;
+}
+
+bool ResultWriter::open(const char* path, uint64_t cellCount, uint32_t flags)
+{
+    close();
+    m_error.clear();
+    m_path = path;
+
+    memcpy(m_header.magic, RESULT_MAGIC, sizeof(RESULT_MAGIC));
+    m_header.version = RESULT_VERSION;
+    m_header.flags = flags;
+    m_header.scalarBytes = sizeof(double);
+    m_header.cellCount = cellCount;
+    m_header.offsetsOffset = alignResultOffset(sizeof(ResultHeader));
+    m_header.positionsOffset = alignResultOffset(m_header.offsetsOffset + (cellCount + 1) * sizeof(uint64_t));
+    m_header.cornersOffset = getResultCornersOffset(m_header);
+
+    m_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ::std::string spillPath = m_path + ".corners";
+    m_spill = m_fd < 0 ? -1 : ::open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (m_spill >= 0)
+        unlink(spillPath.c_str());
+
+    // the file reads as cells without corners until finish
+    if (m_fd < 0 || m_spill < 0 || ftruncate(m_fd, m_header.cornersOffset) != 0)
+    {
+        m_error = ::std::string("Unable to create ") + path;
+        close();
+        return false;
+    }
+
+    void* data = mmap(NULL, m_header.cornersOffset, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        m_error = ::std::string("Unable to map ") + path;
+        close();
+        return false;
+    }
+
+    m_map = data;
+    m_mapSize = m_header.cornersOffset;
+    m_offsets = (uint64_t*)((char*)data + m_header.offsetsOffset);
+    m_positions = (glm::dvec3*)((char*)data + m_header.positionsOffset);
+    if (flags & ResultMeasures)
+    {
+        ResultMeasuresLayout layout = getResultMeasuresLayout(m_header);
+        m_areas = (double*)((char*)data + layout.areasOffset);
+        m_perimeters = (double*)((char*)data + layout.perimetersOffset);
+        m_centroids = (glm::dvec3*)((char*)data + layout.centroidsOffset);
+    }
+    m_ok = true;
+    return true;
+}
+
+bool ResultWriter::write(const VoronoiCell* cells, const uint64_t* indices, size_t count)
+{
+    if (!m_map)
+        return false;
+
+    CellMeasures measures(m_threads);
+    if (m_areas)
+        measures.compute(cells, count);
+
+    ::std::vector<char> records;
+    for (size_t i = 0; i < count; i++)
+    {
+        const VoronoiCell & cell = cells[i];
+        if (cell.corners.empty())
+            continue;
+
+        uint64_t index = indices[i];
+        m_positions[index] = cell.position;
+        m_offsets[index + 1] = cell.corners.size();
+        if (m_areas)
+        {
+            m_areas[index] = measures.getArea(i);
+            m_perimeters[index] = measures.getPerimeter(i);
+            m_centroids[index] = measures.getCentroid(i);
+        }
+
+        SpillRecord record = { index, cell.corners.size() };
+        size_t at = records.size();
+        size_t bytes = cell.corners.size() * sizeof(glm::dvec3);
+        records.resize(at + sizeof(record) + bytes);
+        memcpy(records.data() + at, &record, sizeof(record));
+        memcpy(records.data() + at + sizeof(record), cell.corners.data(), bytes);
+    }
+
+    uint64_t offset;
+    {
+        ::std::lock_guard<::std::mutex> lock(m_mutex);
+        offset = m_spillSize;
+        m_spillSize += records.size();
+    }
+
+    if (!pwriteAll(m_spill, records.data(), records.size(), offset))
+        m_ok = false;
+    return m_ok;
+}
+
+bool ResultWriter::finish()
+{
+    if (!m_map)
+        return false;
+
+    // corner counts become offsets
+    uint64_t cells = m_header.cellCount;
+    m_offsets[0] = 0;
+    for (uint64_t i = 0; i < cells; i++)
+        m_offsets[i + 1] += m_offsets[i];
+
+    m_header.cornerCount = m_offsets[cells];
+    m_header.fileSize = m_header.cornersOffset + m_header.cornerCount * sizeof(glm::dvec3);
+    memcpy(m_map, &m_header, sizeof(m_header));
+
+    // the corner section is mapped with the rest once its size is known
+    void* data = MAP_FAILED;
+    if (m_ok && ftruncate(m_fd, m_header.fileSize) == 0)
+        data = mmap(NULL, m_header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    munmap(m_map, m_mapSize);
+    m_map = NULL;
+
+    if (data == MAP_FAILED)
+    {
+        m_error = "Unable to write " + m_path;
+        close();
+        return false;
+    }
+
+    const uint64_t* offsets = (const uint64_t*)((char*)data + m_header.offsetsOffset);
+    glm::dvec3* corners = (glm::dvec3*)((char*)data + m_header.cornersOffset);
+
+    // stream the scratch file, a block at a time
+    ::std::vector<char> buffer(1 << 22);
+    uint64_t position = 0;
+    bool ok = true;
+    while (ok && position < m_spillSize)
+    {
+        size_t bytes = ::std::min((uint64_t)buffer.size(), m_spillSize - position);
+        ok = preadAll(m_spill, buffer.data(), bytes, position);
+
+        size_t used = 0;
+        while (ok && used + sizeof(SpillRecord) <= bytes)
+        {
+            SpillRecord record;
+            memcpy(&record, buffer.data() + used, sizeof(record));
+            size_t size = sizeof(record) + record.count * sizeof(glm::dvec3);
+            if (used + size > bytes)
+                break;
+
+            memcpy(corners + offsets[record.index], buffer.data() + used + sizeof(record), size - sizeof(record));
+            used += size;
+        }
+
+        // a record larger than the buffer
+        if (used == 0 && ok)
+            buffer.resize(buffer.size() * 2);
+        position += used;
+    }
+
+    munmap(data, m_header.fileSize);
+    ::close(m_spill);
+    m_spill = -1;
+    ok = ::close(m_fd) == 0 && ok;
+    m_fd = -1;
+
+    if (!ok)
+    {
+        m_error = "Unable to write " + m_path;
+        unlink(m_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include "result_format.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace VorGen {
+
+/*
+    Writes a result file, see result_format.h, from cells that arrive in any
+    order, for runs that never hold all of their cells at once. The header,
+    offsets and positions are mapped and filled in place as cells arrive,
+    with the corner count of each cell kept in its offset slot. Corners go
+    to a scratch file until finish, which turns the counts into offsets and
+    copies every cell's corners to its place. With ResultMeasures the
+    measures of each batch of cells are computed on the worker threads as
+    it is written, straight into their mapped sections, which come before
+    the corners.
+*/
+
+class ResultWriter
+{
+    public:
+
+        ResultWriter(int threads = 6);
+        ~ResultWriter();
+
+        ResultWriter(const ResultWriter &) = delete;
+        ResultWriter & operator=(const ResultWriter &) = delete;
+
+        // a file of cellCount cells, each empty until it is written.
+        // flags are ResultFlags.
+        bool open(const char* path, uint64_t cellCount, uint32_t flags);
+
+        // writes cells[i] as cell indices[i], skipping cells without
+        // corners. Safe from several threads for different cells.
+        bool write(const VoronoiCell* cells, const uint64_t* indices, size_t count);
+
+        // lays out the corners and completes the file
+        bool finish();
+
+        // drops an unfinished file
+        void close();
+
+        const ::std::string & getError() const { return m_error; }
+
+    private:
+
+        int m_threads;
+        int m_fd;
+        int m_spill;
+        ::std::string m_path;
+        ::std::string m_error;
+
+        ResultHeader m_header;
+        void* m_map;
+        size_t m_mapSize;
+        uint64_t* m_offsets;
+        glm::dvec3* m_positions;
+        double* m_areas;
+        double* m_perimeters;
+        glm::dvec3* m_centroids;
+
+        ::std::mutex m_mutex;
+        uint64_t m_spillSize;
+        ::std::atomic<bool> m_ok;
+};
+
+}
@@ -0,0 +1,360 @@
+#include "shard_coordinator.h"
+#include "tile_store.h"
+#include "result_format.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace VorGen {
+
+enum ShardMessageType
+{
+    ShardHello = 1,  // worker: ready for a shard, value its pid
+    ShardAssign = 2, // coordinator: shard, value tiles, payload store path, result path, ShardFlags and tile ids
+    ShardDone = 3    // worker: value 1 if the shard was written
+};
+
+// how a worker writes its shard
+enum ShardFlags
+{
+    ShardMeasures = 1 << 0, // VoronoiGenerator::setCellMeasures
+    ShardFloatSweeps = 1 << 1 // VoronoiGenerator::setFloatSweeps
+};
+
+struct ShardMessage
+{
+    uint32_t type;
+    uint32_t shard;
+    uint64_t value;
+    uint64_t bytes;  // payload following the message
+};
+
+static bool sendAll(int fd, const void* data, size_t bytes)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        ssize_t n = send(fd, (const char*)data + done, bytes - done, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, void* data, size_t bytes)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        ssize_t n = recv(fd, (char*)data + done, bytes - done, 0);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool sendMessage(int fd, uint32_t type, uint32_t shard, uint64_t value, const ::std::string & payload = ::std::string())
+{
+    ShardMessage message = { type, shard, value, payload.size() };
+    return sendAll(fd, &message, sizeof(message)) && sendAll(fd, payload.data(), payload.size());
+}
+
+static bool recvMessage(int fd, uint32_t type, ShardMessage & message, ::std::string & payload)
+{
+    if (!recvAll(fd, &message, sizeof(message)) || message.type != type || message.bytes > (1ull << 32))
+        return false;
+    payload.resize(message.bytes);
+    return recvAll(fd, &payload[0], payload.size());
+}
+
+static bool socketAddress(const char* path, sockaddr_un & address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+        return false;
+    strcpy(address.sun_path, path);
+    return true;
+}
+
+ShardCoordinator::ShardCoordinator(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_listen = -1;
+    m_connectTimeout = 60000;
+    m_measureCells = false;
+    m_floatSweeps = false;
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    close();
+}
+
+bool ShardCoordinator::listen(const char* socketPath)
+{
+    close();
+    m_error.clear();
+
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address))
+    {
+        m_error = ::std::string("Socket path too long: ") + socketPath;
+        return false;
+    }
+
+    unlink(socketPath);
+    m_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listen < 0 || bind(m_listen, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(m_listen, 64) != 0)
+    {
+        m_error = ::std::string("Unable to listen on ") + socketPath;
+        close();
+        return false;
+    }
+
+    m_socketPath = socketPath;
+    return true;
+}
+
+void ShardCoordinator::close()
+{
+    if (m_listen >= 0)
+    {
+        ::close(m_listen);
+        unlink(m_socketPath.c_str());
+    }
+    m_listen = -1;
+    m_watched.clear();
+}
+
+bool ShardCoordinator::run(const glm::dvec3* points, size_t count, size_t shards, const char* path, size_t tilePoints)
+{
+    if (m_listen < 0 || shards == 0 || count < 3)
+    {
+        m_error = "Nothing to run";
+        return false;
+    }
+    if (shards >= (1ull << (64 - SHARD_ENTRY_BITS)))
+    {
+        m_error = "Too many shards for the index";
+        return false;
+    }
+
+    // the store outlives this process's use of it, the workers open it by name
+    ::std::string storePath = ::std::string(path) + ".tiles";
+    TileStore store(m_threads);
+    if (!store.build(points, count, tilePoints, VoronoiGenerator::getTileHalo(count), storePath.c_str(), true))
+    {
+        m_error = store.getError();
+        return false;
+    }
+
+    // runs of tiles in store order, which keeps each shard's tiles together
+    vector<vector<size_t>> assigned(shards);
+    size_t taken = 0;
+    for (size_t t = 0, k = 0; t < store.getTileCount(); t++)
+    {
+        while (k + 1 < shards && taken >= count * (k + 1) / shards)
+            k++;
+        assigned[k].push_back(t);
+        taken += store.getCoreCount(t);
+    }
+
+    // workers take the shards in the order they connect
+    vector<int> workers;
+    vector<pid_t> connected;
+    bool ok = true;
+    for (size_t k = 0; k < shards && ok; k++)
+    {
+        int fd = acceptWorker(connected);
+        if (fd < 0)
+        {
+            ok = false;
+            break;
+        }
+        workers.push_back(fd);
+
+        ShardMessage hello;
+        ::std::string payload = storePath + '\0' + path + "." + ::std::to_string(k) + '\0';
+        ::std::string ignored;
+        uint64_t flags = (m_measureCells ? ShardMeasures : 0) | (m_floatSweeps ? ShardFloatSweeps : 0);
+        payload.append((const char*)&flags, sizeof(flags));
+        payload.append((const char*)assigned[k].data(), assigned[k].size() * sizeof(size_t));
+        ok = recvMessage(fd, ShardHello, hello, ignored) &&
+             sendMessage(fd, ShardAssign, (uint32_t)k, assigned[k].size(), payload);
+        connected.push_back((pid_t)hello.value);
+    }
+
+    for (size_t k = 0; k < workers.size(); k++)
+    {
+        ShardMessage done;
+        ::std::string ignored;
+        if (ok && !(recvMessage(workers[k], ShardDone, done, ignored) && done.value == 1))
+        {
+            m_error = "Shard " + ::std::to_string(k) + " failed";
+            ok = false;
+        }
+        ::close(workers[k]);
+    }
+    if (!ok && m_error.empty())
+        m_error = "Lost a worker";
+
+    ok = ok && writeIndex(store, assigned, path);
+    store.close();
+    unlink(storePath.c_str());
+    return ok;
+}
+
+int ShardCoordinator::acceptWorker(const vector<pid_t> & connected)
+{
+    // wakes every POLL_MS to look for watched workers that died
+    const int POLL_MS = 100;
+    int waited = 0;
+    while (m_connectTimeout == 0 || waited < m_connectTimeout)
+    {
+        pollfd listening = { m_listen, POLLIN, 0 };
+        int ready = poll(&listening, 1, POLL_MS);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready > 0)
+            return accept(m_listen, NULL, NULL);
+        waited += POLL_MS;
+
+        // left unreaped for the caller's waitpid
+        for (pid_t pid : m_watched)
+        {
+            siginfo_t info = {};
+            if (::std::find(connected.begin(), connected.end(), pid) == connected.end() &&
+                (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid == pid))
+            {
+                m_error = "Worker " + ::std::to_string(pid) + " exited before taking a shard";
+                return -1;
+            }
+        }
+    }
+    m_error = "No worker connected within " + ::std::to_string(m_connectTimeout) + " ms";
+    return -1;
+}
+
+bool ShardCoordinator::writeIndex(const TileStore & store, const vector<vector<size_t>> & shards, const char* path)
+{
+    ShardIndexHeader header = {};
+    memcpy(header.magic, SHARD_INDEX_MAGIC, sizeof(SHARD_INDEX_MAGIC));
+    header.version = SHARD_INDEX_VERSION;
+    header.shardCount = (uint32_t)shards.size();
+    header.cellCount = store.getPointCount();
+    header.entriesOffset = alignResultOffset(sizeof(header));
+    size_t size = header.entriesOffset + header.cellCount * sizeof(uint64_t);
+
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void* data = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, size) == 0)
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+        ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        m_error = ::std::string("Unable to write ") + path;
+        return false;
+    }
+
+    // the cells of a shard are the core points of its tiles in order
+    memcpy(data, &header, sizeof(header));
+    uint64_t* entries = (uint64_t*)((char*)data + header.entriesOffset);
+    vector<TilePoint> core;
+    bool ok = true;
+    for (size_t k = 0; k < shards.size() && ok; k++)
+    {
+        uint64_t cell = 0;
+        for (size_t t : shards[k])
+        {
+            core.clear();
+            ok = ok && store.readCore(t, core);
+            for (const TilePoint & p : core)
+                entries[p.index] = makeShardEntry(k, cell++);
+        }
+    }
+
+    munmap(data, size);
+    if (!ok)
+    {
+        m_error = ::std::string("Unable to write ") + path;
+        unlink(path);
+    }
+    return ok;
+}
+
+bool runShardWorker(const char* socketPath, int threads)
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address))
+        return false;
+
+    // the coordinator may still be starting
+    int fd = -1;
+    for (int attempt = 0; attempt < 50 && fd < 0; attempt++)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+        {
+            ::close(fd);
+            fd = -1;
+            ::std::this_thread::sleep_for(::std::chrono::milliseconds(100));
+        }
+    }
+    if (fd < 0)
+        return false;
+
+    ShardMessage assign;
+    ::std::string payload;
+    if (!sendMessage(fd, ShardHello, 0, (uint64_t)getpid()) || !recvMessage(fd, ShardAssign, assign, payload))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // store path, result path, the flags, then the tiles, each path
+    // ending inside the payload
+    size_t storeEnd = payload.find('\0');
+    size_t resultEnd = storeEnd == ::std::string::npos ? storeEnd : payload.find('\0', storeEnd + 1);
+    bool ok = resultEnd != ::std::string::npos && assign.value <= payload.size() / sizeof(size_t);
+    const char* storePath = payload.c_str();
+    const char* resultPath = ok ? storePath + storeEnd + 1 : NULL;
+    size_t flagsAt = resultEnd + 1;
+    size_t tilesAt = flagsAt + sizeof(uint64_t);
+    ok = ok && payload.size() >= tilesAt && payload.size() - tilesAt == assign.value * sizeof(size_t);
+
+    uint64_t flags = 0;
+    vector<size_t> tiles(ok ? assign.value : 0);
+    if (ok)
+    {
+        memcpy(&flags, payload.data() + flagsAt, sizeof(flags));
+        memcpy(tiles.data(), payload.data() + tilesAt, tiles.size() * sizeof(size_t));
+    }
+
+    TileStore store(threads);
+    ok = ok && store.open(storePath);
+    if (ok)
+    {
+        VoronoiGenerator vg;
+        vg.setWorkerThreads(threads);
+        vg.setCellMeasures(flags & ShardMeasures);
+        vg.setFloatSweeps(flags & ShardFloatSweeps);
+        ok = vg.generateShard(store, tiles, resultPath);
+    }
+
+    ok = sendMessage(fd, ShardDone, assign.shard, ok ? 1 : 0) && ok;
+    ::close(fd);
+    return ok;
+}
+
+}
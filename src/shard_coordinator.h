@@ -0,0 +1,80 @@
+#pragma once
+
+#include "voronoi_generator.h"
+#include <string>
+#include <sys/types.h>
+
+namespace VorGen {
+
+/*
+    Splits one diagram across worker processes on the same machine.
+
+    The coordinator partitions the points into the tiles of a TileStore
+    kept on disk next to the result, then listens on a unix domain socket.
+    Each worker that connects is given the next shard: a run of
+    neighbouring tiles holding about an equal share of the points. A worker
+    reads its tiles and their halos from the store and sweeps them with
+    VoronoiGenerator::generateShard into a result file of its own. Like
+    the sweeps of one run, it keeps only the cells of the points it owns.
+    Once every worker has reported back, the coordinator writes the index
+    that stitches the shards together, read with ShardedResultReader. The
+    assignment carries the result flags, so every shard is written alike.
+
+    Workers run runShardWorker, in a forked child or with vg -worker, and
+    may connect as soon as listen returns. A run fails when a watched
+    worker exits before taking its shard, or when no worker connects
+    within the connect timeout.
+*/
+
+class ShardCoordinator
+{
+    public:
+
+        ShardCoordinator(int threads = 6);
+        ~ShardCoordinator();
+
+        ShardCoordinator(const ShardCoordinator &) = delete;
+        ShardCoordinator & operator=(const ShardCoordinator &) = delete;
+
+        bool listen(const char* socketPath);
+        void close();
+
+        // a forked worker that run should give up on if it exits early,
+        // until close
+        void watchWorker(pid_t pid) { m_watched.push_back(pid); }
+        // milliseconds run waits for the next worker, 0 waits forever
+        void setConnectTimeout(int milliseconds) { m_connectTimeout = ::std::max(milliseconds, 0); }
+        // shards written with the measures of each cell, see
+        // VoronoiGenerator::setCellMeasures
+        void setCellMeasures(bool measure) { m_measureCells = measure; }
+        // shards swept in float, see VoronoiGenerator::setFloatSweeps
+        void setFloatSweeps(bool floatSweeps) { m_floatSweeps = floatSweeps; }
+
+        // index at path and shard k at path.k, blocks until shards workers
+        // have connected and finished
+        bool run(const glm::dvec3* points, size_t count, size_t shards, const char* path, size_t tilePoints = TILE_POINTS);
+
+        const ::std::string & getError() const { return m_error; }
+
+    private:
+
+        int m_threads;
+        int m_listen;
+        int m_connectTimeout;
+        bool m_measureCells;
+        bool m_floatSweeps;
+        vector<pid_t> m_watched;
+        ::std::string m_socketPath;
+        ::std::string m_error;
+
+        // next worker to connect, -1 on timeout or once a watched worker
+        // not in connected has exited
+        int acceptWorker(const vector<pid_t> & connected);
+        bool writeIndex(const TileStore & store, const vector<vector<size_t>> & shards, const char* path);
+};
+
+// connects to the coordinator at socketPath, waiting a few seconds for it
+// to listen, and generates the shard it is given
+bool runShardWorker(const char* socketPath, int threads = 6);
+
+}
@@ -0,0 +1,171 @@
+#include "sphere_grid.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+SphereGrid::SphereGrid()
+{
+    m_res = 1;
+    m_binRadius = M_PI;
+}
+
+void SphereGrid::build(const VoronoiCell* cells, size_t count, int threads, size_t perBin)
+{
+    build(cells, NULL, count, threads, perBin);
+}
+
+void SphereGrid::build(const glm::dvec3* points, size_t count, int threads, size_t perBin)
+{
+    build(NULL, points, count, threads, perBin);
+}
+
+void SphereGrid::build(const VoronoiCell* cells, const glm::dvec3* points, size_t count, int threads, size_t perBin)
+{
+    layout(::std::max((size_t)1, (size_t)ceil(sqrt(count / (6.0 * ::std::max(perBin, (size_t)1))))));
+
+    ::std::vector<size_t> bins(count);
+    if (count)
+    {
+        TaskGraph tg;
+        size_t chunks = ::std::min(::std::max((size_t)threads + 1, (size_t)1) * 4, ::std::min(count, (size_t)64));
+        for (size_t c = 0; c < chunks; c++)
+        {
+            BinPointsTask* task = new BinPointsTask;
+            task->td = TaskDataBinPoints{cells, points, count * c / chunks, count * (c + 1) / chunks - 1, this, bins.data()};
+            tg.addTask(unique_ptr<Task>(task));
+        }
+        tg.finalizeGraph();
+        tg.processTasks(threads);
+    }
+
+    // counting sort into bin order
+    m_start.assign(getBinCount() + 1, 0);
+    for (size_t i = 0; i < count; i++)
+        m_start[bins[i] + 1]++;
+    for (size_t b = 0; b < getBinCount(); b++)
+        m_start[b + 1] += m_start[b];
+
+    m_items.resize(count);
+    m_points.resize(count);
+    ::std::vector<size_t> next(m_start.begin(), m_start.end() - 1);
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t k = next[bins[i]]++;
+        m_items[k] = i;
+        m_points[k] = cells ? cells[i].position : points[i];
+    }
+}
+
+void SphereGrid::layout(size_t res)
+{
+    m_res = ::std::max(res, (size_t)1);
+
+    m_tan.resize(m_res);
+    for (size_t i = 0; i < m_res; i++)
+        m_tan[i] = tan(((i + 0.5) / m_res * 2.0 - 1.0) * M_PI / 4.0);
+
+    // bin edges are great circles, so the farthest point of a bin from its
+    // center is one of its corners. every face has the same layout.
+    m_binRadius = 0.0;
+    for (size_t j = 0; j < m_res; j++)
+    {
+        for (size_t i = 0; i < m_res; i++)
+        {
+            glm::dvec3 center = getBinCenter(j * m_res + i);
+            for (int k = 0; k < 4; k++)
+            {
+                double u = tan(((double)(i + (k & 1)) / m_res * 2.0 - 1.0) * M_PI / 4.0);
+                double v = tan(((double)(j + (k >> 1)) / m_res * 2.0 - 1.0) * M_PI / 4.0);
+                glm::dvec3 corner = glm::normalize(glm::dvec3(1.0, u, v));
+                m_binRadius = ::std::max(m_binRadius, acos(glm::clamp(glm::dot(center, corner), -1.0, 1.0)));
+            }
+        }
+    }
+    m_binRadius += 1e-9;
+
+    m_start.assign(getBinCount() + 1, 0);
+    m_items.clear();
+    m_points.clear();
+}
+
+static inline size_t binCoordinate(double u, size_t res)
+{
+    double t = (atan(u) * (4.0 / M_PI) + 1.0) * 0.5 * res;
+    if (!(t > 0.0)) return 0;
+    return ::std::min((size_t)t, res - 1);
+}
+
+size_t SphereGrid::getBin(const glm::dvec3 & p) const
+{
+    glm::dvec3 a = glm::abs(p);
+    int axis = a.x >= a.y ? (a.x >= a.z ? 0 : 2) : (a.y >= a.z ? 1 : 2);
+    size_t face = axis * 2 + (p[axis] < 0.0);
+
+    size_t i = binCoordinate(p[(axis + 1) % 3] / a[axis], m_res);
+    size_t j = binCoordinate(p[(axis + 2) % 3] / a[axis], m_res);
+    return (face * m_res + j) * m_res + i;
+}
+
+glm::dvec3 SphereGrid::getBinCenter(size_t b) const
+{
+    size_t face = b / (m_res * m_res);
+    int axis = (int)face / 2;
+
+    glm::dvec3 p;
+    p[axis] = (face & 1) ? -1.0 : 1.0;
+    p[(axis + 1) % 3] = m_tan[b % m_res];
+    p[(axis + 2) % 3] = m_tan[(b / m_res) % m_res];
+    return glm::normalize(p);
+}
+
+size_t SphereGrid::getNeighbor(size_t b, int di, int dj) const
+{
+    size_t face = b / (m_res * m_res);
+    long i = (long)(b % m_res) + di;
+    long j = (long)((b / m_res) % m_res) + dj;
+
+    if (i >= 0 && i < (long)m_res && j >= 0 && j < (long)m_res)
+        return (face * m_res + j) * m_res + i;
+
+    // step half a bin past the face edge and find which bin that lands in
+    auto coordinate = [&](long k) {
+        if (k >= 0 && k < (long)m_res) return m_tan[k];
+        return tan(((k + 0.5) / m_res * 2.0 - 1.0) * M_PI / 4.0);
+    };
+
+    int axis = (int)face / 2;
+    glm::dvec3 p;
+    p[axis] = (face & 1) ? -1.0 : 1.0;
+    p[(axis + 1) % 3] = coordinate(i);
+    p[(axis + 2) % 3] = coordinate(j);
+    return getBin(glm::normalize(p));
+}
+
+bool SphereGrid::markVisited(Query & q, size_t b)
+{
+    if (2 * (q.visitedCount + 1) > q.visited.size())
+    {
+        ::std::vector<size_t> old(q.visited.size() * 2, SIZE_MAX);
+        old.swap(q.visited);
+        q.visitedCount = 0;
+        for (size_t v : old)
+            if (v != SIZE_MAX) markVisited(q, v);
+    }
+
+    size_t mask = q.visited.size() - 1;
+    for (size_t h = (b * 0x9E3779B97F4A7C15ull) >> 20 & mask; ; h = (h + 1) & mask)
+    {
+        if (q.visited[h] == b) return false;
+        if (q.visited[h] == SIZE_MAX)
+        {
+            q.visited[h] = b;
+            q.visitedCount++;
+            return true;
+        }
+    }
+}
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+#include "voronoi_cell.h"
+#include <vector>
+
+namespace VorGen {
+
+/*
+    Buckets points on the sphere into the bins of an equal-angle cube map
+    so the points near a query can be found without scanning all of them.
+    Bins are stored face by face, row by row, with the points of each bin
+    contiguous.
+*/
+
+class SphereGrid
+{
+    public:
+
+        // scratch space for cap queries, reuse it to avoid allocations
+        struct Query
+        {
+            ::std::vector<size_t> stack;
+            ::std::vector<size_t> visited; // open addressed set of bins
+            size_t visitedCount;
+        };
+
+        SphereGrid();
+
+        // bins the cell positions with about perBin points per bin
+        void build(const VoronoiCell* cells, size_t count, int threads, size_t perBin = 3);
+        void build(const glm::dvec3* points, size_t count, int threads, size_t perBin = 3);
+
+        // empty bins, res along each face edge
+        void layout(size_t res);
+
+        size_t getBin(const glm::dvec3 & p) const;
+        size_t getBinCount() const { return 6 * m_res * m_res; }
+        glm::dvec3 getBinCenter(size_t b) const;
+        double getBinRadius() const { return m_binRadius; }
+
+        // points of bin b are [getBinStart(b), getBinStart(b+1))
+        size_t getBinStart(size_t b) const { return m_start[b]; }
+        size_t getIndex(size_t i) const { return m_items[i]; }
+        const glm::dvec3 & getPoint(size_t i) const { return m_points[i]; }
+
+        // calls f(index, position) for the points of every bin that may hold
+        // points within angle of center, a superset of the points in the cap
+        template <typename F>
+        void forEachInCap(const glm::dvec3 & center, double angle, Query & q, F f) const;
+
+        // calls f(bin) for every bin whose center is within angle plus the
+        // bin radius of center, the bins that may hold points in the cap
+        template <typename F>
+        void forEachBinInCap(const glm::dvec3 & center, double angle, Query & q, F f) const;
+
+    private:
+
+        size_t m_res; // bins along each face edge
+        double m_binRadius; // upper bound on the angle from a bin's center to its points
+
+        ::std::vector<double> m_tan; // tan of the equal-angle coordinate of each bin center
+        ::std::vector<size_t> m_start;
+        ::std::vector<size_t> m_items;
+        ::std::vector<glm::dvec3> m_points;
+
+        size_t getNeighbor(size_t b, int di, int dj) const;
+
+        static bool markVisited(Query & q, size_t b);
+
+        // one of cells or points is NULL
+        void build(const VoronoiCell* cells, const glm::dvec3* points, size_t count, int threads, size_t perBin);
+};
+
+template <typename F>
+void SphereGrid::forEachInCap(const glm::dvec3 & center, double angle, Query & q, F f) const
+{
+    forEachBinInCap(center, angle, q, [&](size_t b)
+    {
+        for (size_t i = m_start[b]; i < m_start[b+1]; i++)
+            f(m_items[i], m_points[i]);
+    });
+}
+
+template <typename F>
+void SphereGrid::forEachBinInCap(const glm::dvec3 & center, double angle, Query & q, F f) const
+{
+    double cosLimit = cos(glm::min(angle + m_binRadius, M_PI));
+    const int di[4] = { 1, -1, 0, 0 };
+    const int dj[4] = { 0, 0, 1, -1 };
+
+    // flood fill over the bins whose bounding caps meet the query cap
+    q.stack.clear();
+    q.visited.assign(64, SIZE_MAX);
+    q.visitedCount = 0;
+
+    size_t first = getBin(center);
+    markVisited(q, first);
+    q.stack.push_back(first);
+
+    while (!q.stack.empty())
+    {
+        size_t b = q.stack.back();
+        q.stack.pop_back();
+
+        f(b);
+
+        for (int k = 0; k < 4; k++)
+        {
+            size_t n = getNeighbor(b, di[k], dj[k]);
+            if (glm::dot(getBinCenter(n), center) >= cosLimit && markVisited(q, n))
+                q.stack.push_back(n);
+        }
+    }
+}
+
+}
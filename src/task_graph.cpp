@@ -95,7 +95,7 @@ void TaskGraph::printGraph()
 {
     // Create a copy of the task graph for traversal
     std::vector<Task*> tasks;
-    std::vector<uint8_t> inDegree;
+    std::vector<uint32_t> inDegree;
     
     // Initialize with all tasks
     for (auto& task : m_tasks)
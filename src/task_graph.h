@@ -22,7 +22,7 @@ class Task
         virtual void process() = 0;
 
         ::std::vector<Task*> m_dependents;
-        ::std::atomic<uint8_t> m_preReqs;
+        ::std::atomic<uint32_t> m_preReqs;
         bool isEmpty;
 };
 
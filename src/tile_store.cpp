@@ -0,0 +1,313 @@
+#include "tile_store.h"
+#include "point_loader.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+// records each chunk buffers per tile before writing them
+static const size_t TILE_BUFFER = 128;
+
+// points each chunk reads from an input file at a time
+static const size_t INPUT_BLOCK = 4096;
+
+const char TILE_STORE_MAGIC[8] = { 'V', 'O', 'R', 'T', 'I', 'L', 'E', 0 };
+
+// start of a kept file, followed by the tile starts and core counts
+struct TileStoreHeader
+{
+    char magic[8];
+    uint64_t res;
+    double halo;
+    uint64_t count;
+    uint64_t recordsOffset;
+};
+
+TileStore::TileStore(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+    m_fd = -1;
+    m_recordsOffset = 0;
+    m_halo = 0.0;
+    m_count = 0;
+    m_points = NULL;
+    m_inputFd = -1;
+    m_chunks = 0;
+}
+
+TileStore::~TileStore()
+{
+    close();
+}
+
+void TileStore::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+    m_count = 0;
+    m_tileStart.clear();
+    m_coreCount.clear();
+}
+
+bool TileStore::build(const glm::dvec3* points, size_t count, size_t perTile, double halo, const char* path, bool keep)
+{
+    close();
+    m_error.clear();
+
+    m_points = points;
+    bool ok = partition(count, perTile, halo, path, keep);
+    m_points = NULL;
+    return ok;
+}
+
+bool TileStore::build(const char* input, size_t count, size_t perTile, double halo, const char* path, bool keep)
+{
+    close();
+    m_error.clear();
+
+    m_inputFd = ::open(input, O_RDONLY);
+    if (m_inputFd < 0)
+    {
+        m_error = ::std::string("Unable to open ") + input;
+        return false;
+    }
+
+    bool ok = partition(count, perTile, halo, path, keep);
+    ::close(m_inputFd);
+    m_inputFd = -1;
+    return ok;
+}
+
+bool TileStore::partition(size_t count, size_t perTile, double halo, const char* path, bool keep)
+{
+    // the scratch file only lives as long as its descriptor unless it is kept
+    m_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (m_fd < 0)
+    {
+        m_error = ::std::string("Unable to create ") + path;
+        return false;
+    }
+    if (!keep)
+        unlink(path);
+
+    m_grid.layout(::std::max((size_t)1, (size_t)ceil(sqrt(count / (6.0 * ::std::max(perTile, (size_t)1))))));
+    m_halo = halo;
+    m_count = count;
+
+    size_t tiles = getTileCount();
+    m_chunks = ::std::max((size_t)1, ::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64)));
+    m_chunkCore.assign(m_chunks * tiles, 0);
+    m_chunkHalo.assign(m_chunks * tiles, 0);
+    m_chunkOk.assign(m_chunks, 1);
+    m_chunkRead.assign(m_chunks, 1);
+
+    auto run = [&](auto makeTask)
+    {
+        TaskGraph tg;
+        for (size_t c = 0; c < m_chunks; c++)
+            tg.addTask(unique_ptr<Task>(makeTask(c)));
+        tg.finalizeGraph();
+        tg.processTasks(m_threads);
+    };
+
+    run([&](size_t c) { CountTilePointsTask* t = new CountTilePointsTask; t->td = TaskDataTileStore{this, c}; return t; });
+    bool ok = ::std::all_of(m_chunkRead.begin(), m_chunkRead.end(), [](char k) { return k != 0; });
+
+    // lay the tiles out one after another, core points first, and turn the
+    // counts of each chunk into the place its points go
+    m_tileStart.assign(tiles + 1, 0);
+    m_coreCount.assign(tiles, 0);
+    uint64_t next = 0;
+    for (size_t t = 0; t < tiles; t++)
+    {
+        m_tileStart[t] = next;
+        for (size_t c = 0; c < m_chunks; c++)
+        {
+            uint64_t n = m_chunkCore[c * tiles + t];
+            m_chunkCore[c * tiles + t] = next;
+            m_coreCount[t] += n;
+            next += n;
+        }
+        for (size_t c = 0; c < m_chunks; c++)
+        {
+            uint64_t n = m_chunkHalo[c * tiles + t];
+            m_chunkHalo[c * tiles + t] = next;
+            next += n;
+        }
+    }
+    m_tileStart[tiles] = next;
+
+    m_recordsOffset = 0;
+    if (ok && keep)
+    {
+        TileStoreHeader header = {};
+        memcpy(header.magic, TILE_STORE_MAGIC, sizeof(TILE_STORE_MAGIC));
+        header.res = (uint64_t)round(sqrt(tiles / 6.0));
+        header.halo = halo;
+        header.count = count;
+        header.recordsOffset = sizeof(header) + (2 * tiles + 1) * sizeof(uint64_t);
+        m_recordsOffset = header.recordsOffset;
+        ok = pwriteAll(m_fd, &header, sizeof(header), 0) &&
+             pwriteAll(m_fd, m_tileStart.data(), m_tileStart.size() * sizeof(uint64_t), sizeof(header)) &&
+             pwriteAll(m_fd, m_coreCount.data(), tiles * sizeof(uint64_t), sizeof(header) + m_tileStart.size() * sizeof(uint64_t));
+    }
+
+    ok = ok && ftruncate(m_fd, m_recordsOffset + next * sizeof(TilePoint)) == 0;
+    if (ok)
+    {
+        run([&](size_t c) { FillTilePointsTask* t = new FillTilePointsTask; t->td = TaskDataTileStore{this, c}; return t; });
+        ok = ::std::all_of(m_chunkOk.begin(), m_chunkOk.end(), [](char k) { return k != 0; }) &&
+             ::std::all_of(m_chunkRead.begin(), m_chunkRead.end(), [](char k) { return k != 0; });
+    }
+
+    ::std::vector<uint64_t>().swap(m_chunkCore);
+    ::std::vector<uint64_t>().swap(m_chunkHalo);
+
+    if (!ok)
+    {
+        bool read = ::std::all_of(m_chunkRead.begin(), m_chunkRead.end(), [](char k) { return k != 0; });
+        m_error = read ? ::std::string("Unable to write ") + path : ::std::string("Unable to read the input points, or one is zero or not finite");
+        close();
+        if (keep)
+            unlink(path);
+        return false;
+    }
+    return true;
+}
+
+bool TileStore::open(const char* path)
+{
+    close();
+    m_error.clear();
+
+    m_fd = ::open(path, O_RDONLY);
+    TileStoreHeader header;
+    if (m_fd < 0 || !preadAll(m_fd, &header, sizeof(header), 0) ||
+        memcmp(header.magic, TILE_STORE_MAGIC, sizeof(TILE_STORE_MAGIC)) != 0 || header.res == 0)
+    {
+        m_error = ::std::string("Unable to open tiles ") + path;
+        close();
+        return false;
+    }
+
+    m_grid.layout(header.res);
+    m_halo = header.halo;
+    m_count = header.count;
+    m_recordsOffset = header.recordsOffset;
+
+    size_t tiles = getTileCount();
+    m_tileStart.resize(tiles + 1);
+    m_coreCount.resize(tiles);
+    if (!preadAll(m_fd, m_tileStart.data(), m_tileStart.size() * sizeof(uint64_t), sizeof(header)) ||
+        !preadAll(m_fd, m_coreCount.data(), tiles * sizeof(uint64_t), sizeof(header) + m_tileStart.size() * sizeof(uint64_t)))
+    {
+        m_error = ::std::string("Unable to open tiles ") + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+template <typename F>
+bool TileStore::forEachTile(size_t chunk, F f) const
+{
+    SphereGrid::Query query;
+    size_t start = m_count * chunk / m_chunks;
+    size_t end = m_count * (chunk + 1) / m_chunks;
+    ::std::vector<glm::dvec3> block;
+
+    for (size_t first = start; first < end; first += INPUT_BLOCK)
+    {
+        size_t n = ::std::min(INPUT_BLOCK, end - first);
+        const glm::dvec3* points = m_points + first;
+        if (!m_points)
+        {
+            block.resize(n);
+            if (!preadAll(m_inputFd, block.data(), n * sizeof(glm::dvec3), first * sizeof(glm::dvec3)))
+                return false;
+            for (glm::dvec3 & p : block)
+                if (!toUnitLength(p)) return false;
+            points = block.data();
+        }
+
+        for (size_t k = 0; k < n; k++)
+        {
+            const glm::dvec3 & p = points[k];
+            size_t own = m_grid.getBin(p);
+            f(first + k, p, own, true);
+            m_grid.forEachBinInCap(p, m_halo, query, [&](size_t b)
+            {
+                if (b != own)
+                    f(first + k, p, b, false);
+            });
+        }
+    }
+    return true;
+}
+
+void TileStore::countTiles(size_t chunk)
+{
+    size_t tiles = getTileCount();
+    uint64_t* core = m_chunkCore.data() + chunk * tiles;
+    uint64_t* halo = m_chunkHalo.data() + chunk * tiles;
+
+    m_chunkRead[chunk] = forEachTile(chunk, [&](size_t, const glm::dvec3 &, size_t tile, bool isCore)
+    {
+        (isCore ? core : halo)[tile]++;
+    });
+}
+
+void TileStore::fillTiles(size_t chunk)
+{
+    size_t tiles = getTileCount();
+    uint64_t* cursor[2] = { m_chunkHalo.data() + chunk * tiles, m_chunkCore.data() + chunk * tiles };
+    ::std::vector<::std::vector<TilePoint>> buffers(2 * tiles);
+
+    auto flush = [&](size_t b)
+    {
+        ::std::vector<TilePoint> & buffer = buffers[b];
+        uint64_t & at = cursor[b & 1][b >> 1];
+        if (buffer.size() && !pwriteAll(m_fd, buffer.data(), buffer.size() * sizeof(TilePoint), m_recordsOffset + at * sizeof(TilePoint)))
+            m_chunkOk[chunk] = 0;
+        at += buffer.size();
+        buffer.clear();
+    };
+
+    m_chunkRead[chunk] = forEachTile(chunk, [&](size_t i, const glm::dvec3 & p, size_t tile, bool isCore)
+    {
+        size_t b = tile * 2 + isCore;
+        buffers[b].push_back({ i, p });
+        if (buffers[b].size() >= TILE_BUFFER)
+            flush(b);
+    });
+
+    for (size_t b = 0; b < buffers.size(); b++)
+        flush(b);
+}
+
+bool TileStore::read(size_t first, size_t count, ::std::vector<TilePoint> & points) const
+{
+    size_t old = points.size();
+    points.resize(old + count);
+    return preadAll(m_fd, points.data() + old, count * sizeof(TilePoint), m_recordsOffset + first * sizeof(TilePoint));
+}
+
+bool TileStore::readTile(size_t tile, ::std::vector<TilePoint> & points) const
+{
+    points.clear();
+    return read(m_tileStart[tile], m_tileStart[tile + 1] - m_tileStart[tile], points);
+}
+
+bool TileStore::readCore(size_t tile, ::std::vector<TilePoint> & points) const
+{
+    return read(m_tileStart[tile], m_coreCount[tile], points);
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../glm/glm.hpp"
+#include "sphere_grid.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace VorGen {
+
+struct TilePoint
+{
+    uint64_t index; // input point
+    glm::dvec3 position;
+};
+
+/*
+    Partitions points into the tiles of a coarse cube map for
+    VoronoiGenerator::generateTiled and keeps them in a scratch file, so a
+    tile can be read back without the rest of the input in memory. A point
+    is a core point of the tile whose bin holds it, and a halo point of
+    every other tile whose center is within the bin radius plus the halo of
+    it. Each tile is stored as its core points followed by its halo points.
+
+    The input is counted and then written by the worker threads, each with
+    a small buffer per tile. It is either in memory or a binary file of
+    packed x,y,z doubles, which each thread reads a block at a time. The
+    scratch file is unlinked as soon as it is created and goes away with
+    close, unless it is kept for other processes to open, as the shards of
+    ShardCoordinator do. A kept file starts with the layout of the tiles.
+*/
+
+class TileStore
+{
+    public:
+
+        TileStore(int threads = 6);
+        ~TileStore();
+
+        TileStore(const TileStore &) = delete;
+        TileStore & operator=(const TileStore &) = delete;
+
+        // tiles of about perTile core points, scratch file at path
+        bool build(const glm::dvec3* points, size_t count, size_t perTile, double halo, const char* path, bool keep = false);
+        // the first count points of the binary file input
+        bool build(const char* input, size_t count, size_t perTile, double halo, const char* path, bool keep = false);
+        // a file kept by build, read only
+        bool open(const char* path);
+        void close();
+
+        const SphereGrid & getGrid() const { return m_grid; }
+        size_t getTileCount() const { return m_grid.getBinCount(); }
+        size_t getCoreCount(size_t tile) const { return m_coreCount[tile]; }
+        size_t getPointCount() const { return m_count; }
+        double getHalo() const { return m_halo; }
+
+        // every point within the bin radius plus the halo of the tile
+        // center, core points first
+        bool readTile(size_t tile, ::std::vector<TilePoint> & points) const;
+        // appends the core points of the tile
+        bool readCore(size_t tile, ::std::vector<TilePoint> & points) const;
+
+        const ::std::string & getError() const { return m_error; }
+
+    private:
+
+        int m_threads;
+        int m_fd;
+        uint64_t m_recordsOffset;
+        SphereGrid m_grid;
+        double m_halo;
+        size_t m_count;
+        ::std::string m_error;
+
+        // tile t is records [m_tileStart[t], m_tileStart[t+1]) of the file
+        ::std::vector<uint64_t> m_tileStart;
+        ::std::vector<uint64_t> m_coreCount;
+
+        // input being partitioned, in memory or read from m_inputFd, split
+        // into chunks of points. The counts of chunk c are at c * tiles + t,
+        // and become its write cursors.
+        const glm::dvec3* m_points;
+        int m_inputFd;
+        size_t m_chunks;
+        ::std::vector<uint64_t> m_chunkCore;
+        ::std::vector<uint64_t> m_chunkHalo;
+        ::std::vector<char> m_chunkOk;   // its writes succeeded
+        ::std::vector<char> m_chunkRead; // and its reads of the input
+
+        // build from the input set up by either overload
+        bool partition(size_t count, size_t perTile, double halo, const char* path, bool keep);
+
+        // false if the input could not be read, or a point read from a
+        // file is zero or not finite. Those are normalized as they are read.
+        template <typename F>
+        bool forEachTile(size_t chunk, F f) const;
+
+        bool read(size_t first, size_t count, ::std::vector<TilePoint> & points) const;
+
+        void countTiles(size_t chunk);
+        void fillTiles(size_t chunk);
+
+        friend class CountTilePointsTask;
+        friend class FillTilePointsTask;
+};
+
+}
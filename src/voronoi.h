@@ -9,6 +9,7 @@
 #include "priqueue.h"
 #include "memblock.h"
 #include "globals.h"
+#include "cell_sink.h"
 
 namespace VorGen {
 
@@ -30,7 +31,28 @@ class OrderedIterator
     inline size_t getIndex() { return index; };
 };
 
-template <Order O, Axis A>
+// Event accounting for one sweep. A cell is owned by the first sweep to
+// touch it, so any work a sweep does for a cell owned by another sweep is
+// thrown away.
+struct SweepStats
+{
+  size_t siteEvents;
+  size_t circleEvents;
+
+  // site events whose cell is owned by another sweep
+  size_t wastedSiteEvents;
+
+  // circle events whose three cells are all owned by other sweeps
+  size_t wastedCircleEvents;
+
+  // corners computed for cells owned by other sweeps
+  size_t discardedCorners;
+
+  // cells whose last arc was removed by this sweep
+  size_t cellsCompleted;
+};
+
+template <Order O, Axis A, typename I, typename T>
 class VoronoiSweeper
 {
   public:
@@ -43,47 +65,96 @@ class VoronoiSweeper
 
     void sweep();
 
+    const SweepStats & getStats() { return m_stats; }
+
+    // deliver owned cells to sink as they complete, cells is the cell array
+    // the sites point into
+    void setSink(CellSink* sink, const VoronoiCell* cells);
+
+    // counter of the cells completed by every sweep of the run, the sweep
+    // stops once it reaches gen. completedCells unless set.
+    void setCompletedCounter(::std::atomic<size_t>* completed) { m_completedCells = completed; }
+
   private:
       
     double m_sweeplineLarge;
     double m_sweeplineSmall;
+    double m_sweeplineErr; // bound on the error of the two above
 
-    BeachLine<O> m_beachLine;
-    PriQueue<CircleEvent<O>, VoronoiEventCompare<O>, 8, 64> m_circles;
+    BeachLine<O, I, T> m_beachLine;
+    PriQueue<CircleEvent<O, T>, VoronoiEventCompare<O, A, I, T>, 8, 64> m_circles;
 
     ::std::vector<VoronoiSite>* m_sites;
     OrderedIterator<O> m_next;
 
     size_t m_gen;
     uint8_t m_threadId;
-
-    VoronoiSiteEventCompare<O> voronoi_site_event_comp;
+    ::std::atomic<size_t>* m_completedCells;
+
+    SweepStats m_stats;
+
+    CellSink* m_sink;
+    const VoronoiCell* m_cells;
+    ::std::vector<size_t> m_completed;
+
+    // Corners of the cells this sweep owns are linked into rings as they
+    // are created. A new arc starts its ring from a link without a corner
+    // where its site is, and splitting an arc starts another between the
+    // halves. A vertex goes after the right end of the arc to its left,
+    // before the left end of the arc to its right, and between the two ends
+    // of the arc it removes. Once the last arc of a cell goes its ring is
+    // closed and is walked into the cell's corners.
+    struct CornerLink
+    {
+        uint32_t corner; // index in the cell's corners, NO_CORNER where an arc started
+        I next;          // -1 at the end of a part not joined up yet
+    };
+    static const uint32_t NO_CORNER = UINT32_MAX;
+
+    ::std::vector<CornerLink> m_links;
+    I m_freeLinks; // rings of finished cells, chained through next
+    ::std::vector<glm::dvec3> m_ring;
+
+    I newLink(uint32_t corner);
+    void startRing(SkipNode<O, I, T>* node);
+    // orders the corners of a completed cell from the link of its last
+    // vertex, then hands it on
+    void finishCell(VoronoiCell* cell, I start);
+    // cells still holding arcs when the sweep ends
+    void finishOpenCells();
+    void deliver(VoronoiCell* cell);
+    void flushCompleted();
+
+    VoronoiSiteEventCompare<O, A, I, T> voronoi_site_event_comp;
 
     void processEvents();
 
     void processSiteEvent(VoronoiSite* site);
-    void processCircleEvent(CircleEvent<O>* circle);
+    void processCircleEvent(CircleEvent<O, T>* circle);
 
     bool onOtherSide(const glm::dvec3 & cc);
 
-    bool eventIsUpcoming(double small_polar, double large_polar);
+    inline bool ownsCell(VoronoiCell* cell);
+
+    bool eventIsUpcoming(double small_polar, double large_polar, double err);
 
-    void addCircleEventProcessSite(SkipNode<O>* node);
-    void addCircleEventProcessCircle(SkipNode<O>* node);
+    void addCircleEventProcessSite(SkipNode<O, I, T>* node);
+    void addCircleEventProcessCircle(SkipNode<O, I, T>* node);
     inline void addCircleEvent(
-      SkipNode<O>* node, 
+      SkipNode<O, I, T>* node, 
       double lp, 
       double sp, 
-      const glm::dvec3 & cc);
+      const glm::dvec3 & cc,
+      double err);
 
-    void removeCircleEvent(SkipNode<O>* node);
+    void removeCircleEvent(SkipNode<O, I, T>* node);
 
     // Memory buffer
-    int block;
-    MemBlock<O>* m_memBlocks;
-    MemBlock<O>* m_nextBlock;
+    I block;
+    MemBlock<O, I, T>* m_memBlocks;
+    MemBlock<O, I, T>* m_nextBlock;
 
-    SkipNode<O>* initBlock();
+    SkipNode<O, I, T>* initBlock();
 
   public:
     static glm::dvec3 circumcenter(
@@ -1,17 +1,21 @@
 #include "voronoi_cell.h"
-#include "../glm/gtc/matrix_transform.hpp"
 #include "globals.h"
 #include <algorithm>
+#include <cmath>
 
 namespace VorGen {
 
-void VoronoiCell::addCorner(const glm::dvec3 & c, uint8_t thread)
+bool VoronoiCell::addCorner(const glm::dvec3 & c, uint8_t thread)
 {
     uint8_t prev = m_owner.fetch_or(thread);
     if (prev & thread || prev == 0)
+    {
         corners.push_back(c); // already owned by thread or previously not owned
-    else
-        m_owner.fetch_and(~thread); // revoke ownership
+        return true;
+    }
+
+    m_owner.fetch_and(~thread); // revoke ownership
+    return false;
 }
 
 void VoronoiCell::increment(uint8_t thread)
@@ -23,19 +27,19 @@ void VoronoiCell::increment(uint8_t thread)
         m_owner.fetch_and(~thread); // revoke ownership
 }
 
-void VoronoiCell::decrement(uint8_t thread)
+bool VoronoiCell::decrement(uint8_t thread)
 {
     uint8_t prev = m_owner.fetch_or(thread);
     if (prev & thread || prev == 0)
     {
         m_arcs--; // already owned by thread or previously not owned
         if (m_arcs == 0)
-        {
-            completedCells++;
-        }
+            return true;
     }
     else
         m_owner.fetch_and(~thread); // revoke ownership
+
+    return false;
 }
 
 // VoronoiCell implementations
@@ -85,37 +89,53 @@ void VoronoiCell::sortCorners()
 
 void VoronoiCell::computeCentroid()
 {
-    // construct transformation and inverse
-    glm::dmat4x4 transform = glm::lookAt(glm::dvec3(0.0),
-                                         position,
-                                         glm::dvec3(0.0,1.0,0.0));
-    glm::dmat4x4 inverse = glm::inverse(transform);
-
-    double cx, cy, cz, area;
-    cx = cy = area = 0.0;
+    if (corners.size() < 3) return;
+
+    // direction of the first moment of the spherical polygon, the sum over
+    // its edges of the arc times the normal of the edge's great circle, as
+    // in CellMeasures
+    glm::dvec3 moment(0.0);
+    glm::dvec3 prev = corners.back();
+    for (const glm::dvec3 & corner : corners)
+    {
+        glm::dvec3 n = glm::cross(prev, corner);
+        double s = glm::length(n);
+        if (s > 0.0)
+            moment += n * (atan2(s, glm::dot(prev, corner)) / s);
+        prev = corner;
+    }
 
-    glm::dvec4 pc4 = glm::dvec4(corners[corners.size()-1], 1.0);
+    if (glm::dot(moment, position) < 0.0)
+        moment = -moment;
+    position = glm::normalize(moment);
+}
 
-    glm::dvec4 prev_t_corner = transform * pc4;
-    cz = prev_t_corner.z;
+double VoronoiCell::computeMoments(const glm::dvec3 & site, glm::dvec3 & centroid) const
+{
+    if (corners.size() < 3)
+    {
+        centroid = site;
+        return 0.0;
+    }
 
-    for (auto it = corners.begin(); it != corners.end(); it++)
+    // corners relative to the site, for a triangle (0, b, c) the integral of
+    // |x|^2 is area * (|b|^2 + |c|^2 + b.c) / 6
+    glm::dvec3 sum(0.0);
+    double area = 0.0;
+    double moment = 0.0;
+    glm::dvec3 b = corners[corners.size() - 1] - site;
+    for (const glm::dvec3 & corner : corners)
     {
-        glm::dvec3 corner = *it;
-        glm::dvec4 c4 = glm::dvec4(corner, 1.0);
-        glm::dvec4 t_corner = transform * c4;
-
-        double a = (prev_t_corner.x * t_corner.y) 
-                    - (t_corner.x * prev_t_corner.y);
-        cx += (prev_t_corner.x + t_corner.x) * a;
-        cy += (prev_t_corner.y + t_corner.y) * a;
+        glm::dvec3 c = corner - site;
+        double a = 0.5 * glm::length(glm::cross(b, c));
+        sum += a * (b + c);
         area += a;
-
-        prev_t_corner = t_corner;
+        moment += a * (glm::dot(b, b) + glm::dot(c, c) + glm::dot(b, c));
+        b = c;
     }
 
-    double f = 1.0/(3.0 * area);
-    position = glm::vec3(inverse * glm::dvec4(f*cx, f*cy, cz, 1.0));
+    centroid = area > 0.0 ? glm::normalize(site + sum / (3.0 * area)) : site;
+    return moment / 6.0;
 }
 
 }
\ No newline at end of file
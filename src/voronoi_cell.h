@@ -20,12 +20,20 @@ class VoronoiCell
         uint8_t m_arcs;	// probably enough bits!
         ::std::atomic<uint8_t> m_owner;
 
-        void addCorner(const glm::dvec3 & c, uint8_t thread);
+        // returns true if thread owns the cell and the corner was added
+        bool addCorner(const glm::dvec3 & c, uint8_t thread);
         void increment(uint8_t thread);
-        void decrement(uint8_t thread);
+        // returns true if this call completed the cell
+        bool decrement(uint8_t thread);
 
+        // orders the corners by angle about the site. The sweeps link corners
+        // into rings as they go, this is left for cells they leave open.
         void sortCorners();
         void computeCentroid();
+        // centroid projected onto the sphere and second moment about site of
+        // the fan of flat triangles joining site to each edge, the cell's
+        // share of the CVT energy. The corners must be sorted.
+        double computeMoments(const glm::dvec3 & site, glm::dvec3 & centroid) const;
 };
 
 }
\ No newline at end of file
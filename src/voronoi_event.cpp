@@ -1,24 +1,132 @@
 #include "voronoi_event.h"
+#include "voronoi_event_compare.h"
+#include "memblock.h"
+#include "predicates.h"
 #include <math.h>
+#include <cfloat>
 
 namespace VorGen {
 
-template <Order O>
-CircleEvent<O>::CircleEvent()
+template <Order O, typename T>
+CircleEvent<O, T>::CircleEvent()
 {
     pqn = nullptr;
 }
 
-template <Order O>
-CircleEvent<O>::CircleEvent(double polar, double polar_small, const glm::dvec3 & c)
+template <Order O, typename T>
+CircleEvent<O, T>::CircleEvent(double polar, double polar_small, const glm::dvec3 & c, double err)
 {
-    this->polar = polar;
-    this->polar_small = polar_small;
-    center = c;
+    this->polar = (T)polar;
+    this->polar_small = (T)polar_small;
+    center.set(c);
     pqn = nullptr;
+
+    // rounded up, so the bound holds for the angles as stored
+    err += fabs(polar - this->polar) + fabs(polar_small - this->polar_small);
+    this->err = (T)err;
+    if (this->err < err)
+        this->err = nextafter(this->err, (T)INFINITY);
+}
+
+template class CircleEvent<Increasing, double>;
+template class CircleEvent<Decreasing, double>;
+template class CircleEvent<Increasing, float>;
+template class CircleEvent<Decreasing, float>;
+
+// an error bound of the double angles for those in long double
+constexpr long double LONG_ERR = (long double)LDBL_EPSILON / DBL_EPSILON;
+
+// the sites of a queued event, left to right along the beachline
+template <Order O, typename I, typename T>
+static void getEventSites(CircleEvent<O, T>* ce, const VoronoiSite** sites)
+{
+    SkipNode<O, I, T>* node = getSkipNodeFromCircleEvent<O, I, T>(ce);
+    sites[0] = NODE(node, prev)->m_beachArc.m_site;
+    sites[1] = node->m_beachArc.m_site;
+    sites[2] = NODE(node, next)->m_beachArc.m_site;
+}
+
+// true if site is on the circle through the sites of an event, exactly
+static bool onCircle(const VoronoiSite* const* sites, const VoronoiSite* site)
+{
+    return cocircular(sites[0]->m_position, sites[1]->m_position,
+                      sites[2]->m_position, site->m_position);
 }
 
-template class CircleEvent<Increasing>;
-template class CircleEvent<Decreasing>;
+template <Order O, Axis A>
+long double eventPolarLong(const VoronoiSite* const* sites)
+{
+    const glm::dvec3 & i = sites[0]->m_position;
+    const glm::dvec3 & j = sites[1]->m_position;
+    const glm::dvec3 & k = sites[2]->m_position;
+
+    long double ij[3], kj[3];
+    for (int c = 0; c < 3; c++)
+    {
+        ij[c] = (long double)i[c] - j[c];
+        kj[c] = (long double)k[c] - j[c];
+    }
+
+    // as VoronoiSweeper::circumcenter
+    long double sign = O == Increasing ? 1.0L : -1.0L;
+    long double n[3] = {
+        sign * (ij[1] * kj[2] - ij[2] * kj[1]),
+        sign * (ij[2] * kj[0] - ij[0] * kj[2]),
+        sign * (ij[0] * kj[1] - ij[1] * kj[0]) };
+    long double len = sqrtl(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    long double large = n[A] / len;
+    long double small = (n[0] * j[0] + n[1] * j[1] + n[2] * j[2]) / len;
+    large = acosl(fminl(fmaxl(large, -1.0L), 1.0L));
+    small = acosl(fminl(fmaxl(small, -1.0L), 1.0L));
+    return O == Increasing ? large + small : large - small;
+}
 
-}
\ No newline at end of file
+template <Order O, Axis A>
+int compareEventSites(const VoronoiSite* const* lhs, const VoronoiSite* const* rhs, double err)
+{
+    if (onCircle(lhs, rhs[0]) && onCircle(lhs, rhs[1]) && onCircle(lhs, rhs[2]))
+        return 0;
+    return sweepOrder<O>(eventPolarLong<O, A>(lhs), eventPolarLong<O, A>(rhs), err * LONG_ERR);
+}
+
+template <Order O, Axis A, typename I, typename T>
+int compareEvents(CircleEvent<O, T>* lhs, CircleEvent<O, T>* rhs)
+{
+    const VoronoiSite* l[3];
+    const VoronoiSite* r[3];
+    getEventSites<O, I, T>(lhs, l);
+    getEventSites<O, I, T>(rhs, r);
+    return compareEventSites<O, A>(l, r, (double)lhs->err + rhs->err);
+}
+
+template <Order O, Axis A, typename I, typename T>
+int compareSiteEvent(const VoronoiSite* site, CircleEvent<O, T>* ce)
+{
+    const VoronoiSite* sites[3];
+    getEventSites<O, I, T>(ce, sites);
+    if (onCircle(sites, site))
+        return 0;
+    return sweepOrder<O>(acosl(site->m_position[A]), eventPolarLong<O, A>(sites),
+                         ((double)ce->err + SITE_POLAR_ERR) * LONG_ERR);
+}
+
+#define EVENT_ORDER_LAYOUT(O, A, I, T) \
+    template int compareEvents<O, A, I, T>(CircleEvent<O, T>*, CircleEvent<O, T>*); \
+    template int compareSiteEvent<O, A, I, T>(const VoronoiSite*, CircleEvent<O, T>*);
+
+#define EVENT_ORDER(O, A) \
+    template long double eventPolarLong<O, A>(const VoronoiSite* const*); \
+    template int compareEventSites<O, A>(const VoronoiSite* const*, const VoronoiSite* const*, double); \
+    EVENT_ORDER_LAYOUT(O, A, NarrowIndex, double) \
+    EVENT_ORDER_LAYOUT(O, A, WideIndex, double) \
+    EVENT_ORDER_LAYOUT(O, A, NarrowIndex, float)
+
+EVENT_ORDER(Increasing, X)
+EVENT_ORDER(Decreasing, X)
+EVENT_ORDER(Increasing, Y)
+EVENT_ORDER(Decreasing, Y)
+EVENT_ORDER(Increasing, Z)
+EVENT_ORDER(Decreasing, Z)
+
+}
@@ -9,16 +9,36 @@
 
 namespace VorGen {
 
-template <Order O>
+// Double events keep the center of their circle, which becomes a corner.
+// Float events keep none, it is recomputed from their sites in double.
+template <typename T>
+struct EventCenter
+{
+    glm::dvec3 center;
+    void set(const glm::dvec3 & c) { center = c; }
+    const glm::dvec3* get() const { return &center; }
+};
+
+template <>
+struct EventCenter<float>
+{
+    void set(const glm::dvec3 &) {}
+    const glm::dvec3* get() const { return NULL; }
+};
+
+template <Order O, typename T>
 class CircleEvent
 {
     public:
 
         CircleEvent();
-        CircleEvent(double polar, double polar_, const glm::dvec3 & c);
+        CircleEvent(double polar, double polar_, const glm::dvec3 & c, double err = 0.0);
 
-        double polar, polar_small;
-        glm::dvec3 center;
+        T polar, polar_small;
+        // bound on the error of polar and polar_small together, zero for an
+        // event given exactly. A float event's takes in its rounding.
+        T err;
+        EventCenter<T> center;
 
         void* pqn; // pointer to node in priority queue
 };
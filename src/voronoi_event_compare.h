@@ -3,34 +3,74 @@
 #include "globals.h"
 #include "voronoi_event.h"
 #include "voronoi_site.h"
+#include <cfloat>
+#include <cmath>
 
 namespace VorGen {
 
-template <Order O> struct VoronoiEventCompare;
+// Circle event angles come from acos of a dot product, so each event keeps
+// a bound on its error (CircleEvent::err). Events further apart than their
+// bounds are ordered by their angles. Closer ones are ordered by their
+// sites: events on one circle, as four or more cocircular sites make,
+// happen together, and others by their angles again in long double. The
+// long double angles have the same bounds scaled down to their precision,
+// and events within those are taken to happen together too.
 
-template <> struct VoronoiEventCompare<Increasing>
+// a site's polar angle is acos of an exact coordinate
+constexpr double SITE_POLAR_ERR = M_PI * DBL_EPSILON;
+
+// > 0 if polar comes after other in the sweep, 0 if they are within err
+// of each other
+template <Order O>
+inline int sweepOrder(long double polar, long double other, long double err)
+{
+    long double diff = O == Increasing ? polar - other : other - polar;
+    return (diff > err) - (diff < -err);
+}
+
+// the polar angle of the event of three sites, polar plus or minus
+// polar_small, in long double
+template <Order O, Axis A>
+long double eventPolarLong(const VoronoiSite* const* sites);
+
+// The order of two events whose angles are within err, their bounds
+// together, > 0 if lhs comes after rhs, 0 if they happen together. Queued
+// events are given by their sites, which their arcs lead to through nodes
+// indexed by I, of the sweep's scalar type T.
+template <Order O, Axis A>
+int compareEventSites(const VoronoiSite* const* lhs, const VoronoiSite* const* rhs, double err);
+template <Order O, Axis A, typename I, typename T>
+int compareEvents(CircleEvent<O, T>* lhs, CircleEvent<O, T>* rhs);
+
+// as compareEvents, a site on the event's circle goes first
+template <Order O, Axis A, typename I, typename T>
+int compareSiteEvent(const VoronoiSite* site, CircleEvent<O, T>* ce);
+
+template <Order O, Axis A, typename I, typename T> struct VoronoiEventCompare;
+
+template <Axis A, typename I, typename T> struct VoronoiEventCompare<Increasing, A, I, T>
 {
     // returns true if lhs > rhs
-    inline bool operator()(CircleEvent<Increasing>* lhs, CircleEvent<Increasing>* rhs)
+    inline bool operator()(CircleEvent<Increasing, T>* lhs, CircleEvent<Increasing, T>* rhs)
     {
-        double polarDiff = (lhs->polar - rhs->polar) + (lhs->polar_small - rhs->polar_small);
-        if (polarDiff == 0.0)
-            return false;
-        else
+        double polarDiff = ((double)lhs->polar - rhs->polar) + ((double)lhs->polar_small - rhs->polar_small);
+        double bound = (double)lhs->err + rhs->err;
+        if (fabs(polarDiff) > bound || bound == 0.0)
             return (polarDiff > 0.0);
+        return compareEvents<Increasing, A, I, T>(lhs, rhs) > 0;
     }
 };
 
-template <> struct VoronoiEventCompare<Decreasing>
-{   
+template <Axis A, typename I, typename T> struct VoronoiEventCompare<Decreasing, A, I, T>
+{
     // returns true if rhs > lhs
-    inline bool operator()(CircleEvent<Decreasing>* lhs, CircleEvent<Decreasing>* rhs)
+    inline bool operator()(CircleEvent<Decreasing, T>* lhs, CircleEvent<Decreasing, T>* rhs)
     {
-        double polarDiff = (rhs->polar - lhs->polar) - (rhs->polar_small - lhs->polar_small);
-        if (polarDiff == 0.0)
-            return false;
-        else
+        double polarDiff = ((double)rhs->polar - lhs->polar) - ((double)rhs->polar_small - lhs->polar_small);
+        double bound = (double)lhs->err + rhs->err;
+        if (fabs(polarDiff) > bound || bound == 0.0)
             return (polarDiff > 0.0);
+        return compareEvents<Decreasing, A, I, T>(lhs, rhs) > 0;
     }
 };
 
@@ -47,32 +87,30 @@ struct VoronoiSiteCompare
     }
 };
 
-template <Order O> struct VoronoiSiteEventCompare;
+template <Order O, Axis A, typename I, typename T> struct VoronoiSiteEventCompare;
 
-template <> struct VoronoiSiteEventCompare<Increasing>
+template <Axis A, typename I, typename T> struct VoronoiSiteEventCompare<Increasing, A, I, T>
 {
     // returns true if lhs > rhs
-    inline bool operator()(VoronoiSite* lhs, CircleEvent<Increasing>* rhs)
+    inline bool operator()(VoronoiSite* lhs, CircleEvent<Increasing, T>* rhs)
     {
-        double polarDiff = lhs->m_polar - (rhs->polar + rhs->polar_small);
-        if (polarDiff == 0.0)
-            return false;
-        else
+        double polarDiff = lhs->m_polar - ((double)rhs->polar + rhs->polar_small);
+        if (rhs->err == 0.0 || fabs(polarDiff) > rhs->err + SITE_POLAR_ERR)
             return (polarDiff > 0.0);
+        return compareSiteEvent<Increasing, A, I, T>(lhs, rhs) > 0;
     }
 };
 
-template <> struct VoronoiSiteEventCompare<Decreasing>
+template <Axis A, typename I, typename T> struct VoronoiSiteEventCompare<Decreasing, A, I, T>
 {
     // returns true if rhs > lhs
-    inline bool operator()(VoronoiSite* lhs, CircleEvent<Decreasing>* rhs)
+    inline bool operator()(VoronoiSite* lhs, CircleEvent<Decreasing, T>* rhs)
     {
-        double polarDiff = lhs->m_polar - (rhs->polar - rhs->polar_small);
-        if (polarDiff == 0.0)
-            return false;
-        else
+        double polarDiff = lhs->m_polar - ((double)rhs->polar - rhs->polar_small);
+        if (rhs->err == 0.0 || fabs(polarDiff) > rhs->err + SITE_POLAR_ERR)
             return (polarDiff < 0.0);
+        return compareSiteEvent<Decreasing, A, I, T>(lhs, rhs) > 0;
     }
 };
 
-}
\ No newline at end of file
+}
@@ -1,9 +1,21 @@
 #include "voronoi_generator.h"
 #include "voronoi_tasks.h"
+#include "result_format.h"
+#include "result_writer.h"
+#include "tile_store.h"
+#include "anderson_mixer.h"
+#include "cell_measures.h"
 #include "voronoi.h"
 #include "globals.h"
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../glm/gtc/matrix_transform.hpp"
 
@@ -27,72 +39,802 @@ using ::std::move;
 VoronoiGenerator::VoronoiGenerator()
 {
     cell_vector = NULL;
+    m_sweepCount = 0;
+    m_workerThreads = 6;
+    m_sink = NULL;
+    m_measureCells = false;
+    m_narrowSweepSites = NARROW_SWEEP_SITES;
+    m_floatSweeps = false;
 }
 
 VoronoiGenerator::VoronoiGenerator(size_t seed) : sample_generator(seed)
 {
     cell_vector = NULL;
+    m_sweepCount = 0;
+    m_workerThreads = 6;
+    m_sink = NULL;
+    m_measureCells = false;
+    m_narrowSweepSites = NARROW_SWEEP_SITES;
+    m_floatSweeps = false;
 }
 
 VoronoiGenerator::~VoronoiGenerator()
 {
 }
 
-glm::dvec3 * VoronoiGenerator::genRandomInput(int count)
+void VoronoiGenerator::setWorkerThreads(int threads)
+{
+    m_workerThreads = ::std::max(threads, MIN_WORKER_THREADS);
+}
+
+glm::dvec3 * VoronoiGenerator::genRandomInput(size_t count)
 {
     return sample_generator.getRandomPointsSphere(count);
 }
 
-VoronoiCell* VoronoiGenerator::generate(glm::dvec3* points, int count, int gen, bool writeToFile)
+glm::dvec3 * VoronoiGenerator::genRandomInputParallel(size_t count)
 {
+    glm::dvec3* points = new glm::dvec3[count];
+    if (count == 0) return points;
+
+    TaskGraph taskGraph;
+    size_t chunks = ::std::min((size_t)(m_workerThreads + 1) * 4, ::std::min(count, (size_t)64));
+    for (size_t c = 0; c < chunks; c++)
+    {
+        GenPointsTask* task = new GenPointsTask;
+        task->td = TaskDataGenPoints{&sample_generator, points, count * c / chunks, count * (c + 1) / chunks - 1};
+        taskGraph.addTask(unique_ptr<Task>(task));
+    }
+    taskGraph.finalizeGraph();
+    taskGraph.processTasks(m_workerThreads);
+
+    return points;
+}
+
+VoronoiCell* VoronoiGenerator::generate(const glm::dvec3* points, size_t count, size_t gen, bool writeToFile)
+{
+    if (count > MAX_SWEEP_SITES)
+    {
+        ::std::cout << count << " sites is more than a sweep can index\n";
+        return NULL;
+    }
+
     completedCells = 0;
     m_size = count;
     m_gen = gen;
+    m_sweepCount = 6;
     cell_vector = new VoronoiCell[count];
 
     TaskGraph taskGraph; buildTaskGraph(&taskGraph, points);
-    taskGraph.processTasks(6);
+    taskGraph.processTasks(m_workerThreads);
+    if (m_sink) m_sink->finish();
 
-    if (writeToFile) writeDataToOBJ();
+    if (writeToFile) writeDataToOBJ("output/voronoi_data.obj");
     return cell_vector;
 }
 
-VoronoiCell* VoronoiGenerator::generateCap(const glm::dvec3& origin, glm::dvec3* points, int count)
+VoronoiCell* VoronoiGenerator::relax(glm::dvec3* points, size_t count, size_t iterations, double tolerance, RelaxMethod method)
+{
+    m_relaxStats.clear();
+    if (count > MAX_SWEEP_SITES)
+    {
+        ::std::cout << count << " sites is more than a sweep can index\n";
+        return NULL;
+    }
+
+    // the sweeps would hand every iteration's cells to the sink
+    CellSink* sink = m_sink;
+    m_sink = NULL;
+
+    m_size = count;
+    m_gen = count;
+    m_sweepCount = 6;
+    cell_vector = new VoronoiCell[count];
+    m_sortScratch.resize(3 * count);
+
+    vector<glm::dvec3> centroids(count);
+    size_t chunks = ::std::max(::std::min((size_t)(m_workerThreads + 1) * 4, ::std::min(count, (size_t)64)), (size_t)1);
+    vector<double> energy(chunks);
+    vector<double> movement(chunks);
+
+    // an accelerated step is undone by going back to the last accepted
+    // points and taking the Lloyd step from them
+    AndersonMixer mixer(ANDERSON_DEPTH, m_workerThreads);
+    vector<glm::dvec3> accepted;
+    vector<glm::dvec3> lloyd;
+    if (method == RelaxAnderson)
+    {
+        mixer.reset(count);
+        accepted.resize(count);
+        lloyd.resize(count);
+    }
+    double acceptedEnergy = 0.0;
+    bool accelerated = false;
+    size_t moves = 0;
+
+    for (size_t it = 0; ; it++)
+    {
+        auto start = ::std::chrono::steady_clock::now();
+
+        completedCells = 0;
+        {
+            TaskGraph taskGraph; buildTaskGraph(&taskGraph, points, it > 0);
+            taskGraph.processTasks(m_workerThreads);
+        }
+
+        TaskGraph taskGraph;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            RelaxCellsTask* task = new RelaxCellsTask;
+            task->td = TaskDataRelax{cell_vector, points, centroids.data(), count * c / chunks, count * (c + 1) / chunks - 1, &energy[c], &movement[c]};
+            taskGraph.addTask(unique_ptr<Task>(task));
+        }
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(m_workerThreads);
+
+        RelaxStats stats = {};
+        for (size_t c = 0; c < chunks; c++)
+        {
+            stats.energy += energy[c];
+            stats.movement = ::std::max(stats.movement, movement[c]);
+        }
+        stats.rejected = accelerated && stats.energy > acceptedEnergy;
+
+        bool converged = !stats.rejected && it > 0 && acceptedEnergy - stats.energy <= tolerance * acceptedEnergy;
+        bool done = converged || moves == iterations;
+        if (stats.rejected)
+        {
+            // with no moves left the accepted points are generated again
+            mixer.reset(count);
+            ::std::copy(moves < iterations ? lloyd.begin() : accepted.begin(), moves < iterations ? lloyd.end() : accepted.end(), points);
+            moves += moves < iterations;
+            done = false;
+        }
+        else if (!done && method == RelaxAnderson)
+        {
+            ::std::copy(points, points + count, accepted.begin());
+            ::std::copy(centroids.begin(), centroids.end(), lloyd.begin());
+            mixer.step(points, centroids.data(), points);
+            moves++;
+        }
+        else if (!done)
+        {
+            ::std::copy(centroids.begin(), centroids.end(), points);
+            moves++;
+        }
+        accelerated = !stats.rejected && !done && mixer.getHistory() > 0;
+        if (!stats.rejected)
+            acceptedEnergy = stats.energy;
+
+        stats.ms = ::std::chrono::duration<double, ::std::milli>(::std::chrono::steady_clock::now() - start).count();
+        m_relaxStats.push_back(stats);
+        if (done)
+            break;
+    }
+
+    vector<VoronoiSite>().swap(m_sortScratch);
+    m_sink = sink;
+    return cell_vector;
+}
+
+// halo of the tiles and ring of a split cap, in mean point spacings
+static const double CAP_JOB_HALO = 4.0;
+
+// degrees between +X and the origin of a cap swept whole as one job
+static const double CAP_JOB_TILT = 30.0;
+
+// rotation taking v to +X
+static glm::dmat4 rotationToX(const glm::dvec3 & v)
+{
+    glm::dvec3 n = glm::normalize(v);
+    glm::dvec3 axis = glm::cross(n, glm::dvec3(1.0, 0.0, 0.0));
+    double length = glm::length(axis);
+
+    // glm::rotate takes degrees
+    if (length < 1e-12)
+        return n.x > 0.0 ? glm::dmat4(1.0) : glm::rotate(glm::dmat4(1.0), 180.0, glm::dvec3(0.0, 0.0, 1.0));
+    return glm::rotate(glm::dmat4(1.0), glm::degrees(atan2(length, n.x)), axis / length);
+}
+
+VoronoiCell* VoronoiGenerator::generateCap(const glm::dvec3& origin, const glm::dvec3* points, size_t count)
+{
+    VoronoiCell* cells = generateCapCells(origin, points, count);
+    if (cells && m_sink) m_sink->finish();
+    return cells;
+}
+
+vector<VoronoiCell*> VoronoiGenerator::generateCaps(const CapInput* caps, size_t count)
+{
+    vector<VoronoiCell*> cells(count, NULL);
+    vector<unique_ptr<CapJob>> jobs;
+
+    // every small cap is one job of a shared graph
+    TaskGraph taskGraph;
+    for (size_t c = 0; c < count; c++)
+    {
+        const CapInput & cap = caps[c];
+        if (cap.count < 3 || cap.count >= CAP_SPLIT_MIN)
+            continue;
+
+        cells[c] = new VoronoiCell[cap.count];
+        jobs.emplace_back(new CapJob);
+        CapJob & job = *jobs.back();
+        // the origin is often a site itself, and a site on the start pole of
+        // the sweep has no azimuth, so the cap is tilted off +X
+        job.rotation = glm::rotate(glm::dmat4(1.0), CAP_JOB_TILT, glm::dvec3(0.0, 0.0, 1.0)) * rotationToX(cap.origin);
+        job.rotation_inv = glm::inverse(job.rotation);
+        job.kind = CapCells;
+        job.complete = true;
+        job.cells = NULL;
+        job.indices.resize(cap.count);
+        for (size_t i = 0; i < cap.count; i++)
+            job.indices[i] = i;
+        job.coreCount = cap.count;
+        generateCapJobTasks(&taskGraph, &job, cap.points, cells[c]);
+    }
+    taskGraph.finalizeGraph();
+    taskGraph.processTasks(m_workerThreads);
+
+    SweepStats stats = {};
+    size_t completed = 0;
+    auto addStats = [&](const SweepStats & s)
+    {
+        stats.siteEvents += s.siteEvents;
+        stats.circleEvents += s.circleEvents;
+        stats.wastedSiteEvents += s.wastedSiteEvents;
+        stats.wastedCircleEvents += s.wastedCircleEvents;
+        stats.discardedCorners += s.discardedCorners;
+        stats.cellsCompleted += s.cellsCompleted;
+    };
+    for (unique_ptr<CapJob> & job : jobs)
+    {
+        addStats(job->stats);
+        completed += job->completed;
+    }
+
+    // large caps are split across the workers on their own
+    for (size_t c = 0; c < count; c++)
+    {
+        if (caps[c].count < CAP_SPLIT_MIN)
+            continue;
+        cells[c] = generateCapCells(caps[c].origin, caps[c].points, caps[c].count);
+        addStats(m_sweepStats[0]);
+        completed += completedCells;
+    }
+
+    m_sweepCount = 1;
+    m_sweepStats[0] = stats;
+    completedCells = completed;
+    cell_vector = NULL;
+    m_size = 0;
+    m_gen = 0;
+    if (m_sink) m_sink->finish();
+
+    return cells;
+}
+
+// a sweep of a tiled run, over points read from the tile store
+struct TileRun
+{
+    CapJob job;
+    vector<uint64_t> indices;  // input point of each point of the run
+    vector<glm::dvec3> points;
+    vector<uint64_t> slots;    // cell of the result file of each core point
+    vector<double> covered;    // every point within this of a core point is in the run
+    unique_ptr<VoronoiCell[]> cells;
+
+    void add(const TilePoint & p)
+    {
+        indices.push_back(p.index);
+        points.push_back(p.position);
+    }
+
+    void start(size_t core)
+    {
+        cells.reset(new VoronoiCell[core]);
+        job.cells = NULL;
+        job.coreCount = core;
+        job.indices.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+            job.indices[i] = i;
+    }
+};
+
+static inline uint32_t resultFlags(bool measures)
+{
+#ifdef CENTROID
+    uint32_t flags = ResultCentroids | ResultClockwise;
+#else
+    uint32_t flags = ResultClockwise;
+#endif
+    return measures ? flags | ResultMeasures : flags;
+}
+
+bool VoronoiGenerator::generateTiled(const glm::dvec3* points, size_t count, const char* path, size_t tilePoints)
 {
-    if (count < 3) return NULL;
+    if (count < 3) return false;
+
+    ::std::string scratch = ::std::string(path) + ".tiles";
+    TileStore store(m_workerThreads);
+    if (!store.build(points, count, tilePoints, getTileHalo(count), scratch.c_str()))
+    {
+        ::std::cout << store.getError() << "\n";
+        return false;
+    }
+    return generateTiled(store, path);
+}
+
+bool VoronoiGenerator::generateTiled(const char* input, const char* path, size_t tilePoints)
+{
+    struct stat st;
+    if (stat(input, &st) != 0 || st.st_size % sizeof(glm::dvec3) != 0)
+    {
+        ::std::cout << "Unable to read points from " << input << "\n";
+        return false;
+    }
+    size_t count = st.st_size / sizeof(glm::dvec3);
+    if (count < 3) return false;
+
+    ::std::string scratch = ::std::string(path) + ".tiles";
+    TileStore store(m_workerThreads);
+    if (!store.build(input, count, tilePoints, getTileHalo(count), scratch.c_str()))
+    {
+        ::std::cout << store.getError() << "\n";
+        return false;
+    }
+    return generateTiled(store, path);
+}
+
+bool VoronoiGenerator::generateTiled(const TileStore & store, const char* path)
+{
+    #ifdef ENABLE_TIMERS
+    boost::timer::auto_cpu_timer t;
+    #endif
+
+    ResultWriter writer(m_workerThreads);
+    if (!writer.open(path, store.getPointCount(), resultFlags(m_measureCells)))
+    {
+        ::std::cout << writer.getError() << "\n";
+        return false;
+    }
+
+    // every cell goes to the slot of its input point
+    vector<size_t> tiles(store.getTileCount());
+    for (size_t t = 0; t < tiles.size(); t++)
+        tiles[t] = t;
+
+    if (!generateTiles(store, tiles, NULL, writer) || !writer.finish())
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
+
+    ::std::cout << "Data written to: " << path << "\n";
+    return true;
+}
+
+double VoronoiGenerator::getTileHalo(size_t count)
+{
+    return CAP_JOB_HALO * sqrt(4.0 * M_PI / ::std::max(count, (size_t)1));
+}
+
+bool VoronoiGenerator::generateShard(const TileStore & store, const vector<size_t> & tiles, const char* path)
+{
+    // the cells of each tile follow those of the tiles before it
+    vector<uint64_t> bases(tiles.size());
+    uint64_t cells = 0;
+    for (size_t k = 0; k < tiles.size(); k++)
+    {
+        bases[k] = cells;
+        cells += store.getCoreCount(tiles[k]);
+    }
+
+    ResultWriter writer(m_workerThreads);
+    if (!writer.open(path, cells, resultFlags(m_measureCells)))
+    {
+        ::std::cout << writer.getError() << "\n";
+        return false;
+    }
+
+    if (!generateTiles(store, tiles, bases.data(), writer) || !writer.finish())
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
+    return true;
+}
+
+bool VoronoiGenerator::generateTiles(const TileStore & store, const vector<size_t> & tiles, const uint64_t* bases, ResultWriter & writer)
+{
+    const SphereGrid & grid = store.getGrid();
+    size_t count = store.getPointCount();
+    size_t tileCount = store.getTileCount();
+    double gather = grid.getBinRadius() + store.getHalo();
+
+    // the cells of the runs are local to them
+    CellSink* sink = m_sink;
+    m_sink = NULL;
+
+    SweepStats stats = {};
+    SphereGrid::Query query;
+    bool ok = true;
+
+    for (size_t first = 0; first < tiles.size() && ok; first += m_workerThreads + 1)
+    {
+        // one tile per worker, swept as a cap around the tile center
+        vector<unique_ptr<TileRun>> pending;
+        vector<TilePoint> read;
+        for (size_t k = first; k < ::std::min(tiles.size(), first + m_workerThreads + 1) && ok; k++)
+        {
+            size_t t = tiles[k];
+            size_t core = store.getCoreCount(t);
+            if (core == 0)
+                continue;
+
+            ok = store.readTile(t, read);
+
+            // a sweep needs 3 sites, a tile short of them takes the core
+            // points of the tiles around it, twice as far each time
+            glm::dvec3 center = grid.getBinCenter(t);
+            double radius = gather;
+            while (read.size() < 3 && radius < M_PI && ok)
+            {
+                radius = ::std::min(2.0 * radius, M_PI);
+                read.resize(core);
+                grid.forEachBinInCap(center, radius, query, [&](size_t b)
+                {
+                    if (b != t && ok) ok = store.readCore(b, read);
+                });
+            }
+
+            pending.emplace_back(new TileRun);
+            TileRun & run = *pending.back();
+            for (const TilePoint & p : read)
+                run.add(p);
+            for (size_t i = 0; i < core; i++)
+                run.slots.push_back(bases ? bases[k] + i : read[i].index);
+            run.covered.assign(core, store.getHalo());
+
+            CapJob & job = run.job;
+            job.rotation = glm::rotate(glm::dmat4(1.0), CAP_JOB_TILT, glm::dvec3(0.0, 0.0, 1.0)) * rotationToX(center);
+            job.rotation_inv = glm::inverse(job.rotation);
+            job.kind = CapDisk;
+            job.diskCenter = glm::dvec3(job.rotation * glm::dvec4(center, 1.0));
+            job.diskRadius = radius;
+            job.complete = read.size() == count;
+            run.start(core);
+        }
+
+        while (!pending.empty() && ok)
+        {
+            TaskGraph taskGraph;
+            for (unique_ptr<TileRun> & run : pending)
+                generateCapJobTasks(&taskGraph, &run->job, run->points.data(), run->cells.get());
+            taskGraph.finalizeGraph();
+            taskGraph.processTasks(m_workerThreads);
+
+            // certified cells are written, the others are swept again with
+            // the core points of every tile within their reach. A cell left
+            // open has no reach yet, it takes twice what its run covered.
+            vector<unique_ptr<TileRun>> retries;
+            for (unique_ptr<TileRun> & run : pending)
+            {
+                const CapJob & job = run->job;
+                stats.siteEvents += job.stats.siteEvents;
+                stats.circleEvents += job.stats.circleEvents;
+                stats.wastedSiteEvents += job.stats.wastedSiteEvents;
+                stats.wastedCircleEvents += job.stats.wastedCircleEvents;
+                stats.discardedCorners += job.stats.discardedCorners;
+                stats.cellsCompleted += job.stats.cellsCompleted;
+                ok = writer.write(run->cells.get(), run->slots.data(), run->slots.size()) && ok;
+
+                if (job.coreCount == 0)
+                    continue;
+
+                retries.emplace_back(new TileRun);
+                TileRun & retry = *retries.back();
+                vector<size_t> bins;
+                bool all = false;
+                for (size_t k = 0; k < job.coreCount; k++)
+                {
+                    size_t i = job.indices[k];
+                    double reach = job.reach[k] < M_PI ? job.reach[k] : ::std::min(2.0 * run->covered[i], M_PI);
+                    retry.indices.push_back(run->indices[i]);
+                    retry.points.push_back(run->points[i]);
+                    retry.slots.push_back(run->slots[i]);
+                    retry.covered.push_back(reach);
+                    all = all || reach >= M_PI;
+                    if (!all)
+                        grid.forEachBinInCap(run->points[i], reach, query, [&](size_t b) { bins.push_back(b); });
+                }
+
+                if (all)
+                {
+                    bins.resize(tileCount);
+                    for (size_t b = 0; b < tileCount; b++)
+                        bins[b] = b;
+                }
+                ::std::sort(bins.begin(), bins.end());
+                bins.erase(::std::unique(bins.begin(), bins.end()), bins.end());
+
+                vector<uint64_t> own(retry.indices);
+                ::std::sort(own.begin(), own.end());
+                for (size_t b : bins)
+                {
+                    read.clear();
+                    ok = store.readCore(b, read) && ok;
+                    for (const TilePoint & p : read)
+                        if (!::std::binary_search(own.begin(), own.end(), p.index))
+                            retry.add(p);
+                }
+
+                retry.job.rotation = job.rotation;
+                retry.job.rotation_inv = job.rotation_inv;
+                retry.job.kind = CapCells;
+                retry.job.reach = retry.covered;
+                retry.job.complete = retry.points.size() == count;
+                retry.start(job.coreCount);
+            }
+            pending.swap(retries);
+        }
+    }
+
+    m_sink = sink;
+    m_sweepCount = 1;
+    m_sweepStats[0] = stats;
+    completedCells = count;
+    cell_vector = NULL;
+    m_size = 0;
+    m_gen = 0;
+    return ok;
+}
+
+VoronoiCell* VoronoiGenerator::generateCapCells(const glm::dvec3& origin, const glm::dvec3* points, size_t count)
+{
+    if (count < 3 || count > MAX_SWEEP_SITES) return NULL;
 
     completedCells = 0;
     m_size = count;
     m_gen = count;
+    m_sweepCount = 1;
     cell_vector = new VoronoiCell[count];
 
-    glm::dvec3* points_copy = new glm::dvec3[m_size];
-    for (size_t i = 0; i < m_size; i++)
-        points_copy[i] = points[i];
+    if (m_size >= CAP_SPLIT_MIN && generateSplitCap(origin, points))
+        return cell_vector;
 
-    TaskGraph taskGraph; buildCapTaskGraph(&taskGraph, origin, points_copy);
+    m_sitesX.resize(m_size);
+
+    // points are rotated as the sites are built, the caller's buffer is only read
+    TaskGraph taskGraph; buildCapTaskGraph(&taskGraph, origin, points);
     taskGraph.processTasks(2);
 
-    delete[] points_copy;
-    
     return cell_vector;
 }
 
-void VoronoiGenerator::buildTaskGraph(TaskGraph* tg, glm::dvec3* points)
+bool VoronoiGenerator::generateSplitCap(const glm::dvec3& origin, const glm::dvec3* points)
+{
+    // cap frame, origin at +X
+    glm::dmat4 toCap = rotationToX(origin);
+    auto capPoint = [&](size_t i) { return glm::dvec3(toCap * glm::dvec4(points[i], 1.0)); };
+
+    double minX = 1.0;
+    for (size_t i = 0; i < m_size; i++)
+        minX = ::std::min(minX, capPoint(i).x);
+
+    // tiles are squares of the y,z plane, which stretches too much for wide caps
+    double capRadius = acos(glm::clamp(minX, -1.0, 1.0));
+    if (capRadius > M_PI / 3.0)
+        return false;
+
+    double spacing = sqrt(2.0 * M_PI * (1.0 - minX) / m_size);
+    double halo = CAP_JOB_HALO * spacing;
+    double ringRadius = capRadius - 2.0 * halo;
+    if (ringRadius < 4.0 * halo)
+        return false;
+
+    // a grid of tiles over the inside of the ring, each at least 2 halos wide
+    double extent = sin(ringRadius);
+    size_t tiles = ::std::min((size_t)8, 2 * (size_t)ceil(sqrt(m_workerThreads + 1.0)));
+    tiles = ::std::max((size_t)1, ::std::min(tiles, (size_t)(extent / halo)));
+    double tileWidth = 2.0 * extent / tiles;
+    auto tileCoord = [&](double v) { return (long)glm::clamp((v + extent) / tileWidth, 0.0, tiles - 1.0); };
+
+    vector<unique_ptr<CapJob>> jobs(tiles * tiles + 1);
+    for (size_t t = 0; t < jobs.size(); t++)
+    {
+        jobs[t].reset(new CapJob);
+        CapJob & job = *jobs[t];
+        job.rotation = toCap;
+        job.rotation_inv = glm::inverse(toCap);
+        job.kind = t == tiles * tiles ? CapRing : CapTile;
+        job.tileCenter = glm::dvec2(-extent + (t % tiles + 0.5) * tileWidth, -extent + (t / tiles + 0.5) * tileWidth);
+        job.tileHalfWidth = 0.5 * tileWidth;
+        job.ringRadius = ringRadius;
+        job.halo = halo;
+        job.complete = false;
+        job.cells = NULL;
+    }
+    CapJob & ring = *jobs.back();
+
+    auto inJob = [](const CapJob & job, const glm::dvec3 & p)
+    {
+        if (job.kind == CapRing)
+            return p.x <= cos(job.ringRadius - job.halo);
+        double reach = job.tileHalfWidth + job.halo;
+        return fabs(p.y - job.tileCenter.x) <= reach && fabs(p.z - job.tileCenter.y) <= reach;
+    };
+
+    // core points, the ring takes those beyond ringRadius
+    double ringCos = cos(ringRadius);
+    for (size_t i = 0; i < m_size; i++)
+    {
+        glm::dvec3 p = capPoint(i);
+        if (p.x <= ringCos)
+            ring.indices.push_back(i);
+        else
+            jobs[tileCoord(p.z) * tiles + tileCoord(p.y)]->indices.push_back(i);
+    }
+    for (unique_ptr<CapJob> & job : jobs)
+        job->coreCount = job->indices.size();
+
+    // halo points
+    for (size_t i = 0; i < m_size; i++)
+    {
+        glm::dvec3 p = capPoint(i);
+        bool ringCore = p.x <= ringCos;
+        if (!ringCore && inJob(ring, p))
+            ring.indices.push_back(i);
+
+        size_t own = ringCore ? jobs.size() : tileCoord(p.z) * tiles + tileCoord(p.y);
+        for (long z = ::std::max(0L, tileCoord(p.z - halo) - 1); z <= ::std::min((long)tiles - 1, tileCoord(p.z + halo) + 1); z++)
+            for (long y = ::std::max(0L, tileCoord(p.y - halo) - 1); y <= ::std::min((long)tiles - 1, tileCoord(p.y + halo) + 1); y++)
+            {
+                size_t t = z * tiles + y;
+                if (t != own && jobs[t]->coreCount && inJob(*jobs[t], p))
+                    jobs[t]->indices.push_back(i);
+            }
+    }
+
+    // a sweep needs 3 sites, a tile short of them takes every point
+    vector<CapJob*> pending;
+    for (unique_ptr<CapJob> & job : jobs)
+    {
+        if (job->coreCount == 0)
+            continue;
+        if (job->indices.size() < 3)
+        {
+            job->complete = true;
+            job->indices.resize(job->coreCount);
+            for (size_t i = 0; i < m_size; i++)
+                if (::std::find(job->indices.begin(), job->indices.begin() + job->coreCount, i) == job->indices.begin() + job->coreCount)
+                    job->indices.push_back(i);
+        }
+        pending.push_back(job.get());
+    }
+
+    // cells left uncertain are swept again with every point within the
+    // reach their last run says they need, found through a grid
+    SphereGrid grid;
+    SphereGrid::Query query;
+    vector<size_t> stamp;
+    size_t nextStamp = 0;
+    vector<unique_ptr<CapJob>> retries;
+
+    m_sweepStats[0] = {};
+    while (!pending.empty())
+    {
+        TaskGraph taskGraph;
+        for (CapJob* job : pending)
+            generateCapJobTasks(&taskGraph, job, points, cell_vector);
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(m_workerThreads);
+
+        vector<size_t> cells;
+        vector<double> reach;
+        for (CapJob* job : pending)
+        {
+            SweepStats & s = m_sweepStats[0];
+            s.siteEvents += job->stats.siteEvents;
+            s.circleEvents += job->stats.circleEvents;
+            s.wastedSiteEvents += job->stats.wastedSiteEvents;
+            s.wastedCircleEvents += job->stats.wastedCircleEvents;
+            s.discardedCorners += job->stats.discardedCorners;
+
+            cells.insert(cells.end(), job->indices.begin(), job->indices.begin() + job->coreCount);
+            reach.insert(reach.end(), job->reach.begin(), job->reach.begin() + job->coreCount);
+        }
+        pending.clear();
+        if (cells.empty())
+            break;
+
+        if (stamp.empty())
+        {
+            grid.build(points, m_size, m_workerThreads);
+            stamp.assign(m_size, 0);
+        }
+
+        size_t chunks = ::std::min((size_t)(m_workerThreads + 1) * 4, ::std::min(cells.size(), (size_t)64));
+        retries.clear();
+        for (size_t c = 0; c < chunks; c++)
+        {
+            retries.emplace_back(new CapJob);
+            CapJob & job = *retries.back();
+            job.rotation = toCap;
+            job.rotation_inv = glm::inverse(toCap);
+            job.kind = CapCells;
+            job.complete = false;
+            job.cells = NULL;
+
+            size_t first = cells.size() * c / chunks;
+            size_t last = cells.size() * (c + 1) / chunks;
+            job.indices.assign(cells.begin() + first, cells.begin() + last);
+            job.reach.assign(reach.begin() + first, reach.begin() + last);
+            job.coreCount = job.indices.size();
+
+            size_t id = ++nextStamp;
+            for (size_t i : job.indices)
+                stamp[i] = id;
+            for (size_t k = 0; k < job.coreCount && !job.complete; k++)
+            {
+                job.complete = job.reach[k] >= M_PI;
+                double cosReach = cos(job.reach[k]);
+                const glm::dvec3 & site = points[job.indices[k]];
+                grid.forEachInCap(site, job.reach[k], query, [&](size_t i, const glm::dvec3 & p)
+                {
+                    if (stamp[i] != id && glm::dot(p, site) >= cosReach)
+                    {
+                        stamp[i] = id;
+                        job.indices.push_back(i);
+                    }
+                });
+            }
+            if (job.complete)
+            {
+                job.indices.resize(job.coreCount);
+                for (size_t i = 0; i < m_size; i++)
+                    if (stamp[i] != id)
+                        job.indices.push_back(i);
+            }
+            pending.push_back(&job);
+        }
+    }
+
+    m_sweepStats[0].cellsCompleted = m_size;
+    completedCells = m_size;
+    return true;
+}
+
+void VoronoiGenerator::generateCapJobTasks(TaskGraph* tg, CapJob* job, const glm::dvec3* points, VoronoiCell* output)
+{
+    InitCapJobTask* init = new InitCapJobTask;
+    init->td = { job, points, output, m_sink };
+    tg->addTask(unique_ptr<Task>(init));
+
+    SweepTask<Increasing, X>* sweep = new SweepTask<Increasing, X>;
+    sweep->td = { &job->sites, job->indices.size(), 1, &job->stats, NULL, NULL, &job->completed, isWideSweep(job->sites.size()), m_floatSweeps };
+    tg->addTask(unique_ptr<Task>(sweep));
+    tg->addDependency(init, sweep);
+
+    CollectCapJobTask* collect = new CollectCapJobTask;
+    collect->td = { job, points, output, m_sink };
+    tg->addTask(unique_ptr<Task>(collect));
+    tg->addDependency(sweep, collect);
+}
+
+void VoronoiGenerator::buildTaskGraph(TaskGraph* tg, const glm::dvec3* points, bool warm)
 {
     SyncTask* sync;
     SyncXYZ syncXYZ;
 
-    generateInitCellsTasks(tg, points, sync);
-    generateInitSitesTasks(tg, sync, syncXYZ);
-    generateSortPointsTasks(tg, syncXYZ);
+    generateInitCellsTasks(tg, points, sync, warm);
+    generateInitSitesTasks(tg, sync, syncXYZ, warm);
+    generateSortPointsTasks(tg, syncXYZ, warm);
     generateSweepTasks(tg, syncXYZ, sync);
-    generateSortCellCornersTasks(tg, sync, 6);
 
     tg->finalizeGraph();
 }
 
-void VoronoiGenerator::buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin, glm::dvec3* points)
+void VoronoiGenerator::buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin, const glm::dvec3* points)
 {
     SyncTask* sync;
 
@@ -103,12 +845,10 @@ void VoronoiGenerator::buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin
     glm::dmat4 rotation = glm::rotate(glm::dmat4(1.0), angle, rotation_axis);
     glm::dmat4 rotation_inv = glm::rotate(glm::dmat4(1.0), -angle, rotation_axis);
 
-    generateRotatePointsTasks(tg, sync, rotation, points);
-    generateCapInitCellsTasks(tg, points, sync);
-    generateCapInitSitesTasks(tg, sync);
+    generateCapInitCellsTasks(tg, points, rotation, sync);
     generateCapSortPointsTasks(tg, sync);
     generateCapSweepTasks(tg, sync);
-    generateCapSortCellCornersTasks(tg, sync, 2, rotation_inv);
+    generateCapRotateCellsTasks(tg, sync, 2, points, rotation_inv);
 
     tg->finalizeGraph();
 }
@@ -116,8 +856,9 @@ void VoronoiGenerator::buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin
 inline void VoronoiGenerator
 ::generateInitCellsTasks(
     TaskGraph * tg, 
-    glm::dvec3 * points, 
-    SyncTask *& syncOut)
+    const glm::dvec3 * points, 
+    SyncTask *& syncOut,
+    bool warm)
 {
     syncOut = new SyncTask;
     tg->addTask(unique_ptr<Task>(syncOut));
@@ -129,42 +870,48 @@ inline void VoronoiGenerator
         tg->addDependency(task, syncOut);
     };
 
-    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,0,(size_t)(1.f / 6.f * m_size) - 1});
-    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,(size_t)(1.f / 6.f * m_size), (size_t)(2.f / 6.f * m_size) - 1});
-    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,(size_t)(2.f / 6.f * m_size), (size_t)(3.f / 6.f * m_size) - 1});
-    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,(size_t)(3.f / 6.f * m_size), (size_t)(4.f / 6.f * m_size) - 1, &m_sitesX, m_size});
-    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,(size_t)(4.f / 6.f * m_size), (size_t)(5.f / 6.f * m_size) - 1, &m_sitesY, m_size});
-    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,(size_t)(5.f / 6.f * m_size), m_size - 1, &m_sitesZ, m_size});
+    if (warm)
+    {
+        for (size_t i = 0; i < 6; i++)
+            addTask(new ResetCellsTask, TaskDataCells{cell_vector, points, m_size * i / 6, m_size * (i + 1) / 6 - 1});
+        return;
+    }
+
+    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,0,m_size / 6 - 1});
+    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,m_size / 6, m_size * 2 / 6 - 1});
+    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,m_size * 2 / 6, m_size * 3 / 6 - 1});
+    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,m_size * 3 / 6, m_size * 4 / 6 - 1, &m_sitesX, m_size});
+    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,m_size * 4 / 6, m_size * 5 / 6 - 1, &m_sitesY, m_size});
+    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,m_size * 5 / 6, m_size - 1, &m_sitesZ, m_size});
 }
 
 inline void VoronoiGenerator
 ::generateCapInitCellsTasks(
     TaskGraph * tg, 
-    glm::dvec3 * points, 
-    SyncTask *& syncInOut)
+    const glm::dvec3 * points, 
+    glm::dmat4 rotation,
+    SyncTask *& syncOut)
 {
-    SyncTask* sync = new SyncTask;
-    tg->addTask(unique_ptr<Task>(sync));
+    syncOut = new SyncTask;
+    tg->addTask(unique_ptr<Task>(syncOut));
 
     auto addTask = [&](auto task, auto && td)
     {
         task->td = move(td);
         tg->addTask(unique_ptr<Task>(task));
-        tg->addDependency(syncInOut, task);
-        tg->addDependency(task, sync);
+        tg->addDependency(task, syncOut);
     };
 
-    addTask(new InitCellsTask, TaskDataCells{cell_vector,points,0,(size_t)(m_size/2.f) - 1});
-    addTask(new InitCellsAndResizeSitesTask, TaskDataCellsResize{cell_vector,points,(size_t)(m_size/2.f), m_size-1, &m_sitesX, m_size});
-
-    syncInOut = sync;
+    addTask(new InitCapCellsTask, TaskDataCapCells{cell_vector, points, 0, m_size/2 - 1, rotation, &m_sitesX});
+    addTask(new InitCapCellsTask, TaskDataCapCells{cell_vector, points, m_size/2, m_size-1, rotation, &m_sitesX});
 }
 
 inline void VoronoiGenerator
 ::generateInitSitesTasks(
     TaskGraph * tg, 
     SyncTask * syncIn, 
-    SyncXYZ & syncOut)
+    SyncXYZ & syncOut,
+    bool warm)
 {
     syncOut.syncX = new SyncTask;
     syncOut.syncY = new SyncTask;
@@ -181,6 +928,17 @@ inline void VoronoiGenerator
         tg->addDependency(task, sync);
     };
 
+    if (warm)
+    {
+        addTask(new UpdateSitesTask<X>, TaskDataSites{cell_vector, 0, m_size / 2 - 1, &m_sitesX}, syncOut.syncX);
+        addTask(new UpdateSitesTask<X>, TaskDataSites{cell_vector, m_size / 2, m_size - 1, &m_sitesX}, syncOut.syncX);
+        addTask(new UpdateSitesTask<Y>, TaskDataSites{cell_vector, 0, m_size / 2 - 1, &m_sitesY}, syncOut.syncY);
+        addTask(new UpdateSitesTask<Y>, TaskDataSites{cell_vector, m_size / 2, m_size - 1, &m_sitesY}, syncOut.syncY);
+        addTask(new UpdateSitesTask<Z>, TaskDataSites{cell_vector, 0, m_size / 2 - 1, &m_sitesZ}, syncOut.syncZ);
+        addTask(new UpdateSitesTask<Z>, TaskDataSites{cell_vector, m_size / 2, m_size - 1, &m_sitesZ}, syncOut.syncZ);
+        return;
+    }
+
     addTask(new InitSitesTask<X>, TaskDataSites{cell_vector, 0, m_size / 2 - 1, &m_sitesX}, syncOut.syncX);
     addTask(new InitSitesTask<X>, TaskDataSites{cell_vector, m_size / 2, m_size - 1, &m_sitesX}, syncOut.syncX);
     addTask(new InitSitesTask<Y>, TaskDataSites{cell_vector, 0, m_size / 2 - 1, &m_sitesY}, syncOut.syncY);
@@ -189,50 +947,7 @@ inline void VoronoiGenerator
     addTask(new InitSitesTask<Z>, TaskDataSites{cell_vector, m_size / 2, m_size - 1, &m_sitesZ}, syncOut.syncZ);
 }
 
-inline void VoronoiGenerator
-::generateRotatePointsTasks(
-    TaskGraph * tg, 
-    SyncTask *& syncOut,
-    glm::dmat4 rotation,
-    glm::dvec3* points)
-{
-    syncOut = new SyncTask;
-    tg->addTask(unique_ptr<Task>(syncOut));
-
-    auto addTask = [&](auto task, auto && td)
-    {
-        task->td = move(td);
-        tg->addTask(unique_ptr<Task>(task));
-        tg->addDependency(task, syncOut);
-    };
-
-    addTask(new RotatePointsTask, TaskDataRotatePoints{points,0,m_size/2 - 1, rotation});
-    addTask(new RotatePointsTask, TaskDataRotatePoints{points,m_size/2, m_size-1, rotation});
-}
-
-inline void VoronoiGenerator
-::generateCapInitSitesTasks(
-    TaskGraph * tg, 
-    SyncTask *& syncInOut)
-{
-    SyncTask* syncX = new SyncTask;
-    tg->addTask(unique_ptr<Task>(syncX));
-
-    auto addTask = [&](auto task, auto && td)
-    {
-        task->td = move(td);
-        tg->addTask(unique_ptr<Task>(task));
-        tg->addDependency(syncInOut, task);
-        tg->addDependency(task, syncX);
-    };
-
-    addTask(new InitSitesTask<X>, TaskDataSites{cell_vector, 0, m_size/2 - 1, &m_sitesX});
-    addTask(new InitSitesTask<X>, TaskDataSites{cell_vector, m_size/2, m_size-1, &m_sitesX});
-
-    syncInOut = syncX;
-}
-
-inline void VoronoiGenerator::generateSortPointsTasks(TaskGraph * tg, SyncXYZ & syncInOut)
+inline void VoronoiGenerator::generateSortPointsTasks(TaskGraph * tg, SyncXYZ & syncInOut, bool warm)
 {
     auto p_tempsX1 = new promise<VoronoiSite*>; auto p_tempsX2 = new promise<VoronoiSite*>;
     auto p_tempsY1 = new promise<VoronoiSite*>; auto p_tempsY2 = new promise<VoronoiSite*>;
@@ -257,12 +972,18 @@ inline void VoronoiGenerator::generateSortPointsTasks(TaskGraph * tg, SyncXYZ &
     #define UA unique_ptr<promise<VoronoiSite*>>
     #define UB unique_ptr<promise<bool>>
     #define TD TaskDataDualSort
-    addTask(new SortPoints1Task, TD{&m_sitesX, UA(p_tempsX1), UB(p_doneX1), p_tempsX2->get_future(), p_doneX2->get_future()}, syncInOut.syncX, syncX);
-    addTask(new SortPoints2Task, TD{&m_sitesX, UA(p_tempsX2), UB(p_doneX2), p_tempsX1->get_future(), p_doneX1->get_future()}, syncInOut.syncX, syncX);
-    addTask(new SortPoints1Task, TD{&m_sitesY, UA(p_tempsY1), UB(p_doneY1), p_tempsY2->get_future(), p_doneY2->get_future()}, syncInOut.syncY, syncY);
-    addTask(new SortPoints2Task, TD{&m_sitesY, UA(p_tempsY2), UB(p_doneY2), p_tempsY1->get_future(), p_doneY1->get_future()}, syncInOut.syncY, syncY);
-    addTask(new SortPoints1Task, TD{&m_sitesZ, UA(p_tempsZ1), UB(p_doneZ1), p_tempsZ2->get_future(), p_doneZ2->get_future()}, syncInOut.syncZ, syncZ);
-    addTask(new SortPoints2Task, TD{&m_sitesZ, UA(p_tempsZ2), UB(p_doneZ2), p_tempsZ1->get_future(), p_doneZ1->get_future()}, syncInOut.syncZ, syncZ);
+    // the halves of each axis share one scratch of m_size sites when it is kept
+    VoronoiSite* scratch = m_sortScratch.size() == 3 * m_size ? m_sortScratch.data() : NULL;
+    auto half = [&](size_t axis, size_t second) -> VoronoiSite*
+    {
+        return scratch ? scratch + axis * m_size + second * (m_size / 2) : NULL;
+    };
+    addTask(new SortPoints1Task, TD{&m_sitesX, UA(p_tempsX1), UB(p_doneX1), p_tempsX2->get_future(), p_doneX2->get_future(), warm, half(0, 0)}, syncInOut.syncX, syncX);
+    addTask(new SortPoints2Task, TD{&m_sitesX, UA(p_tempsX2), UB(p_doneX2), p_tempsX1->get_future(), p_doneX1->get_future(), warm, half(0, 1)}, syncInOut.syncX, syncX);
+    addTask(new SortPoints1Task, TD{&m_sitesY, UA(p_tempsY1), UB(p_doneY1), p_tempsY2->get_future(), p_doneY2->get_future(), warm, half(1, 0)}, syncInOut.syncY, syncY);
+    addTask(new SortPoints2Task, TD{&m_sitesY, UA(p_tempsY2), UB(p_doneY2), p_tempsY1->get_future(), p_doneY1->get_future(), warm, half(1, 1)}, syncInOut.syncY, syncY);
+    addTask(new SortPoints1Task, TD{&m_sitesZ, UA(p_tempsZ1), UB(p_doneZ1), p_tempsZ2->get_future(), p_doneZ2->get_future(), warm, half(2, 0)}, syncInOut.syncZ, syncZ);
+    addTask(new SortPoints2Task, TD{&m_sitesZ, UA(p_tempsZ2), UB(p_doneZ2), p_tempsZ1->get_future(), p_doneZ1->get_future(), warm, half(2, 1)}, syncInOut.syncZ, syncZ);
 
     syncInOut.syncX = syncX;
     syncInOut.syncY = syncY;
@@ -306,6 +1027,7 @@ inline void VoronoiGenerator
     syncOut = new SyncTask;
     tg->addTask(unique_ptr<Task>(syncOut));
 
+    bool wide = isWideSweep(m_size);
     auto addTask = [&](auto task, auto && td, SyncTask* syncIn)
     {
         task->td = move(td);
@@ -314,12 +1036,12 @@ inline void VoronoiGenerator
         tg->addDependency(task, syncOut);
     };
 
-    addTask(new SweepTask<Increasing, X>, TaskDataSweep{&m_sitesX, m_gen, 1}, syncIn.syncX);
-    addTask(new SweepTask<Decreasing, X>, TaskDataSweep{&m_sitesX, m_gen, 1 << 1}, syncIn.syncX);
-    addTask(new SweepTask<Increasing, Y>, TaskDataSweep{&m_sitesY, m_gen, 1 << 2}, syncIn.syncY);
-    addTask(new SweepTask<Decreasing, Y>, TaskDataSweep{&m_sitesY, m_gen, 1 << 3}, syncIn.syncY);
-    addTask(new SweepTask<Increasing, Z>, TaskDataSweep{&m_sitesZ, m_gen, 1 << 4}, syncIn.syncZ);
-    addTask(new SweepTask<Decreasing, Z>, TaskDataSweep{&m_sitesZ, m_gen, 1 << 5}, syncIn.syncZ);
+    addTask(new SweepTask<Increasing, X>, TaskDataSweep{&m_sitesX, m_gen, 1, &m_sweepStats[0], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncX);
+    addTask(new SweepTask<Decreasing, X>, TaskDataSweep{&m_sitesX, m_gen, 1 << 1, &m_sweepStats[1], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncX);
+    addTask(new SweepTask<Increasing, Y>, TaskDataSweep{&m_sitesY, m_gen, 1 << 2, &m_sweepStats[2], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncY);
+    addTask(new SweepTask<Decreasing, Y>, TaskDataSweep{&m_sitesY, m_gen, 1 << 3, &m_sweepStats[3], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncY);
+    addTask(new SweepTask<Increasing, Z>, TaskDataSweep{&m_sitesZ, m_gen, 1 << 4, &m_sweepStats[4], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncZ);
+    addTask(new SweepTask<Decreasing, Z>, TaskDataSweep{&m_sitesZ, m_gen, 1 << 5, &m_sweepStats[5], m_sink, cell_vector, NULL, wide, m_floatSweeps}, syncIn.syncZ);
 }
 
 inline void VoronoiGenerator
@@ -328,7 +1050,7 @@ inline void VoronoiGenerator
     SyncTask *& syncInOut)
 {
     SweepTask<Increasing, X>* sweepIX = new SweepTask<Increasing, X>;
-    sweepIX->td = { &m_sitesX, m_gen, 1 };
+    sweepIX->td = { &m_sitesX, m_gen, 1, &m_sweepStats[0], NULL, NULL, NULL, isWideSweep(m_size), m_floatSweeps };
     tg->addTask(unique_ptr<Task>(sweepIX));
     tg->addDependency(syncInOut, sweepIX);
 
@@ -337,128 +1059,201 @@ inline void VoronoiGenerator
     tg->addDependency(sweepIX, syncInOut);
 }
 
-inline void VoronoiGenerator::generateSortCellCornersTasks(TaskGraph * tg, SyncTask * syncIn, size_t threads)
+inline void VoronoiGenerator::generateCapRotateCellsTasks(TaskGraph * tg, SyncTask * syncIn, size_t threads, const glm::dvec3* points, glm::dmat4 rotation)
 {
     for (size_t i = 0; i<threads; i++)
     {
-        SortCellCornersTask* task = new SortCellCornersTask;
-        task->td = { cell_vector, (size_t)(i / (double)threads * m_size), (size_t)((i + 1) / (double)threads * m_size - 1) };
+        RotateCellsTask* task = new RotateCellsTask;
+        task->td = { cell_vector, points, (size_t)(i / (double)threads * m_size), (size_t)((i + 1) / (double)threads * m_size - 1), rotation, m_sink };
         tg->addTask(unique_ptr<Task>(task));
         tg->addDependency(syncIn, task);
     }
 }
 
-inline void VoronoiGenerator::generateCapSortCellCornersTasks(TaskGraph * tg, SyncTask * syncIn, size_t threads, glm::dmat4 rotation)
+void VoronoiGenerator::printSweepStats(FILE* out)
 {
-    for (size_t i = 0; i<threads; i++)
-    {
-        SortCornersRotateTask* task = new SortCornersRotateTask;
-        task->td = { cell_vector, (size_t)(i / (double)threads * m_size), (size_t)((i + 1) / (double)threads * m_size - 1), rotation };
-        tg->addTask(unique_ptr<Task>(task));
-        tg->addDependency(syncIn, task);
-    }
-}
-
-inline void VoronoiGenerator::writeCell(::std::ofstream & os, int i)
-{
-    if (cell_vector[i].m_arcs != 0)
-        return;
-
-    int numCorners = (int)cell_vector[i].corners.size();
+    const char* names[] = { "+X", "-X", "+Y", "-Y", "+Z", "-Z" };
 
-    if (numCorners < 3)
-        return;
+    size_t completed = 0;
+    for (size_t i = 0; i < m_sweepCount; i++)
+        completed += m_sweepStats[i].cellsCompleted;
 
-    os.write(reinterpret_cast <const char*>(&numCorners), sizeof(int));
-#ifdef CENTROID
-    os.write(reinterpret_cast <const char*>(&(cell_vector[i].position.x)), sizeof(double));
-    os.write(reinterpret_cast <const char*>(&(cell_vector[i].position.y)), sizeof(double));
-    os.write(reinterpret_cast <const char*>(&(cell_vector[i].position.z)), sizeof(double));
-#endif
-    for (int j = 0; j < numCorners; j++)
+    fprintf(out, "sweep  site events  wasted  circle events  wasted  discarded corners  completed  coverage\n");
+    for (size_t i = 0; i < m_sweepCount; i++)
     {
-        os.write(reinterpret_cast <const char*>(&(cell_vector[i].corners[j].x)), sizeof(double));
-        os.write(reinterpret_cast <const char*>(&(cell_vector[i].corners[j].y)), sizeof(double));
-        os.write(reinterpret_cast <const char*>(&(cell_vector[i].corners[j].z)), sizeof(double));
+        const SweepStats & s = m_sweepStats[i];
+        fprintf(out, "%-5s  %11zu  %5.1f%%  %13zu  %5.1f%%  %17zu  %9zu  %7.1f%%\n",
+            names[i],
+            s.siteEvents,
+            s.siteEvents ? 100.0 * s.wastedSiteEvents / s.siteEvents : 0.0,
+            s.circleEvents,
+            s.circleEvents ? 100.0 * s.wastedCircleEvents / s.circleEvents : 0.0,
+            s.discardedCorners,
+            s.cellsCompleted,
+            m_size ? 100.0 * s.cellsCompleted / m_size : 0.0);
     }
-        
+    fprintf(out, "cells completed: %zu of %zu\n", completed, m_size);
 }
 
-void VoronoiGenerator::writeDataToFile()
+bool VoronoiGenerator::writeDataToFile(const char* path)
 {
     #ifdef ENABLE_TIMERS
     boost::timer::auto_cpu_timer t;
     #endif
 
-    ::std::ofstream file;
-    file.open("output/voronoi_data", ::std::ofstream::binary);
+    if (cell_vector == NULL || m_size == 0)
+        return false;
+
+    size_t chunks = ::std::min((size_t)(m_workerThreads + 1) * 4, ::std::min(m_size, (size_t)64));
+    vector<size_t> offsets(chunks + 1, 0);
+
+    // bytes written by each chunk of cells
+    {
+        TaskGraph taskGraph;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            RecordSizesTask* task = new RecordSizesTask;
+            task->td = TaskDataRecordSizes{cell_vector, m_size * c / chunks, m_size * (c + 1) / chunks - 1, &offsets[c + 1]};
+            taskGraph.addTask(unique_ptr<Task>(task));
+        }
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(m_workerThreads);
+    }
+
+    for (size_t c = 0; c < chunks; c++)
+        offsets[c + 1] += offsets[c];
 
-    if (!file.is_open())
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, offsets[chunks]) != 0)
     {
         ::std::cout << "Unable to write data to file.\n";
-        return;
+        if (fd >= 0) close(fd);
+        return false;
     }
 
-    for (size_t i = 0; i < m_size; i++)
-        writeCell(file, i);
+    vector<char> ok(chunks, 1);
+    {
+        TaskGraph taskGraph;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            WriteRecordsTask* task = new WriteRecordsTask;
+            task->td = TaskDataWriteRecords{cell_vector, m_size * c / chunks, m_size * (c + 1) / chunks - 1, fd, offsets[c], &ok[c]};
+            taskGraph.addTask(unique_ptr<Task>(task));
+        }
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(m_workerThreads);
+    }
 
-    file.close();
+    bool written = close(fd) == 0 && ::std::all_of(ok.begin(), ok.end(), [](char k) { return k != 0; });
+    if (!written)
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
 
-    ::std::cout << "Data written to: output/voronoi_data\n";
+    ::std::cout << "Data written to: " << path << "\n";
+    return true;
 }
 
-void VoronoiGenerator::writeDataToOBJ()
+bool VoronoiGenerator::writeResultFile(const char* path)
 {
     #ifdef ENABLE_TIMERS
     boost::timer::auto_cpu_timer t;
     #endif
 
-    ::std::ofstream file;
-    file.open("output/voronoi_data.obj", ::std::ofstream::binary);
+    if (cell_vector == NULL || m_size == 0)
+        return false;
+
+    vector<uint64_t> offsets(m_size + 1, 0);
+    for (size_t i = 0; i < m_size; i++)
+        offsets[i + 1] = offsets[i] + cell_vector[i].corners.size();
+
+    ResultHeader header = {};
+    memcpy(header.magic, RESULT_MAGIC, sizeof(RESULT_MAGIC));
+    header.version = RESULT_VERSION;
+    header.flags = resultFlags(m_measureCells);
+    header.scalarBytes = sizeof(double);
+    header.cellCount = m_size;
+    header.cornerCount = offsets[m_size];
+    header.offsetsOffset = alignResultOffset(sizeof(ResultHeader));
+    header.positionsOffset = alignResultOffset(header.offsetsOffset + (m_size + 1) * sizeof(uint64_t));
+    header.cornersOffset = getResultCornersOffset(header);
+    header.fileSize = header.cornersOffset + header.cornerCount * sizeof(glm::dvec3);
+
+    // the measures are computed up front and written with the header
+    CellMeasures measures(m_workerThreads);
+    ResultMeasuresLayout layout = {};
+    if (m_measureCells)
+    {
+        measures.compute(cell_vector, m_size);
+        layout = getResultMeasuresLayout(header);
+    }
 
-    if (!file.is_open())
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, header.fileSize) != 0 ||
+        !pwriteAll(fd, &header, sizeof(header), 0) ||
+        !pwriteAll(fd, offsets.data(), offsets.size() * sizeof(uint64_t), header.offsetsOffset) ||
+        (m_measureCells &&
+         (!pwriteAll(fd, measures.getAreas(), m_size * sizeof(double), layout.areasOffset) ||
+          !pwriteAll(fd, measures.getPerimeters(), m_size * sizeof(double), layout.perimetersOffset) ||
+          !pwriteAll(fd, measures.getCentroids(), m_size * sizeof(glm::dvec3), layout.centroidsOffset))))
     {
         ::std::cout << "Unable to write data to file.\n";
-        return;
+        if (fd >= 0) close(fd);
+        return false;
     }
 
-    for (size_t i = 0; i < m_size; i++)
-        writeCellOBJ(file, i);
+    size_t chunks = ::std::min((size_t)(m_workerThreads + 1) * 4, ::std::min(m_size, (size_t)64));
+    vector<char> ok(chunks, 1);
+    {
+        TaskGraph taskGraph;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            WriteResultTask* task = new WriteResultTask;
+            task->td = TaskDataWriteResult{cell_vector, m_size * c / chunks, m_size * (c + 1) / chunks - 1, fd, &header, offsets.data(), &ok[c]};
+            taskGraph.addTask(unique_ptr<Task>(task));
+        }
+        taskGraph.finalizeGraph();
+        taskGraph.processTasks(m_workerThreads);
+    }
 
-    file.close();
+    bool written = close(fd) == 0 && ::std::all_of(ok.begin(), ok.end(), [](char k) { return k != 0; });
+    if (!written)
+    {
+        ::std::cout << "Unable to write data to file.\n";
+        return false;
+    }
 
-    ::std::cout << "Data written to: output/voronoi_data\n";
+    ::std::cout << "Data written to: " << path << "\n";
+    return true;
 }
 
-inline void VoronoiGenerator::writeCellOBJ(::std::ofstream & os, int i)
+bool VoronoiGenerator::writeDataToOBJ(const char* path)
 {
-    if (cell_vector[i].m_arcs != 0)
-        return;
-
-    int numCorners = (int)cell_vector[i].corners.size();
-
-    if (numCorners < 3)
-        return;
+    #ifdef ENABLE_TIMERS
+    boost::timer::auto_cpu_timer t;
+    #endif
 
-    ::std::string idx = "f ";
-    for (int j = 0; j < numCorners; j++)
-    {
-        os.write("v ", 2);
+    if (cell_vector == NULL)
+        return false;
 
-        ::std::string x = ::std::to_string(cell_vector[i].corners[j].x); x += " ";
-        ::std::string y = ::std::to_string(cell_vector[i].corners[j].y); y += " ";
-        ::std::string z = ::std::to_string(cell_vector[i].corners[j].z); z += "\n";
+    MeshExporter exporter(m_workerThreads);
+    exporter.build(cell_vector, m_size);
+    return exporter.writeOBJ(path);
+}
 
-        os.write(x.c_str(), x.length());
-        os.write(y.c_str(), y.length());
-        os.write(z.c_str(), z.length());
+bool VoronoiGenerator::writeDataToPLY(const char* path)
+{
+    #ifdef ENABLE_TIMERS
+    boost::timer::auto_cpu_timer t;
+    #endif
 
-        idx += ::std::to_string(j-numCorners) + " ";
-    }
+    if (cell_vector == NULL)
+        return false;
 
-    // write face
-    idx += "\n";
-    os.write(idx.c_str(), idx.length());   
+    MeshExporter exporter(m_workerThreads);
+    exporter.build(cell_vector, m_size);
+    return exporter.writePLY(path);
 }
 
 }
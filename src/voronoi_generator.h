@@ -5,6 +5,8 @@
 #include "voronoi_cell.h"
 #include "mp_sample_generator.h"
 #include "task_graph.h"
+#include "cell_sink.h"
+#include <cstdio>
 #include <vector>
 #include "gtest/gtest_prod.h"
 
@@ -14,6 +16,39 @@ namespace VorGen {
 
 using ::std::vector;
 
+// caps with at least this many points are split into sub-caps that are
+// swept in parallel, see VoronoiGenerator::generateCap
+const size_t CAP_SPLIT_MIN = 20000;
+
+// core points of each tile of VoronoiGenerator::generateTiled
+const size_t TILE_POINTS = 1 << 20;
+
+struct CapJob;
+class TileStore;
+class ResultWriter;
+
+// one iteration of VoronoiGenerator::relax
+struct RelaxStats
+{
+    double energy;   // CVT energy of the diagram of the points the iteration started with
+    double movement; // largest distance from a point to the centroid of its cell
+    double ms;       // wall time of the iteration
+    bool rejected;   // an accelerated step that raised the energy, undone
+};
+
+enum RelaxMethod
+{
+    RelaxLloyd,   // every point to the centroid of its cell
+    RelaxAnderson // Anderson accelerated Lloyd steps, see AndersonMixer
+};
+
+struct CapInput
+{
+    glm::dvec3 origin;
+    const glm::dvec3* points;
+    size_t count;
+};
+
 class VoronoiGenerator
 {
     public:
@@ -22,9 +57,110 @@ class VoronoiGenerator
         VoronoiGenerator(size_t seed);
         ~VoronoiGenerator();
 
-        glm::dvec3* genRandomInput(int count);
-        VoronoiCell* generate(glm::dvec3* points, int count, int gen, bool writeToFile);
-        VoronoiCell* generateCap(const glm::dvec3& origin, glm::dvec3* points, int count);
+        // threads spawned alongside the calling thread by generate. The
+        // paired sort tasks wait on each other, so at least
+        // MIN_WORKER_THREADS are used.
+        static const int MIN_WORKER_THREADS = 3;
+        void setWorkerThreads(int threads);
+
+        // cells of later runs are handed to sink as they are finished, see
+        // CellSink. NULL to stop.
+        void setCellSink(CellSink* sink) { m_sink = sink; }
+
+        // result files of later runs, from writeResultFile, generateTiled
+        // and generateShard, carry the area, perimeter and centroid of every
+        // cell, see CellMeasures
+        void setCellMeasures(bool measure) { m_measureCells = measure; }
+        bool getCellMeasures() const { return m_measureCells; }
+
+        // later runs sweep with float beachline ends and event angles,
+        // which halves the events, and settle the comparisons too close
+        // for float in double. The settling costs more time than the
+        // smaller events save, so it is for runs short of memory. Sweeps
+        // beyond NARROW_SWEEP_SITES stay double.
+        void setFloatSweeps(bool floatSweeps) { m_floatSweeps = floatSweeps; }
+        bool getFloatSweeps() const { return m_floatSweeps; }
+
+        glm::dvec3* genRandomInput(size_t count);
+        // counter based points generated in chunks on the worker threads,
+        // identical for a seed whatever the number of threads
+        glm::dvec3* genRandomInputParallel(size_t count);
+        VoronoiCell* generate(const glm::dvec3* points, size_t count, size_t gen, bool writeToFile);
+        // cells of points gathered around origin. Large caps no wider than
+        // 60 degrees are split into a ring along the border and a grid of
+        // tiles, each swept on its own with a halo of neighbouring points.
+        // Cells that could depend on points outside their job are swept
+        // again with every point they could depend on, so the result
+        // matches a single sweep.
+        VoronoiCell* generateCap(const glm::dvec3& origin, const glm::dvec3* points, size_t count);
+
+        // Lloyd relaxation towards a centroidal Voronoi tessellation. Each
+        // iteration generates the diagram of points and moves every point to
+        // the centroid of its cell, until the energy drops by less than
+        // tolerance times its last value or iterations points have been
+        // moved. points is updated in place and the cells of its final
+        // positions are returned. Iterations after the first keep the cells,
+        // sites and sort buffers and sort the sites starting from their last
+        // order, which is nearly sorted once the moves are small. The sink
+        // does not apply, the writers write the final cells.
+        //
+        // RelaxAnderson extrapolates from the last few iterations instead.
+        // A step that raises the energy is undone and replaced by the
+        // Lloyd step, and the history starts over.
+        VoronoiCell* relax(glm::dvec3* points, size_t count, size_t iterations, double tolerance, RelaxMethod method = RelaxLloyd);
+        // one entry per diagram generated by the last relax
+        const vector<RelaxStats> & getRelaxStats() const { return m_relaxStats; }
+
+        // generates many independent caps, one cell array per cap and NULL
+        // for caps of fewer than 3 points. The small caps share one task
+        // graph, so each is swept whole on one worker while the others run.
+        // The sink is finished once, after the last cap. The writers do not
+        // apply to these runs.
+        vector<VoronoiCell*> generateCaps(const CapInput* caps, size_t count);
+
+        // generates the cells of points a tile at a time and writes them to
+        // a result file at path, see ResultWriter, for inputs whose cells do
+        // not fit in memory. Tiles are the bins of a cube map holding about
+        // tilePoints points each. A tile is swept as a cap of every point
+        // within a halo of it and keeps the cells of its own points that
+        // provably do not depend on the points left out, the rest are swept
+        // again with every point they could depend on. One tile per worker
+        // is resident at a time, points are only read and may be mapped
+        // from disk. No cells are kept, so the other writers and the sink
+        // do not apply.
+        bool generateTiled(const glm::dvec3* points, size_t count, const char* path, size_t tilePoints = TILE_POINTS);
+        // as above for the points of a binary file of packed x,y,z doubles
+        // of unit length, which are read a block at a time into the tiles
+        // and never held in memory together
+        bool generateTiled(const char* input, const char* path, size_t tilePoints = TILE_POINTS);
+
+        // generateTiled for some of the tiles of a store, the cells of a
+        // shard, see ShardCoordinator. The result file at path holds the
+        // core cells of the tiles in the order given, each tile's in the
+        // order of the store.
+        bool generateShard(const TileStore & store, const vector<size_t> & tiles, const char* path);
+
+        // halo of the tiles of a tiled run over count points
+        static double getTileHalo(size_t count);
+
+        // event accounting for the sweeps of the last run
+        size_t getSweepCount() { return m_sweepCount; }
+        const SweepStats & getSweepStats(size_t sweep) { return m_sweepStats[sweep]; }
+        void printSweepStats(FILE* out = stdout);
+
+        // writes the cells of the last run in the binary format described in
+        // output/output_format.txt. Records are laid out from a prefix sum of
+        // their sizes and written by the worker threads with pwrite.
+        bool writeDataToFile(const char* path);
+
+        // writes the cells of the last run in the random access format of
+        // result_format.h, read back with ResultReader. Cells keep the
+        // index of their input point.
+        bool writeResultFile(const char* path);
+
+        // indexed meshes of the last run with shared corners welded, see MeshExporter
+        bool writeDataToOBJ(const char* path);
+        bool writeDataToPLY(const char* path);
 
     private:
 
@@ -43,13 +179,26 @@ class VoronoiGenerator
         vector<VoronoiSite> m_sitesY;
         vector<VoronoiSite> m_sitesZ;
 
-        void writeDataToFile();
-        void writeDataToOBJ();
-        inline void writeCell(::std::ofstream & os, int i);
-        inline void writeCellOBJ(::std::ofstream & os, int i);
+        int m_workerThreads;
+        CellSink* m_sink;
+        bool m_measureCells;
+        bool m_floatSweeps;
+
+        SweepStats m_sweepStats[6];
+        size_t m_sweepCount;
+        // sweeps of more sites index their nodes with WideIndex
+        size_t m_narrowSweepSites;
 
-        void buildTaskGraph(TaskGraph* tg, glm::dvec3* points);
-        void buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin, glm::dvec3* points);
+        vector<RelaxStats> m_relaxStats;
+        // merge scratch of the three sorts, kept between relax iterations
+        vector<VoronoiSite> m_sortScratch;
+
+
+        bool isWideSweep(size_t sites) const { return sites > m_narrowSweepSites; }
+
+        // warm reuses the cells and sites of the last run over the same count
+        void buildTaskGraph(TaskGraph* tg, const glm::dvec3* points, bool warm = false);
+        void buildCapTaskGraph(TaskGraph* tg, const glm::dvec3& origin, const glm::dvec3* points);
         struct SyncXYZ
         {
             SyncTask* syncX;
@@ -57,27 +206,36 @@ class VoronoiGenerator
             SyncTask* syncZ;
         };
 
-        inline void generateInitCellsTasks(TaskGraph* tg, glm::dvec3* points, SyncTask* & syncOut);
-        inline void generateInitSitesTasks(TaskGraph* tg, SyncTask* syncIn, SyncXYZ & syncOut);
-        inline void generateSortPointsTasks(TaskGraph* tg, SyncXYZ & syncInOut);
+        inline void generateInitCellsTasks(TaskGraph* tg, const glm::dvec3* points, SyncTask* & syncOut, bool warm);
+        inline void generateInitSitesTasks(TaskGraph* tg, SyncTask* syncIn, SyncXYZ & syncOut, bool warm);
+        inline void generateSortPointsTasks(TaskGraph* tg, SyncXYZ & syncInOut, bool warm);
         inline void generateSweepTasks(TaskGraph* tg, SyncXYZ & syncIn, SyncTask* & syncOut);
-        inline void generateSortCellCornersTasks(TaskGraph* tg, SyncTask* syncIn, size_t threads);
 
-        inline void generateRotatePointsTasks(TaskGraph* tg, SyncTask* & syncOut, glm::dmat4 rotation, glm::dvec3* points);
-        inline void generateCapInitCellsTasks(TaskGraph* tg, glm::dvec3* points, SyncTask* & syncInOut);
-        inline void generateCapInitSitesTasks(TaskGraph* tg, SyncTask* & syncInOut);
+        inline void generateCapInitCellsTasks(TaskGraph* tg, const glm::dvec3* points, glm::dmat4 rotation, SyncTask* & syncOut);
         inline void generateCapSortPointsTasks(TaskGraph* tg, SyncTask* & syncInOut);
         inline void generateCapSweepTasks(TaskGraph* tg, SyncTask* & syncInOut);
-        inline void generateCapSortCellCornersTasks(TaskGraph* tg, SyncTask* syncIn, size_t threads, glm::dmat4 rotation);
+        inline void generateCapRotateCellsTasks(TaskGraph* tg, SyncTask* syncIn, size_t threads, const glm::dvec3* points, glm::dmat4 rotation);
+
+        VoronoiCell* generateCapCells(const glm::dvec3& origin, const glm::dvec3* points, size_t count);
+        bool generateSplitCap(const glm::dvec3& origin, const glm::dvec3* points);
+        void generateCapJobTasks(TaskGraph* tg, CapJob* job, const glm::dvec3* points, VoronoiCell* output);
+        // every tile of the store to a result file of its input points
+        bool generateTiled(const TileStore & store, const char* path);
+        // the core cells of tile tiles[k] go to bases[k] on, or to their input points when bases is NULL
+        bool generateTiles(const TileStore & store, const vector<size_t> & tiles, const uint64_t* bases, ResultWriter & writer);
 
         // tests
         FRIEND_TEST(VoronoiTests, TestIntersect);
         FRIEND_TEST(VoronoiTests, TestIntersectDegenerateParabola);
         FRIEND_TEST(VoronoiTests, TestVerifyResult);
+        FRIEND_TEST(VoronoiTests, TestVerifierMatchesBruteForce);
         FRIEND_TEST(VoronoiTests, TestCapVerifyResult);
         FRIEND_TEST(VoronoiTests, TestBeachLine);
         FRIEND_TEST(VoronoiTests, TestCircumcenter);
         FRIEND_TEST(VoronoiTests, TestCapDeterminism);
+        FRIEND_TEST(VoronoiTests, TestSweepStats);
+        FRIEND_TEST(VoronoiTests, TestNodeIndex);
+        FRIEND_TEST(VoronoiTests, TestFloatSweeps);
 };
 
 }
@@ -15,42 +15,30 @@ VoronoiSite::VoronoiSite(
 {
 }
 
-inline void computePolarAndAzimuthHelper(VoronoiSite& site)
+// the axis is the pole, the azimuth is measured from the next axis
+// towards the one after it
+template<Axis A>
+void computePolarAndAzimuth(VoronoiSite& site)
 {
-    site.m_azimuth /= PI2;
-    site.m_azimuth -= floor(site.m_azimuth);
-    site.m_azimuth *= PI2;
+    const glm::dvec3 & p = site.m_position;
 
-    site.m_polSin = sin(site.m_polar);
-    site.m_aziCosPS = cos(site.m_azimuth) * site.m_polSin;
-    site.m_aziSinPS = sin(site.m_azimuth) * site.m_polSin;
-}
+    double azimuth = atan2(p[(A + 2) % 3], p[(A + 1) % 3]);
+    azimuth /= PI2;
+    azimuth -= floor(azimuth);
+    azimuth *= PI2;
 
-template<>
-void computePolarAndAzimuth<X>(VoronoiSite& site)
-{
-    site.m_polar = acos(site.m_position.x);
-    site.m_azimuth = atan2(site.m_position.z, site.m_position.y);
-    site.m_polCos = site.m_position.x;
-    computePolarAndAzimuthHelper(site);
-}
+    site.m_polar = acos(p[A]);
+    double polSin = sin(site.m_polar);
 
-template<>
-void computePolarAndAzimuth<Y>(VoronoiSite& site)
-{
-    site.m_polar = acos(site.m_position.y);
-    site.m_azimuth = atan2(site.m_position.x, site.m_position.z);
-    site.m_polCos = site.m_position.y;
-    computePolarAndAzimuthHelper(site);
+    site.m_azimuth = azimuth;
+    site.m_polCos = p[A];
+    site.m_polSin = polSin;
+    site.m_aziCosPS = cos(azimuth) * polSin;
+    site.m_aziSinPS = sin(azimuth) * polSin;
 }
 
-template<>
-void computePolarAndAzimuth<Z>(VoronoiSite& site)
-{
-    site.m_polar = acos(site.m_position.z);
-    site.m_azimuth = atan2(site.m_position.y, site.m_position.x);
-    site.m_polCos = site.m_position.z;
-    computePolarAndAzimuthHelper(site);
-}
+template void computePolarAndAzimuth<X>(VoronoiSite&);
+template void computePolarAndAzimuth<Y>(VoronoiSite&);
+template void computePolarAndAzimuth<Z>(VoronoiSite&);
 
-}
\ No newline at end of file
+}
@@ -29,4 +29,4 @@ public:
 template<Axis A>
 void computePolarAndAzimuth(VoronoiSite& site);
 
-}
\ No newline at end of file
+}
@@ -1,5 +1,8 @@
 #include "voronoi.h"
+#include "voronoi_generator.h" // CENTROID
 #include "../glm/glm.hpp"
+#include <algorithm>
+#include <cfloat>
 
 namespace VorGen {
 
@@ -42,8 +45,8 @@ inline bool OrderedIterator<O>
 	return index >= maxSize;
 }
 
-template <Order O, Axis A>
-VoronoiSweeper<O, A>::VoronoiSweeper(
+template <Order O, Axis A, typename I, typename T>
+VoronoiSweeper<O, A, I, T>::VoronoiSweeper(
 	::std::vector<VoronoiSite>* sites, 
 	size_t gen, 
 	uint8_t threadId
@@ -54,44 +57,220 @@ VoronoiSweeper<O, A>::VoronoiSweeper(
 {
 	m_sweeplineLarge = sweeplineStart<O>;
 	m_sweeplineSmall = 0.0;
+	m_sweeplineErr = 0.0;
 
-	size_t count = ::std::min((int)sites->size(), (int)(m_gen * 2));
-	auto size = (2 * count - 2) * sizeof(MemBlock<O>);
-	m_nextBlock = m_memBlocks = (MemBlock<O>*)malloc( size );
+	m_stats = {};
+
+	m_sink = NULL;
+	m_cells = NULL;
+	m_completedCells = &completedCells;
+	m_freeLinks = -1;
+
+	size_t count = ::std::min(sites->size(), m_gen * 2);
+	auto size = (2 * count - 2) * sizeof(MemBlock<O, I, T>);
+	m_nextBlock = m_memBlocks = (MemBlock<O, I, T>*)malloc( size );
 	block = 0;
 }
 
-template <Order O, Axis A>
-VoronoiSweeper<O, A>
+template <Order O, Axis A, typename I, typename T>
+VoronoiSweeper<O, A, I, T>
 ::~VoronoiSweeper()
 {
 	free(m_memBlocks);
 }
 
-template <Order O, Axis A>
-inline SkipNode<O>* VoronoiSweeper<O, A>
+template <Order O, Axis A, typename I, typename T>
+inline SkipNode<O, I, T>* VoronoiSweeper<O, A, I, T>
 ::initBlock()
 {
-	new(&(m_nextBlock->skipNode)) SkipNode<O>(block);
-	new(&(m_nextBlock->circleEvent)) CircleEvent<O>();
+	new(&(m_nextBlock->skipNode)) SkipNode<O, I, T>(block);
+	new(&(m_nextBlock->circleEvent)) CircleEvent<O, T>();
 	block++;
 	return &((m_nextBlock++)->skipNode);
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>::sweep()
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>::sweep()
 {
 	processEvents();
+	finishOpenCells();
+	flushCompleted();
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::setSink(CellSink* sink, const VoronoiCell* cells)
+{
+	m_sink = sink;
+	m_cells = cells;
+	m_completed.reserve(CELL_SINK_BATCH);
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
+template <Order O, Axis A, typename I, typename T>
+inline I VoronoiSweeper<O, A, I, T>
+::newLink(uint32_t corner)
+{
+	I link = m_freeLinks;
+	if (link >= 0)
+		m_freeLinks = m_links[link].next;
+	else
+	{
+		link = (I)m_links.size();
+		m_links.emplace_back();
+	}
+
+	m_links[link] = CornerLink{corner, -1};
+	return link;
+}
+
+template <Order O, Axis A, typename I, typename T>
+inline void VoronoiSweeper<O, A, I, T>
+::startRing(SkipNode<O, I, T>* node)
+{
+	if (!ownsCell(node->m_beachArc.m_site->m_cell))
+		return;
+
+	I link = newLink(NO_CORNER);
+	node->m_beachArc.m_ringLeft = link;
+	node->m_beachArc.m_ringRight = link;
+}
+
+// only the owner adds corners to a cell, so once its last arc is gone
+// the cell is final and no other sweep touches anything but m_owner
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::finishCell(VoronoiCell* cell, I start)
+{
+	// a ring that does not close over every corner, which only near
+	// degenerate events can leave, is sorted by angle instead
+	size_t count = cell->corners.size();
+	size_t steps = 0;
+	I link = start;
+	I last = start;
+	m_ring.clear();
+	do
+	{
+		const CornerLink & l = m_links[link];
+		if (l.corner != NO_CORNER)
+		{
+			if (l.corner >= count || m_ring.size() == count)
+				break;
+			m_ring.push_back(cell->corners[l.corner]);
+		}
+		last = link;
+		link = l.next;
+	} while (link >= 0 && link != start && ++steps < m_links.size());
+
+	if (link == start && m_ring.size() == count)
+	{
+		// rings run against the corner order of sortCorners, except when
+		// sweeping towards the axis where the beachline runs the other way
+		if (O == Increasing)
+			::std::reverse_copy(m_ring.begin(), m_ring.end(), cell->corners.begin());
+		else
+			::std::copy(m_ring.begin(), m_ring.end(), cell->corners.begin());
+
+		m_links[last].next = m_freeLinks;
+		m_freeLinks = start;
+	}
+	else
+		cell->sortCorners();
+
+#ifdef CENTROID
+	cell->computeCentroid();
+#endif
+	if (m_sink)
+		deliver(cell);
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::finishOpenCells()
+{
+	// a run that stops early leaves cells open, and a complete run may end
+	// with two arcs whose cells have every corner. Neither ring is closed.
+	::std::vector<VoronoiCell*> open;
+	SkipNode<O, I, T>* node = m_beachLine.getFront();
+	for (size_t i = 0; i < m_beachLine.getSize(); i++, node = NODE(node, next))
+	{
+		VoronoiCell* cell = node->m_beachArc.m_site->m_cell;
+		if (ownsCell(cell) && cell->corners.size())
+			open.push_back(cell);
+	}
+	::std::sort(open.begin(), open.end());
+	open.erase(::std::unique(open.begin(), open.end()), open.end());
+
+	for (VoronoiCell* cell : open)
+	{
+		cell->sortCorners();
+#ifdef CENTROID
+		cell->computeCentroid();
+#endif
+		if (m_sink)
+			deliver(cell);
+	}
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::deliver(VoronoiCell* cell)
+{
+	m_completed.push_back(cell - m_cells);
+	if (m_completed.size() >= CELL_SINK_BATCH)
+		flushCompleted();
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::flushCompleted()
+{
+	if (m_sink && m_completed.size())
+		m_sink->consume(m_cells, m_completed.data(), m_completed.size());
+	m_completed.clear();
+}
+
+// ownership never changes hands once taken, so this is final
+template <Order O, Axis A, typename I, typename T>
+inline bool VoronoiSweeper<O, A, I, T>
+::ownsCell(VoronoiCell* cell)
+{
+	return cell->m_owner.load(::std::memory_order_relaxed) & m_threadId;
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
 ::processSiteEvent(VoronoiSite* site)
 {
-	SkipNode<O>* node = initBlock(); node->initSite(site, m_threadId);
-	SkipNode<O>* node2 = initBlock();
+	SkipNode<O, I, T>* node = initBlock(); node->initSite(site, m_threadId);
+	SkipNode<O, I, T>* node2 = initBlock();
 		
-	m_beachLine.findAndInsert(node, node2, site->m_polar, m_threadId);
+	bool split = m_beachLine.findAndInsert(node, node2, site->m_polar, m_threadId);
+
+	m_stats.siteEvents++;
+	if (!ownsCell(site->m_cell))
+		m_stats.wastedSiteEvents++;
+
+	// the halves of a split arc keep the outer ends of its ring and meet
+	// below the new site
+	startRing(node);
+	SkipNode<O, I, T>* left = NODE(node, prev);
+	if (split && ownsCell(left->m_beachArc.m_site->m_cell))
+	{
+		I link = newLink(NO_CORNER);
+		node2->m_beachArc.m_ringRight = left->m_beachArc.m_ringRight;
+		node2->m_beachArc.m_ringLeft = link;
+		left->m_beachArc.m_ringRight = link;
+	}
+
+	if (!split)
+	{
+		// both neighbours are arcs that were there before
+		removeCircleEvent(NODE(node, prev));
+		removeCircleEvent(NODE(node, next));
+		addCircleEventProcessCircle(NODE(node, prev));
+		addCircleEventProcessCircle(NODE(node, next));
+		return;
+	}
 
 	removeCircleEvent(NODE(node, prev));
 	addCircleEventProcessSite(NODE(node, prev));
@@ -99,106 +278,190 @@ void VoronoiSweeper<O,A>
 }
 
 // creates a voronoi vertex
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
-::processCircleEvent(CircleEvent<O>* circle)
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::processCircleEvent(CircleEvent<O, T>* circle)
 {
 	m_sweeplineLarge = circle->polar;
 	m_sweeplineSmall = circle->polar_small;
+	m_sweeplineErr = circle->err;
+
+	SkipNode<O, I, T>* sn = getSkipNodeFromCircleEvent<O, I, T>(circle);
+	SkipNode<O, I, T>* sni = NODE(sn, prev);
+	SkipNode<O, I, T>* snk = NODE(sn, next);
+
+	// add vertex to cells, linked into the rings of those this sweep owns.
+	// It ends the breakpoints either side of sn and starts the one that
+	// replaces them.
+	const glm::dvec3* center = circle->center.get();
+	glm::dvec3 dv = glm::normalize(center ? *center : 
+		circumcenter(sni->m_beachArc.m_site->m_position, 
+					 sn->m_beachArc.m_site->m_position, 
+					 snk->m_beachArc.m_site->m_position));
+	VoronoiCell* cellI = sni->m_beachArc.m_site->m_cell;
+	VoronoiCell* cell = sn->m_beachArc.m_site->m_cell;
+	VoronoiCell* cellK = snk->m_beachArc.m_site->m_cell;
+
+	bool ownsI = cellI->addCorner(dv, m_threadId);
+	if (ownsI)
+	{
+		I link = newLink((uint32_t)cellI->corners.size() - 1);
+		m_links[sni->m_beachArc.m_ringRight].next = link;
+		sni->m_beachArc.m_ringRight = link;
+	}
 
-	SkipNode<O>* sn = getSkipNodeFromCircleEvent(circle);
-	SkipNode<O>* sni = NODE(sn, prev);
-	SkipNode<O>* snk = NODE(sn, next);
+	bool owns = cell->addCorner(dv, m_threadId);
+	I closing = -1;
+	if (owns)
+	{
+		closing = newLink((uint32_t)cell->corners.size() - 1);
+		m_links[sn->m_beachArc.m_ringRight].next = closing;
+		m_links[closing].next = sn->m_beachArc.m_ringLeft;
+	}
+
+	bool ownsK = cellK->addCorner(dv, m_threadId);
+	if (ownsK)
+	{
+		I link = newLink((uint32_t)cellK->corners.size() - 1);
+		m_links[link].next = snk->m_beachArc.m_ringLeft;
+		snk->m_beachArc.m_ringLeft = link;
+	}
 
-    // add vertex to cells
-	glm::dvec3 dv = glm::normalize(circle->center);
-	sni->m_beachArc.m_site->m_cell->addCorner(dv, m_threadId);
-	sn->m_beachArc.m_site->m_cell->addCorner(dv, m_threadId);
-	snk->m_beachArc.m_site->m_cell->addCorner(dv, m_threadId);
+	int owned = ownsI + owns + ownsK;
+	m_stats.circleEvents++;
+	m_stats.discardedCorners += 3 - owned;
+	if (owned == 0)
+		m_stats.wastedCircleEvents++;
 
 	// remove circle events of neighbors
 	removeCircleEvent(sni);
 	removeCircleEvent(snk);
 
 	// remove site from beachline
-	m_beachLine.erase(sn, m_threadId);
+	if (m_beachLine.erase(sn, m_threadId))
+	{
+		(*m_completedCells)++;
+		m_stats.cellsCompleted++;
+		finishCell(cell, closing);
+	}
 
 	// check for new circle events
 	addCircleEventProcessCircle(sni);
 	addCircleEventProcessCircle(snk);
 }
 
-template <Order O, Axis A>
-inline void VoronoiSweeper<O,A>
+template <Order O, Axis A, typename I, typename T>
+inline void VoronoiSweeper<O, A, I, T>
 ::addCircleEvent(
-	SkipNode<O>* node, 
+	SkipNode<O, I, T>* node, 
 	double large_polar, 
 	double small_polar, 
-	const glm::dvec3 & cc)
+	const glm::dvec3 & cc,
+	double err)
 {
-	CircleEvent<O>* ce = new(getCircleEventFromSkipNode(node)) CircleEvent<O>(large_polar, small_polar, cc);
+	CircleEvent<O, T>* ce = new(getCircleEventFromSkipNode(node)) CircleEvent<O, T>(large_polar, small_polar, cc, err);
   	m_circles.push(ce);
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
-::removeCircleEvent(SkipNode<O>* node)
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::removeCircleEvent(SkipNode<O, I, T>* node)
 {
-	CircleEvent<O>* ce = getCircleEventFromSkipNode(node);
+	CircleEvent<O, T>* ce = getCircleEventFromSkipNode(node);
 	m_circles.erase(ce);
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
-::addCircleEventProcessSite(SkipNode<O>* node)
+// error of acos(x) for x off by at most xErr, where the result has sine s
+inline double acosError(double xErr, double s)
 {
-	glm::dvec3 cc = circumcenter(
-		NODE(node, prev)->m_beachArc.m_site->m_position,
-		node->m_beachArc.m_site->m_position,
-		NODE(node, next)->m_beachArc.m_site->m_position);
+	return xErr / ::std::max(s, sqrt(xErr));
+}
 
-	double small_polar = acos(
-		glm::dot(cc, node->m_beachArc.m_site->m_position));
+// Bound on the error of an event's polar + polar_small. The circumcenter
+// turns by a few ulps over the sine of the angle its sites make at j,
+// which moves both dot products by that over the sine of their angle.
+template <Axis A>
+inline double eventError(
+	const glm::dvec3 & i, 
+	const glm::dvec3 & j, 
+	const glm::dvec3 & k, 
+	const glm::dvec3 & cc, 
+	double small_cos)
+{
+	glm::dvec3 ij = i - j;
+	glm::dvec3 kj = k - j;
+	double turn = 4.0 * DBL_EPSILON * 
+		sqrt(glm::dot(ij, ij) * glm::dot(kj, kj)) / glm::length(glm::cross(ij, kj));
+
+	double largeSin = sqrt(::std::max(1.0 - cc[A] * cc[A], 0.0));
+	double smallSin = sqrt(::std::max(1.0 - small_cos * small_cos, 0.0));
+	double err = acosError(turn * largeSin + DBL_EPSILON, largeSin) + 
+				 acosError(turn * smallSin + 2.0 * DBL_EPSILON, smallSin);
+	return 2.0 * (err + M_PI * DBL_EPSILON);
+}
+
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::addCircleEventProcessSite(SkipNode<O, I, T>* node)
+{
+	const glm::dvec3 & j = node->m_beachArc.m_site->m_position;
+	const glm::dvec3 & i = NODE(node, prev)->m_beachArc.m_site->m_position;
+	const glm::dvec3 & k = NODE(node, next)->m_beachArc.m_site->m_position;
+	glm::dvec3 cc = circumcenter(i, j, k);
+
+	double small_cos = glm::dot(cc, j);
+	double small_polar = acos(small_cos);
 	double large_polar = acos(cc[A]);
 
-	addCircleEvent(node, large_polar, small_polar, cc);
+	addCircleEvent(node, large_polar, small_polar, cc, eventError<A>(i, j, k, cc, small_cos));
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
-::addCircleEventProcessCircle(SkipNode<O>* node)
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
+::addCircleEventProcessCircle(SkipNode<O, I, T>* node)
 {
-	glm::dvec3 cc = circumcenter(
-		NODE(node, prev)->m_beachArc.m_site->m_position,
-		node->m_beachArc.m_site->m_position,
-		NODE(node, next)->m_beachArc.m_site->m_position);
+	// the last two arcs of a sweep have one site either side, and no event
+	if (NODE(node, prev)->m_beachArc.m_site == NODE(node, next)->m_beachArc.m_site)
+		return;
+
+	const glm::dvec3 & j = node->m_beachArc.m_site->m_position;
+	const glm::dvec3 & i = NODE(node, prev)->m_beachArc.m_site->m_position;
+	const glm::dvec3 & k = NODE(node, next)->m_beachArc.m_site->m_position;
+	glm::dvec3 cc = circumcenter(i, j, k);
 
-	double small_polar = acos(
-		glm::dot(cc, node->m_beachArc.m_site->m_position));
+	double small_cos = glm::dot(cc, j);
+	double small_polar = acos(small_cos);
 	double large_polar = acos(cc[A]);
+	double err = eventError<A>(i, j, k, cc, small_cos);
 
-	if (eventIsUpcoming(small_polar, large_polar))
-		addCircleEvent(node, large_polar, small_polar, cc);
+	if (eventIsUpcoming(small_polar, large_polar, err))
+		addCircleEvent(node, large_polar, small_polar, cc, err);
 }
 
-template <Order O, Axis A>
-void VoronoiSweeper<O,A>
+template <Order O, Axis A, typename I, typename T>
+void VoronoiSweeper<O, A, I, T>
 ::processEvents()
 {
 	// process first two sites
 	VoronoiSite* site = &(*m_sites)[m_next++];
-	SkipNode<O>* node = initBlock();
+	SkipNode<O, I, T>* node = initBlock();
 	node->initSite(site, m_threadId);
 	m_beachLine.insert1(node);
+	startRing(node);
+	m_stats.siteEvents++;
+	if (!ownsCell(site->m_cell)) m_stats.wastedSiteEvents++;
 
 	site = &(*m_sites)[m_next++];
 	node = initBlock();
 	node->initSite(site, m_threadId);
 	m_beachLine.insert2(node);
+	startRing(node);
+	m_stats.siteEvents++;
+	if (!ownsCell(site->m_cell)) m_stats.wastedSiteEvents++;
 
 	// pop events from sites and circles in order of 
 	// O polar angle
-	while ( completedCells < m_gen && 
+	while ( *m_completedCells < m_gen && 
 					(m_next.isInRange() || !m_circles.empty()) )
 	{
 		if (m_circles.empty()) // No circle events so we process 
@@ -210,7 +473,7 @@ void VoronoiSweeper<O,A>
 		else if (m_next.isAtEnd()) // No site events so we process 
                                // next circle event
 		{
-			CircleEvent<O>* next_circle = m_circles.top();
+			CircleEvent<O, T>* next_circle = m_circles.top();
 			m_circles.pop();
 			processCircleEvent(next_circle);
 		}
@@ -218,7 +481,7 @@ void VoronoiSweeper<O,A>
          // whichever is closer
 		{
 			VoronoiSite* next_site = &(*m_sites)[m_next.getIndex()];
-			CircleEvent<O>* next_circle = m_circles.top();
+			CircleEvent<O, T>* next_circle = m_circles.top();
 
 			if (voronoi_site_event_comp(next_site, next_circle))
 			{
@@ -234,6 +497,40 @@ void VoronoiSweeper<O,A>
 	}
 }
 
+template <Order O, Axis A, typename I, typename T>
+glm::dvec3 VoronoiSweeper<O, A, I, T>
+::circumcenter(
+	const glm::dvec3 & i, 
+	const glm::dvec3 & j, 
+	const glm::dvec3 & k)
+{
+	if (O == Increasing)
+		return glm::normalize( glm::cross((i-j),(k-j)) );
+	return glm::normalize( glm::cross((k-j),(i-j)) );
+}
+
+// an event within the bounds of its angle and the sweepline's is upcoming,
+// as the sites it was made from at the sweepline are on its circle
+template <Order O, Axis A, typename I, typename T>
+bool VoronoiSweeper<O, A, I, T>
+::eventIsUpcoming(double small_polar, double large_polar, double err)
+{
+	if (O == Increasing)
+		return (large_polar - m_sweeplineLarge) + 
+			   (small_polar - m_sweeplineSmall) >= -(err + m_sweeplineErr);
+	return (large_polar - m_sweeplineLarge) - 
+		   (small_polar - m_sweeplineSmall) <= err + m_sweeplineErr;
+}
+
+template <Order O, Axis A, typename I, typename T>
+inline bool VoronoiSweeper<O, A, I, T>
+::onOtherSide(const glm::dvec3 & cc)
+{
+	if (O == Increasing)
+		return cc[A] < -0.0;
+	return cc[A] > 0.0;
+}
+
 }
 
 #define SWEEP_AXIS X
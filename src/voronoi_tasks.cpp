@@ -5,15 +5,10 @@
 #include "voronoi.h"
 #include <algorithm>
 #include <cstring>
+#include <unistd.h>
 
 namespace VorGen {
 
-void RotatePointsTask::process()
-{
-    for (size_t i = td.start; i <= td.end; i++)
-        td.points[i] = (td.rotation * glm::dvec4(td.points[i], 1.0)).xyz();
-}
-
 void InitCellsTask::process()
 {
     for (size_t i = td.start; i <= td.end; i++)
@@ -28,6 +23,29 @@ void InitCellsAndResizeSitesTask::process()
     td.sites->resize(td.size);
 }
 
+void ResetCellsTask::process()
+{
+    for (size_t i = td.start; i <= td.end; i++)
+    {
+        VoronoiCell & cell = td.cells[i];
+        cell.position = td.points[i];
+        cell.corners.clear();
+        cell.m_arcs = 0;
+        cell.m_owner.store(0);
+    }
+}
+
+void InitCapCellsTask::process()
+{
+    for (size_t i = td.start; i <= td.end; i++)
+    {
+        glm::dvec3 p = (td.rotation * glm::dvec4(td.points[i], 1.0)).xyz();
+        new(td.cells + i) VoronoiCell(p);
+        (*(td.sites))[i] = {p, td.cells + i};
+        computePolarAndAzimuth<X>((*(td.sites))[i]);
+    }
+}
+
 template<Axis A>
 void InitSitesTask<A>::process()
 {
@@ -42,23 +60,65 @@ template class InitSitesTask<X>;
 template class InitSitesTask<Y>;
 template class InitSitesTask<Z>;
 
+template<Axis A>
+void UpdateSitesTask<A>::process()
+{
+    for (size_t i = td.start; i <= td.end; i++)
+    {
+        VoronoiSite & site = (*(td.sites))[i];
+        site = {site.m_cell->position, site.m_cell};
+        computePolarAndAzimuth<A>(site);
+    }
+}
+
+template class UpdateSitesTask<X>;
+template class UpdateSitesTask<Y>;
+template class UpdateSitesTask<Z>;
+
+// sites left in the order of a previous sort are only a few places out
+// after a small move, and insertion sort moves each one that far. Past
+// WARM_SORT_MOVES moves a site a full sort is about as fast, and takes over.
+static const size_t WARM_SORT_MOVES = 32;
+
+static void sortSites(VoronoiSite* first, VoronoiSite* last, bool warm)
+{
+    VoronoiSiteCompare voronoiSiteCompare;
+    size_t budget = warm ? WARM_SORT_MOVES * (last - first) : 0;
+    for (VoronoiSite* i = first + 1; i < last && budget; i++)
+    {
+        if (!voronoiSiteCompare(*i, *(i - 1)))
+            continue;
+
+        VoronoiSite site = *i;
+        VoronoiSite* j = i;
+        for (; j > first && voronoiSiteCompare(site, *(j - 1)) && budget; j--, budget--)
+            *j = *(j - 1);
+        *j = site;
+    }
+
+    if (budget == 0)
+        ::std::sort(first, last, voronoiSiteCompare);
+}
+
 void SortPoints1Task::process()
 {
     // sort array half
     size_t size = (size_t)td.sites->size() / 2;
     VoronoiSiteCompare voronoiSiteCompare;
-    sort(td.sites->begin(), td.sites->begin() + size, voronoiSiteCompare);
+    sortSites(td.sites->data(), td.sites->data() + size, td.warm);
 
     // copy into scratch array
-    std::unique_ptr<VoronoiSite[]> scratch = std::make_unique<VoronoiSite[]>(size);
-    memcpy(scratch.get(), td.sites->data(), size * sizeof(VoronoiSite));
+    std::unique_ptr<VoronoiSite[]> owned;
+    if (!td.scratch) owned = std::make_unique<VoronoiSite[]>(size);
+    VoronoiSite* scratch = td.scratch ? td.scratch : owned.get();
+    memcpy(scratch, td.sites->data(), size * sizeof(VoronoiSite));
 
     // send data to other thread
-    td.p_temp->set_value(scratch.get());
+    td.p_temp->set_value(scratch);
     VoronoiSite* scratch2 = td.f_temp.get();
 
     // merge into original array
-    int a = 0; int b = 0;
+    size_t a = 0; size_t b = 0;
     for (size_t i = 0; i < size; i++)
     {
         if (voronoiSiteCompare(scratch[a], scratch2[b]))
@@ -78,18 +138,20 @@ void SortPoints2Task::process()
     size_t size1 = (size_t)td.sites->size() / 2;
     size_t size = (size_t)td.sites->size() - size1;
     VoronoiSiteCompare voronoiSiteCompare;
-    sort(td.sites->begin() + size1, td.sites->end(), voronoiSiteCompare);
+    sortSites(td.sites->data() + size1, td.sites->data() + td.sites->size(), td.warm);
 
     // copy into scratch array
-    std::unique_ptr<VoronoiSite[]> scratch = std::make_unique<VoronoiSite[]>(size);
-    memcpy(scratch.get(), td.sites->data() + size1, size * sizeof(VoronoiSite));
+    std::unique_ptr<VoronoiSite[]> owned;
+    if (!td.scratch) owned = std::make_unique<VoronoiSite[]>(size);
+    VoronoiSite* scratch = td.scratch ? td.scratch : owned.get();
+    memcpy(scratch, td.sites->data() + size1, size * sizeof(VoronoiSite));
 
     // send data to other thread
-    td.p_temp->set_value(scratch.get());
+    td.p_temp->set_value(scratch);
     VoronoiSite* scratch1 = td.f_temp.get();
 
     // merge into original array
-    int a = size1 - 1; int b = size - 1;
+    ::std::ptrdiff_t a = size1 - 1; ::std::ptrdiff_t b = size - 1;
     for (size_t i = (size_t)td.sites->size() - 1; i >= size1; i--)
     {
         if (a < 0 || voronoiSiteCompare(scratch1[a], scratch[b]))
@@ -250,6 +312,18 @@ void BucketSort2Task::process()
     bool ready = td.f_done.get();
 }
 
+template<Order O, Axis A, typename I, typename T>
+static void sweep(TaskDataSweep & td)
+{
+    VoronoiSweeper<O, A, I, T> voronoiSweeper(td.sites, td.gen, td.taskId);
+    if (td.sink)
+        voronoiSweeper.setSink(td.sink, td.cells);
+    if (td.completed)
+        voronoiSweeper.setCompletedCounter(td.completed);
+    voronoiSweeper.sweep();
+    *td.stats = voronoiSweeper.getStats();
+}
+
 template<Order O, Axis A>
 inline void SweepTask<O, A>::process()
 {
@@ -257,8 +331,12 @@ inline void SweepTask<O, A>::process()
     boost::timer::cpu_timer timer;
 #endif
     
-    VoronoiSweeper<O, A> voronoiSweeper(td.sites, td.gen, td.taskId);
-    voronoiSweeper.sweep();
+    if (td.wideIndex)
+        sweep<O, A, WideIndex, double>(td);
+    else if (td.floatScalar)
+        sweep<O, A, NarrowIndex, float>(td);
+    else
+        sweep<O, A, NarrowIndex, double>(td);
     
 #ifdef ENABLE_SWEEP_TIMERS
     string orderStr = (O == Increasing) ? "Increasing" : "Decreasing";
@@ -279,34 +357,475 @@ template class SweepTask<Decreasing, X>;
 template class SweepTask<Decreasing, Y>;
 template class SweepTask<Decreasing, Z>;
 
-void SortCellCornersTask::process()
+// hands finished cells to a sink in batches
+class SinkBatch
 {
+    public:
+        SinkBatch(CellSink* sink, const VoronoiCell* cells) : m_sink(sink), m_cells(cells) {}
+        ~SinkBatch() { flush(); }
+
+        void add(size_t cell)
+        {
+            if (!m_sink) return;
+            m_indices.push_back(cell);
+            if (m_indices.size() >= CELL_SINK_BATCH)
+                flush();
+        }
+
+        void flush()
+        {
+            if (m_sink && m_indices.size())
+                m_sink->consume(m_cells, m_indices.data(), m_indices.size());
+            m_indices.clear();
+        }
+
+    private:
+        CellSink* m_sink;
+        const VoronoiCell* m_cells;
+        ::std::vector<size_t> m_indices;
+};
+
+void RelaxCellsTask::process()
+{
+    double energy = 0.0;
+    double movement = 0.0;
     for (size_t i = td.start; i <= td.end; i++)
     {
-        if (td.cell_vector[i].corners.size() == 0)
-            continue;
-        (td.cell_vector[i]).sortCorners();
-#ifdef CENTROID
-        (td.cell_vector[i]).computeCentroid();
-#endif
+        energy += td.cells[i].computeMoments(td.points[i], td.centroids[i]);
+        movement = ::std::max(movement, glm::distance(td.points[i], td.centroids[i]));
     }
+    *td.energy = energy;
+    *td.movement = movement;
+}
+
+void AndersonRecordTask::process()
+{
+    td.mixer->record(td.chunk);
+}
+
+void AndersonExtrapolateTask::process()
+{
+    td.mixer->extrapolate(td.chunk);
 }
 
-void SortCornersRotateTask::process()
+void CellMeasuresTask::process()
 {
+    td.measures->measure(td.chunk);
+}
+
+void RotateCellsTask::process()
+{
+    SinkBatch batch(td.sink, td.cell_vector);
     for (size_t i = td.start; i <= td.end; i++)
     {
-        (td.cell_vector[i]).sortCorners();
         for (size_t j = 0; j < td.cell_vector[i].corners.size(); j++)
         {
             td.cell_vector[i].corners[j] = (td.rotation * glm::dvec4(td.cell_vector[i].corners[j], 1.0)).xyz();
         }
+        td.cell_vector[i].position = td.points[i];
 #ifdef CENTROID
         (td.cell_vector[i]).computeCentroid();
-#else
-        td.cell_vector[i].position = (td.rotation * glm::dvec4(td.cell_vector[i].position, 1.0)).xyz();
 #endif
+        batch.add(i);
+    }
+}
+
+void InitCapJobTask::process()
+{
+    CapJob & job = *td.job;
+    size_t size = job.indices.size();
+    job.cells = new VoronoiCell[size];
+    job.sites.resize(size);
+    job.completed = 0;
+    job.stats = {};
+
+    for (size_t i = 0; i < size; i++)
+    {
+        glm::dvec3 p = (job.rotation * glm::dvec4(td.points[job.indices[i]], 1.0)).xyz();
+        new(job.cells + i) VoronoiCell(p);
+        job.sites[i] = {p, job.cells + i};
+        computePolarAndAzimuth<X>(job.sites[i]);
+    }
+
+    sort(job.sites.begin(), job.sites.end(), VoronoiSiteCompare());
+}
+
+// margin for the rounding of the membership tests, in radians
+static const double CAP_JOB_MARGIN = 1e-9;
+
+// A corner is a vertex of the full diagram if no input point is closer to
+// it than its sites, so a cell is right when the circle of each corner
+// stays inside the job region. The y,z projection moves no two points
+// further apart than their angle, so for a tile the circle fits if its
+// projected bounding square does.
+static bool certifyCapJobCell(const CapJob & job, const VoronoiCell & cell, double reach)
+{
+    if (job.complete)
+        return true;
+    if (cell.corners.size() < 3)
+        return false;
+
+    for (const glm::dvec3 & c : cell.corners)
+    {
+        double radius = acos(glm::clamp(glm::dot(c, cell.position), -1.0, 1.0));
+        if (job.kind == CapRing)
+        {
+            if (acos(glm::clamp(c.x, -1.0, 1.0)) - radius < job.ringRadius - job.halo + CAP_JOB_MARGIN)
+                return false;
+        }
+        else if (job.kind == CapTile)
+        {
+            double offset = ::std::max(fabs(c.y - job.tileCenter.x), fabs(c.z - job.tileCenter.y));
+            if (offset + radius > job.tileHalfWidth + job.halo - CAP_JOB_MARGIN)
+                return false;
+        }
+        else if (job.kind == CapDisk)
+        {
+            if (acos(glm::clamp(glm::dot(c, job.diskCenter), -1.0, 1.0)) + radius > job.diskRadius - CAP_JOB_MARGIN)
+                return false;
+        }
+        else if (2.0 * radius > reach - CAP_JOB_MARGIN)
+            return false;
+    }
+    return true;
+}
+
+// Adding points only cuts a cell down, so every corner it ends up with is
+// within the farthest current corner r of its site, and the circle of that
+// corner within 2r.
+static double capJobCellReach(const VoronoiCell & cell)
+{
+    if (cell.corners.size() < 3)
+        return 2.0 * M_PI;
+
+    double farthest = 0.0;
+    for (const glm::dvec3 & c : cell.corners)
+        farthest = ::std::max(farthest, acos(glm::clamp(glm::dot(c, cell.position), -1.0, 1.0)));
+    return 2.0 * farthest + 4.0 * CAP_JOB_MARGIN;
+}
+
+void CollectCapJobTask::process()
+{
+    CapJob & job = *td.job;
+    SinkBatch batch(td.sink, td.cell_vector);
+
+    size_t uncertified = 0;
+    job.reach.resize(job.coreCount);
+    for (size_t i = 0; i < job.coreCount; i++)
+    {
+        VoronoiCell & cell = job.cells[i];
+        size_t index = job.indices[i];
+        if (!certifyCapJobCell(job, cell, job.reach[i]))
+        {
+            job.reach[uncertified] = capJobCellReach(cell);
+            job.indices[uncertified++] = index;
+            continue;
+        }
+
+        VoronoiCell & out = td.cell_vector[index];
+        out.corners = ::std::move(cell.corners);
+        for (glm::dvec3 & c : out.corners)
+            c = (job.rotation_inv * glm::dvec4(c, 1.0)).xyz();
+        out.position = td.points[index];
+#ifdef CENTROID
+        out.computeCentroid();
+#endif
+        out.m_arcs = 0;
+        out.m_owner.store(1);
+        batch.add(index);
+    }
+
+    job.coreCount = uncertified;
+    job.indices.resize(uncertified);
+    delete[] job.cells;
+    job.cells = NULL;
+    vector<VoronoiSite>().swap(job.sites);
+}
+
+void GenPointsTask::process()
+{
+    td.generator->getCounterPointsSphere(td.start, td.end - td.start + 1, td.points + td.start);
+}
+
+static_assert(sizeof(glm::dvec3) == 3 * sizeof(double), "corners are written as packed doubles");
+
+// size of a cell's record in the binary output, 0 for cells that are skipped
+static inline size_t recordSize(const VoronoiCell & cell)
+{
+    if (cell.m_arcs != 0 || cell.corners.size() < 3)
+        return 0;
+
+    size_t bytes = sizeof(int) + cell.corners.size() * sizeof(glm::dvec3);
+#ifdef CENTROID
+    bytes += sizeof(glm::dvec3);
+#endif
+    return bytes;
+}
+
+void RecordSizesTask::process()
+{
+    size_t bytes = 0;
+    for (size_t i = td.start; i <= td.end; i++)
+        bytes += recordSize(td.cells[i]);
+    *td.bytes = bytes;
+}
+
+void WriteRecordsTask::process()
+{
+    // flush at block boundaries of the file so the writes from different
+    // tasks only meet at the edges of their ranges
+    const size_t block = 1 << 22;
+
+    ::std::vector<char> buffer(block);
+    size_t used = 0;
+    size_t offset = td.offset;
+    size_t boundary = (offset / block + 1) * block;
+
+    auto flush = [&](size_t bytes)
+    {
+        if (!pwriteAll(td.fd, buffer.data(), bytes, offset))
+        {
+            *td.ok = 0;
+            return;
+        }
+        offset += bytes;
+        used -= bytes;
+        memmove(buffer.data(), buffer.data() + bytes, used);
+    };
+
+    for (size_t i = td.start; i <= td.end && *td.ok; i++)
+    {
+        const VoronoiCell & cell = td.cells[i];
+        size_t bytes = recordSize(cell);
+        if (bytes == 0)
+            continue;
+
+        if (used + bytes > buffer.size())
+            buffer.resize(used + bytes);
+
+        char* out = buffer.data() + used;
+        int numCorners = (int)cell.corners.size();
+        memcpy(out, &numCorners, sizeof(int)); out += sizeof(int);
+#ifdef CENTROID
+        memcpy(out, &cell.position, sizeof(glm::dvec3)); out += sizeof(glm::dvec3);
+#endif
+        memcpy(out, cell.corners.data(), numCorners * sizeof(glm::dvec3));
+        used += bytes;
+
+        while (offset + used >= boundary)
+        {
+            flush(boundary - offset);
+            boundary += block;
+        }
+    }
+
+    if (*td.ok && used)
+        flush(used);
+}
+
+bool pwriteAll(int fd, const void* data, size_t bytes, size_t offset)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        ssize_t n = pwrite(fd, (const char*)data + done, bytes - done, offset + done);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+bool preadAll(int fd, void* data, size_t bytes, size_t offset)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        ssize_t n = pread(fd, (char*)data + done, bytes - done, offset + done);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+void WriteResultTask::process()
+{
+    const size_t block = (1 << 22) / sizeof(glm::dvec3);
+    ::std::vector<glm::dvec3> buffer;
+    buffer.reserve(block);
+
+    // positions of the chunk are contiguous in the file, and so are its corners
+    size_t offset = td.header->positionsOffset + td.start * sizeof(glm::dvec3);
+    auto flush = [&]()
+    {
+        size_t bytes = buffer.size() * sizeof(glm::dvec3);
+        if (!pwriteAll(td.fd, buffer.data(), bytes, offset))
+            *td.ok = 0;
+        offset += bytes;
+        buffer.clear();
+    };
+
+    for (size_t i = td.start; i <= td.end && *td.ok; i++)
+    {
+        buffer.push_back(td.cells[i].position);
+        if (buffer.size() >= block)
+            flush();
     }
+    flush();
+
+    offset = td.header->cornersOffset + td.offsets[td.start] * sizeof(glm::dvec3);
+    for (size_t i = td.start; i <= td.end && *td.ok; i++)
+    {
+        buffer.insert(buffer.end(), td.cells[i].corners.begin(), td.cells[i].corners.end());
+        if (buffer.size() >= block)
+            flush();
+    }
+    flush();
+}
+
+void CountLinesTask::process()
+{
+    td.loader->countLines(td.chunk);
+}
+
+void ParseLinesTask::process()
+{
+    td.loader->parseLines(td.chunk);
+}
+
+void CheckPointsTask::process()
+{
+    td.loader->checkPoints(td.chunk);
+}
+
+void NormalizePointsTask::process()
+{
+    td.loader->normalizePoints(td.chunk);
+}
+
+void CountTilePointsTask::process()
+{
+    td.store->countTiles(td.chunk);
+}
+
+void FillTilePointsTask::process()
+{
+    td.store->fillTiles(td.chunk);
+}
+
+void MeshShardTask::process()
+{
+    td.exporter->shardCorners(td.index);
+}
+
+void MeshWeldTask::process()
+{
+    td.exporter->weldShard(td.index);
+}
+
+void MeshPlaceTask::process()
+{
+    td.exporter->placeShard(td.index);
+}
+
+void MeshLinkTask::process()
+{
+    td.exporter->linkShard(td.index);
+}
+
+void MeshFormatTask::process()
+{
+    td.exporter->format((MeshExporter::Format)td.format, td.chunk, *td.out);
+}
+
+void BinPointsTask::process()
+{
+    for (size_t i = td.start; i <= td.end; i++)
+        td.bins[i] = td.grid->getBin(td.cells ? td.cells[i].position : td.points[i]);
+}
+
+void VerifyCellsTask::process()
+{
+    SphereGrid::Query query;
+    ::std::vector<glm::dvec3> near;
+
+    for (size_t i = td.start; i <= td.end; i++)
+    {
+        const VoronoiCell & cell = td.cells[i];
+        td.result->corners += cell.corners.size();
+        if (cell.corners.size() < 3)
+            td.result->missingCorners++;
+        if (cell.m_arcs != 0)
+            td.result->openCells++;
+        if (cell.corners.empty())
+            continue;
+
+        // a site closer to a corner than this one lies within twice the
+        // distance of the farthest corner
+        double minCos = 1.0;
+        for (const glm::dvec3 & c : cell.corners)
+            minCos = glm::min(minCos, glm::dot(glm::normalize(c), cell.position));
+        double radius = acos(glm::max(minCos, -1.0));
+
+        near.clear();
+        td.grid->forEachInCap(cell.position, 2.0 * radius + 1e-9, query,
+            [&](size_t j, const glm::dvec3 & p) { if (j != i) near.push_back(p); });
+
+        for (const glm::dvec3 & corner : cell.corners)
+        {
+            glm::dvec3 c = corner;
+            c += (cell.position - c) * 0.01;
+
+            double iclose = glm::dot(cell.position, c);
+            for (const glm::dvec3 & p : near)
+            {
+                if (glm::dot(p, c) > iclose)
+                {
+                    td.result->incorrectCorners++;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void LocatorShardTask::process()
+{
+    td.locator->shardCorners(td.index);
+}
+
+void LocatorPairTask::process()
+{
+    td.locator->pairShard(td.index);
+}
+
+void LocatorNeighborsTask::process()
+{
+    td.locator->sortNeighbors(td.index);
+}
+
+void LocatePointsTask::process()
+{
+    td.locator->locate(td.points, td.cells, td.start, td.end);
+}
+
+void NearestSitesTask::process()
+{
+    td.locator->nearest(td.points, td.k, td.cells, td.start, td.end);
+}
+
+void WithinAngleTask::process()
+{
+    td.locator->withinAngle(td.points, td.angle, td.counts, td.offsets, *td.found, td.start, td.end);
+}
+
+void IncrementalPatchTask::process()
+{
+    td.diagram->findPatches(td.chunk);
+}
+
+void IncrementalClipTask::process()
+{
+    td.diagram->clipCells(td.chunk);
 }
 
 }
\ No newline at end of file
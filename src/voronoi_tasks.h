@@ -4,6 +4,16 @@
 #include "voronoi_site.h"
 #include "voronoi_cell.h"
 #include "task_graph.h"
+#include "sphere_grid.h"
+#include "voronoi_verifier.h"
+#include "mesh_exporter.h"
+#include "result_format.h"
+#include "point_loader.h"
+#include "tile_store.h"
+#include "point_locator.h"
+#include "anderson_mixer.h"
+#include "cell_measures.h"
+#include "incremental_diagram.h"
 #include <future>
 #include <vector>
 
@@ -13,30 +23,33 @@ using ::std::vector;
 using ::std::promise;
 using ::std::future;
 
-struct TaskDataRotatePoints
+struct TaskDataCells
 {
-    glm::dvec3* points;
+    VoronoiCell* cells;
+    const glm::dvec3* points;
     size_t start;
     size_t end;
-    glm::dmat4 rotation;
 };
 
-struct TaskDataCells
+struct TaskDataCellsResize
 {
     VoronoiCell* cells;
-    glm::dvec3* points;
+    const glm::dvec3* points;
     size_t start;
     size_t end;
+    vector<VoronoiSite>* sites;
+    size_t size;
 };
 
-struct TaskDataCellsResize
+// cap cells and sites built from the caller's points in the rotated frame
+struct TaskDataCapCells
 {
     VoronoiCell* cells;
-    glm::dvec3* points;
+    const glm::dvec3* points;
     size_t start;
     size_t end;
+    glm::dmat4 rotation;
     vector<VoronoiSite>* sites;
-    size_t size;
 };
 
 struct TaskDataSites
@@ -62,6 +75,8 @@ struct TaskDataDualSort
     std::unique_ptr<promise<bool>> p_done;
     future<VoronoiSite*> f_temp;
     future<bool> f_done;
+    bool warm;            // sites are in the order of a previous sort
+    VoronoiSite* scratch; // room for this half, allocated when NULL
 };
 
 struct TaskDataBucketDualSort
@@ -78,28 +93,213 @@ struct TaskDataSweep
     vector<VoronoiSite>* sites;
     size_t gen;
     uint8_t taskId;
+    SweepStats* stats;
+    CellSink* sink;
+    VoronoiCell* cells;
+    ::std::atomic<size_t>* completed; // NULL for completedCells
+    bool wideIndex; // index the nodes with WideIndex rather than NarrowIndex
+    bool floatScalar; // float nodes and events, for narrow sweeps
 };
 
-struct TaskDataSortCorners
+struct TaskDataRelax
 {
-    VoronoiCell* cell_vector;
+    const VoronoiCell* cells;
+    const glm::dvec3* points;
+    glm::dvec3* centroids;
     size_t start;
     size_t end;
+    double* energy;
+    double* movement;
+};
+
+struct TaskDataAnderson
+{
+    AndersonMixer* mixer;
+    size_t chunk;
+};
+
+struct TaskDataCellMeasures
+{
+    CellMeasures* measures;
+    size_t chunk;
 };
 
 struct TaskDataRotateCorners
 {
     VoronoiCell* cell_vector;
+    const glm::dvec3* points;
     size_t start;
     size_t end;
     glm::dmat4 rotation;
+    CellSink* sink;
 };
 
-class RotatePointsTask : public Task
+enum CapJobKind
 {
-    public:
-        void process();
-        TaskDataRotatePoints td;
+    CapTile,  // a square of the y,z plane inside the ring
+    CapRing,  // the border of the cap
+    CapCells, // cells left uncertain by an earlier job
+    CapDisk   // a tile of a tiled run with every point near it
+};
+
+// One part of a split cap run. The job sweeps its own points and keeps
+// the cells of its core points whose corners provably do not depend on
+// the points it left out. Regions are in the cap frame, where the center
+// of the cap is +X.
+struct CapJob
+{
+    glm::dmat4 rotation;            // input frame to the cap frame
+    glm::dmat4 rotation_inv;
+    CapJobKind kind;
+    glm::dvec2 tileCenter;          // tile: square holding the core
+    double tileHalfWidth;
+    double ringRadius;              // ring: core points are beyond it from +X
+    double halo;                    // tile and ring: points this far outside the core are in the job
+    glm::dvec3 diskCenter;          // disk: every point within diskRadius of diskCenter is in the job
+    double diskRadius;
+    ::std::vector<double> reach;    // cells: points within reach[i] of core point i are in the job.
+                                    // after a run, the reach each leftover core point needs
+    bool complete;                  // every input point is in the job
+    ::std::vector<size_t> indices;  // input points of the job, core points first
+    size_t coreCount;
+
+    VoronoiCell* cells;
+    vector<VoronoiSite> sites;
+    ::std::atomic<size_t> completed;
+    SweepStats stats;
+};
+
+struct TaskDataCapJob
+{
+    CapJob* job;
+    const glm::dvec3* points;
+    VoronoiCell* cell_vector;
+    CellSink* sink;
+};
+
+struct TaskDataGenPoints
+{
+    const SampleGenerator* generator;
+    glm::dvec3* points;
+    size_t start;
+    size_t end;
+};
+
+struct TaskDataRecordSizes
+{
+    const VoronoiCell* cells;
+    size_t start;
+    size_t end;
+    size_t* bytes;
+};
+
+struct TaskDataWriteRecords
+{
+    const VoronoiCell* cells;
+    size_t start;
+    size_t end;
+    int fd;
+    size_t offset;
+    char* ok;
+};
+
+struct TaskDataWriteResult
+{
+    const VoronoiCell* cells;
+    size_t start;
+    size_t end;
+    int fd;
+    const ResultHeader* header;
+    const uint64_t* offsets;
+    char* ok;
+};
+
+struct TaskDataPointLoader
+{
+    PointLoader* loader;
+    size_t chunk;
+};
+
+struct TaskDataTileStore
+{
+    TileStore* store;
+    size_t chunk;
+};
+
+struct TaskDataMesh
+{
+    MeshExporter* exporter;
+    size_t index;
+};
+
+struct TaskDataMeshFormat
+{
+    const MeshExporter* exporter;
+    int format;
+    size_t chunk;
+    ::std::string* out;
+};
+
+struct TaskDataBinPoints
+{
+    const VoronoiCell* cells; // binned by position, unless NULL
+    const glm::dvec3* points;
+    size_t start;
+    size_t end;
+    const SphereGrid* grid;
+    size_t* bins;
+};
+
+struct TaskDataVerify
+{
+    const VoronoiCell* cells;
+    size_t start;
+    size_t end;
+    const SphereGrid* grid;
+    VerifyResult* result;
+};
+
+struct TaskDataLocator
+{
+    PointLocator* locator;
+    size_t index;
+};
+
+struct TaskDataLocate
+{
+    const PointLocator* locator;
+    const glm::dvec3* points;
+    size_t* cells;
+    size_t start;
+    size_t end;
+};
+
+struct TaskDataNearest
+{
+    const PointLocator* locator;
+    const glm::dvec3* points;
+    size_t k;
+    size_t* cells;
+    size_t start;
+    size_t end;
+};
+
+struct TaskDataWithinAngle
+{
+    const PointLocator* locator;
+    const glm::dvec3* points;
+    double angle;
+    size_t* counts;
+    size_t* offsets;
+    ::std::vector<size_t>* found;
+    size_t start;
+    size_t end;
+};
+
+struct TaskDataIncremental
+{
+    IncrementalDiagram* diagram;
+    size_t chunk;
 };
 
 class InitCellsTask : public Task
@@ -116,6 +316,22 @@ class InitCellsAndResizeSitesTask : public Task
         TaskDataCellsResize td;
 };
 
+// puts the cells of the last run back at their points, keeping the
+// memory of their corners
+class ResetCellsTask : public Task
+{
+    public:
+        void process();
+        TaskDataCells td;
+};
+
+class InitCapCellsTask : public Task
+{
+    public:
+        void process();
+        TaskDataCapCells td;
+};
+
 template <Axis A>
 class InitSitesTask : public Task
 {
@@ -124,6 +340,16 @@ class InitSitesTask : public Task
         TaskDataSites td;
 };
 
+// moves the sites of the last run to their cells' new positions, leaving
+// them in the order of the last sort
+template <Axis A>
+class UpdateSitesTask : public Task
+{
+    public:
+        void process();
+        TaskDataSites td;
+};
+
 class SortPoints1Task : public Task
 {
     public:
@@ -160,18 +386,237 @@ class SweepTask : public Task
         TaskDataSweep td;
 };
 
-class SortCellCornersTask : public Task
+class RelaxCellsTask : public Task
 {
     public:
         void process();
-        TaskDataSortCorners td;
+        TaskDataRelax td;
 };
 
-class SortCornersRotateTask : public Task
+class AndersonRecordTask : public Task
+{
+    public:
+        void process();
+        TaskDataAnderson td;
+};
+
+class AndersonExtrapolateTask : public Task
+{
+    public:
+        void process();
+        TaskDataAnderson td;
+};
+
+class CellMeasuresTask : public Task
+{
+    public:
+        void process();
+        TaskDataCellMeasures td;
+};
+
+// takes the cells of a cap run back from the cap frame
+class RotateCellsTask : public Task
 {
     public:
         void process();
         TaskDataRotateCorners td;
 };
 
+// builds and sorts the cells and sites of a cap job
+class InitCapJobTask : public Task
+{
+    public:
+        void process();
+        TaskDataCapJob td;
+};
+
+// moves the certified core cells of a cap job to the output and leaves
+// the rest as the core of the next attempt
+class CollectCapJobTask : public Task
+{
+    public:
+        void process();
+        TaskDataCapJob td;
+};
+
+class GenPointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataGenPoints td;
+};
+
+class RecordSizesTask : public Task
+{
+    public:
+        void process();
+        TaskDataRecordSizes td;
+};
+
+class WriteRecordsTask : public Task
+{
+    public:
+        void process();
+        TaskDataWriteRecords td;
+};
+
+class WriteResultTask : public Task
+{
+    public:
+        void process();
+        TaskDataWriteResult td;
+};
+
+class CountLinesTask : public Task
+{
+    public:
+        void process();
+        TaskDataPointLoader td;
+};
+
+class ParseLinesTask : public Task
+{
+    public:
+        void process();
+        TaskDataPointLoader td;
+};
+
+class CheckPointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataPointLoader td;
+};
+
+class NormalizePointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataPointLoader td;
+};
+
+class CountTilePointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataTileStore td;
+};
+
+class FillTilePointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataTileStore td;
+};
+
+class MeshShardTask : public Task
+{
+    public:
+        void process();
+        TaskDataMesh td;
+};
+
+class MeshWeldTask : public Task
+{
+    public:
+        void process();
+        TaskDataMesh td;
+};
+
+class MeshPlaceTask : public Task
+{
+    public:
+        void process();
+        TaskDataMesh td;
+};
+
+class MeshLinkTask : public Task
+{
+    public:
+        void process();
+        TaskDataMesh td;
+};
+
+class MeshFormatTask : public Task
+{
+    public:
+        void process();
+        TaskDataMeshFormat td;
+};
+
+// pwrite that retries until every byte is written
+bool pwriteAll(int fd, const void* data, size_t bytes, size_t offset);
+// pread that retries until every byte is read, false at the end of the file
+bool preadAll(int fd, void* data, size_t bytes, size_t offset);
+
+class BinPointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataBinPoints td;
+};
+
+class VerifyCellsTask : public Task
+{
+    public:
+        void process();
+        TaskDataVerify td;
+};
+
+class LocatorShardTask : public Task
+{
+    public:
+        void process();
+        TaskDataLocator td;
+};
+
+class LocatorPairTask : public Task
+{
+    public:
+        void process();
+        TaskDataLocator td;
+};
+
+class LocatorNeighborsTask : public Task
+{
+    public:
+        void process();
+        TaskDataLocator td;
+};
+
+class LocatePointsTask : public Task
+{
+    public:
+        void process();
+        TaskDataLocate td;
+};
+
+class NearestSitesTask : public Task
+{
+    public:
+        void process();
+        TaskDataNearest td;
+};
+
+class WithinAngleTask : public Task
+{
+    public:
+        void process();
+        TaskDataWithinAngle td;
+};
+
+class IncrementalPatchTask : public Task
+{
+    public:
+        void process();
+        TaskDataIncremental td;
+};
+
+class IncrementalClipTask : public Task
+{
+    public:
+        void process();
+        TaskDataIncremental td;
+};
+
 }
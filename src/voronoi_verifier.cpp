@@ -0,0 +1,60 @@
+#include "voronoi_verifier.h"
+#include "voronoi_tasks.h"
+#include <algorithm>
+
+namespace VorGen {
+
+using ::std::unique_ptr;
+
+VoronoiVerifier::VoronoiVerifier(int threads)
+{
+    m_threads = ::std::max(threads, 0);
+}
+
+VerifyResult VoronoiVerifier::verify(const VoronoiCell* cells, size_t count, bool complete)
+{
+    VerifyResult result = {};
+    result.cells = count;
+    result.complete = complete;
+    if (count == 0) return result;
+
+    m_grid.build(cells, count, m_threads);
+
+    size_t chunks = ::std::min((size_t)(m_threads + 1) * 4, ::std::min(count, (size_t)64));
+    ::std::vector<VerifyResult> partial(chunks, VerifyResult{});
+
+    TaskGraph tg;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        VerifyCellsTask* task = new VerifyCellsTask;
+        task->td = TaskDataVerify{cells, count * c / chunks, count * (c + 1) / chunks - 1, &m_grid, &partial[c]};
+        tg.addTask(unique_ptr<Task>(task));
+    }
+    tg.finalizeGraph();
+    tg.processTasks(m_threads);
+
+    for (const VerifyResult & p : partial)
+    {
+        result.corners += p.corners;
+        result.incorrectCorners += p.incorrectCorners;
+        result.missingCorners += p.missingCorners;
+        result.openCells += p.openCells;
+    }
+    return result;
+}
+
+void VerifyResult::print(FILE* out) const
+{
+    fprintf(out, "cells              %zu\n", cells);
+    fprintf(out, "corners            %zu\n", corners);
+    fprintf(out, "incorrect corners  %zu\n", incorrectCorners);
+    fprintf(out, "cells < 3 corners  %zu\n", missingCorners);
+    fprintf(out, "open cells         %zu\n", openCells);
+    if (complete)
+        fprintf(out, "euler (V - E + F)  %.2f\n", cells - corners / 6.0);
+    else
+        fprintf(out, "partial run, only corners checked\n");
+    fprintf(out, "%s\n", isValid() ? "valid" : "INVALID");
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "voronoi_cell.h"
+#include "sphere_grid.h"
+#include <cstdio>
+
+namespace VorGen {
+
+struct VerifyResult
+{
+    size_t cells;
+    size_t corners;
+    size_t incorrectCorners; // corners closer to another site than to their own
+    size_t missingCorners;   // cells with fewer than 3 corners
+    size_t openCells;        // cells still holding arcs when the sweeps ended
+    bool complete;           // every cell was generated
+
+    // with three cells meeting at every corner V = C/3 and E = C/2,
+    // so V - E + F = 2 on the sphere means C = 6F - 12
+    bool eulerHolds() const { return 6 * cells == corners + 12; }
+
+    // a sweep may end with 2 arcs on the beachline after adding the
+    // vertex they converge to, so those cells are still complete. A run
+    // that generated only some of the cells leaves the rest empty or
+    // open, so only its corners are checked.
+    bool isValid() const
+    {
+        return incorrectCorners == 0 &&
+               (!complete || (missingCorners == 0 && openCells <= 2 && eulerHolds()));
+    }
+
+    void print(FILE* out = stdout) const;
+};
+
+/*
+    Checks a diagram in near linear time. Every corner of a cell must be
+    at least as close to the cell's site as to any other site. The sites
+    that could violate that lie within twice the cell's circumradius, so
+    they are found through a SphereGrid instead of scanning every cell.
+*/
+
+class VoronoiVerifier
+{
+    public:
+
+        VoronoiVerifier(int threads = 6);
+
+        // complete is false when generate was asked for fewer cells
+        // than sites
+        VerifyResult verify(const VoronoiCell* cells, size_t count, bool complete = true);
+
+    private:
+
+        int m_threads;
+        SphereGrid m_grid;
+};
+
+}
@@ -9,8 +9,17 @@
 #include <iostream>
 #include <vector>
 #include <future>
+#include <fstream>
+#include <map>
 #include "../src/task_graph.h"
 #include "../src/voronoi_tasks.h"
+#include "../src/result_reader.h"
+#include "../src/shard_coordinator.h"
+#include "../src/point_locator.h"
+#include "../src/cell_measures.h"
+#include "../src/incremental_diagram.h"
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../glm/gtc/matrix_transform.hpp"
 
 #define _USE_MATH_DEFINES
@@ -21,6 +30,32 @@
 
 namespace VorGen {
 
+// counts corners that are closer to another site than to their own
+static unsigned int countIncorrectCorners(VoronoiCell* cells, size_t size)
+{
+    unsigned int incorrect = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        VoronoiCell* b = cells + i;
+        for (auto ct = b->corners.begin(); ct != b->corners.end(); ++ct)
+        {
+            glm::dvec3 c = *ct;
+            c += (b->position - c) * 0.01;
+
+            long double iclose = glm::dot(b->position, c);
+            for (size_t j = 0; j < size; ++j)
+            {
+                if (j != i && glm::dot(cells[j].position, c) > iclose)
+                {
+                    incorrect++;
+                    break;
+                }
+            }
+        }
+    }
+    return incorrect;
+}
+
 TEST(VoronoiTests, TestIntersect)
 {
     glm::dvec3 p1 = glm::normalize(glm::dvec3(1.0, 1.0, 0.0));
@@ -28,7 +63,7 @@ TEST(VoronoiTests, TestIntersect)
     glm::dvec3 p3 = glm::normalize(glm::dvec3(-1.0, -1.0, 0.0));
     glm::dvec3 p4 = glm::normalize(glm::dvec3(1.0, -1.0, 0.0));
 
-    SkipNode<Increasing> sn = SkipNode<Increasing>{0};
+    SkipNode<Increasing, NarrowIndex, double> sn = SkipNode<Increasing, NarrowIndex, double>{0};
     
     SweepLine sl;
     sl.m_polar = 3.0;
@@ -56,7 +91,7 @@ TEST(VoronoiTests, TestIntersectDegenerateParabola)
     glm::dvec3 p1 = glm::normalize(glm::dvec3(1.0,1.0,0.5f));
     glm::dvec3 p2 = glm::normalize(glm::dvec3(1.0,1.0,0.0));
 
-    SkipNode<Increasing> sn = SkipNode<Increasing>{0};
+    SkipNode<Increasing, NarrowIndex, double> sn = SkipNode<Increasing, NarrowIndex, double>{0};
 
     SweepLine sl;
     sl.m_polar = acos(p2.z);
@@ -75,9 +110,192 @@ TEST(VoronoiTests, TestIntersectDegenerateParabola)
     EXPECT_DOUBLE_EQ(results[1], s2.m_azimuth);
 }
 
+TEST(VoronoiTests, TestIntersectOnSweepline)
+{
+    // sites on the sweepline together meet at their bisector
+    glm::dvec3 p1 = glm::normalize(glm::dvec3(1.0, 1.0, 0.0));
+    glm::dvec3 p2 = glm::normalize(glm::dvec3(-1.0, 1.0, 0.0));
+    glm::dvec3 p3 = glm::normalize(glm::dvec3(-1.0, -1.0, 0.0));
+    glm::dvec3 p4 = glm::normalize(glm::dvec3(1.0, -1.0, 0.0));
+
+    SkipNode<Increasing, NarrowIndex, double> sn = SkipNode<Increasing, NarrowIndex, double>{0};
+
+    SweepLine sl;
+    sl.m_polar = acos(p1.z);
+    sl.m_polCos = p1.z;
+    sl.m_polSin = sin(sl.m_polar);
+
+    VoronoiSite s1 = VoronoiSite(p1, NULL);
+    computePolarAndAzimuth<Z>(s1);
+    VoronoiSite s2 = VoronoiSite(p2, NULL);
+    computePolarAndAzimuth<Z>(s2);
+    VoronoiSite s3 = VoronoiSite(p3, NULL);
+    computePolarAndAzimuth<Z>(s3);
+    VoronoiSite s4 = VoronoiSite(p4, NULL);
+    computePolarAndAzimuth<Z>(s4);
+
+    ALIGN(16) double results[2];
+    sn.intersect2(&s1, &s2, &s3, &s4, sl, 0.0, results);
+
+    EXPECT_NEAR(results[1], M_PI / 2.0, 1e-15);
+    EXPECT_NEAR(results[0], 3.0 * M_PI / 2.0, 1e-15);
+}
+
+// cells of b without the corners of a in the same order, from some
+// starting corner
+static size_t countDifferentCells(const VoronoiCell* a, const VoronoiCell* b, size_t count)
+{
+    size_t different = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const ::std::vector<glm::dvec3> & ca = a[i].corners;
+        const ::std::vector<glm::dvec3> & cb = b[i].corners;
+        size_t start = 0;
+        while (start < cb.size() && glm::length(cb[start] - ca[0]) > 1e-12)
+            start++;
+        bool same = ca.size() == cb.size() && start < cb.size();
+        for (size_t j = 0; same && j < ca.size(); j++)
+            same = glm::length(cb[(start + j) % cb.size()] - ca[j]) <= 1e-12;
+        if (!same)
+            different++;
+    }
+    return different;
+}
+
+TEST(VoronoiTests, TestNodeIndex)
+{
+    EXPECT_LT(sizeof(MemBlock<Increasing, NarrowIndex, double>), sizeof(MemBlock<Increasing, WideIndex, double>));
+
+    // neighbours are found in either direction from a node's own index
+    // as the sweeper lays them out, in raw memory, past the narrow range
+    ::std::vector<char> memory(3 * sizeof(MemBlock<Increasing, WideIndex, double>));
+    MemBlock<Increasing, WideIndex, double>* blocks = (MemBlock<Increasing, WideIndex, double>*)memory.data();
+    for (size_t i = 0; i < 3; i++)
+        blocks[i].skipNode.index = (WideIndex)(2 * NARROW_SWEEP_SITES + i);
+    EXPECT_EQ(&blocks[0].skipNode, getPointerFromIndex(&blocks[2].skipNode, blocks[0].skipNode.index));
+    EXPECT_EQ(&blocks[2].skipNode, getPointerFromIndex(&blocks[0].skipNode, blocks[2].skipNode.index));
+
+    // with no sites left to the narrow index every sweep is wide, and makes
+    // the cells the narrow sweeps do
+    size_t count = 20000;
+    VoronoiGenerator narrow(1);
+    VoronoiGenerator wide(1);
+    wide.m_narrowSweepSites = 0;
+    EXPECT_FALSE(narrow.isWideSweep(count));
+    EXPECT_TRUE(wide.isWideSweep(count));
+
+    glm::dvec3* points = narrow.genRandomInputParallel(count);
+    VoronoiCell* a = narrow.generate(points, count, count, false);
+    VoronoiCell* b = wide.generate(points, count, count, false);
+    EXPECT_TRUE(VoronoiVerifier().verify(b, count).isValid());
+
+    EXPECT_EQ((size_t)0, countDifferentCells(a, b, count));
+    delete[] a;
+    delete[] b;
+
+    // a cap's sweep as well
+    ::std::vector<glm::dvec3> cap;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (points[i].z > 0.9)
+            cap.push_back(points[i]);
+    }
+    delete[] points;
+    VoronoiCell* cells = wide.generateCap(glm::dvec3(0.0, 0.0, 1.0), cap.data(), cap.size());
+    ASSERT_TRUE(cells != NULL);
+    EXPECT_TRUE(VoronoiVerifier().verify(cells, wide.m_size).isValid());
+    delete[] cells;
+
+    // a run too large to index even so is refused before anything is read
+    glm::dvec3 point(1.0, 0.0, 0.0);
+    if (MAX_SWEEP_SITES < SIZE_MAX)
+    {
+        EXPECT_TRUE(wide.generate(&point, MAX_SWEEP_SITES + 1, MAX_SWEEP_SITES + 1, false) == NULL);
+    }
+}
+
+TEST(VoronoiTests, TestFloatSweeps)
+{
+    EXPECT_LE(2 * sizeof(CircleEvent<Increasing, float>), sizeof(CircleEvent<Increasing, double>));
+    EXPECT_LT(sizeof(MemBlock<Increasing, NarrowIndex, float>), sizeof(MemBlock<Increasing, NarrowIndex, double>));
+
+    // float range ends are within their bounds of the double ones, for
+    // sites from far apart down to nearly on top of each other, and
+    // sweeplines from far past them down to nearly on the later one
+    SkipNode<Increasing, NarrowIndex, float> sn(0);
+    ::std::default_random_engine re(3);
+    ::std::uniform_real_distribution<double> unif(0.0, 1.0);
+    size_t outside = 0;
+    size_t unbounded = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        glm::dvec3 p = glm::normalize(glm::dvec3(unif(re), unif(re), unif(re)) - 0.5);
+        double spread = pow(10.0, -4.0 * unif(re));
+        glm::dvec3 q = glm::normalize(p + spread * (glm::dvec3(unif(re), unif(re), unif(re)) - 0.5));
+        VoronoiSite a(p, NULL);
+        VoronoiSite b(q, NULL);
+        computePolarAndAzimuth<Z>(a);
+        computePolarAndAzimuth<Z>(b);
+
+        SweepLine sl;
+        sl.m_polar = ::std::min(::std::max(a.m_polar, b.m_polar) + spread * pow(10.0, -4.0 * unif(re)), M_PI);
+        sl.m_polCos = cos(sl.m_polar);
+        sl.m_polSin = sin(sl.m_polar);
+        double shift = 2.0 * M_PI * unif(re);
+
+        ALIGN(16) double ends[2];
+        ALIGN(16) double errs[2];
+        sn.intersect2(&a, &b, &b, &a, sl, shift, ends, errs);
+        double exact[2] = { sn.intersect(&b, &a, sl, shift), sn.intersect(&a, &b, sl, shift) };
+        for (int l = 0; l < 2; l++)
+        {
+            double diff = fabs(ends[l] - exact[l]);
+            diff = ::std::min(diff, 2.0 * M_PI - diff);
+            if (!(errs[l] < 1e-3))
+                unbounded++;
+            else if (diff > errs[l])
+                outside++;
+        }
+    }
+    EXPECT_EQ((size_t)0, outside);
+    // only ends near degenerate are left to the double fallback whole
+    EXPECT_LT(unbounded, (size_t)2000);
+
+    // float sweeps make the cells double sweeps do, settling what float
+    // cannot in double
+    size_t count = 100000;
+    VoronoiGenerator vgDouble(1);
+    VoronoiGenerator vgFloat(1);
+    vgFloat.setFloatSweeps(true);
+    glm::dvec3* points = vgDouble.genRandomInputParallel(count);
+    VoronoiCell* a = vgDouble.generate(points, count, count, false);
+    VoronoiCell* b = vgFloat.generate(points, count, count, false);
+    EXPECT_TRUE(VoronoiVerifier().verify(b, count).isValid());
+    EXPECT_EQ((size_t)0, countDifferentCells(a, b, count));
+    delete[] a;
+    delete[] b;
+
+    // and caps, split into jobs and not
+    for (double z : { 0.99, 0.9 })
+    {
+        ::std::vector<glm::dvec3> cap;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (points[i].z > z)
+                cap.push_back(points[i]);
+        }
+        VoronoiCell* cells = vgFloat.generateCap(glm::dvec3(0.0, 0.0, 1.0), cap.data(), cap.size());
+        ASSERT_TRUE(cells != NULL);
+        EXPECT_TRUE(VoronoiVerifier().verify(cells, vgFloat.m_size).isValid()) << "cap above " << z;
+        delete[] cells;
+    }
+    delete[] points;
+}
+
 TEST(VoronoiTests, TestVerifyResult)
 {
-    for (int w = 0; w < 12; w++)
+    VoronoiVerifier verifier;
+    for (int w = 0; w < 15; w++)
     {
         VoronoiGenerator vg;
         size_t count = (int)pow(10, ((w / 3) + 1));
@@ -86,52 +304,1007 @@ TEST(VoronoiTests, TestVerifyResult)
         delete[] points;
 
         // verify that each corner is closest to its origin point
-        //unsigned int corner_sum = 0;
-        unsigned int incorrect = 0;
-        unsigned int corner_count_incorrect = 0;
-        for (unsigned int i = 0; i < vg.m_size; ++i)
+        VerifyResult r = verifier.verify(cells, vg.m_size);
+        delete[] cells;
+
+        // assert correctness == 100%
+        EXPECT_EQ((size_t)0, r.incorrectCorners);
+        EXPECT_EQ((size_t)0, r.missingCorners);
+        EXPECT_LE(r.openCells, (size_t)2);
+        EXPECT_TRUE(r.eulerHolds()) << r.corners << " corners for " << count << " cells";
+        EXPECT_GE(completedCells+2, count); // there may be 2 arcs on the beachline, but the vertex they converge to has been added
+    }
+}
+
+TEST(VoronoiTests, TestVerifierMatchesBruteForce)
+{
+    VoronoiGenerator vg;
+    size_t count = 5000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    VoronoiVerifier verifier(3);
+    VerifyResult r = verifier.verify(cells, count);
+    EXPECT_TRUE(r.isValid());
+    EXPECT_EQ((size_t)0, r.incorrectCorners);
+
+    // move one corner of every 10th cell onto a neighbouring site and drop
+    // a corner from another cell, both checks should see the damage
+    for (size_t i = 0; i < count; i += 10)
+        cells[i].corners[0] = cells[(i + 1) % count].position;
+    cells[1].corners.resize(2);
+
+    r = verifier.verify(cells, count);
+    EXPECT_EQ((size_t)countIncorrectCorners(cells, count), r.incorrectCorners);
+    EXPECT_GT(r.incorrectCorners, (size_t)0);
+    EXPECT_EQ((size_t)1, r.missingCorners);
+    EXPECT_FALSE(r.eulerHolds());
+    EXPECT_FALSE(r.isValid());
+    delete[] cells;
+
+    // a run generating a quarter of the cells leaves the rest empty, only
+    // its corners are checked
+    points = vg.genRandomInput(count);
+    cells = vg.generate(points, count, count / 4, false);
+    delete[] points;
+    r = verifier.verify(cells, count, false);
+    EXPECT_GT(r.missingCorners, (size_t)0);
+    EXPECT_EQ((size_t)0, r.incorrectCorners);
+    EXPECT_TRUE(r.isValid());
+    EXPECT_FALSE(verifier.verify(cells, count).isValid());
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestSweepStats)
+{
+    VoronoiGenerator vg;
+    size_t count = 100000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    // every cell is owned by exactly one sweep and completed by its owner
+    size_t owned = 0;
+    size_t completed = 0;
+    EXPECT_EQ((size_t)6, vg.getSweepCount());
+    for (size_t i = 0; i < vg.getSweepCount(); i++)
+    {
+        const SweepStats & s = vg.getSweepStats(i);
+        EXPECT_LE(s.wastedSiteEvents, s.siteEvents);
+        EXPECT_LE(s.wastedCircleEvents, s.circleEvents);
+        EXPECT_LE(s.discardedCorners, 3 * s.circleEvents);
+        EXPECT_LE(s.cellsCompleted, s.siteEvents - s.wastedSiteEvents);
+        owned += s.siteEvents - s.wastedSiteEvents;
+        completed += s.cellsCompleted;
+    }
+    EXPECT_EQ(count, owned);
+    EXPECT_EQ((size_t)completedCells, completed);
+
+    size_t cellsOwned[6] = {};
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t owner = cells[i].m_owner;
+        ASSERT_NE(0, owner);
+        ASSERT_EQ(0, owner & (owner - 1)); // a single owner bit
+        cellsOwned[__builtin_ctz(owner)]++;
+    }
+    for (size_t i = 0; i < vg.getSweepCount(); i++)
+    {
+        const SweepStats & s = vg.getSweepStats(i);
+        EXPECT_EQ(cellsOwned[i], s.siteEvents - s.wastedSiteEvents);
+    }
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestParallelRandomInput)
+{
+    size_t count = 100003;
+    SampleGenerator sg(42);
+    ::std::vector<glm::dvec3> serial(count);
+    sg.getCounterPointsSphere(0, count, serial.data());
+
+    // same points whatever the thread count or chunking
+    for (int threads : {3, 4, 7})
+    {
+        VoronoiGenerator vg(42);
+        vg.setWorkerThreads(threads);
+        glm::dvec3* points = vg.genRandomInputParallel(count);
+        for (size_t i = 0; i < count; i++)
+            ASSERT_TRUE(serial[i] == points[i]) << "point " << i << " with " << threads << " threads";
+        delete[] points;
+    }
+
+    glm::dvec3 range[10];
+    sg.getCounterPointsSphere(500, 10, range);
+    for (size_t i = 0; i < 10; i++)
+        EXPECT_TRUE(serial[500 + i] == range[i]);
+
+    glm::dvec3 sum(0.0);
+    for (size_t i = 0; i < count; i++)
+    {
+        EXPECT_NEAR(1.0, glm::length(serial[i]), 1e-12);
+        sum += serial[i];
+    }
+    EXPECT_LT(glm::length(sum) / count, 0.01);
+
+    SampleGenerator other(43);
+    other.getCounterPointsSphere(0, 1, range);
+    EXPECT_FALSE(serial[0] == range[0]);
+}
+
+TEST(VoronoiTests, TestWriteDataToFile)
+{
+    // large enough that every task flushes at several block boundaries
+    VoronoiGenerator vg(3);
+    size_t count = 200000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    ::std::string path = "output/voronoi_data_test";
+    ASSERT_TRUE(vg.writeDataToFile(path.c_str()));
+
+    // read the records back in order, skipping cells the writer leaves out
+    ::std::ifstream file(path, ::std::ifstream::binary);
+    ASSERT_TRUE(file.is_open());
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cells[i].m_arcs != 0 || cells[i].corners.size() < 3)
+            continue;
+
+        int numCorners = 0;
+        file.read(reinterpret_cast<char*>(&numCorners), sizeof(int));
+        ASSERT_EQ(cells[i].corners.size(), (size_t)numCorners) << "cell " << i;
+#ifdef CENTROID
+        glm::dvec3 centroid;
+        file.read(reinterpret_cast<char*>(&centroid), sizeof(glm::dvec3));
+        EXPECT_TRUE(centroid == cells[i].position);
+#endif
+        for (int j = 0; j < numCorners; j++)
+        {
+            glm::dvec3 c;
+            file.read(reinterpret_cast<char*>(&c), sizeof(glm::dvec3));
+            ASSERT_TRUE(c == cells[i].corners[j]) << "cell " << i << " corner " << j;
+        }
+    }
+    EXPECT_EQ(::std::ifstream::traits_type::eof(), file.peek());
+    file.close();
+    remove(path.c_str());
+
+    EXPECT_FALSE(vg.writeDataToFile("/nonexistent/voronoi_data"));
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestMeshExporter)
+{
+    VoronoiGenerator vg(4);
+    size_t count = 20000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    MeshExporter exporter(3);
+    exporter.build(cells, count);
+
+    // every Voronoi vertex appears once and is shared by 3 faces
+    ::std::vector<int> uses(exporter.getVertexCount(), 0);
+    size_t corners = 0;
+    for (size_t f = 0; f < exporter.getFaceCount(); f++)
+    {
+        const VoronoiCell & cell = cells[exporter.getFaceCell(f)];
+        ASSERT_EQ(cell.corners.size(), exporter.getFaceSize(f));
+        for (size_t j = 0; j < exporter.getFaceSize(f); j++)
         {
-            VoronoiCell* b = cells + i;
-            //corner_sum += (unsigned int)b->corners.size();
+            uint32_t v = exporter.getFace(f)[j];
+            ASSERT_LT(v, exporter.getVertexCount());
+            EXPECT_LT(glm::length(exporter.getVertex(v) - cell.corners[j]), 1e-9);
+            uses[v]++;
+        }
+        corners += exporter.getFaceSize(f);
+    }
+    EXPECT_EQ(2 * count - 4, exporter.getVertexCount());
+    EXPECT_EQ(0, ::std::count_if(uses.begin(), uses.end(), [](int u) { return u != 3; }));
+
+    // the same mesh whatever the number of threads
+    MeshExporter serial(0);
+    serial.build(cells, count);
+    ASSERT_EQ(exporter.getVertexCount(), serial.getVertexCount());
+    for (size_t f = 0; f < exporter.getFaceCount(); f++)
+        for (size_t j = 0; j < exporter.getFaceSize(f); j++)
+            ASSERT_EQ(exporter.getFace(f)[j], serial.getFace(f)[j]);
+
+    // OBJ coordinates read back exactly
+    ::std::string path = "output/voronoi_mesh_test.obj";
+    ASSERT_TRUE(exporter.writeOBJ(path.c_str()));
+    ::std::ifstream obj(path);
+    ::std::string line;
+    size_t v = 0, f = 0;
+    while (::std::getline(obj, line))
+    {
+        if (line[0] == 'v')
+        {
+            glm::dvec3 p;
+            ASSERT_EQ(3, sscanf(line.c_str(), "v %lf %lf %lf", &p.x, &p.y, &p.z));
+            ASSERT_TRUE(p == exporter.getVertex(v++));
+        }
+        else if (line[0] == 'f')
+            f++;
+    }
+    obj.close();
+    remove(path.c_str());
+    EXPECT_EQ(exporter.getVertexCount(), v);
+    EXPECT_EQ(exporter.getFaceCount(), f);
+
+    // PLY is the header then fixed size vertex and face records
+    path = "output/voronoi_mesh_test.ply";
+    ASSERT_TRUE(exporter.writePLY(path.c_str()));
+    ::std::ifstream ply(path, ::std::ifstream::binary);
+    size_t header = 0;
+    while (::std::getline(ply, line))
+    {
+        header += line.size() + 1;
+        if (line == "end_header") break;
+    }
+    ply.seekg(0, ::std::ios::end);
+    EXPECT_EQ(header + exporter.getVertexCount() * 24 + exporter.getFaceCount() + corners * 4, (size_t)ply.tellg());
+    ply.close();
+    remove(path.c_str());
 
-            for (auto ct = b->corners.begin(); ct != b->corners.end(); ++ct)
-            {
-                glm::dvec3 c = *ct;
-                c += (b->position - c) * 0.01;
+    delete[] cells;
+}
 
-                long double iclose = glm::dot(b->position, c);
+TEST(VoronoiTests, TestMeshExporterWeldAcrossBuckets)
+{
+    // three cells meet at a vertex on the face between two buckets, each
+    // computed it a little to one side or the other
+    glm::dvec3 v = glm::normalize(glm::dvec3(1.0, 0.5, 0.25));
+    v.x = (floor(v.x * WELD_SCALE) + 0.5) / WELD_SCALE;
+    glm::dvec3 copies[3] = { v, v, v };
+    copies[0].x = nextafter(v.x, 0.0);
+    copies[2].x = nextafter(v.x, 2.0);
+    ASSERT_FALSE(vertexKey(copies[0]) == vertexKey(copies[2]));
+
+    VoronoiCell cells[3] = { VoronoiCell(v), VoronoiCell(v), VoronoiCell(v) };
+    for (int i = 0; i < 3; i++)
+        cells[i].corners = { copies[i], v + 0.1 * (i + 1) * glm::dvec3(1.0, 0.0, 0.0),
+                                        v + 0.1 * (i + 1) * glm::dvec3(0.0, 1.0, 0.0) };
+
+    MeshExporter exporter(2);
+    exporter.build(cells, 3);
+    EXPECT_EQ((size_t)7, exporter.getVertexCount());
+    EXPECT_EQ(exporter.getFace(0)[0], exporter.getFace(1)[0]);
+    EXPECT_EQ(exporter.getFace(0)[0], exporter.getFace(2)[0]);
+    for (size_t f = 0; f < 3; f++)
+        for (size_t j = 0; j < 3; j++)
+            EXPECT_LT(exporter.getFace(f)[j], exporter.getVertexCount());
+}
 
-                bool correct = true;
-                for (unsigned int j = 0; j < vg.m_size; ++j)
-                {
-                    if (j != i)
-                    {
-                        VoronoiCell* b2 = cells + j;
-                        long double jclose = glm::dot(b2->position, c);
-                        if (jclose > iclose)
-                            correct = false;
-                    }
-                }
-                if (!correct)
-                    incorrect++;
+TEST(VoronoiTests, TestRelax)
+{
+    VoronoiGenerator vg;
+    size_t count = 20000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.relax(points, count, 10, 0.0);
+    ASSERT_TRUE(cells != NULL);
+
+    // Lloyd iterations lower the energy until they stop
+    const vector<RelaxStats> & stats = vg.getRelaxStats();
+    ASSERT_LE((size_t)2, stats.size());
+    ASSERT_GE((size_t)11, stats.size());
+    for (size_t i = 1; i + 1 < stats.size(); i++)
+        EXPECT_LT(stats[i].energy, stats[i - 1].energy);
+    EXPECT_LT(stats.back().energy, 0.8 * stats[0].energy);
+
+    // the warm started runs end with the diagram a cold one finds
+    VoronoiGenerator cold;
+    VoronoiCell* expected = cold.generate(points, count, count, false);
+    for (size_t i = 0; i < count; i++)
+    {
+        EXPECT_TRUE(cells[i].position == points[i]);
+        ASSERT_EQ(expected[i].corners.size(), cells[i].corners.size());
+        for (const glm::dvec3 & corner : cells[i].corners)
+        {
+            double nearest = 1.0;
+            for (const glm::dvec3 & other : expected[i].corners)
+                nearest = ::std::min(nearest, glm::distance(corner, other));
+            EXPECT_GT(1e-12, nearest);
+        }
+    }
+
+    // a loose tolerance stops sooner
+    delete[] cells;
+    cells = vg.relax(points, count, 10, 0.05);
+    EXPECT_GT((size_t)11, vg.getRelaxStats().size());
+
+    delete[] expected;
+    delete[] cells;
+    delete[] points;
+}
+
+TEST(VoronoiTests, TestRelaxAnderson)
+{
+    VoronoiGenerator vg;
+    size_t count = 5000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    ::std::vector<glm::dvec3> lloyd(points, points + count);
+    ::std::vector<glm::dvec3> anderson(points, points + count);
+    delete[] points;
+
+    VoronoiCell* cells = vg.relax(lloyd.data(), count, 30, 0.0);
+    double lloydEnergy = vg.getRelaxStats().back().energy;
+    delete[] cells;
+
+    // accepted steps only ever lower the energy, and get further in half
+    // the iterations
+    cells = vg.relax(anderson.data(), count, 15, 0.0, RelaxAnderson);
+    const vector<RelaxStats> & stats = vg.getRelaxStats();
+    double accepted = stats[0].energy;
+    for (size_t i = 1; i + 1 < stats.size(); i++)
+    {
+        if (stats[i].rejected)
+            EXPECT_GT(stats[i].energy, accepted);
+        else
+        {
+            EXPECT_LT(stats[i].energy, accepted);
+            accepted = stats[i].energy;
+        }
+    }
+    EXPECT_FALSE(stats.back().rejected);
+    EXPECT_LT(stats.back().energy, lloydEnergy);
+
+    EXPECT_TRUE(VoronoiVerifier().verify(cells, count).isValid());
+    for (size_t i = 0; i < count; i++)
+        EXPECT_TRUE(cells[i].position == anderson[i]);
+
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestPointLocator)
+{
+    VoronoiGenerator vg;
+    size_t count = 20000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    PointLocator locator(3);
+    locator.build(cells, count);
+    ASSERT_EQ(count, locator.getCellCount());
+
+    // every corner is shared with at least two other cells
+    for (size_t i = 0; i < count; i++)
+        EXPECT_LE(cells[i].corners.size(), locator.getNeighborCount(i));
+
+    // a site locates to its own cell
+    for (size_t i = 0; i < count; i += 7)
+        EXPECT_EQ(i, locator.locate(cells[i].position));
+
+    // batched queries match one at a time and a scan of every site
+    SampleGenerator sg(2);
+    size_t queries = 5000;
+    glm::dvec3* q = sg.getRandomPointsSphere(queries);
+    ::std::vector<size_t> found(queries);
+    locator.locate(q, queries, found.data());
+    for (size_t k = 0; k < queries; k++)
+    {
+        double best = -2.0;
+        for (size_t i = 0; i < count; i++)
+            best = ::std::max(best, glm::dot(q[k], cells[i].position));
+
+        EXPECT_EQ(found[k], locator.locate(q[k]));
+        EXPECT_EQ(best, glm::dot(q[k], cells[found[k]].position));
+    }
+
+    delete[] q;
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestPointLocatorAcrossBuckets)
+{
+    // the cells of three sites meet at a corner on the face between two
+    // buckets, computed a little to either side of it
+    glm::dvec3 v = glm::normalize(glm::dvec3(1.0, 0.5, 0.25));
+    v.x = (floor(v.x * WELD_SCALE) + 0.5) / WELD_SCALE;
+    glm::dvec3 copies[3] = { v, v, v };
+    copies[0].x = nextafter(v.x, 0.0);
+    copies[2].x = nextafter(v.x, 2.0);
+
+    VoronoiCell cells[3] = { VoronoiCell(glm::normalize(v + glm::dvec3(0.1, 0.0, 0.0))),
+                             VoronoiCell(glm::normalize(v + glm::dvec3(0.0, 0.1, 0.0))),
+                             VoronoiCell(glm::normalize(v + glm::dvec3(0.0, 0.0, 0.1))) };
+    for (int i = 0; i < 3; i++)
+        cells[i].corners = { copies[i] };
+
+    PointLocator locator(2);
+    locator.build(cells, 3);
+    for (size_t i = 0; i < 3; i++)
+        EXPECT_EQ((size_t)2, locator.getNeighborCount(i)) << i;
+}
+
+TEST(VoronoiTests, TestNeighborhoodQueries)
+{
+    VoronoiGenerator vg;
+    size_t count = 20000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    PointLocator locator(3);
+    locator.build(cells, count);
+
+    SampleGenerator sg(3);
+    size_t queries = 1000;
+    size_t k = 12;
+    double angle = 0.05;
+    glm::dvec3* q = sg.getRandomPointsSphere(queries);
+    ::std::vector<size_t> nearest(queries * k);
+    ::std::vector<size_t> start;
+    ::std::vector<size_t> within;
+    locator.nearest(q, queries, k, nearest.data());
+    locator.withinAngle(q, queries, angle, start, within);
+    ASSERT_EQ(queries + 1, start.size());
+
+    // batched answers match a scan of every site, nearest first
+    ::std::vector<double> dots(count);
+    for (size_t j = 0; j < queries; j++)
+    {
+        glm::dvec3 p = glm::normalize(q[j]);
+        for (size_t i = 0; i < count; i++)
+            dots[i] = glm::dot(p, cells[i].position);
+        ::std::sort(dots.begin(), dots.end(), ::std::greater<double>());
+
+        for (size_t n = 0; n < k; n++)
+            EXPECT_EQ(dots[n], glm::dot(p, cells[nearest[j * k + n]].position));
+
+        size_t inside = ::std::lower_bound(dots.begin(), dots.end(), cos(angle), ::std::greater<double>()) - dots.begin();
+        ASSERT_EQ(inside, start[j + 1] - start[j]);
+        for (size_t n = 0; n < inside; n++)
+            EXPECT_EQ(dots[n], glm::dot(p, cells[within[start[j] + n]].position));
+    }
+
+    // asking for more sites than there are finds every one
+    PointLocator::Query scratch;
+    ::std::vector<size_t> all(count + 2);
+    EXPECT_EQ(count, locator.nearest(q[0], count + 2, all.data(), scratch));
+    locator.withinAngle(q[0], M_PI, all, scratch);
+    EXPECT_EQ(count, all.size());
+
+    delete[] q;
+    delete[] cells;
+}
+
+// the cells of diagram against a diagram of its sites generated from scratch
+static void expectMatchesGenerated(const IncrementalDiagram & diagram)
+{
+    ::std::vector<size_t> ids;
+    VoronoiCell* cells = diagram.copyCells(ids);
+    ASSERT_EQ(diagram.getSiteCount(), ids.size());
+
+    VerifyResult r = VoronoiVerifier().verify(cells, ids.size());
+    EXPECT_TRUE(r.isValid());
+
+    ::std::vector<glm::dvec3> points(ids.size());
+    for (size_t i = 0; i < ids.size(); i++)
+        points[i] = cells[i].position;
+    VoronoiGenerator vg;
+    VoronoiCell* generated = vg.generate(points.data(), points.size(), points.size(), false);
+
+    // the same corners in the same order, from some starting corner
+    size_t different = 0;
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        const ::std::vector<glm::dvec3> & a = cells[i].corners;
+        const ::std::vector<glm::dvec3> & b = generated[i].corners;
+        size_t start = 0;
+        while (start < b.size() && glm::length(b[start] - a[0]) > 1e-12)
+            start++;
+        bool same = a.size() == b.size() && start < b.size();
+        for (size_t j = 0; same && j < a.size(); j++)
+            same = glm::length(b[(start + j) % b.size()] - a[j]) <= 1e-12;
+        if (!same)
+            different++;
+    }
+    EXPECT_EQ((size_t)0, different);
+
+    delete[] generated;
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestIncrementalDiagram)
+{
+    VoronoiGenerator vg;
+    size_t count = 20000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+
+    IncrementalDiagram diagram(3);
+    diagram.build(cells, count);
+    delete[] cells;
+
+    // scattered moves touch a few cells each
+    glm::dvec3* moved = vg.genRandomInput(200);
+    for (size_t k = 0; k < 200; k++)
+    {
+        diagram.remove(k * 97);
+        diagram.insert(moved[k]);
+    }
+    delete[] moved;
+    size_t clipped = diagram.update();
+    EXPECT_LT(clipped, (size_t)4000);
+    EXPECT_EQ(count, diagram.getSiteCount());
+    expectMatchesGenerated(diagram);
+
+    // a hole of removed sites with a few new ones in it, new sites whose
+    // patches overlap, and an insert cancelled before the update
+    glm::dvec3 center = glm::normalize(glm::dvec3(1.0, 2.0, 3.0));
+    size_t removed = 0;
+    for (size_t i = 0; i < diagram.getSlotCount(); i++)
+    {
+        if (diagram.isAlive(i) && glm::dot(diagram.getPosition(i), center) > cos(0.15))
+        {
+            diagram.remove(i);
+            removed++;
+        }
+    }
+    for (int k = 0; k < 5; k++)
+        diagram.insert(center + 0.05 * glm::dvec3(k % 2, k % 3, 1.0 - k % 2));
+    for (int k = 0; k < 100; k++)
+        diagram.insert(-center + 0.002 * glm::dvec3(sin(k), cos(k * 1.3), sin(k * 0.7)));
+    diagram.remove(diagram.insert(glm::dvec3(0.0, 0.0, 1.0)));
+    diagram.update();
+    EXPECT_EQ(count - removed + 105, diagram.getSiteCount());
+    expectMatchesGenerated(diagram);
+
+    // too few sites to repair are generated again
+    cells = vg.generate(points, 40, 40, false);
+    IncrementalDiagram small(3);
+    small.build(cells, 40);
+    delete[] cells;
+    for (size_t k = 0; k < 30; k++)
+        small.remove(k);
+    small.update();
+    EXPECT_EQ((size_t)10, small.getSiteCount());
+    expectMatchesGenerated(small);
+
+    delete[] points;
+}
+
+TEST(VoronoiTests, TestResultFile)
+{
+    VoronoiGenerator vg(5);
+    size_t count = 50000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    ::std::string path = "output/voronoi_result_test";
+    ASSERT_TRUE(vg.writeResultFile(path.c_str()));
+
+    ResultReader reader;
+    ASSERT_TRUE(reader.open(path.c_str()));
+    ASSERT_EQ(count, reader.getCellCount());
+    EXPECT_TRUE(reader.getHeader().flags & ResultClockwise);
+
+    size_t corners = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_TRUE(reader.getPosition(i) == cells[i].position);
+        ASSERT_EQ(cells[i].corners.size(), reader.getCornerCount(i));
+        for (size_t j = 0; j < cells[i].corners.size(); j++)
+            ASSERT_TRUE(reader.getCorners(i)[j] == cells[i].corners[j]);
+        corners += cells[i].corners.size();
+    }
+    EXPECT_EQ(corners, reader.getCornerCount());
+    reader.close();
+
+    // damaged headers and truncated files are rejected
+    {
+        ::std::fstream file(path, ::std::ios::in | ::std::ios::out | ::std::ios::binary);
+        uint32_t version = RESULT_VERSION + 1;
+        file.seekp(offsetof(ResultHeader, version));
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+    EXPECT_FALSE(reader.open(path.c_str()));
+    ASSERT_TRUE(vg.writeResultFile(path.c_str()));
+    ASSERT_EQ(0, truncate(path.c_str(), 1000));
+    EXPECT_FALSE(reader.open(path.c_str()));
+    EXPECT_FALSE(reader.open("output/does_not_exist"));
+
+    remove(path.c_str());
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestCellMeasures)
+{
+    // an octant, its corners either way round, and a cell too small to measure
+    glm::dvec3 octant[] = { glm::dvec3(1, 0, 0), glm::dvec3(0, 1, 0), glm::dvec3(0, 0, 1),
+                            glm::dvec3(0, 0, 1), glm::dvec3(0, 1, 0), glm::dvec3(1, 0, 0),
+                            glm::dvec3(1, 0, 0), glm::dvec3(0, 1, 0) };
+    uint64_t offsets[] = { 0, 3, 6, 8 };
+    CellMeasures measures(2);
+    measures.compute(offsets, octant, 3);
+    for (size_t c = 0; c < 2; c++)
+    {
+        EXPECT_NEAR(M_PI / 2, measures.getArea(c), 1e-14);
+        EXPECT_NEAR(3 * M_PI / 2, measures.getPerimeter(c), 1e-14);
+        EXPECT_LT(glm::length(measures.getCentroid(c) - glm::normalize(glm::dvec3(1.0))), 1e-14);
+    }
+    EXPECT_EQ(0.0, measures.getArea(2));
+    EXPECT_TRUE(measures.getCentroid(2) == glm::dvec3(0.0));
+
+    VoronoiGenerator vg(7);
+    size_t count = 20001;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+
+    measures.compute(cells, count);
+    ASSERT_EQ(count, measures.getCount());
+    double total = 0.0;
+    for (size_t i = 0; i < count; i++)
+        total += measures.getArea(i);
+    EXPECT_NEAR(4 * M_PI, total, 1e-10);
+
+    // the same sums one cell at a time with the library arctangent
+    for (size_t i = 0; i < count; i += 37)
+    {
+        const vector<glm::dvec3> & corners = cells[i].corners;
+        glm::dvec3 inside(0.0), moment(0.0);
+        for (const glm::dvec3 & c : corners)
+            inside += c;
+        inside = glm::normalize(inside);
+
+        double area = 0.0, perimeter = 0.0;
+        for (size_t k = 0; k < corners.size(); k++)
+        {
+            const glm::dvec3 & a = corners[k];
+            const glm::dvec3 & b = corners[(k + 1) % corners.size()];
+            glm::dvec3 n = glm::cross(a, b);
+            double arc = atan2(glm::length(n), glm::dot(a, b));
+            perimeter += arc;
+            moment += arc * glm::normalize(n);
+            area += 2 * atan2(fabs(glm::dot(inside, n)), 1 + glm::dot(inside, a) + glm::dot(a, b) + glm::dot(inside, b));
+        }
+        glm::dvec3 centroid = glm::normalize(glm::dot(moment, inside) < 0 ? -moment : moment);
+
+        ASSERT_NEAR(area, measures.getArea(i), 1e-12 * area) << "cell " << i;
+        ASSERT_NEAR(perimeter, measures.getPerimeter(i), 1e-12 * perimeter) << "cell " << i;
+        ASSERT_LT(glm::length(centroid - measures.getCentroid(i)), 1e-12) << "cell " << i;
+        ASSERT_LT(glm::length(centroid - points[i]), perimeter) << "cell " << i;
+    }
+
+    // the flat corners of a result file give the same answers
+    ::std::string path = "output/voronoi_measures_test";
+    vg.setCellMeasures(true);
+    ASSERT_TRUE(vg.writeResultFile(path.c_str()));
+    ResultReader reader;
+    ASSERT_TRUE(reader.open(path.c_str()));
+    ASSERT_TRUE(reader.hasMeasures());
+    EXPECT_TRUE(reader.getHeader().flags & ResultMeasures);
+
+    CellMeasures flat(0);
+    flat.compute((const uint64_t*)((const char*)&reader.getHeader() + reader.getHeader().offsetsOffset),
+                 reader.getCorners(0), count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_EQ(measures.getArea(i), reader.getArea(i)) << "cell " << i;
+        ASSERT_EQ(measures.getPerimeter(i), reader.getPerimeter(i)) << "cell " << i;
+        ASSERT_TRUE(measures.getCentroid(i) == reader.getCentroid(i)) << "cell " << i;
+        ASSERT_EQ(measures.getArea(i), flat.getArea(i)) << "cell " << i;
+        ASSERT_TRUE(measures.getCentroid(i) == flat.getCentroid(i)) << "cell " << i;
+    }
+    reader.close();
+
+    // a file without its measures is rejected
+    vg.setCellMeasures(false);
+    ASSERT_TRUE(vg.writeResultFile(path.c_str()));
+    {
+        ::std::fstream file(path, ::std::ios::in | ::std::ios::out | ::std::ios::binary);
+        uint32_t flags = 0;
+        file.seekg(offsetof(ResultHeader, flags));
+        file.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+        flags |= ResultMeasures;
+        file.seekp(offsetof(ResultHeader, flags));
+        file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    }
+    EXPECT_FALSE(reader.open(path.c_str()));
+    vg.setCellMeasures(true);
+
+    // tiled runs measure each batch of cells as it is written
+    ASSERT_TRUE(vg.generateTiled(points, count, path.c_str(), 4000));
+    ASSERT_TRUE(reader.open(path.c_str()));
+    ASSERT_TRUE(reader.hasMeasures());
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_NEAR(measures.getArea(i), reader.getArea(i), 1e-9 * measures.getArea(i)) << "cell " << i;
+        ASSERT_LT(glm::length(measures.getCentroid(i) - reader.getCentroid(i)), 1e-9) << "cell " << i;
+    }
+    reader.close();
+
+    remove(path.c_str());
+    delete[] cells;
+    delete[] points;
+}
+
+TEST(VoronoiTests, TestCellSink)
+{
+    size_t count = 100000;
+    VoronoiGenerator vg(6);
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+
+    QueueCellSink sink;
+    vg.setCellSink(&sink);
+
+    // copy each cell as it arrives, while the run continues
+    ::std::vector<::std::vector<glm::dvec3>> received(count);
+    ::std::vector<int> deliveries(count, 0);
+    ::std::thread consumer([&]()
+    {
+        ::std::vector<size_t> batch;
+        while (sink.pop(batch))
+        {
+            for (size_t i : batch)
+            {
+                deliveries[i]++;
+                received[i] = sink.getCells()[i].corners;
             }
+        }
+    });
+
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    consumer.join();
+
+    // cells were final when delivered, each exactly once
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_EQ(1, deliveries[i]) << "cell " << i;
+        ASSERT_EQ(cells[i].corners.size(), received[i].size());
+        for (size_t j = 0; j < received[i].size(); j++)
+            ASSERT_TRUE(received[i][j] == cells[i].corners[j]);
+    }
+    EXPECT_TRUE(VoronoiVerifier().verify(cells, count).isValid());
+    delete[] cells;
+
+    // caps deliver every cell after rotating back
+    sink.reset();
+    ::std::vector<glm::dvec3> cap_points;
+    for (size_t i = 0; i < count; i++)
+        if (points[i].z > 0.9)
+            cap_points.push_back(points[i]);
+    delete[] points;
+
+    ::std::fill(deliveries.begin(), deliveries.end(), 0);
+    consumer = ::std::thread([&]()
+    {
+        ::std::vector<size_t> batch;
+        while (sink.pop(batch))
+            for (size_t i : batch)
+                deliveries[i]++;
+    });
+    cells = vg.generateCap(glm::dvec3(0.0, 0.0, 1.0), cap_points.data(), cap_points.size());
+    consumer.join();
+    for (size_t i = 0; i < cap_points.size(); i++)
+        ASSERT_EQ(1, deliveries[i]) << "cap cell " << i;
+    delete[] cells;
+}
+
+TEST(VoronoiTests, TestPointLoader)
+{
+    size_t count = 20000;
+    VoronoiGenerator vg(6);
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    PointLoader loader(3);
+
+    // binary input is used in place
+    ::std::string path = "output/voronoi_points_test";
+    {
+        ::std::ofstream file(path, ::std::ios::binary);
+        file.write(reinterpret_cast<const char*>(points), count * sizeof(glm::dvec3));
+    }
+    ASSERT_TRUE(loader.loadBinary(path.c_str())) << loader.getError();
+    ASSERT_EQ(count, loader.getCount());
+    for (size_t i = 0; i < count; i++)
+        ASSERT_TRUE(loader.getPoints()[i] == points[i]);
+
+    VoronoiCell* cells = vg.generate(loader.getPoints(), loader.getCount(), loader.getCount(), false);
+    EXPECT_TRUE(VoronoiVerifier().verify(cells, count).isValid());
+    delete[] cells;
+
+    // text with a header, comments, CRLF line ends and mixed separators
+    {
+        ::std::ofstream file(path, ::std::ios::binary);
+        file << "x,y,z\r\n# comment\r\n";
+        file.precision(17);
+        for (size_t i = 0; i < count; i++)
+        {
+            const char* sep = i % 3 == 0 ? ", " : (i % 3 == 1 ? "\t" : ";");
+            file << (i % 2 ? "+" : "") << points[i].x << sep << points[i].y << sep << points[i].z << "\r\n";
+        }
+    }
+    ASSERT_TRUE(loader.loadText(path.c_str(), PointLoader::XYZ)) << loader.getError();
+    ASSERT_EQ(count, loader.getCount());
+    for (size_t i = 0; i < count; i++)
+        ASSERT_NEAR(0.0, glm::length(loader.getPoints()[i] - points[i]), 1e-15) << "point " << i;
+
+    // latitude and longitude in degrees
+    {
+        ::std::ofstream file(path);
+        file.precision(17);
+        file << "lat lon\n";
+        for (size_t i = 0; i < count; i++)
+            file << glm::degrees(asin(points[i].z)) << " " << glm::degrees(atan2(points[i].y, points[i].x)) << "\n";
+    }
+    ASSERT_TRUE(loader.loadText(path.c_str(), PointLoader::LatLon)) << loader.getError();
+    ASSERT_EQ(count, loader.getCount());
+    for (size_t i = 0; i < count; i++)
+        ASSERT_NEAR(0.0, glm::length(loader.getPoints()[i] - points[i]), 1e-12) << "point " << i;
+
+    // malformed lines, partial records and missing files are rejected
+    {
+        ::std::ofstream file(path);
+        file << "0 0 1\n1 0\n";
+    }
+    EXPECT_FALSE(loader.loadText(path.c_str(), PointLoader::XYZ));
+    EXPECT_EQ(0u, loader.getCount());
+    {
+        ::std::ofstream file(path, ::std::ios::binary);
+        file.write(reinterpret_cast<const char*>(points), sizeof(glm::dvec3) + 8);
+    }
+    EXPECT_FALSE(loader.loadBinary(path.c_str()));
+    EXPECT_FALSE(loader.loadBinary("output/does_not_exist"));
+    EXPECT_FALSE(loader.getError().empty());
+
+    // binary points off unit length are normalized, zero or NaN ones rejected
+    glm::dvec3 scaled[3] = { 2.0 * points[0], points[1], 0.5 * points[2] };
+    {
+        ::std::ofstream file(path, ::std::ios::binary);
+        file.write(reinterpret_cast<const char*>(scaled), sizeof(scaled));
+    }
+    ASSERT_TRUE(loader.loadBinary(path.c_str())) << loader.getError();
+    ASSERT_EQ(3u, loader.getCount());
+    for (size_t i = 0; i < 3; i++)
+        EXPECT_NEAR(0.0, glm::length(loader.getPoints()[i] - points[i]), 1e-15) << "point " << i;
+    EXPECT_TRUE(loader.getPoints()[1] == points[1]);
+
+    for (double bad : { 0.0, (double)NAN })
+    {
+        scaled[1] = glm::dvec3(bad);
+        {
+            ::std::ofstream file(path, ::std::ios::binary);
+            file.write(reinterpret_cast<const char*>(scaled), sizeof(scaled));
+        }
+        EXPECT_FALSE(loader.loadBinary(path.c_str()));
+        EXPECT_EQ(0u, loader.getCount());
+    }
+
+    remove(path.c_str());
+    delete[] points;
+}
+
+TEST(VoronoiTests, TestVerifyDistributions)
+{
+    for (int d = Uniform; d <= Fibonacci; d++)
+    {
+        SampleGenerator sg(d + 1);
+        size_t count = 3000;
+        glm::dvec3* points = sg.getPointsSphere((Distribution)d, count);
+
+        VoronoiGenerator vg;
+        VoronoiCell* cells = vg.generate(points, count, count, false);
+        delete[] points;
 
-            if (b->corners.size() < 3)
+        unsigned int corner_count_incorrect = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (cells[i].corners.size() < 3)
                 corner_count_incorrect++;
         }
+
+        const char* name = SampleGenerator::getDistributionName((Distribution)d);
+        EXPECT_EQ((unsigned int)0, countIncorrectCorners(cells, count)) << name;
+        EXPECT_EQ((unsigned int)0, corner_count_incorrect) << name;
+        EXPECT_GE(completedCells+2, count) << name;
         delete[] cells;
+    }
+}
 
-        // assert correctness == 100%
-        EXPECT_EQ((unsigned int)0, incorrect);
-        EXPECT_EQ((unsigned int)0, corner_count_incorrect);
-        EXPECT_GE(completedCells+2, count); // there may be 2 arcs on the beachline, but the vertex they converge to has been added
+TEST(VoronoiTests, TestVerifyNearDegenerateGrid)
+{
+    // rows of sites on one latitude and four sites to nearly every circle,
+    // jittered by 1e-10 of the grid spacing. The grid is tilted off the
+    // sweep axes, rings centred on one are still ill-conditioned.
+    SampleGenerator sg(1);
+    size_t count = 20000;
+    glm::dvec3* points = sg.getGridPointsSphere((int)count, 1e-10 * sqrt(4.0 * M_PI / count));
+    glm::dmat3 tilt = glm::dmat3(glm::rotate(glm::dmat4(1.0), glm::degrees(0.7), glm::dvec3(1.0, 0.0, 0.0))) *
+                      glm::dmat3(glm::rotate(glm::dmat4(1.0), glm::degrees(0.3), glm::dvec3(0.0, 0.0, 1.0)));
+    for (size_t i = 0; i < count; i++)
+        points[i] = tilt * points[i];
+
+    VoronoiGenerator vg;
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    delete[] points;
+
+    // the jitter leaves no four sites exactly on one circle, so every
+    // short edge keeps both its corners
+    VerifyResult r = VoronoiVerifier().verify(cells, count);
+    EXPECT_EQ((size_t)0, r.incorrectCorners);
+    EXPECT_EQ((size_t)0, r.missingCorners);
+    EXPECT_EQ((size_t)0, r.openCells);
+    EXPECT_TRUE(r.eulerHolds()) << r.corners << " corners for " << count << " cells";
+    delete[] cells;
+}
+
+// true if the corners of cell are those of sortCorners in the same cyclic order
+static bool cornersInSortedOrder(const VoronoiCell & cell)
+{
+    VoronoiCell sorted(cell.position);
+    sorted.corners = cell.corners;
+    sorted.sortCorners();
+
+    size_t k = cell.corners.size();
+    size_t start = 0;
+    while (start < k && sorted.corners[start] != cell.corners[0])
+        start++;
+    for (size_t j = 0; j < k; j++)
+    {
+        if (sorted.corners[(start + j) % k] != cell.corners[j])
+            return false;
+    }
+    return true;
+}
+
+TEST(VoronoiTests, TestCornerRings)
+{
+    // the sweeps link the corners of every cell into a ring, in the order
+    // sortCorners would give them
+    for (int d = Uniform; d <= Fibonacci; d++)
+    {
+        SampleGenerator sg(d + 1);
+        size_t count = 20000;
+        glm::dvec3* points = sg.getPointsSphere((Distribution)d, count);
+
+        VoronoiGenerator vg;
+        VoronoiCell* cells = vg.generate(points, count, count, false);
+        delete[] points;
+
+        size_t unordered = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!cornersInSortedOrder(cells[i]))
+                unordered++;
+        }
+        EXPECT_EQ((size_t)0, unordered) << SampleGenerator::getDistributionName((Distribution)d);
+        delete[] cells;
+    }
+
+    VoronoiGenerator vg;
+    size_t count = 200000;
+    glm::dvec3* points = vg.genRandomInput(count);
+    ::std::vector<glm::dvec3> cap_points;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (glm::dot(points[i], glm::dvec3(0.0, 0.0, -1.0)) > 0.99)
+            cap_points.push_back(points[i]);
     }
+    delete[] points;
+
+    VoronoiCell* cells = vg.generateCap(glm::dvec3(1.0, 1.0, 0.5), cap_points.data(), cap_points.size());
+    ASSERT_TRUE(cells != NULL);
+    size_t unordered = 0;
+    for (size_t i = 0; i < cap_points.size(); i++)
+    {
+        if (!cornersInSortedOrder(cells[i]))
+            unordered++;
+    }
+    EXPECT_EQ((size_t)0, unordered);
+    delete[] cells;
 }
 
 TEST(VoronoiTests, TestCircumcenter)
 {
     ::std::vector<VoronoiSite> sites;
-    VoronoiSweeper<Increasing,X> vorI(&sites, 0, 0);
+    VoronoiSweeper<Increasing, X, NarrowIndex, double> vorI(&sites, 0, 0);
     glm::dvec3 p1 = glm::normalize(glm::dvec3( 0.0, 1.0, 0.5f));
     glm::dvec3 p2 = glm::normalize(glm::dvec3( 1.0, 0.0, 0.5f));
     glm::dvec3 p3 = glm::normalize(glm::dvec3( 0.0,-1.0, 0.5f));
@@ -142,7 +1315,7 @@ TEST(VoronoiTests, TestCircumcenter)
     EXPECT_DOUBLE_EQ( 0.0, cc.y );
     EXPECT_DOUBLE_EQ( 1.0, cc.z );
 
-    VoronoiSweeper<Decreasing, X> vorD(&sites, 0, 0);
+    VoronoiSweeper<Decreasing, X, NarrowIndex, double> vorD(&sites, 0, 0);
     cc = vorD.circumcenter(p1, p2, p3);
 
     EXPECT_DOUBLE_EQ( 0.0, cc.x );
@@ -152,23 +1325,23 @@ TEST(VoronoiTests, TestCircumcenter)
 
 TEST(VoronoiTests, TestCompare)
 {
-    CircleEvent<Increasing> ce3 = CircleEvent<Increasing>(3.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
-    CircleEvent<Increasing> ce2 = CircleEvent<Increasing>(2.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Increasing, double> ce3 = CircleEvent<Increasing, double>(3.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Increasing, double> ce2 = CircleEvent<Increasing, double>(2.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
 
-    CircleEvent<Decreasing> ce1 = CircleEvent<Decreasing>(1.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
-    CircleEvent<Decreasing> ce4 = CircleEvent<Decreasing>(4.0, 1.70, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Decreasing, double> ce1 = CircleEvent<Decreasing, double>(1.0, 0.25, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Decreasing, double> ce4 = CircleEvent<Decreasing, double>(4.0, 1.70, glm::dvec3(0.0, 0.0, 0.0));
 
-    CircleEvent<Increasing> ceX = CircleEvent<Increasing>(2.0, 0.5, glm::dvec3(0.0, 0.0, 0.0));
-    CircleEvent<Decreasing> ceY = CircleEvent<Decreasing>(3.0, 0.5, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Increasing, double> ceX = CircleEvent<Increasing, double>(2.0, 0.5, glm::dvec3(0.0, 0.0, 0.0));
+    CircleEvent<Decreasing, double> ceY = CircleEvent<Decreasing, double>(3.0, 0.5, glm::dvec3(0.0, 0.0, 0.0));
 
     VoronoiSite v1; v1.m_polar = 1.0;
     VoronoiSite v2; v2.m_polar = 2.5;
 
-    VoronoiEventCompare<Increasing> vecI;
-    VoronoiEventCompare<Decreasing> vecD;
+    VoronoiEventCompare<Increasing, X, NarrowIndex, double> vecI;
+    VoronoiEventCompare<Decreasing, X, NarrowIndex, double> vecD;
     VoronoiSiteCompare vsc;
-    VoronoiSiteEventCompare<Increasing> vsecI;
-    VoronoiSiteEventCompare<Decreasing> vsecD;
+    VoronoiSiteEventCompare<Increasing, X, NarrowIndex, double> vsecI;
+    VoronoiSiteEventCompare<Decreasing, X, NarrowIndex, double> vsecD;
 
     EXPECT_TRUE( vecI(&ce3,&ce2) );
     EXPECT_TRUE( vecD(&ce1,&ce4) );
@@ -258,42 +1431,13 @@ TEST(VoronoiTests, TestCapVerifyResult)
             continue;
 
         // verify that each corner is closest to its origin point
-        unsigned int incorrect = 0;
-        unsigned int corner_count_incorrect = 0;
-        for (unsigned int i = 0; i < vg.m_size; ++i)
-        {
-            VoronoiCell* b = cells + i;
-
-            for (auto ct = b->corners.begin(); ct != b->corners.end(); ++ct)
-            {
-                glm::dvec3 c = *ct;
-                c += (b->position - c) * 0.01;
-
-                long double iclose = glm::dot(b->position, c);
-
-                bool correct = true;
-                for (unsigned int j = 0; j < vg.m_size; ++j)
-                {
-                    if (j != i)
-                    {
-                        VoronoiCell* b2 = cells + j;
-                        long double jclose = glm::dot(b2->position, c);
-                        if (jclose > iclose)
-                            correct = false;
-                    }
-                }
-                if (!correct)
-                    incorrect++;
-            }
-
-            if (b->corners.size() < 3)
-                corner_count_incorrect++;
-        }
+        VerifyResult r = VoronoiVerifier().verify(cells, vg.m_size);
         delete[] cells;
 
         // assert correctness == 100%
-        EXPECT_EQ((unsigned int)0, incorrect);
-        EXPECT_EQ((unsigned int)0, corner_count_incorrect);
+        EXPECT_EQ((size_t)0, r.incorrectCorners);
+        EXPECT_EQ((size_t)0, r.missingCorners);
+        EXPECT_TRUE(r.eulerHolds());
         EXPECT_GE(completedCells+2, vg.m_size); // there may be 2 arcs on the beachline, but the vertex they converge to has been added
     }
 }
@@ -341,10 +1485,297 @@ TEST(VoronoiTests, TestCapDeterminism)
     }
     std::cout << "error count: " << error_count << std::endl;
     EXPECT_EQ((uint)0, error_count);
+
+#ifndef CENTROID
+    // cells keep the caller's points exactly, rather than rotated there and back
+    for (uint i = 0; i < vg1.m_size; i++)
+        ASSERT_TRUE(cells1[i].position == cap_points[i]) << "cell " << i;
+#endif
     delete[] cells1;
     delete[] cells2;
     delete[] points;
 }
+
+TEST(VoronoiTests, TestSplitCap)
+{
+    VoronoiGenerator vg(6);
+    size_t count = 600000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    glm::dvec3 origin = glm::normalize(glm::dvec3(1.0, 1.0, 0.5));
+
+    // a uniform cap, and a dense cluster in a sparse cap whose tiles leave
+    // cells uncertain
+    ::std::vector<glm::dvec3> uniform, clustered;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (glm::dot(points[i], origin) > 0.9)
+            uniform.push_back(points[i]);
+        if (glm::dot(points[i], origin) > 0.8 && clustered.size() < 5000)
+            clustered.push_back(points[i]);
+    }
+    srand(7);
+    while (clustered.size() < 30000)
+    {
+        glm::dvec3 offset(rand() - RAND_MAX / 2.0, rand() - RAND_MAX / 2.0, rand() - RAND_MAX / 2.0);
+        clustered.push_back(glm::normalize(origin + 0.05 / RAND_MAX * offset));
+    }
+    delete[] points;
+
+    for (::std::vector<glm::dvec3>* cap : { &uniform, &clustered })
+    {
+        ASSERT_GE(cap->size(), CAP_SPLIT_MIN);
+        VoronoiCell* cells = vg.generateCap(origin, cap->data(), cap->size());
+        EXPECT_TRUE(VoronoiVerifier().verify(cells, cap->size()).isValid());
+
+        // the same cells as the six sweeps of a full run
+        VoronoiCell* expected = vg.generate(cap->data(), cap->size(), cap->size(), false);
+        for (size_t i = 0; i < cap->size(); i++)
+        {
+#ifndef CENTROID
+            ASSERT_TRUE(cells[i].position == (*cap)[i]);
+#endif
+            ASSERT_EQ(expected[i].corners.size(), cells[i].corners.size()) << "cell " << i;
+            for (size_t j = 0; j < cells[i].corners.size(); j++)
+            {
+                double nearest = 2.0;
+                for (const glm::dvec3 & c : expected[i].corners)
+                    nearest = ::std::min(nearest, glm::length(c - cells[i].corners[j]));
+                ASSERT_LT(nearest, 1e-9) << "cell " << i;
+            }
+        }
+        delete[] expected;
+        delete[] cells;
+    }
+}
+
+TEST(VoronoiTests, TestGenerateCaps)
+{
+    VoronoiGenerator vg(6);
+    size_t count = 500000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+
+    // many small caps of assorted sizes, one too small and one large enough to split
+    ::std::vector<::std::vector<glm::dvec3>> capPoints;
+    ::std::vector<CapInput> caps;
+    for (size_t c = 0; c < 300; c++)
+    {
+        glm::dvec3 origin = points[c * 997];
+        double limit = c == 0 ? 0.9 : (c == 1 ? 1.0 - 1e-12 : 1.0 - 1e-5 * (c % 50 + 3));
+        capPoints.emplace_back();
+        for (size_t i = 0; i < count; i++)
+            if (glm::dot(points[i], origin) > limit)
+                capPoints.back().push_back(points[i]);
+        caps.push_back({origin, NULL, capPoints.back().size()});
+    }
+    for (size_t c = 0; c < caps.size(); c++)
+        caps[c].points = capPoints[c].data();
+    delete[] points;
+    ASSERT_GE(caps[0].count, CAP_SPLIT_MIN);
+    ASSERT_LT(caps[1].count, 3u);
+
+    struct CountingSink : public CellSink
+    {
+        ::std::mutex mutex;
+        ::std::map<const VoronoiCell*, ::std::map<size_t, int>> deliveries;
+        void consume(const VoronoiCell* cells, const size_t* indices, size_t count) override
+        {
+            ::std::lock_guard<::std::mutex> lock(mutex);
+            for (size_t i = 0; i < count; i++)
+                deliveries[cells][indices[i]]++;
+        }
+    } sink;
+
+    vg.setCellSink(&sink);
+    ::std::vector<VoronoiCell*> cells = vg.generateCaps(caps.data(), caps.size());
+    vg.setCellSink(NULL);
+    ASSERT_EQ(caps.size(), cells.size());
+    EXPECT_TRUE(cells[1] == NULL);
+
+    // the same cells as one cap at a time
+    for (size_t c = 0; c < caps.size(); c++)
+    {
+        if (c == 1)
+            continue;
+        ASSERT_TRUE(cells[c] != NULL);
+        EXPECT_TRUE(VoronoiVerifier().verify(cells[c], caps[c].count).isValid()) << "cap " << c;
+
+        ::std::map<size_t, int> & delivered = sink.deliveries[cells[c]];
+        EXPECT_EQ(caps[c].count, delivered.size()) << "cap " << c;
+        for (size_t i = 0; i < caps[c].count; i++)
+            ASSERT_EQ(1, delivered[i]) << "cap " << c << " cell " << i;
+
+        VoronoiCell* expected = vg.generateCap(caps[c].origin, caps[c].points, caps[c].count);
+        for (size_t i = 0; i < caps[c].count; i++)
+        {
+            ASSERT_EQ(expected[i].corners.size(), cells[c][i].corners.size()) << "cap " << c << " cell " << i;
+            for (const glm::dvec3 & corner : cells[c][i].corners)
+            {
+                double nearest = 2.0;
+                for (const glm::dvec3 & e : expected[i].corners)
+                    nearest = ::std::min(nearest, glm::length(e - corner));
+                ASSERT_LT(nearest, 1e-9) << "cap " << c << " cell " << i;
+            }
+        }
+        delete[] expected;
+        delete[] cells[c];
+    }
+}
+
+TEST(VoronoiTests, TestTiledGeneration)
+{
+    VoronoiGenerator vg(6);
+    size_t count = 50000;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    ::std::string path = "output/voronoi_tiled_test";
+
+    for (int clustered = 0; clustered < 2; clustered++)
+    {
+        // a dense cluster has cells far smaller than the halo next to a
+        // sparse region whose cells reach well past it
+        if (clustered)
+            for (size_t i = 0; i < count * 9 / 10; i++)
+                points[i] = glm::normalize(glm::dvec3(0.3, 0.5, 0.8) + 0.05 * points[i]);
+
+        // the clustered points are streamed from a binary input file
+        if (clustered)
+        {
+            ::std::string input = path + ".points";
+            {
+                ::std::ofstream file(input, ::std::ios::binary);
+                file.write(reinterpret_cast<const char*>(points), count * sizeof(glm::dvec3));
+            }
+            ASSERT_TRUE(vg.generateTiled(input.c_str(), path.c_str(), 2000));
+            remove(input.c_str());
+        }
+        else
+            ASSERT_TRUE(vg.generateTiled(points, count, path.c_str(), 2000));
+        VoronoiCell* cells = vg.generate(points, count, count, false);
+        EXPECT_TRUE(VoronoiVerifier().verify(cells, count).isValid());
+
+        ResultReader reader;
+        ASSERT_TRUE(reader.open(path.c_str()));
+        ASSERT_EQ(count, reader.getCellCount());
+        for (size_t i = 0; i < count; i++)
+        {
+#ifndef CENTROID
+            ASSERT_TRUE(reader.getPosition(i) == points[i]) << "cell " << i;
+#endif
+            ASSERT_EQ(cells[i].corners.size(), reader.getCornerCount(i)) << "cell " << i;
+            for (size_t j = 0; j < reader.getCornerCount(i); j++)
+            {
+                double nearest = 2.0;
+                for (const glm::dvec3 & c : cells[i].corners)
+                    nearest = ::std::min(nearest, glm::length(c - reader.getCorners(i)[j]));
+                ASSERT_LT(nearest, 1e-9) << "cell " << i;
+            }
+        }
+        reader.close();
+        delete[] cells;
+    }
+
+    remove(path.c_str());
+    delete[] points;
+}
+
+TEST(VoronoiTests, TestShardedGeneration)
+{
+    VoronoiGenerator vg(7);
+    size_t count = 50000;
+    size_t shards = 3;
+    glm::dvec3* points = vg.genRandomInputParallel(count);
+    ::std::string path = "output/voronoi_sharded_test";
+    ::std::string socketPath = path + ".sock";
+
+    ShardCoordinator coordinator(2);
+    coordinator.setCellMeasures(true);
+    ASSERT_TRUE(coordinator.listen(socketPath.c_str())) << coordinator.getError();
+
+    // worker processes, each with its own generator, told to measure the
+    // cells by the coordinator
+    ::std::vector<pid_t> workers;
+    for (size_t k = 0; k < shards; k++)
+    {
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0)
+            _exit(runShardWorker(socketPath.c_str(), 1) ? 0 : 1);
+        workers.push_back(pid);
+        coordinator.watchWorker(pid);
+    }
+
+    bool ran = coordinator.run(points, count, shards, path.c_str(), 2000);
+    for (pid_t pid : workers)
+    {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    ASSERT_TRUE(ran) << coordinator.getError();
+    coordinator.close();
+
+    VoronoiCell* cells = vg.generate(points, count, count, false);
+    ShardedResultReader reader;
+    ASSERT_TRUE(reader.open(path.c_str()));
+    ASSERT_EQ(count, reader.getCellCount());
+    ASSERT_EQ(shards, reader.getShardCount());
+
+    size_t shardCells = 0;
+    for (size_t k = 0; k < shards; k++)
+    {
+        EXPECT_GT(reader.getShard(k).getCellCount(), 0u);
+        EXPECT_TRUE(reader.getShard(k).getHeader().flags & ResultMeasures) << "shard " << k;
+        shardCells += reader.getShard(k).getCellCount();
+    }
+    EXPECT_EQ(count, shardCells);
+    ASSERT_TRUE(reader.hasMeasures());
+
+    double area = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_GT(reader.getArea(i), 0.0) << "cell " << i;
+        area += reader.getArea(i);
+    }
+    EXPECT_NEAR(4.0 * M_PI, area, 1e-9);
+
+    for (size_t i = 0; i < count; i++)
+    {
+#ifndef CENTROID
+        ASSERT_TRUE(reader.getPosition(i) == points[i]) << "cell " << i;
+#endif
+        ASSERT_EQ(cells[i].corners.size(), reader.getCornerCount(i)) << "cell " << i;
+        for (size_t j = 0; j < reader.getCornerCount(i); j++)
+        {
+            double nearest = 2.0;
+            for (const glm::dvec3 & c : cells[i].corners)
+                nearest = ::std::min(nearest, glm::length(c - reader.getCorners(i)[j]));
+            ASSERT_LT(nearest, 1e-9) << "cell " << i;
+        }
+    }
+    reader.close();
+
+    remove(path.c_str());
+    for (size_t k = 0; k < shards; k++)
+        remove((path + "." + ::std::to_string(k)).c_str());
+
+    // a worker that dies before connecting fails the run instead of
+    // leaving it waiting, as does a shard count the index cannot hold
+    ASSERT_TRUE(coordinator.listen(socketPath.c_str())) << coordinator.getError();
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0)
+        _exit(1);
+    coordinator.watchWorker(pid);
+    EXPECT_FALSE(coordinator.run(points, count, 1, path.c_str(), 2000));
+    EXPECT_NE(::std::string::npos, coordinator.getError().find("exited"));
+    waitpid(pid, NULL, 0);
+    EXPECT_FALSE(coordinator.run(points, count, 1 << 16, path.c_str(), 2000));
+    coordinator.close();
+    remove(path.c_str());
+
+    delete[] cells;
+    delete[] points;
+}
+
 TEST(VoronoiTests, SortPointsTest)
 {
     ::boost::timer::cpu_timer total;
@@ -460,65 +1891,5 @@ TEST(VoronoiTests, BucketSortTest)
     ::std::cout << (total.elapsed().wall / (runs * 1000000.f)) << "ms\n";
 }
 
-TEST(VoronoiTests, RotatePointsTaskDeterminism)
-{
-    const int runs = 5;
-    const size_t count = 1'000'000;
-    
-    for (int run = 0; run < runs; run++)
-    {
-        // Create consistent set of points for each run
-        std::vector<::glm::dvec3> points1(count);
-        std::vector<::glm::dvec3> points2(count);
-        
-        // Initialize with same random points
-        srand(42); // Fixed seed for determinism
-        for (size_t i = 0; i < count; i++)
-        {
-            ::glm::dvec3 p = ::glm::dvec3(
-                static_cast<double>(rand()) / RAND_MAX,
-                static_cast<double>(rand()) / RAND_MAX,
-                static_cast<double>(rand()) / RAND_MAX
-            );
-            p = ::glm::normalize(p);
-            points1[i] = p;
-            points2[i] = p;
-        }
-        
-        // Create rotation matrix
-        ::glm::dvec3 origin(0.5, 0.7, 0.3);
-        origin = ::glm::normalize(origin);
-        ::glm::dvec3 x_axis(1, 0, 0);
-        ::glm::dvec3 rotation_axis = ::glm::cross(x_axis, origin);
-        double angle = ::glm::acos(::glm::dot(x_axis, origin));
-        ::glm::dmat4 rotation = ::glm::rotate(::glm::dmat4(1.0), angle, rotation_axis);
-        
-        auto RotatePoints = [&](std::vector<::glm::dvec3>& points) {
-            RotatePointsTask* task = new RotatePointsTask;
-            task->td = TaskDataRotatePoints{points.data(), 0, count - 1, rotation};
-            task->process();
-            delete task;
-        };
-        
-        RotatePoints(points1);
-        RotatePoints(points2);
-        
-        // Verify that both rotations produced identical results
-        bool identical = true;
-        for (size_t i = 0; i < count; i++)
-        {
-            if (::glm::distance(points1[i], points2[i]) != 0.0)
-            {
-                identical = false;
-                std::cout << "Difference at index " << i << ": " 
-                          << ::glm::distance(points1[i], points2[i]) << std::endl;
-                break;
-            }
-        }
-        
-        EXPECT_TRUE(identical) << "RotatePointsTask is not deterministic";
-    }
-}
-
 
 }
@@ -1,42 +1,270 @@
 #include "src/voronoi_generator.h"
+#include "src/voronoi_verifier.h"
+#include "src/point_loader.h"
+#include "src/shard_coordinator.h"
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 #include <iostream>
 #include <chrono>
 #include <string>
 
 int main(int argc, char* argv[])
 {
-    int count = 1000000; // default number of points
-    int gen = count; // default number of cells to generate
+    size_t count = 1000000; // default number of points
+    size_t gen = count; // default number of cells to generate
     bool writeToFile = false; // default: don't write to file
+    bool printStats = false; // default: don't print sweep statistics
+    bool verify = false; // default: don't verify the diagram
+    const char* outputPath = NULL; // default: don't write the binary output
+    const char* resultPath = NULL; // default: don't write the result file
+    std::string meshPath; // default: don't write a mesh, .ply for PLY otherwise OBJ
+    std::string inputPath; // default: random points, .csv .txt .xyz are text otherwise binary
+    bool latLon = false; // default: text input is x,y,z
+    size_t tilePoints = 0; // default: generate all cells at once, otherwise tiles of this many points written to -r
+    size_t shards = 0; // default: one process, otherwise worker processes writing shards of -r
+    const char* workerSocket = NULL; // default: not a worker of another vg
+    size_t relaxIterations = 0; // default: the diagram of the input, otherwise Lloyd iterations
+    double relaxTolerance = 1e-4; // relative energy drop that ends the iterations
+    VorGen::RelaxMethod relaxMethod = VorGen::RelaxLloyd; // default: plain Lloyd steps
+    bool measures = false; // default: result files without cell areas, perimeters and centroids
+    bool floatSweeps = false; // default: double beachlines and events
+    bool genSet = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "-w") {
             writeToFile = true;
+        } else if (arg == "-s") {
+            printStats = true;
+        } else if (arg == "-v") {
+            verify = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            resultPath = argv[++i];
+        } else if (arg == "-m" && i + 1 < argc) {
+            meshPath = argv[++i];
+        } else if (arg == "-i" && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (arg == "-latlon") {
+            latLon = true;
+        } else if (arg == "-t" && i + 1 < argc) {
+            tilePoints = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "-shards" && i + 1 < argc) {
+            shards = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "-relax" && i + 1 < argc) {
+            relaxIterations = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "-tol" && i + 1 < argc) {
+            relaxTolerance = strtod(argv[++i], NULL);
+        } else if (arg == "-anderson") {
+            relaxMethod = VorGen::RelaxAnderson;
+        } else if (arg == "-measures") {
+            measures = true;
+        } else if (arg == "-float") {
+            floatSweeps = true;
+        } else if (arg == "-worker" && i + 1 < argc) {
+            workerSocket = argv[++i];
         } else if (i == 1) {
-            count = atoi(arg.c_str());
+            count = strtoull(arg.c_str(), NULL, 10);
             gen = count; // reset gen to match count unless overridden
-        } else if (i == 2 && arg != "-w") {
-            gen = atoi(arg.c_str());
+        } else if (i == 2) {
+            gen = strtoull(arg.c_str(), NULL, 10);
+            genSet = true;
         }
     }
-        
-    printf("Count: %d\n", count);
+
+    if (workerSocket)
+        return VorGen::runShardWorker(workerSocket) ? 0 : 1;
+
+    VorGen::VoronoiGenerator vg(1);
+    vg.setCellMeasures(measures);
+    vg.setFloatSweeps(floatSweeps);
+    VorGen::PointLoader loader;
+    glm::dvec3* randomPoints = NULL;
+    const glm::dvec3* points;
+
+    if (!inputPath.empty()) {
+        auto endsWith = [&](const char* ext) {
+            size_t n = strlen(ext);
+            return inputPath.size() > n && inputPath.compare(inputPath.size() - n, n, ext) == 0;
+        };
+        bool text = latLon || endsWith(".csv") || endsWith(".txt") || endsWith(".xyz");
+
+        // tiles of a binary input are read from it, it is never loaded whole
+        if (tilePoints && !shards && !text) {
+            if (!resultPath) {
+                printf("-t writes its cells to the result file, give one with -r\n");
+                return 1;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            bool written = vg.generateTiled(inputPath.c_str(), resultPath, tilePoints);
+            double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+                (std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << elapsed / 1000.0 << " milliseconds\n";
+
+            if (printStats)
+                vg.printSweepStats();
+            return written ? 0 : 1;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool loaded = text
+            ? loader.loadText(inputPath.c_str(), latLon ? VorGen::PointLoader::LatLon : VorGen::PointLoader::XYZ)
+            : loader.loadBinary(inputPath.c_str());
+        double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        if (!loaded) {
+            printf("%s\n", loader.getError().c_str());
+            return 1;
+        }
+        std::cout << "loaded in " << elapsed / 1000.0 << " milliseconds\n";
+
+        points = loader.getPoints();
+        count = loader.getCount();
+        gen = genSet ? std::min(gen, count) : count;
+    } else {
+        randomPoints = vg.genRandomInputParallel(count);
+        points = randomPoints;
+    }
+
+    printf("Count: %zu\n", count);
     if (writeToFile) {
         printf("Results will be written to file\n");
     }
 
-    VorGen::VoronoiGenerator vg;
-    glm::dvec3* points = vg.genRandomInput(count);
+    if (shards) {
+        if (!resultPath) {
+            printf("-shards writes an index and its shards, give its path with -r\n");
+            delete[] randomPoints;
+            return 1;
+        }
+
+        // the workers split the cores, more can join with vg -worker on the socket
+        std::string socketPath = std::string(resultPath) + ".sock";
+        VorGen::ShardCoordinator coordinator;
+        coordinator.setCellMeasures(measures);
+        coordinator.setFloatSweeps(floatSweeps);
+        if (!coordinator.listen(socketPath.c_str())) {
+            printf("%s\n", coordinator.getError().c_str());
+            delete[] randomPoints;
+            return 1;
+        }
+
+        int threads = std::max(1, (int)(std::thread::hardware_concurrency() / shards)) - 1;
+        std::vector<pid_t> workers;
+        for (size_t k = 0; k < shards; k++) {
+            pid_t pid = fork();
+            if (pid == 0)
+                _exit(VorGen::runShardWorker(socketPath.c_str(), threads) ? 0 : 1);
+            if (pid > 0) {
+                workers.push_back(pid);
+                coordinator.watchWorker(pid);
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool written = workers.size() == shards &&
+            coordinator.run(points, count, shards, resultPath, tilePoints ? tilePoints : VorGen::TILE_POINTS);
+        double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        if (!written)
+            printf("%s\n", coordinator.getError().c_str());
+        coordinator.close();
+        for (pid_t pid : workers)
+            waitpid(pid, NULL, 0);
+        std::cout << elapsed / 1000.0 << " milliseconds\n";
+
+        delete[] randomPoints;
+        return written ? 0 : 1;
+    }
+
+    if (tilePoints) {
+        if (!resultPath) {
+            printf("-t writes its cells to the result file, give one with -r\n");
+            delete[] randomPoints;
+            return 1;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool written = vg.generateTiled(points, count, resultPath, tilePoints);
+        double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << elapsed / 1000.0 << " milliseconds\n";
+
+        if (printStats)
+            vg.printSweepStats();
+
+        delete[] randomPoints;
+        return written ? 0 : 1;
+    }
 
 	auto start = std::chrono::high_resolution_clock::now();
-    vg.generate(points, count, gen, writeToFile);
+    // relax moves the points, so it works on a copy
+    std::vector<glm::dvec3> relaxed;
+    VorGen::VoronoiCell* cells;
+    if (relaxIterations) {
+        relaxed.assign(points, points + count);
+        cells = vg.relax(relaxed.data(), count, relaxIterations, relaxTolerance, relaxMethod);
+        for (const VorGen::RelaxStats & s : vg.getRelaxStats())
+            printf("energy %.9g  movement %.3g  %.1f ms%s\n", s.energy, s.movement, s.ms, s.rejected ? "  rejected" : "");
+        if (cells && writeToFile)
+            vg.writeDataToOBJ("output/voronoi_data.obj");
+    } else {
+        cells = vg.generate(points, count, gen, writeToFile);
+    }
+    if (!cells) {
+        delete[] randomPoints;
+        return 1;
+    }
 	double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
         (std::chrono::high_resolution_clock::now() - start).count();
 	std::cout << elapsed / 1000.0 << " milliseconds\n";
 
-    delete[] points;
+    if (printStats)
+        vg.printSweepStats();
+
+    if (verify) {
+        start = std::chrono::high_resolution_clock::now();
+        VorGen::VerifyResult result = VorGen::VoronoiVerifier().verify(cells, count, gen >= count);
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        result.print();
+        std::cout << "verified in " << elapsed / 1000.0 << " milliseconds\n";
+    }
+
+    if (outputPath) {
+        start = std::chrono::high_resolution_clock::now();
+        vg.writeDataToFile(outputPath);
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "written in " << elapsed / 1000.0 << " milliseconds\n";
+    }
+
+    if (resultPath) {
+        start = std::chrono::high_resolution_clock::now();
+        vg.writeResultFile(resultPath);
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "result written in " << elapsed / 1000.0 << " milliseconds\n";
+    }
+
+    if (!meshPath.empty()) {
+        bool ply = meshPath.size() > 4 && meshPath.compare(meshPath.size() - 4, 4, ".ply") == 0;
+        start = std::chrono::high_resolution_clock::now();
+        if (ply)
+            vg.writeDataToPLY(meshPath.c_str());
+        else
+            vg.writeDataToOBJ(meshPath.c_str());
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "mesh written in " << elapsed / 1000.0 << " milliseconds\n";
+    }
+
+    delete[] cells;
+    delete[] randomPoints;
 
     return 0;
 }